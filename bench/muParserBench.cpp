@@ -0,0 +1,323 @@
+#include "muParser.h"
+#include "muParserThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Benchmark suite of the expression engine.
+ *
+ * Every expression of a catalogue is timed through each stage of the engine:
+ * parsing, compiling bytecode to machine code, scalar `Eval()`, bulk mode
+ * and array evaluation, the last two running on the thread pool. Results are
+ * written as JSON and compared against a baseline written by an earlier run.
+ *
+ * Usage: muParserBench [--json FILE] [--baseline FILE] [--tolerance PERCENT]
+ *                      [--quick] [--scaling]
+ *
+ * The process exits with status 2 if a timing got slower than the baseline
+ * by more than the tolerance (10% by default).
+ */
+
+namespace
+{
+    /** Expression of the catalogue. */
+    struct BenchExpr
+    {
+        const char *name;
+        const char *expr;
+    };
+
+    const BenchExpr catalogue[] =
+    {
+        { "poly",      "((((0.1*x+0.2)*x+0.3)*x+0.4)*x+0.5)*x + 3*x^4 - 2*x^3 + x^2 - 7" },
+        { "trig",      "sin(x)*cos(y) + tan(x/3) - sinh(x/10)*cosh(y/10) + atan2(y, x) + sin(2*x)^2" },
+        { "exp_log",   "exp(-x*x) * ln(1+y*y) + sqrt(abs(x*y)) + log10(5+x)" },
+        { "if_else",   "x<-3 ? -1 : x<-2 ? x^2 : x<-1 ? sin(x) : x<0 ? cos(y) : x<1 ? x*y : x<2 ? exp(-x) : x<3 ? ln(x) : 1" },
+        { "many_vars", "a*b + c*d - e/f + g^2 + h*i*j + a*j - b*i + c*h - d*g + e*f + x*y" },
+        { "shared",    "sin(x)*cos(y) + (sin(x)*cos(y))^2 + sqrt(1+(sin(x)*cos(y))^2)" },
+        { "multi_arg", "min(x,y,1) + max(x,y,-1) + sum(x,y,x*y,1) + avg(x,y,2)" },
+    };
+
+    const char *const varNames[] = { "x", "y", "a", "b", "c", "d", "e", "f", "g", "h", "i", "j" };
+    const int numVars = sizeof(varNames) / sizeof(varNames[0]);
+
+    /** Number of values of the bulk and array evaluations. */
+    const int numValues = 1 << 16;
+
+    /** Minimum duration of a timing run in seconds. */
+    double minTime = 0.1;
+
+    /** Timing of one stage of one expression. */
+    struct Result
+    {
+        std::string expr;
+        std::string metric;
+        double value;
+    };
+
+    /**
+     * Returns the time in seconds taken by a call of `f`, the best of three
+     * runs that repeat it for at least `minTime` seconds each.
+     */
+    template<typename F>
+    double timeIt(F f)
+    {
+        double best = 0;
+        for(int run = 0; run < 3; run++)
+        {
+            int reps = 0;
+            double elapsed = 0;
+            auto start = std::chrono::steady_clock::now();
+            do
+            {
+                f();
+                reps++;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while(elapsed < minTime);
+            if(run == 0 || elapsed / reps < best)
+                best = elapsed / reps;
+        }
+        return best;
+    }
+
+    /**
+     * Values of the variables: x sweeps [-4, 4], the others stay away from
+     * zero so that divisions and logarithms are defined.
+     */
+    std::vector<std::vector<double>> makeValues()
+    {
+        std::vector<std::vector<double>> values(numVars, std::vector<double>(numValues));
+        for(int i = 0; i < numValues; i++)
+        {
+            values[0][i] = -4 + 8. * i / numValues;
+            for(int k = 1; k < numVars; k++)
+                values[k][i] = 0.5 + 0.1 * ((i * (k + 2)) % 29);
+        }
+        return values;
+    }
+
+    /** Times all the stages of an expression and appends the results. */
+    void benchExpr(const BenchExpr &be, const std::vector<std::vector<double>> &values, std::vector<Result> &results)
+    {
+        std::vector<double> vars(numVars);
+        std::vector<double> out(numValues);
+        mu::Parser p;
+        for(int k = 0; k < numVars; k++)
+        {
+            vars[k] = values[k][0];
+            p.DefineVar(varNames[k], &vars[k]);
+        }
+
+        // Parsing: from the string to the bytecode
+        double parse = timeIt([&]() { p.SetExpr(be.expr); p.Validate(); });
+
+        // Compiling: from saved bytecode to machine code, without parsing
+        std::vector<char> blob;
+        p.SaveByteCode(blob);
+        mu::Parser jit(p);
+        jit.EnableJit(true);
+        double compile = timeIt([&]() { jit.LoadByteCode(&blob[0], blob.size()); jit.Eval(); });
+
+        // Scalar evaluation, one call per value
+        int n = 0;
+        auto evalAll = [&](mu::Parser &q)
+        {
+            for(int i = 0; i < 1024; i++, n = (n + 1) % numValues)
+            {
+                for(int k = 0; k < numVars; k++)
+                    vars[k] = values[k][n];
+                out[i] = q.Eval();
+            }
+        };
+        double eval = timeIt([&]() { evalAll(p); }) / 1024;
+        double evalJit = timeIt([&]() { evalAll(jit); }) / 1024;
+
+        // Bulk mode: the variables point to arrays
+        mu::Parser bulk;
+        for(int k = 0; k < numVars; k++)
+            bulk.DefineVar(varNames[k], const_cast<double*>(&values[k][0]));
+        bulk.SetExpr(be.expr);
+        double bulkTime = timeIt([&]() { bulk.Eval(&out[0], numValues); }) / numValues;
+
+        // Array evaluation: blocks of values, SIMD operators
+        std::vector<double*> arrVars(numVars);
+        std::vector<const double*> arrValues(numVars);
+        for(int k = 0; k < numVars; k++)
+        {
+            arrVars[k] = &vars[k];
+            arrValues[k] = &values[k][0];
+        }
+        double array = timeIt([&]() { p.EvalArray(&arrVars[0], &arrValues[0], numVars, &out[0], numValues); }) / numValues;
+
+        results.push_back({ be.name, "parse_us", parse * 1e6 });
+        results.push_back({ be.name, "compile_us", compile * 1e6 });
+        results.push_back({ be.name, "eval_ns", eval * 1e9 });
+        results.push_back({ be.name, "eval_jit_ns", evalJit * 1e9 });
+        results.push_back({ be.name, "bulk_ns", bulkTime * 1e9 });
+        results.push_back({ be.name, "array_ns", array * 1e9 });
+    }
+
+    /**
+     * Writes the results as JSON. Every result is on its own line so that
+     * readBaseline doesn't need a full JSON parser.
+     */
+    bool writeJson(const char *path, const std::vector<Result> &results)
+    {
+        FILE *f = fopen(path, "w");
+        if(!f)
+            return false;
+        fprintf(f, "{\n  \"version\": 1,\n  \"threads\": %d,\n  \"values\": %d,\n  \"results\": [\n",
+                mu::ParserThreadPool::Instance().GetNumThreads(), numValues);
+        for(size_t i = 0; i < results.size(); i++)
+            fprintf(f, "    {\"expr\": \"%s\", \"metric\": \"%s\", \"value\": %.6g}%s\n",
+                    results[i].expr.c_str(), results[i].metric.c_str(), results[i].value, i + 1 < results.size() ? "," : "");
+        fprintf(f, "  ]\n}\n");
+        fclose(f);
+        return true;
+    }
+
+    /** Reads the results of a file written by writeJson, keyed by "expr/metric". */
+    bool readBaseline(const char *path, std::map<std::string, double> &baseline)
+    {
+        std::ifstream ifs(path);
+        if(!ifs)
+            return false;
+        std::string line;
+        while(std::getline(ifs, line))
+        {
+            char expr[64], metric[64];
+            double value;
+            const char *rec = strstr(line.c_str(), "{\"expr\"");
+            if(rec && sscanf(rec, "{\"expr\": \"%63[^\"]\", \"metric\": \"%63[^\"]\", \"value\": %lf", expr, metric, &value) == 3)
+                baseline[std::string(expr) + "/" + metric] = value;
+        }
+        return true;
+    }
+
+    /**
+     * Generates a polynomial of `terms` terms in `x`, such as
+     * "1*x^0 + 0.5*x^1 + 0.333*sin(x)^2 + ...".
+     */
+    std::string makePolynomial(int terms)
+    {
+        std::string expr;
+        char buf[64];
+        for(int i = 0; i < terms; i++)
+        {
+            snprintf(buf, sizeof(buf), i % 5 == 4 ? "%s%.6g*sin(x)^%d" : "%s%.6g*x^%d", i ? " + " : "", 1. / (i + 1), i % 7);
+            expr += buf;
+        }
+        return expr;
+    }
+
+    /**
+     * Times the parsing of large generated expressions and checks that it
+     * grows linearly with their length.
+     */
+    int benchScaling()
+    {
+        double x = 0.5;
+        mu::Parser p;
+        p.DefineVar("x", &x);
+
+        printf("%8s %10s %12s %12s\n", "terms", "chars", "ms/parse", "ns/char");
+        double first = 0, last = 0;
+        for(int terms = 250; terms <= 4000; terms *= 2)
+        {
+            std::string expr = makePolynomial(terms);
+            double t = timeIt([&]() { p.SetExpr(expr); p.Eval(); });
+            printf("%8d %10zu %12.3f %12.1f\n", terms, expr.size(), t * 1e3, t * 1e9 / expr.size());
+            if(!first)
+                first = t / expr.size();
+            last = t / expr.size();
+        }
+
+        // Parsing is linear if the time per character stays about the same
+        printf("time per char grew by %.2fx over a 16x longer expression\n", last / first);
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *jsonPath = NULL, *baselinePath = NULL;
+    double tolerance = 10;
+    bool scaling = false;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--json") && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if(!strcmp(argv[i], "--baseline") && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if(!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--quick"))
+            minTime = 0.02;
+        else if(!strcmp(argv[i], "--scaling"))
+            scaling = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--json FILE] [--baseline FILE] [--tolerance PERCENT] [--quick] [--scaling]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    try
+    {
+        if(scaling)
+            return benchScaling();
+
+        std::map<std::string, double> baseline;
+        bool hasBaseline = baselinePath && readBaseline(baselinePath, baseline);
+        if(baselinePath && !hasBaseline)
+            printf("no baseline at %s\n", baselinePath);
+
+        std::vector<std::vector<double>> values = makeValues();
+        std::vector<Result> results;
+        for(const BenchExpr &be : catalogue)
+            benchExpr(be, values, results);
+
+        // Print the results with their change relative to the baseline
+        int regressions = 0;
+        printf("%-10s %-12s %12s %12s %9s\n", "expr", "metric", "value", "baseline", "change");
+        for(const Result &r : results)
+        {
+            printf("%-10s %-12s %12.3f", r.expr.c_str(), r.metric.c_str(), r.value);
+            auto it = baseline.find(r.expr + "/" + r.metric);
+            if(it != baseline.end() && it->second > 0)
+            {
+                double change = (r.value / it->second - 1) * 100;
+                bool slower = change > tolerance;
+                regressions += slower;
+                printf(" %12.3f %+8.1f%%%s", it->second, change, slower ? "  REGRESSION" : "");
+            }
+            printf("\n");
+        }
+
+        if(jsonPath && !writeJson(jsonPath, results))
+        {
+            fprintf(stderr, "can't write %s\n", jsonPath);
+            return 1;
+        }
+
+        if(regressions)
+        {
+            printf("%d timings are more than %g%% slower than the baseline\n", regressions, tolerance);
+            return 2;
+        }
+    }
+    catch(mu::Parser::exception_type &e)
+    {
+        printf("failed: %s\n", e.GetMsg().c_str());
+        return 1;
+    }
+    return 0;
+}
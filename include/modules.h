@@ -2,7 +2,16 @@
 #define INC_MODULES
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
 #include <numeric>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "imgui.h"
@@ -56,7 +65,18 @@ protected:
     T *parent;
 };
 
+/**
+ * Sample budget of a function graph, number of intervals of the preview grid
+ * the sampling starts from, and of the grid it refines it into before going
+ * adaptive.
+ */
 #define PLOT_INTERVALS 5000
+#define PLOT_PREVIEW_INTERVALS 16
+#define PLOT_COARSE_INTERVALS 256
+/**
+ * Time in milliseconds between two previews of a graph being sampled.
+ */
+#define PLOT_FRAME_BUDGET 4
 #define MAX_FUNC_LENGTH 5000
 
 class GrapherModule;
@@ -85,6 +105,165 @@ private:
     float endX = 1;
 };
 
+/**
+ * Number of samples in a tile of a SampleCache, tiles kept at most, and
+ * number of graphing ranges whose other results are kept.
+ */
+#define SAMPLE_CACHE_TILE 64
+#define SAMPLE_CACHE_TILES 4096
+#define SAMPLE_CACHE_VIEWS 16
+
+/**
+ * Cache of the values of functions, so that changing the graphing range only
+ * evaluates what wasn't sampled yet. Any double is k * 2^-level for a unique
+ * odd k, so samples are filed by (expression, level, k). Since the sampling
+ * grids are aligned on powers of two, the samples of overlapping ranges fall
+ * on the same keys. The samples are grouped into tiles of SAMPLE_CACHE_TILE
+ * consecutive odd k's, dropped in least recently used order past
+ * SAMPLE_CACHE_TILES tiles.
+ * It also keeps the results that don't come from samples for the last
+ * SAMPLE_CACHE_VIEWS ranges.
+ */
+class SampleCache
+{
+public:
+    /**
+     * Results of a graph besides its samples.
+     */
+    typedef struct
+    {
+        std::string expr;
+        double minX, maxX;
+        bool needsDouble;
+        std::vector<std::pair<double, double>> roots;
+    } View;
+    /**
+     * Reads cached values of a function.
+     * @param   expr    expression of the function, and anything else its values depend on
+     * @param   xs      abscissae
+     * @param   ys      where to write the cached ordinates, resized to match xs
+     * @param   missing where to write the indices of the abscissae that aren't cached
+     */
+    void lookup(const std::string &expr, const std::vector<double> &xs, std::vector<double> &ys,
+        std::vector<size_t> &missing);
+    /**
+     * Caches values of a function.
+     * @param   expr    expression of the function, and anything else its values depend on
+     * @param   xs      abscissae
+     * @param   ys      ordinates
+     */
+    void store(const std::string &expr, const std::vector<double> &xs, const std::vector<double> &ys);
+    /**
+     * Looks the results of a range up.
+     * @return  the results, or nullptr if they aren't cached
+     */
+    const View *findView(const std::string &expr, double minX, double maxX);
+    /**
+     * Caches the results of a range.
+     */
+    void storeView(const View &view);
+private:
+    struct TileKey
+    {
+        unsigned int expr;
+        int level;
+        std::int64_t tile;
+        bool operator==(const TileKey &o) const
+        {
+            return expr == o.expr && level == o.level && tile == o.tile;
+        }
+    };
+    struct TileKeyHash
+    {
+        size_t operator()(const TileKey &k) const
+        {
+            return std::hash<std::uint64_t>()((std::uint64_t)k.tile * 0x9e3779b97f4a7c15ull
+                ^ ((std::uint64_t)(std::uint32_t)k.level << 32 | k.expr));
+        }
+    };
+    typedef struct
+    {
+        /**
+         * Bit mask of the samples present.
+         */
+        std::uint64_t filled;
+        double ys[SAMPLE_CACHE_TILE];
+        /**
+         * Position in the use order.
+         */
+        std::list<TileKey>::iterator use;
+    } Tile;
+    /**
+     * Finds the tile and slot of an abscissa.
+     */
+    TileKey locate(unsigned int expr, double x, unsigned int *slot);
+    /**
+     * Numbers the expressions so that keys are cheap to hash.
+     */
+    unsigned int exprId(const std::string &expr);
+    /**
+     * Drops the least recently used tile, and the number of its expression
+     * if it was the last tile of it, unless it's the expression keep.
+     */
+    void evict(unsigned int keep);
+    std::unordered_map<std::string, unsigned int> exprIds;
+    /**
+     * Expression and number of tiles of each expression number.
+     */
+    std::vector<std::string> exprNames;
+    std::vector<size_t> exprTiles;
+    /**
+     * Expression numbers no longer in use.
+     */
+    std::vector<unsigned int> freeIds;
+    std::unordered_map<TileKey, Tile, TileKeyHash> tiles;
+    /**
+     * Keys of the tiles, most recently used first.
+     */
+    std::list<TileKey> uses;
+    /**
+     * Results of the last ranges, most recently used first.
+     */
+    std::list<View> views;
+};
+
+/**
+ * Evaluation of the grapher's function on a range, run on the worker thread.
+ * Holds a copy of the inputs taken when it was submitted, then the results.
+ */
+typedef struct
+{
+    /**
+     * Number of the job. It's stale once a newer one was submitted or the
+     * inputs were edited, and stops as soon as it notices.
+     */
+    unsigned int id = 0;
+    std::string expr;
+    double minX, maxX;
+    /**
+     * Size of the plot in pixels, for the sampling tolerance.
+     */
+    double width, height;
+    std::vector<double> xs, ys, dys;
+    std::vector<std::pair<double, double>> roots;
+    bool needsDouble = false;
+    unsigned int discontinuities = 0;
+    /**
+     * Number of samples that weren't in the cache.
+     */
+    unsigned int evaluated = 0;
+    /**
+     * Whether the results are final, rather than a preview of the samples
+     * so far.
+     */
+    bool complete = false;
+    /**
+     * Counters of the worker thread's parsers after the job, only set on the
+     * final results.
+     */
+    mu::ParserProfile profile{}, dprofile{};
+} GraphJob;
+
 /**
  * Graphing, tangent plotting and numerical integration module.
  */
@@ -99,6 +278,7 @@ public:
      * @param   windowHeight    height of the window
      */
     GrapherModule(bool *open, int windowWidth = 640, int windowHeight = 480);
+    virtual ~GrapherModule();
     virtual void render() override;
 private:
     /**
@@ -110,14 +290,51 @@ private:
      */
     GraphInfo gi;
     /**
-     * Reapplies the contents of the function to the graph info and the coordinate
-     * arrays.
+     * Submits an evaluation of the function on the graphing range, cancelling
+     * the one in progress.
      */
     void refreshFunctionData();
     /**
-     * Reapplies the contents of the function to the coordinate arrays.
+     * Cancels the evaluation in progress without submitting a new one.
+     */
+    void cancelEvaluation();
+    /**
+     * Asks the worker thread to reset the profiling counters of its parsers.
+     * @param   function    whether to reset the function's parser
+     * @param   derivative  whether to reset the derivative's parser
+     */
+    void resetProfiles(bool function, bool derivative);
+    /**
+     * Applies the results of the last evaluation to the graph info and the
+     * coordinate arrays, once they're available.
+     */
+    void collectFunctionData();
+    /**
+     * Main loop of the worker thread.
+     */
+    void work();
+    /**
+     * Hands a copy of the samples of a job in progress over to the UI.
+     * @param   job     job being evaluated
+     */
+    void postPreview(const GraphJob &job);
+    /**
+     * Computes the coordinate arrays of a job. Runs on the worker thread.
+     * @param   job     job to fill in
+     * @return  false if the job was cancelled
+     */
+    bool evaluateFunction(GraphJob &job);
+    /**
+     * Evaluates the function of a job, or its derivative, on an array of
+     * abscissae, going through the sample cache. Runs on the worker thread.
+     * @param   job         job being evaluated
+     * @param   sxs         abscissae
+     * @param   sys         where to write the ordinates, resized as needed
+     * @param   derivative  whether to evaluate the derivative instead
+     * @return  false if the job was cancelled
      */
-    void evaluateFunction();
+    bool evaluateSamples(GraphJob &job, const std::vector<double> &sxs, std::vector<double> &sys,
+        bool derivative = false);
     /**
      * Handles user selecting an area in the graph widget to zoom in.
      */
@@ -127,6 +344,21 @@ private:
      * @param   length  length of the tangent in pixels
      */
     void plotTangent(float length = 50);
+    /**
+     * Plots the derivative of the current function.
+     */
+    void plotDerivative();
+    /**
+     * Isolates the zeros of the function of a job on its range. Runs on the
+     * worker thread.
+     * @param   job     job to fill in
+     * @return  false if the job was cancelled
+     */
+    bool findRoots(GraphJob &job);
+    /**
+     * Marks the intervals that may contain a zero of the current function.
+     */
+    void plotRoots();
     /**
      * Window width.
      */
@@ -139,6 +371,33 @@ private:
      * Parser for the function's expression.
      */
     mu::Parser p;
+    /**
+     * Copy of the function's parser owned by the worker thread.
+     */
+    mu::Parser wp;
+    /**
+     * Parser compiling the derivative of the function's expression, owned by
+     * the worker thread.
+     */
+    mu::Parser dp;
+    /**
+     * Expressions last given to the worker thread's parsers, which keep their
+     * bytecode until the function changes.
+     */
+    std::string wpExpr, dpExpr;
+    /**
+     * Tells whether `dpExpr` could be differentiated.
+     */
+    bool dpValid = false;
+    /**
+     * Parameter for the worker thread's parsers.
+     */
+    double wx = 0.;
+    /**
+     * Values of the function and its derivative from the previous graphs,
+     * owned by the worker thread.
+     */
+    SampleCache cache;
     /**
      * Boundaries for the graphing range.
      */
@@ -148,13 +407,52 @@ private:
      */
     float maxX = 1;
     /**
-     * Abscissae for the function graph.
+     * Abscissae for the function graph, in increasing order. They're denser
+     * where the graph bends.
      */
     std::vector<double> xs;
     /**
      * Ordinates for the function graph.
      */
     std::vector<double> ys;
+    /**
+     * Number of jumps found by the adaptive sampling. Each one is marked by a
+     * NaN sample in the middle so that the graph isn't connected across it.
+     */
+    unsigned int discontinuities = 0;
+    /**
+     * Number of samples of the graph that weren't in the cache.
+     */
+    unsigned int evaluated = 0;
+    /**
+     * Profiling counters of the worker thread's function and derivative
+     * parsers, as of the last complete job.
+     */
+    mu::ParserProfile profile{}, dprofile{};
+    /**
+     * Ordinates for the derivative graph. Empty if the function can't be
+     * differentiated.
+     */
+    std::vector<double> dys;
+    /**
+     * Summary of the derivative graph for drawing.
+     */
+    CurveLOD dlod;
+    /**
+     * Single precision copies of the abscissae and ordinates, used by the
+     * worker thread to evaluate the function when float is accurate enough on
+     * the graphing range.
+     */
+    std::vector<float> xsf, ysf;
+    /**
+     * Tells whether the function had to be evaluated in double precision.
+     */
+    bool needsDouble = false;
+    /**
+     * Intervals that may contain a zero of the function, in increasing order.
+     * The function has no zero on the graphing range outside of them.
+     */
+    std::vector<std::pair<double, double>> roots;
     /**
      * Parameter for the function's parser evaluations.
      */
@@ -171,6 +469,44 @@ private:
      * Child numerical integration submodule.
      */
     IntegrationSubModule ism;
+    /**
+     * Thread running the evaluations, so that the UI doesn't wait for them.
+     */
+    std::thread worker;
+    /**
+     * Protects the jobs and flags below, shared with the worker thread.
+     */
+    std::mutex jobMutex;
+    /**
+     * Wakes the worker thread up when a job is submitted or on exit.
+     */
+    std::condition_variable jobCond;
+    /**
+     * Job waiting for the worker thread, valid when hasPending is set.
+     */
+    GraphJob pending;
+    /**
+     * Results of the last job, valid until collected when hasFinished is set.
+     */
+    GraphJob finished;
+    bool hasPending = false, hasFinished = false, quit = false;
+    /**
+     * Profiling counters the worker thread should reset, the function's and
+     * the derivative's.
+     */
+    bool resetProfile = false, resetDProfile = false;
+    /**
+     * Number of the latest job, the others are stale.
+     */
+    std::atomic<unsigned int> generation{0};
+    /**
+     * Number of the job whose results the UI waits for, 0 if none.
+     */
+    unsigned int submitted = 0;
+    /**
+     * Fraction of the current job done, for the progress bar.
+     */
+    std::atomic<float> progress{0};
 };
 
 /**
@@ -218,8 +554,14 @@ public:
         : open(open), w(windowWidth), h(windowHeight)
     {
         for(unsigned int k = 0; k < MAX_DIFFEQ_DEGREE; k++)
+        {
             aParsers[k].DefineVar("x", &x);
+            aParsers[k].EnableJit(true);
+        }
         bParser.DefineVar("x", &x);
+        bParser.EnableJit(true);
+        coefParser.DefineVar("x", &x);
+        coefParser.EnableJit(true);
     }
     virtual void render() override;
 private:
@@ -256,6 +598,10 @@ private:
      * Parser for the `b` function.
      */
     mu::Parser bParser;
+    /**
+     * Parser evaluating `b` and all the `a` functions at once when solving.
+     */
+    mu::Parser coefParser;
     /**
      * Array of boundary conditions for the derivatives of `y`.
      */
@@ -108,6 +108,15 @@ namespace mu
     static value_type Max(const value_type*, int);  // maximum
 
     static int IsVal(const char_type* a_szExpr, int *a_iPos, value_type *a_fVal);
+    static bool IsSimpleVal(const char_type *a_szVal, int a_iLen, char_type a_cDecPoint, value_type *a_fVal);
+
+  private:
+
+    /** \brief Tag selecting the constructor that runs the initialization. */
+    struct SBuiltinTag {};
+
+    explicit Parser(SBuiltinTag);
+    static const Parser& Builtin();
   };
 } // namespace mu
 
@@ -39,7 +39,12 @@
 #include "muParserStack.h"
 #include "muParserTokenReader.h"
 #include "muParserBytecode.h"
+#include "muParserJit.h"
+#include "muParserRegisterCode.h"
+#include "muParserProgram.h"
+#include "muParserProfile.h"
 #include "muParserError.h"
+#include "muParserSharedMap.h"
 
 
 namespace mu
@@ -85,8 +90,15 @@ private:
     /** \brief Type used for parser tokens. */
     typedef ParserToken<value_type, string_type> token_type;
 
-    /** \brief Maximum number of threads spawned by OpenMP when using the bulk mode. */
-    static const int s_MaxNumOpenMPThreads;
+    /** \brief Arguments of a bulk mode evaluation passed to the thread pool. */
+    struct SBulkJob
+    {
+      const ParserBase *pParser;
+      value_type *pResults;
+    };
+
+    template<typename TValue>
+    struct SArrayJob;
 
  public:
 
@@ -104,13 +116,48 @@ private:
 
     virtual ~ParserBase();
     
+    bool Validate(ParserError *a_pError = NULL) const;
+    ParserProgram Compile() const;
 	  value_type  Eval() const;
     value_type* Eval(int &nStackSize) const;
     void Eval(value_type *results, int nBulkSize);
+    void EvalArray(value_type *a_pVar, const value_type *a_pValues, value_type *a_pResults, int a_iSize) const;
+    void EvalArray(value_type * const *a_pVar, 
+                   const value_type * const *a_pValues, 
+                   int a_iNumVar, 
+                   value_type *a_pResults, 
+                   int a_iSize) const;
+    void EvalArray(value_type * const *a_pVar, 
+                   const value_type * const *a_pValues, 
+                   int a_iNumVar, 
+                   value_type * const *a_pResults, 
+                   int a_iNumResults,
+                   int a_iSize) const;
+    void EvalArray(value_type *a_pVar, const float *a_pValues, float *a_pResults, int a_iSize) const;
+    void EvalArray(value_type * const *a_pVar, 
+                   const float * const *a_pValues, 
+                   int a_iNumVar, 
+                   float * const *a_pResults, 
+                   int a_iNumResults,
+                   int a_iSize) const;
+    value_type EvalFloatError(value_type *a_pVar, const value_type *a_pValues, int a_iSize) const;
+    value_type EvalDiff(value_type *a_pVar, value_type *a_pDeriv, value_type *a_pDeriv2 = NULL) const;
+    void SetDiffVar(value_type *a_pVar, int a_iOrder = 1);
+    void SetSweepVars(value_type * const *a_pVar, int a_iNumVar);
+    void EvalInterval(value_type *a_pVar, 
+                      value_type a_fLo, 
+                      value_type a_fHi, 
+                      value_type *a_pLo, 
+                      value_type *a_pHi) const;
 
     int GetNumResults() const;
+    ParserProfile GetProfile() const;
+    void ResetProfile();
 
     void SetExpr(const string_type &a_sExpr);
+    void SetFusedExpr(const std::vector<string_type> &a_vExpr);
+    void SaveByteCode(std::vector<char> &a_vBlob) const;
+    std::size_t LoadByteCode(const void *a_pBlob, std::size_t a_iSize);
     void SetVarFactory(facfun_type a_pFactory, void *pUserData = NULL);
 
     void SetDecSep(char_type cDecSep);
@@ -118,6 +165,9 @@ private:
     void ResetLocale();
 
     void EnableOptimizer(bool a_bIsOn=true);
+    void EnableJit(bool a_bIsOn=true);
+    void EnableRegisterCode(bool a_bIsOn=true);
+    void EnableFastMath(bool a_bIsOn=true);
     void EnableBuiltInOprt(bool a_bIsOn=true);
 
     bool HasBuiltInOprt() const;
@@ -135,6 +185,50 @@ private:
       AddCallback( a_strName, ParserCallback(a_pFun, a_bAllowOpt), m_FunDef, ValidNameChars() );
     }
 
+    /** \fn void mu::ParserBase::DefineDiff(T a_pFun, diff_fun_type a_pDiff, const string_type &a_sExpr) 
+        \brief Define the derivative rule of a callback.
+        \param a_pFun Pointer to the callback of a function or operator
+        \param a_pDiff Callback computing the partial derivatives of a_pFun for EvalDiff
+        \param a_sExpr Comma separated partial derivatives of a_pFun for SetDiffVar, written
+                       in terms of the arguments x1, x2, ... (x for the first argument)
+
+        Callbacks without a rule are differentiated numerically.
+    */
+    template<typename T>
+    void DefineDiff(T a_pFun, diff_fun_type a_pDiff, const string_type &a_sExpr = string_type())
+    {
+      m_DiffDef[(generic_fun_type)a_pFun] = a_pDiff;
+      if (a_sExpr.length())
+        m_DiffExprDef[(generic_fun_type)a_pFun] = a_sExpr;
+    }
+
+    /** \fn void mu::ParserBase::DefineInterval(T a_pFun, interval_fun_type a_pRange) 
+        \brief Define the interval rule of a callback for EvalInterval.
+        \param a_pFun Pointer to the callback of a function or operator
+        \param a_pRange Callback computing the range of a_pFun over intervals
+
+        Callbacks without a rule can take any value.
+    */
+    template<typename T>
+    void DefineInterval(T a_pFun, interval_fun_type a_pRange)
+    {
+      m_IntervalDef[(generic_fun_type)a_pFun] = a_pRange;
+    }
+
+    /** \fn void mu::ParserBase::DefineVecFun(T a_pFun, vec_fun_type a_pVec, vec_funf_type a_pVecF) 
+        \brief Define the array versions of a callback with one argument for EvalArray.
+        \param a_pFun Pointer to the callback of a function
+        \param a_pVec Callback applying a_pFun to a double precision array in place
+        \param a_pVecF Callback applying a_pFun to a single precision array in place
+
+      Callbacks without array versions are called once per value.
+    */
+    template<typename T>
+    void DefineVecFun(T a_pFun, vec_fun_type a_pVec, vec_funf_type a_pVecF)
+    {
+      m_VecFunDef[(generic_fun_type)a_pFun] = std::make_pair(a_pVec, a_pVecF);
+    }
+
     void DefineOprt(const string_type &a_strName, 
                     fun_type2 a_pFun, 
                     unsigned a_iPri=0, 
@@ -244,7 +338,7 @@ private:
 
     void AddCallback( const string_type &a_strName, 
                       const ParserCallback &a_Callback, 
-                      funmap_type &a_Storage,
+                      ParserSharedMap<funmap_type> &a_Storage,
                       const char_type *a_szCharSet );
 
     void ApplyRemainingOprt(ParserStack<token_type> &a_stOpt,
@@ -266,10 +360,33 @@ private:
     EOprtAssociativity GetOprtAssociativity(const token_type &a_Tok) const;
 
     void CreateRPN() const;
+    void CreateDiffRPN() const;
+    void CompileString() const;
+    void CompileByteCode() const;
+    void HoistInvariants() const;
+    void UpdateHoisted() const;
 
     value_type ParseString() const; 
     value_type ParseCmdCode() const;
     value_type ParseCmdCodeBulk(int nOffset, int nThreadID) const;
+    value_type ParseHoisted() const;
+    value_type ParseHoistedCmdCode() const;
+    value_type RunCmdCode(const ParserByteCode &a_Code, int nOffset, int nThreadID) const;
+    static void BulkRange(void *a_pJob, int a_iBegin, int a_iEnd, int a_iThread);
+    template<typename TValue>
+    void EvalArrayImpl(value_type * const *a_pVar, 
+                       const TValue * const *a_pValues, 
+                       int a_iNumVar, 
+                       TValue * const *a_pResults, 
+                       int a_iNumResults,
+                       int a_iSize) const;
+    template<typename TValue>
+    static void ArrayRange(void *a_pJob, int a_iBegin, int a_iEnd, int a_iThread);
+    template<typename TValue>
+    void EvalArrayBlocks(const SArrayJob<TValue> &a_Job, int a_iBegin, int a_iEnd, int a_iThread) const;
+    value_type ParseCmdCodeJit() const;
+    value_type ParseRegisterCode() const;
+    ParserProfileCounters* GetProfileCounters(int a_iThread) const;
 
     void  CheckName(const string_type &a_strName, const string_type &a_CharSet) const;
     void  CheckOprt(const string_type &a_sName,
@@ -285,20 +402,33 @@ private:
     */
     mutable ParseFunction  m_pParseFormula;
     mutable ParserByteCode m_vRPN;        ///< The Bytecode class.
+    mutable ParserJit m_Jit;              ///< Machine code compiled from the bytecode.
+    mutable ParserRegisterCode m_RegCode; ///< Register code translated from the bytecode.
     mutable stringbuf_type  m_vStringBuf; ///< String buffer, used for storing string function arguments
     stringbuf_type  m_vStringVarBuf;
 
     std::unique_ptr<token_reader_type> m_pTokenReader; ///< Managed pointer to the token reader object.
 
-    funmap_type  m_FunDef;         ///< Map of function names and pointers.
-    funmap_type  m_PostOprtDef;    ///< Postfix operator callbacks
-    funmap_type  m_InfixOprtDef;   ///< unary infix operator.
-    funmap_type  m_OprtDef;        ///< Binary operator callbacks
-    valmap_type  m_ConstDef;       ///< user constants.
-    strmap_type  m_StrVarDef;      ///< user defined string constants
-    varmap_type  m_VarDef;         ///< user defind variables.
+    ParserSharedMap<funmap_type> m_FunDef;             ///< Map of function names and pointers.
+    ParserSharedMap<funmap_type> m_PostOprtDef;        ///< Postfix operator callbacks
+    ParserSharedMap<funmap_type> m_InfixOprtDef;       ///< unary infix operator.
+    ParserSharedMap<funmap_type> m_OprtDef;            ///< Binary operator callbacks
+    ParserSharedMap<valmap_type> m_ConstDef;           ///< user constants.
+    ParserSharedMap<strmap_type> m_StrVarDef;          ///< user defined string constants
+    ParserSharedMap<varmap_type> m_VarDef;             ///< user defind variables.
+    ParserSharedMap<diffmap_type> m_DiffDef;           ///< Derivative rules of the callbacks
+    ParserSharedMap<diffexprmap_type> m_DiffExprDef;   ///< Partial derivatives of the callbacks as expressions
+    value_type *m_pDiffVar;                            ///< Variable the evaluated derivative is taken with respect to or NULL
+    int m_iDiffOrder;                                  ///< Order of the evaluated derivative
+    ParserSharedMap<intervalmap_type> m_IntervalDef;   ///< Interval rules of the callbacks
+    ParserSharedMap<vecfunmap_type> m_VecFunDef;       ///< Array versions of the callbacks
+    std::vector<value_type*> m_vSweepVar;              ///< Variables varying from one evaluation to the next, see SetSweepVars()
 
     bool m_bBuiltInOp;             ///< Flag that can be used for switching built in operators on and off
+    bool m_bEnableJit;             ///< Flag indicating the bytecode is compiled to machine code
+    bool m_bEnableRegCode;         ///< Flag indicating the bytecode is translated to register code
+    bool m_bFastMath;              ///< Flag indicating EvalArray uses single precision math functions
+    mutable std::vector<ParserProfileCounters> m_vProfile;  ///< Profiling counters per thread of the pool, see MUP_PROFILING
 
     string_type m_sNameChars;      ///< Charset for names
     string_type m_sOprtChars;      ///< Charset for postfix/ binary operator tokens
@@ -308,6 +438,14 @@ private:
 
     // items merely used for caching state information
     mutable valbuf_type m_vStackBuffer; ///< This is merely a buffer used for the stack in the cmd parsing routine
+    mutable valbuf_type m_vRegFrame;    ///< Frame used for evaluating the register code
+    mutable ParserByteCode m_vPrologue;   ///< Bytecode of the subexpressions hoisted out of the sweep, see SetSweepVars()
+    mutable ParserByteCode m_vHoistedRPN; ///< Bytecode of the expression reading the hoisted values
+    mutable valbuf_type m_vHoisted;       ///< Values of the hoisted subexpressions, empty if nothing is hoisted
+    mutable valbuf_type m_vPrologueStack; ///< Stack used for evaluating the prologue
+    mutable std::vector<std::pair<value_type*, value_type> > m_vParam; ///< Parameters read by the prologue and their values at the last update
+    mutable bool m_bHoistedValid;         ///< Flag indicating m_vHoisted was computed from the current bytecode
+    mutable ParseFunction m_pParseHoisted; ///< Routine evaluating m_vHoistedRPN
     mutable int m_nFinalResultIdx;
 };
 
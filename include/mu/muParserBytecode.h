@@ -26,6 +26,7 @@
 #define MU_PARSER_BYTECODE_H
 
 #include <cassert>
+#include <map>
 #include <string>
 #include <stack>
 #include <vector>
@@ -64,12 +65,14 @@ namespace mu
         generic_fun_type ptr;
         int   argc;
         int   idx;
+        bool  opt;  ///< The function may be optimized (it has no side effects)
       } Fun;
 
       struct //SOprtData
       {
         value_type *ptr;
-        int offset;
+        int offset;   ///< Jump offset for if-then-else and loops, stack index of the temporary for cmSTORE and cmLOAD
+        ECmdCode code; ///< Operator combining the iterations of a loop, cmADD or cmMUL
       } Oprt;
     };
   };
@@ -97,6 +100,9 @@ private:
     /** \brief Position in the Calculation array. */
     unsigned m_iStackPos;
 
+    /** \brief Stack positions at the start of the pending if-then-else branches. */
+    std::stack<unsigned> m_stIfStackPos;
+
     /** \brief Maximum size needed for the stack. */
     std::size_t m_iMaxStackSize;
     
@@ -105,10 +111,37 @@ private:
 
     bool m_bEnableOptimizer;
 
+    /** \brief Number of tokens removed by Optimize(). */
+    int m_iTokensSaved;
+
     void ConstantFolding(ECmdCode a_Oprt);
+    void Optimize();
+    void SetCode(rpn_type &a_vRPN, int a_iTemps);
+    void Terminate();
 
 public:
 
+    /** \brief Bytecode of the partial derivatives of callbacks, see Differentiate(). */
+    typedef std::map<generic_fun_type, ParserByteCode> rulemap_type;
+
+    /** \brief Names of the variables for Serialize(). */
+    typedef std::map<const value_type*, string_type> varname_type;
+
+    /** \brief A callback as stored in the symbols of a serialized bytecode. */
+    struct SFunSymbol
+    {
+      string_type Name;      ///< Name prefixed by the kind of callback
+      generic_fun_type Ptr;  ///< Address of the callback
+      int Argc;              ///< Number of arguments, -1 for any number
+      ECmdCode Cmd;          ///< cmFUNC, cmFUNC_STR or cmFUNC_BULK
+    };
+
+    /** \brief Callbacks by address for Serialize(). */
+    typedef std::map<generic_fun_type, SFunSymbol> funname_type;
+
+    /** \brief Callbacks by name for Deserialize(). */
+    typedef std::map<string_type, SFunSymbol> funaddr_type;
+
     ParserByteCode();
     ParserByteCode(const ParserByteCode &a_ByteCode);
     ParserByteCode& operator=(const ParserByteCode &a_ByteCode);
@@ -118,17 +151,37 @@ public:
     void AddVal(value_type a_fVal);
     void AddOp(ECmdCode a_Oprt);
     void AddIfElse(ECmdCode a_Oprt);
+    int  AddLoop(ECmdCode a_Oprt);
+    void AddEndLoop(ECmdCode a_Oprt);
+    void AddLoad(int a_iIdx);
     void AddAssignOp(value_type *a_pVar);
-    void AddFun(generic_fun_type a_pFun, int a_iArgc);
+    void AddFun(generic_fun_type a_pFun, int a_iArgc, bool a_bOptimize);
     void AddBulkFun(generic_fun_type a_pFun, int a_iArgc);
     void AddStrFun(generic_fun_type a_pFun, int a_iArgc, int a_iIdx);
 
     void EnableOptimizer(bool bStat);
 
     void Finalize();
+    void Differentiate(value_type *a_pVar, 
+                       int a_iOrder, 
+                       const rulemap_type &a_Rule, 
+                       const value_type *a_pArg, 
+                       int a_iNumArg);
+    bool Hoist(const std::vector<value_type*> &a_vSweepVar,
+               ParserByteCode &a_Prologue,
+               ParserByteCode &a_Body,
+               std::vector<value_type> &a_vSlot) const;
+    void Serialize(std::vector<char> &a_vBlob, 
+                   const varname_type &a_VarName, 
+                   const funname_type &a_FunName) const;
+    std::size_t Deserialize(const char *a_pBlob, 
+                            std::size_t a_iSize,
+                            const varmap_type &a_VarDef,
+                            const funaddr_type &a_FunDef);
     void clear();
     std::size_t GetMaxStackSize() const;
     std::size_t GetSize() const;
+    int GetTokensSaved() const;
 
     const SToken* GetBase() const;
     void AsciiDump();
@@ -44,6 +44,12 @@
 /** \brief If this macro is defined mathematical exceptions (div by zero) will be thrown as exceptions. */
 //#define MUP_MATH_EXCEPTIONS
 
+/** \brief If this macro is defined the evaluator counts the executed tokens and times the callbacks, see ParserBase::GetProfile. */
+//#define MUP_PROFILING
+
+/** \brief Maximum number of iterations of a sum or product, larger ones evaluate to NaN. */
+#define MUP_LOOP_MAX 1000000
+
 /** \brief Define the base datatype for values.
 
   This datatype must be a built in value type. You can not use custom classes.
@@ -51,12 +57,6 @@
 */
 #define MUP_BASETYPE double
 
-/** \brief Activate this option in order to compile with OpenMP support. 
-
-  OpenMP is used only in the bulk mode it may increase the performance a bit. 
-*/
-//#define MUP_USE_OPENMP
-
 #if defined(_UNICODE)
   /** \brief Definition of the basic parser string type. */
   #define MUP_STRING_TYPE std::wstring
@@ -180,6 +180,12 @@ namespace mu
     cmVARPOW4,
     cmVARMUL,
     cmPOW2,
+    cmSTORE,               ///< Store the top of the stack in a temporary (common subexpressions)
+    cmLOAD,                ///< Push the value of a temporary (common subexpressions)
+
+    // sums and products
+    cmLOOP,                ///< Start of the body of a sum or product, skips it if there are no iterations
+    cmENDLOOP,             ///< End of the body of a sum or product, jumps back if iterations are left
 
     // operators and functions
     cmFUNC,                ///< Code for a generic function item
@@ -362,6 +368,43 @@ namespace mu
 
   /** \brief Callback used for variable creation factory functions. */
   typedef value_type* (*facfun_type)(const char_type*, void*);
+
+  /** \brief Callback computing the partial derivatives of a function for the automatic differentiation.
+  
+    The arguments are the argument values of the function and their number, the
+    first partial derivatives are written to the third argument. If the fourth 
+    argument is not NULL the second partial derivatives are written to it 
+    (row major matrix of argc*argc values).
+  */
+  typedef void (*diff_fun_type)(const value_type*, int, value_type*, value_type*);
+
+  /** \brief Type used for storing the derivative rules of the function callbacks. */
+  typedef std::map<generic_fun_type, diff_fun_type> diffmap_type;
+
+  /** \brief Type used for storing the partial derivatives of the function callbacks as expressions. */
+  typedef std::map<generic_fun_type, string_type> diffexprmap_type;
+
+  /** \brief Callback type computing the range of a function over intervals.
+
+    The first two arguments are the lower and upper bounds of the function 
+    arguments, the third one is their number. The bounds of the result are 
+    written to the last two arguments. They must enclose the function value 
+    for any arguments within the bounds. An empty result (the function is 
+    undefined everywhere) is represented by NaN bounds.
+  */
+  typedef void (*interval_fun_type)(const value_type*, const value_type*, int, value_type*, value_type*);
+
+  /** \brief Type used for storing the interval rules of the function callbacks. */
+  typedef std::map<generic_fun_type, interval_fun_type> intervalmap_type;
+
+  /** \brief Callback replacing the values of an array by their image under a function in place. */
+  typedef void (*vec_fun_type)(value_type*, int);
+
+  /** \brief Single precision version of vec_fun_type. */
+  typedef void (*vec_funf_type)(float*, int);
+
+  /** \brief Type used for storing the array versions of the function callbacks. */
+  typedef std::map<generic_fun_type, std::pair<vec_fun_type, vec_funf_type> > vecfunmap_type;
 } // end of namespace
 
 #endif
@@ -91,6 +91,16 @@ enum EErrorCodes
 
   // internal errors
   ecINTERNAL_ERROR         = 36, ///< Internal error of any kind.
+
+  // symbolic differentiation
+  ecNOT_DIFFERENTIABLE     = 37, ///< The expression can't be differentiated (assignments)
+
+  // fused expressions
+  ecTOO_FEW_RESULTS        = 38, ///< More results were requested than the expression has
+
+  // serialized bytecode
+  ecINVALID_BYTECODE       = 39, ///< The blob was not written by this version of SaveByteCode or is damaged
+  ecBYTECODE_SYMBOL        = 40, ///< The bytecode uses a variable or callback the parser does not define
   
   // The last two are special entries 
   ecCOUNT,                      ///< This is no error code, It just stores just the total number of error codes
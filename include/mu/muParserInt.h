@@ -132,6 +132,14 @@ public:
     virtual void InitOprt();
     virtual void InitConst();
     virtual void InitCharSets();
+
+private:
+
+    /** \brief Tag selecting the constructor that runs the initialization. */
+    struct SBuiltinTag {};
+
+    explicit ParserInt(SBuiltinTag);
+    static const ParserInt& Builtin();
 };
 
 } // namespace mu
@@ -0,0 +1,106 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_JIT_H
+#define MU_PARSER_JIT_H
+
+#include <cstddef>
+#include <vector>
+
+#include "muParserDef.h"
+#include "muParserBytecode.h"
+
+/** \file
+    \brief Definition of the just in time compiler for the parser bytecode.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64)
+  /** \brief Defined if the just in time compiler can create code for the target platform. */
+  #define MUP_JIT_X64
+#endif
+
+
+namespace mu
+{
+  /** \brief Just in time compiler for the parser bytecode.
+
+    Translates the bytecode into straight line x86-64 machine code. The stack
+    positions of all tokens are known at compile time so each token turns into
+    a few SSE2 instructions operating on fixed stack slots. Function tokens 
+    become direct calls of the callbacks.
+    
+    Bytecode containing tokens the compiler does not support (string functions,
+    bulk functions and functions with more than four arguments) is rejected, 
+    the parser will then use the interpreter.
+  */
+  class ParserJit
+  {
+  public:
+
+    ParserJit();
+   ~ParserJit();
+
+    bool Compile(const ParserByteCode &a_ByteCode);
+    void Clear();
+    bool IsCompiled() const;
+
+    /** \brief Run the compiled code. 
+        \param a_pStack The stack buffer, it must provide GetMaxStackSize() values.
+        \pre IsCompiled() returned true.
+    */
+    void Run(value_type *a_pStack) const
+    {
+      m_pFun(a_pStack);
+    }
+
+  private:
+
+    /** \brief Signature of the generated code. */
+    typedef void (*jitfun_type)(value_type*);
+
+    ParserJit(const ParserJit &a_Jit);
+    ParserJit& operator=(const ParserJit &a_Jit);
+
+    void Emit(const unsigned char *a_pBytes, std::size_t a_iSize);
+    void Emit8(unsigned char a_iByte);
+    void Emit32(int a_iVal);
+    void Emit64(const void *a_pVal);
+
+    void EmitMovRax(const void *a_pVal);
+    void EmitSse(unsigned char a_iPrefix, unsigned char a_iOp, int a_iDst, int a_iSrc);
+    void EmitSlotOp(unsigned char a_iOp, int a_iReg, int a_iSlot);
+    void EmitLoadVal(int a_iReg, value_type a_fVal);
+    void EmitLoadVar(int a_iReg, const value_type *a_pVar);
+    void EmitAndOne(int a_iReg);
+    void EmitCall(const void *a_pFun);
+
+    bool CreateFunction();
+
+    std::vector<unsigned char> m_vCode; ///< The machine code while it is created
+    void *m_pMem;                       ///< The executable memory holding the code
+    std::size_t m_iMemSize;             ///< Size of the executable memory
+    jitfun_type m_pFun;                 ///< Entry point of the code
+  };
+} // namespace mu
+
+#endif
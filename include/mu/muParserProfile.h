@@ -0,0 +1,147 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_PROFILE_H
+#define MU_PARSER_PROFILE_H
+
+#include <chrono>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "muParserDef.h"
+#include "muParserBytecode.h"
+
+/** \file
+    \brief Definition of the profiling counters of the evaluator.
+*/
+
+
+namespace mu
+{
+  //---------------------------------------------------------------------------
+  /** \brief Counters of the instrumented evaluator, see ParserBase::GetProfile.
+
+    The counters are only maintained if the parser is built with MUP_PROFILING
+    defined, #bEnabled tells whether this is the case.
+  */
+  struct ParserProfile
+  {
+    /** \brief Calls of a callback and the time spent in them. */
+    struct SFunStat
+    {
+      string_type Name;           ///< Name of the callback, operators are prefixed with their kind
+      unsigned long long nCalls;  ///< Number of values the callback was computed for
+      double fTime;               ///< Seconds spent in the callback
+    };
+
+    bool bEnabled;                           ///< The parser was built with MUP_PROFILING
+    unsigned long long nParse;               ///< Number of times the expression was parsed
+    double fParseTime;                       ///< Seconds spent parsing and compiling
+    unsigned long long nEval;                ///< Number of values computed
+    double fEvalTime;                        ///< Seconds spent evaluating, summed over threads
+    unsigned long long aCmdCount[cmUNKNOWN]; ///< Executed tokens per command code
+    std::vector<SFunStat> vFun;              ///< Callbacks by decreasing time
+
+    static const char_type* GetCmdName(ECmdCode a_iCmd);
+  };
+
+  //---------------------------------------------------------------------------
+  /** \brief Raw counters of a parser on one thread of the pool. */
+  struct ParserProfileCounters
+  {
+    /** \brief Calls and seconds per callback. */
+    typedef std::map<generic_fun_type, std::pair<unsigned long long, double> > funstat_type;
+
+    ParserProfileCounters();
+    void Reset();
+
+    unsigned long long nParse;
+    double fParseTime;
+    unsigned long long nEval;
+    double fEvalTime;
+    unsigned long long aCmdCount[cmUNKNOWN];
+    funstat_type mapFun;
+  };
+
+  //---------------------------------------------------------------------------
+  /** \brief Counts the tokens run by an evaluator and times its callbacks.
+
+    Next is called before running each token. A callback is timed from the 
+    call of Next for its token to the call for the token after it. Does 
+    nothing if the counters are NULL.
+  */
+  class ParserProfileTimer
+  {
+  public:
+    typedef std::chrono::steady_clock clock_type;
+
+    explicit ParserProfileTimer(ParserProfileCounters *a_pCounters)
+      :m_pCounters(a_pCounters)
+      ,m_pFun(NULL)
+      ,m_iWeight(0)
+      ,m_Start()
+    {}
+
+    ~ParserProfileTimer()
+    {
+      Stop();
+    }
+
+    /** \brief Count a token run for a_iWeight values. */
+    void Next(const SToken *a_pTok, int a_iWeight = 1)
+    {
+      if (!m_pCounters)
+        return;
+
+      Stop();
+      m_pCounters->aCmdCount[a_pTok->Cmd] += a_iWeight;
+      if (a_pTok->Cmd==cmFUNC || a_pTok->Cmd==cmFUNC_STR || a_pTok->Cmd==cmFUNC_BULK)
+      {
+        m_pFun = a_pTok->Fun.ptr;
+        m_iWeight = a_iWeight;
+        m_Start = clock_type::now();
+      }
+    }
+
+    /** \brief Stop timing the current callback. */
+    void Stop()
+    {
+      if (!m_pFun)
+        return;
+
+      std::pair<unsigned long long, double> &stat = m_pCounters->mapFun[m_pFun];
+      stat.first += m_iWeight;
+      stat.second += std::chrono::duration<double>(clock_type::now() - m_Start).count();
+      m_pFun = NULL;
+    }
+
+  private:
+    ParserProfileCounters *m_pCounters;
+    generic_fun_type m_pFun;
+    int m_iWeight;
+    clock_type::time_point m_Start;
+  };
+} // namespace mu
+
+#endif
@@ -0,0 +1,341 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_PROGRAM_H
+#define MU_PARSER_PROGRAM_H
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "muParserDef.h"
+#include "muParserError.h"
+#include "muParserBytecode.h"
+#include "muParserProfile.h"
+#include "muParserTemplateMagic.h"
+
+/** \file
+    \brief Definition of the compiled program and of the bytecode interpreter.
+*/
+
+
+namespace mu
+{
+  //---------------------------------------------------------------------------
+  /** \brief Run the bytecode.
+      \param a_pTok The first token of the bytecode.
+      \param Stack The evaluation stack, index zero is not used.
+      \param a_Var Functor returning a reference to the variable of a token.
+      \param a_pStrBuf The string arguments of string functions.
+      \param nOffset The offset passed to bulk functions.
+      \param nThreadID The thread id passed to bulk functions.
+      \param a_pProfile Counters updated if the parser is built with MUP_PROFILING, may be NULL.
+      \return The value left at the top of the stack.
+
+    This is the interpreter shared by ParserBase and ParserProgram, they only 
+    differ in the way variables are accessed. a_Var(pTok, ptr) is called with
+    the variable pointer of the value and assignment tokens.
+  */
+  template<typename TVar>
+  value_type RunByteCode(const SToken *a_pTok, 
+                         value_type *Stack, 
+                         const TVar &a_Var, 
+                         const string_type *a_pStrBuf,
+                         int nOffset, 
+                         int nThreadID,
+                         ParserProfileCounters *a_pProfile = NULL)
+  {
+    value_type buf;
+    int sidx(0);
+#if defined(MUP_PROFILING)
+    ParserProfileTimer timer(a_pProfile);
+#else
+    (void)a_pProfile;
+#endif
+    for (const SToken *pTok = a_pTok; pTok->Cmd!=cmEND ; ++pTok)
+    {
+#if defined(MUP_PROFILING)
+      timer.Next(pTok);
+#endif
+      switch (pTok->Cmd)
+      {
+      // built in binary operators
+      case  cmLE:   --sidx; Stack[sidx]  = Stack[sidx] <= Stack[sidx+1]; continue;
+      case  cmGE:   --sidx; Stack[sidx]  = Stack[sidx] >= Stack[sidx+1]; continue;
+      case  cmNEQ:  --sidx; Stack[sidx]  = Stack[sidx] != Stack[sidx+1]; continue;
+      case  cmEQ:   --sidx; Stack[sidx]  = Stack[sidx] == Stack[sidx+1]; continue;
+      case  cmLT:   --sidx; Stack[sidx]  = Stack[sidx] < Stack[sidx+1];  continue;
+      case  cmGT:   --sidx; Stack[sidx]  = Stack[sidx] > Stack[sidx+1];  continue;
+      case  cmADD:  --sidx; Stack[sidx] += Stack[1+sidx]; continue;
+      case  cmSUB:  --sidx; Stack[sidx] -= Stack[1+sidx]; continue;
+      case  cmMUL:  --sidx; Stack[sidx] *= Stack[1+sidx]; continue;
+      case  cmDIV:  --sidx;
+
+  #if defined(MUP_MATH_EXCEPTIONS)
+                  if (Stack[1+sidx]==0)
+                    throw ParserError(ecDIV_BY_ZERO);
+  #endif
+                  Stack[sidx] /= Stack[1+sidx]; 
+                  continue;
+
+      case  cmPOW: 
+              --sidx; Stack[sidx] = MathImpl<value_type>::Pow(Stack[sidx], Stack[1+sidx]);
+              continue;
+
+      case  cmLAND: --sidx; Stack[sidx]  = Stack[sidx] && Stack[sidx+1]; continue;
+      case  cmLOR:  --sidx; Stack[sidx]  = Stack[sidx] || Stack[sidx+1]; continue;
+
+      case  cmASSIGN: 
+          // Bugfix for Bulkmode:
+          // for details see:
+          //    https://groups.google.com/forum/embed/?place=forum/muparser-dev&showsearch=true&showpopout=true&showtabs=false&parenturl=http://muparser.beltoforion.de/mup_forum.html&afterlogin&pli=1#!topic/muparser-dev/szgatgoHTws
+          --sidx; Stack[sidx] = a_Var(pTok, pTok->Oprt.ptr) = Stack[sidx + 1]; continue;
+          // original code:
+          //--sidx; Stack[sidx] = *pTok->Oprt.ptr = Stack[sidx+1]; continue;
+
+      //case  cmBO:  // unused, listed for compiler optimization purposes
+      //case  cmBC:
+      //      MUP_FAIL(INVALID_CODE_IN_BYTECODE);
+      //      continue;
+
+      case  cmIF:
+            if (Stack[sidx--]==0)
+              pTok += pTok->Oprt.offset;
+            continue;
+
+      case  cmELSE:
+            pTok += pTok->Oprt.offset;
+            continue;
+
+      case  cmENDIF:
+            continue;
+
+      //case  cmARG_SEP:
+      //      MUP_FAIL(INVALID_CODE_IN_BYTECODE);
+      //      continue;
+
+      // value and variable tokens
+      case  cmVAR:    Stack[++sidx] = a_Var(pTok, pTok->Val.ptr);  continue;
+      case  cmVAL:    Stack[++sidx] =  pTok->Val.data2;  continue;
+      
+      case  cmVARPOW2: buf = a_Var(pTok, pTok->Val.ptr);
+                       Stack[++sidx] = buf*buf;
+                       continue;
+
+      case  cmVARPOW3: buf = a_Var(pTok, pTok->Val.ptr);
+                       Stack[++sidx] = buf*buf*buf;
+                       continue;
+
+      case  cmVARPOW4: buf = a_Var(pTok, pTok->Val.ptr);
+                       Stack[++sidx] = buf*buf*buf*buf;
+                       continue;
+      
+      case  cmVARMUL:  Stack[++sidx] = a_Var(pTok, pTok->Val.ptr) * pTok->Val.data + pTok->Val.data2;
+                       continue;
+
+      // temporaries holding common subexpressions
+      case  cmSTORE:   Stack[pTok->Oprt.offset] = Stack[sidx];
+                       continue;
+
+      case  cmLOAD:    Stack[++sidx] = Stack[pTok->Oprt.offset];
+                       continue;
+
+      // sums and products: the lower bound slot holds the loop variable, the 
+      // upper bound slot the number of iterations left
+      case  cmLOOP:
+            {
+              value_type fCount = std::floor(Stack[sidx] - Stack[sidx-1]) + 1,
+                         fInit = (pTok->Oprt.code==cmMUL) ? 1 : 0;
+              if (fCount>0 && fCount<=MUP_LOOP_MAX)
+              {
+                Stack[sidx] = fCount;
+                Stack[++sidx] = fInit;
+                continue;
+              }
+
+              // No iterations or too many of them, NaN bounds included
+              Stack[--sidx] = (fCount<=0) ? fInit : std::numeric_limits<value_type>::quiet_NaN();
+              pTok += pTok->Oprt.offset;
+            }
+            continue;
+
+      case  cmENDLOOP:
+            --sidx;
+            if (pTok->Oprt.code==cmMUL)
+              Stack[sidx] *= Stack[sidx+1];
+            else
+              Stack[sidx] += Stack[sidx+1];
+
+            if (--Stack[sidx-1]>0)
+            {
+              Stack[sidx-2] += 1;
+              pTok -= pTok->Oprt.offset;
+              continue;
+            }
+
+            sidx -= 2;
+            Stack[sidx] = Stack[sidx+2];
+            continue;
+
+      // Next is treatment of numeric functions
+      case  cmFUNC:
+            {
+              int iArgCount = pTok->Fun.argc;
+
+              // switch according to argument count
+              switch(iArgCount)  
+              {
+              case 0: sidx += 1; Stack[sidx] = (*(fun_type0)pTok->Fun.ptr)(); continue;
+              case 1:            Stack[sidx] = (*(fun_type1)pTok->Fun.ptr)(Stack[sidx]);   continue;
+              case 2: sidx -= 1; Stack[sidx] = (*(fun_type2)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1]); continue;
+              case 3: sidx -= 2; Stack[sidx] = (*(fun_type3)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2]); continue;
+              case 4: sidx -= 3; Stack[sidx] = (*(fun_type4)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3]); continue;
+              case 5: sidx -= 4; Stack[sidx] = (*(fun_type5)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4]); continue;
+              case 6: sidx -= 5; Stack[sidx] = (*(fun_type6)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5]); continue;
+              case 7: sidx -= 6; Stack[sidx] = (*(fun_type7)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6]); continue;
+              case 8: sidx -= 7; Stack[sidx] = (*(fun_type8)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7]); continue;
+              case 9: sidx -= 8; Stack[sidx] = (*(fun_type9)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8]); continue;
+              case 10:sidx -= 9; Stack[sidx] = (*(fun_type10)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8], Stack[sidx+9]); continue;
+              default:
+                if (iArgCount>0) // function with variable arguments store the number as a negative value
+                  throw ParserError(ecINTERNAL_ERROR, 1, string_type());
+
+                sidx -= -iArgCount - 1;
+                Stack[sidx] =(*(multfun_type)pTok->Fun.ptr)(&Stack[sidx], -iArgCount);
+                continue;
+              }
+            }
+
+      // Next is treatment of string functions
+      case  cmFUNC_STR:
+            {
+              sidx -= pTok->Fun.argc -1;
+
+              // The index of the string argument in the string table
+              const char_type *szStr = a_pStrBuf[pTok->Fun.idx].c_str();
+              switch(pTok->Fun.argc)  // switch according to argument count
+              {
+              case 0: Stack[sidx] = (*(strfun_type1)pTok->Fun.ptr)(szStr); continue;
+              case 1: Stack[sidx] = (*(strfun_type2)pTok->Fun.ptr)(szStr, Stack[sidx]); continue;
+              case 2: Stack[sidx] = (*(strfun_type3)pTok->Fun.ptr)(szStr, Stack[sidx], Stack[sidx+1]); continue;
+              }
+
+              continue;
+            }
+
+        case  cmFUNC_BULK:
+              {
+                int iArgCount = pTok->Fun.argc;
+
+                // switch according to argument count
+                switch(iArgCount)  
+                {
+                case 0: sidx += 1; Stack[sidx] = (*(bulkfun_type0 )pTok->Fun.ptr)(nOffset, nThreadID); continue;
+                case 1:            Stack[sidx] = (*(bulkfun_type1 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx]); continue;
+                case 2: sidx -= 1; Stack[sidx] = (*(bulkfun_type2 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1]); continue;
+                case 3: sidx -= 2; Stack[sidx] = (*(bulkfun_type3 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2]); continue;
+                case 4: sidx -= 3; Stack[sidx] = (*(bulkfun_type4 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3]); continue;
+                case 5: sidx -= 4; Stack[sidx] = (*(bulkfun_type5 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4]); continue;
+                case 6: sidx -= 5; Stack[sidx] = (*(bulkfun_type6 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5]); continue;
+                case 7: sidx -= 6; Stack[sidx] = (*(bulkfun_type7 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6]); continue;
+                case 8: sidx -= 7; Stack[sidx] = (*(bulkfun_type8 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7]); continue;
+                case 9: sidx -= 8; Stack[sidx] = (*(bulkfun_type9 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8]); continue;
+                case 10:sidx -= 9; Stack[sidx] = (*(bulkfun_type10)pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8], Stack[sidx+9]); continue;
+                default:
+                  throw ParserError(ecINTERNAL_ERROR, 2, string_type());
+                }
+              }
+
+        default:
+              throw ParserError(ecINTERNAL_ERROR, 3, string_type());
+      } // switch CmdCode
+    } // for all bytecode tokens
+
+    return Stack[sidx];
+  }
+
+
+  //---------------------------------------------------------------------------
+  /** \brief Compiled expression that can be evaluated from several threads.
+
+    A program holds a copy of the bytecode of a parser together with its 
+    string arguments. It is immutable, copies share the same data and it stays 
+    valid when the parser is modified or destroyed.
+
+    The variables are not accessed through the pointers bound to the parser. 
+    Each distinct variable used by the expression is given a slot and the 
+    caller passes the variable values in slot order. Assignments write to the 
+    caller's array. The evaluation stack is supplied by the caller too, so 
+    every thread needs its own stack and variable array but no parser.
+
+    \sa ParserBase::Compile
+  */
+  class ParserProgram
+  {
+  public:
+    typedef std::vector<string_type> stringbuf_type;
+
+    ParserProgram();
+    ParserProgram(const ParserByteCode &a_ByteCode, const stringbuf_type &a_vStrBuf, int a_iNumResults);
+
+    value_type Eval(value_type *a_pVar, value_type *a_pStack) const;
+    void LoadVar(value_type *a_pVar) const;
+
+    int GetNumVar() const;
+    int GetVarSlot(const value_type *a_pVar) const;
+    value_type* GetVarPtr(int a_iSlot) const;
+    std::size_t GetStackSize() const;
+    int GetNumResults() const;
+    bool IsEmpty() const;
+
+  private:
+    /** \brief The shared immutable program. */
+    struct SProgram
+    {
+      std::vector<SToken> vRPN;          ///< The bytecode
+      std::vector<int> vSlot;            ///< Variable slot of each token or -1
+      std::vector<value_type*> vVar;     ///< Variables bound to the parser by slot
+      stringbuf_type vStrBuf;            ///< String arguments of string functions
+      std::size_t iStackSize;            ///< Number of stack values needed
+      int iNumResults;                   ///< Number of comma separated results
+    };
+
+    /** \brief Variable access of the interpreter using the slot table. */
+    struct SSlotVar
+    {
+      const SToken *pBase;
+      const int *pSlot;
+      value_type *pVar;
+
+      value_type& operator()(const SToken *a_pTok, value_type*) const
+      {
+        return pVar[pSlot[a_pTok - pBase]];
+      }
+    };
+
+    std::shared_ptr<const SProgram> m_pProgram;
+  };
+} // namespace mu
+
+#endif
@@ -0,0 +1,151 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_REGISTER_CODE_H
+#define MU_PARSER_REGISTER_CODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "muParserDef.h"
+#include "muParserBytecode.h"
+
+/** \file
+    \brief Definition of the register based form of the parser bytecode.
+*/
+
+
+namespace mu
+{
+  /** \brief Operation codes of the register code. */
+  enum ERegCode
+  {
+    rcLOADVAR = 0,  ///< frame[Dst] = *var[Aux]
+    rcMOV,          ///< frame[Dst] = frame[A]
+    rcLE,           ///< frame[Dst] = frame[A] <= frame[B]
+    rcGE,           ///< frame[Dst] = frame[A] >= frame[B]
+    rcNEQ,          ///< frame[Dst] = frame[A] != frame[B]
+    rcEQ,           ///< frame[Dst] = frame[A] == frame[B]
+    rcLT,           ///< frame[Dst] = frame[A] < frame[B]
+    rcGT,           ///< frame[Dst] = frame[A] > frame[B]
+    rcADD,          ///< frame[Dst] = frame[A] + frame[B]
+    rcSUB,          ///< frame[Dst] = frame[A] - frame[B]
+    rcMUL,          ///< frame[Dst] = frame[A] * frame[B]
+    rcDIV,          ///< frame[Dst] = frame[A] / frame[B]
+    rcPOW,          ///< frame[Dst] = frame[A] ^ frame[B]
+    rcLAND,         ///< frame[Dst] = frame[A] && frame[B]
+    rcLOR,          ///< frame[Dst] = frame[A] || frame[B]
+    rcMULADD,       ///< frame[Dst] = frame[A] * frame[B] + frame[C]
+    rcMULSUB,       ///< frame[Dst] = frame[A] * frame[B] - frame[C]
+    rcNMULADD,      ///< frame[Dst] = frame[C] - frame[A] * frame[B]
+    rcPOW2,         ///< frame[Dst] = frame[A]^2
+    rcPOW3,         ///< frame[Dst] = frame[A]^3
+    rcPOW4,         ///< frame[Dst] = frame[A]^4
+    rcFUNC0,        ///< frame[Dst] = fun[Aux]()
+    rcFUNC1,        ///< frame[Dst] = fun[Aux](frame[A])
+    rcFUNC2,        ///< frame[Dst] = fun[Aux](frame[A], frame[B])
+    rcFUNC3,        ///< frame[Dst] = fun[Aux](frame[A], frame[B], frame[C])
+    rcFUNCN,        ///< frame[Dst] = fun[Aux](frame[A], ..., frame[A+C-1]) with 4 to 10 arguments
+    rcFUNCMULT,     ///< frame[Dst] = fun[Aux](&frame[A], C) for functions with a variable number of arguments
+    rcASSIGN,       ///< frame[Dst] = *var[Aux] = frame[A]
+    rcJZ,           ///< if frame[A]==0 jump to instruction Aux
+    rcJMP,          ///< jump to instruction Aux
+    rcEND           ///< return frame[A]
+  };
+
+  /** \brief A single instruction of the register code.
+  
+    Operands are indices into the frame of the evaluation. The frame contains
+    the temporary values, the constants and the values of the variables. 
+    Function and variable pointers are referred to by index (Aux) into the 
+    tables of the register code.
+  */
+  struct SRegInstr
+  {
+    unsigned short Op;
+    unsigned short Dst;
+    unsigned short A;
+    unsigned short B;
+    unsigned short C;
+    unsigned short Aux;
+  };
+
+
+  /** \brief Register based form of the parser bytecode.
+
+    The stack based bytecode pays for moving every value through the stack and 
+    for the size of its tokens. This class translates the bytecode into compact
+    three address instructions referring to a frame of values: the temporaries 
+    (laid out like the stack of the bytecode) followed by the constant pool and
+    the variable values. Variables and constants are used in place, common patterns are fused into single instructions 
+    (a*b+c, f(var), x^n). 
+    
+    Expressions with string functions or bulk functions are not translated.
+  */
+  class ParserRegisterCode
+  {
+  public:
+
+    ParserRegisterCode();
+
+    bool Compile(const ParserByteCode &a_ByteCode);
+    void clear();
+    bool IsCompiled() const;
+
+    std::size_t GetFrameSize() const;
+    void InitFrame(value_type *a_pFrame) const;
+    value_type Run(value_type *a_pFrame) const;
+
+    void AsciiDump() const;
+
+  private:
+
+    /** \brief Describes where a value of the simulated stack is located. */
+    struct SOperand
+    {
+      unsigned Slot;  ///< Frame index of the value
+      int Instr;      ///< Index of the instruction computing the value or -1
+    };
+
+    unsigned ConstSlot(value_type a_fVal);
+    unsigned VarSlot(value_type *a_pVar);
+    unsigned VarIndex(value_type *a_pVar);
+    unsigned FunIndex(generic_fun_type a_pFun);
+    int AddInstr(unsigned a_iOp, unsigned a_iDst, unsigned a_iA = 0, unsigned a_iB = 0, unsigned a_iC = 0, unsigned a_iAux = 0);
+    void Materialize(std::vector<SOperand> &a_vStack, std::size_t a_iPos);
+
+    std::vector<SRegInstr> m_vCode;         ///< The instructions
+    std::vector<value_type> m_vConst;       ///< Initial values of the frame behind the temporaries (constants and variable slots)
+    std::unordered_map<std::uint64_t, unsigned> m_ConstSlot; ///< Frame index of each constant by its bit pattern
+    std::vector<value_type*> m_vVar;        ///< Variable pointers
+    std::vector<unsigned> m_vVarSlot;       ///< Frame index of each variable, unused if m_bLiveVar is set
+    std::vector<generic_fun_type> m_vFun;   ///< Function pointers
+    std::size_t m_iMaxStackSize;            ///< Number of temporaries, they are the first part of the frame
+    std::size_t m_iLabel;                   ///< Most recent jump target, instructions before it can't be fused
+    bool m_bLiveVar;                        ///< Read variables when used instead of once at the start
+  };
+} // namespace mu
+
+#endif
@@ -0,0 +1,187 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_SHARED_MAP_H
+#define MU_PARSER_SHARED_MAP_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "muParserDef.h"
+
+/** \file
+    \brief Definition of the copy on write maps holding the parser definitions.
+*/
+
+
+namespace mu
+{
+  /** \brief Map shared between copies of a parser until one of them modifies it.
+
+    Copying the map only copies a reference, the elements are copied by the 
+    first modification of a map that is shared. Parsers of the same type thus 
+    share their built in functions, operators and constants unless they 
+    define their own.
+
+    Maps keyed by names can be looked up directly in the expression with Find,
+    it uses a hash table built on first use and shared like the elements.
+
+    \attention Modifying a map invalidates the references and iterators 
+               obtained from it before.
+  */
+  template<typename TMap>
+  class ParserSharedMap
+  {
+  public:
+    typedef TMap map_type;
+    typedef typename TMap::key_type key_type;
+    typedef typename TMap::mapped_type mapped_type;
+    typedef typename TMap::value_type value_type;
+    typedef typename TMap::const_iterator const_iterator;
+    typedef typename TMap::const_reverse_iterator const_reverse_iterator;
+
+    ParserSharedMap()
+      :m_pData()
+    {}
+
+    /** \brief Return the elements for reading. */
+    const TMap& Get() const
+    {
+      static const TMap s_Empty;
+      return m_pData ? m_pData->Map : s_Empty;
+    }
+
+    /** \brief Return the elements for modification, they are copied first if the map is shared. 
+    
+      An indexed map is moved to new storage since the index can't be reset.
+    */
+    TMap& Edit()
+    {
+      if (!m_pData)
+      {
+        m_pData = std::make_shared<SData>();
+      }
+      else if (m_pData.use_count()>1)
+      {
+        m_pData = std::make_shared<SData>(m_pData->Map);
+      }
+      else if (m_pData->bIndexed)
+      {
+        std::shared_ptr<SData> pData = std::make_shared<SData>();
+        pData->Map.swap(m_pData->Map);
+        m_pData = pData;
+      }
+
+      return m_pData->Map;
+    }
+
+    /** \brief Look up the element named by a part of a string.
+        \param a_szName Start of the name, it does not need to be null terminated.
+        \param a_iLen Length of the name.
+        \return The element or NULL if there is none.
+    */
+    const value_type* Find(const char_type *a_szName, std::size_t a_iLen) const
+    {
+      if (!m_pData || m_pData->Map.empty())
+        return NULL;
+
+      SData &data = *m_pData;
+      std::call_once(data.IndexFlag, &SData::BuildIndex, &data);
+
+      for (std::size_t i = Hash(a_szName, a_iLen) & data.iMask; data.vIndex[i]; i = (i + 1) & data.iMask)
+      {
+        const key_type &sKey = data.vIndex[i]->first;
+        if (sKey.length()==a_iLen && std::char_traits<char_type>::compare(sKey.data(), a_szName, a_iLen)==0)
+          return data.vIndex[i];
+      }
+
+      return NULL;
+    }
+
+    const_iterator find(const key_type &a_Key) const  { return Get().find(a_Key); }
+    const_iterator begin() const                      { return Get().begin(); }
+    const_iterator end() const                        { return Get().end(); }
+    const_reverse_iterator rbegin() const             { return Get().rbegin(); }
+    const_reverse_iterator rend() const               { return Get().rend(); }
+    bool empty() const                                { return Get().empty(); }
+    std::size_t size() const                          { return Get().size(); }
+
+    mapped_type& operator[](const key_type &a_Key)    { return Edit()[a_Key]; }
+    void erase(const key_type &a_Key)                 { Edit().erase(a_Key); }
+    void clear()                                      { m_pData.reset(); }
+
+  private:
+    /** \brief The elements and their hash index. */
+    struct SData
+    {
+      TMap Map;
+      std::once_flag IndexFlag;
+      std::vector<const value_type*> vIndex;  ///< Open addressing table, NULL marks free slots
+      std::size_t iMask;
+      bool bIndexed;
+
+      SData()
+        :Map(), IndexFlag(), vIndex(), iMask(0), bIndexed(false)
+      {}
+
+      explicit SData(const TMap &a_Map)
+        :Map(a_Map), IndexFlag(), vIndex(), iMask(0), bIndexed(false)
+      {}
+
+      void BuildIndex()
+      {
+        std::size_t iSize = 8;
+        while (iSize < 2 * Map.size())
+          iSize *= 2;
+
+        vIndex.assign(iSize, (const value_type*)NULL);
+        iMask = iSize - 1;
+        for (const_iterator it = Map.begin(); it!=Map.end(); ++it)
+        {
+          std::size_t i = Hash(it->first.data(), it->first.length()) & iMask;
+          while (vIndex[i])
+            i = (i + 1) & iMask;
+          vIndex[i] = &*it;
+        }
+
+        bIndexed = true;
+      }
+    };
+
+    /** \brief FNV-1a hash of a name. */
+    static std::size_t Hash(const char_type *a_szName, std::size_t a_iLen)
+    {
+      std::size_t h = 2166136261u;
+      for (std::size_t i=0; i<a_iLen; ++i)
+        h = (h ^ (std::size_t)a_szName[i]) * 16777619u;
+      return h;
+    }
+
+    std::shared_ptr<SData> m_pData;
+  };
+} // namespace mu
+
+#endif
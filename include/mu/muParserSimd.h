@@ -0,0 +1,260 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_SIMD_H
+#define MU_PARSER_SIMD_H
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+  #define MUP_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+  #include <emmintrin.h>
+  #define MUP_SIMD_SSE2
+#endif
+
+/** \file
+    \brief Thin wrappers around the SIMD instructions used by the array evaluation.
+
+    MUP_SIMD_AVX or MUP_SIMD_SSE2 is defined if the instructions are available, 
+    the wrappers don't exist otherwise. The integer operations on 256 bit 
+    registers are split in two halves unless AVX2 is enabled.
+
+    Round, Pow2n and Exponent rely on the exact IEEE rounding of additions, 
+    the files using them must not be compiled with -ffast-math or similar.
+*/
+
+#if defined(MUP_SIMD_AVX) || defined(MUP_SIMD_SSE2)
+
+namespace mu
+{
+  namespace simd
+  {
+  #if defined(MUP_SIMD_AVX) && !defined(__AVX2__)
+    /** \brief Apply a 128 bit integer operation to both halves of a 256 bit register. */
+    template<typename TOp>
+    inline __m256i Split(__m256i a, TOp op)
+    {
+      __m128i lo = op(_mm256_castsi256_si128(a)), 
+              hi = op(_mm256_extractf128_si256(a, 1));
+      return _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    }
+  #endif
+
+    //------------------------------------------------------------------------------
+    /** \brief SIMD instructions on packed double values. */
+    struct VecDouble
+    {
+      typedef double value_type;
+
+  #if defined(MUP_SIMD_AVX)
+      typedef __m256d type;
+      static const int size = 4;
+      static type Load(const double *p)          { return _mm256_loadu_pd(p); }
+      static void Store(double *p, type v)       { _mm256_storeu_pd(p, v); }
+      static type Set(double v)                  { return _mm256_set1_pd(v); }
+      static type Add(type a, type b)            { return _mm256_add_pd(a, b); }
+      static type Sub(type a, type b)            { return _mm256_sub_pd(a, b); }
+      static type Mul(type a, type b)            { return _mm256_mul_pd(a, b); }
+      static type Div(type a, type b)            { return _mm256_div_pd(a, b); }
+      static type Sqrt(type a)                   { return _mm256_sqrt_pd(a); }
+      static type Min(type a, type b)            { return _mm256_min_pd(a, b); }
+      static type Max(type a, type b)            { return _mm256_max_pd(a, b); }
+      static type And(type a, type b)            { return _mm256_and_pd(a, b); }
+      static type AndNot(type a, type b)         { return _mm256_andnot_pd(a, b); }
+      static type Or(type a, type b)             { return _mm256_or_pd(a, b); }
+      static type CmpLT(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+      static type CmpLE(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+      static type CmpGT(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+      static type CmpGE(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+      static type CmpEQ(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+      static type CmpNEQ(type a, type b)         { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+      static type Blend(type a, type b, type m)  { return _mm256_blendv_pd(a, b, m); }
+      static int MoveMask(type m)                { return _mm256_movemask_pd(m); }
+      static type Bits(long long v)              { return _mm256_castsi256_pd(_mm256_set1_epi64x(v)); }
+
+    #if defined(__AVX2__)
+      static type ShiftL(type a)                 { return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), 52)); }
+      static type ShiftR(type a)                 { return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), 52)); }
+    #else
+      static __m128i ShiftL128(__m128i a)        { return _mm_slli_epi64(a, 52); }
+      static __m128i ShiftR128(__m128i a)        { return _mm_srli_epi64(a, 52); }
+      static type ShiftL(type a)                 { return _mm256_castsi256_pd(Split(_mm256_castpd_si256(a), ShiftL128)); }
+      static type ShiftR(type a)                 { return _mm256_castsi256_pd(Split(_mm256_castpd_si256(a), ShiftR128)); }
+    #endif
+  #else
+      typedef __m128d type;
+      static const int size = 2;
+      static type Load(const double *p)          { return _mm_loadu_pd(p); }
+      static void Store(double *p, type v)       { _mm_storeu_pd(p, v); }
+      static type Set(double v)                  { return _mm_set1_pd(v); }
+      static type Add(type a, type b)            { return _mm_add_pd(a, b); }
+      static type Sub(type a, type b)            { return _mm_sub_pd(a, b); }
+      static type Mul(type a, type b)            { return _mm_mul_pd(a, b); }
+      static type Div(type a, type b)            { return _mm_div_pd(a, b); }
+      static type Sqrt(type a)                   { return _mm_sqrt_pd(a); }
+      static type Min(type a, type b)            { return _mm_min_pd(a, b); }
+      static type Max(type a, type b)            { return _mm_max_pd(a, b); }
+      static type And(type a, type b)            { return _mm_and_pd(a, b); }
+      static type AndNot(type a, type b)         { return _mm_andnot_pd(a, b); }
+      static type Or(type a, type b)             { return _mm_or_pd(a, b); }
+      static type CmpLT(type a, type b)          { return _mm_cmplt_pd(a, b); }
+      static type CmpLE(type a, type b)          { return _mm_cmple_pd(a, b); }
+      static type CmpGT(type a, type b)          { return _mm_cmpgt_pd(a, b); }
+      static type CmpGE(type a, type b)          { return _mm_cmpge_pd(a, b); }
+      static type CmpEQ(type a, type b)          { return _mm_cmpeq_pd(a, b); }
+      static type CmpNEQ(type a, type b)         { return _mm_cmpneq_pd(a, b); }
+      static type Blend(type a, type b, type m)  { return _mm_or_pd(_mm_andnot_pd(m, a), _mm_and_pd(m, b)); }
+      static int MoveMask(type m)                { return _mm_movemask_pd(m); }
+      static type Bits(long long v)              { return _mm_castsi128_pd(_mm_set1_epi64x(v)); }
+      static type ShiftL(type a)                 { return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), 52)); }
+      static type ShiftR(type a)                 { return _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(a), 52)); }
+  #endif
+
+      /** \brief Round to the nearest integer, |a| must be below 2^51. */
+      static type Round(type a)
+      {
+        const type m = Set(6755399441055744.0);  // 1.5*2^52
+        return Sub(Add(a, m), m);
+      }
+
+      static type Abs(type a) { return AndNot(Set(-0.0), a); }
+
+      /** \brief 2^n for an integer n in [-1022, 1023]. 
+      
+        Adding 1.5*2^52 moves n+1023 to the low bits of the mantissa, from 
+        where it is shifted into the exponent.
+      */
+      static type Pow2n(type n) { return ShiftL(Add(n, Set(6755399441055744.0 + 1023))); }
+
+      /** \brief The unbiased exponent of a positive normal number. */
+      static type Exponent(type a)
+      {
+        const type m = Set(4503599627370496.0);  // 2^52
+        return Sub(Or(ShiftR(a), m), Set(4503599627370496.0 + 1023));
+      }
+
+      /** \brief The mantissa of a positive normal number, within [1, 2). */
+      static type Mantissa(type a) { return Or(And(a, Bits(0x000FFFFFFFFFFFFFLL)), Set(1)); }
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief SIMD instructions on packed float values. 
+    
+      A vector holds twice as many floats as doubles.
+    */
+    struct VecFloat
+    {
+      typedef float value_type;
+
+  #if defined(MUP_SIMD_AVX)
+      typedef __m256 type;
+      static const int size = 8;
+      static type Load(const float *p)           { return _mm256_loadu_ps(p); }
+      static void Store(float *p, type v)        { _mm256_storeu_ps(p, v); }
+      static type Set(float v)                   { return _mm256_set1_ps(v); }
+      static type Add(type a, type b)            { return _mm256_add_ps(a, b); }
+      static type Sub(type a, type b)            { return _mm256_sub_ps(a, b); }
+      static type Mul(type a, type b)            { return _mm256_mul_ps(a, b); }
+      static type Div(type a, type b)            { return _mm256_div_ps(a, b); }
+      static type Sqrt(type a)                   { return _mm256_sqrt_ps(a); }
+      static type Min(type a, type b)            { return _mm256_min_ps(a, b); }
+      static type Max(type a, type b)            { return _mm256_max_ps(a, b); }
+      static type And(type a, type b)            { return _mm256_and_ps(a, b); }
+      static type AndNot(type a, type b)         { return _mm256_andnot_ps(a, b); }
+      static type Or(type a, type b)             { return _mm256_or_ps(a, b); }
+      static type CmpLT(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+      static type CmpLE(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+      static type CmpGT(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+      static type CmpGE(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+      static type CmpEQ(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+      static type CmpNEQ(type a, type b)         { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+      static type Blend(type a, type b, type m)  { return _mm256_blendv_ps(a, b, m); }
+      static int MoveMask(type m)                { return _mm256_movemask_ps(m); }
+      static type Bits(int v)                    { return _mm256_castsi256_ps(_mm256_set1_epi32(v)); }
+
+    #if defined(__AVX2__)
+      static type ShiftL(type a)                 { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_castps_si256(a), 23)); }
+      static type ShiftR(type a)                 { return _mm256_castsi256_ps(_mm256_srli_epi32(_mm256_castps_si256(a), 23)); }
+    #else
+      static __m128i ShiftL128(__m128i a)        { return _mm_slli_epi32(a, 23); }
+      static __m128i ShiftR128(__m128i a)        { return _mm_srli_epi32(a, 23); }
+      static type ShiftL(type a)                 { return _mm256_castsi256_ps(Split(_mm256_castps_si256(a), ShiftL128)); }
+      static type ShiftR(type a)                 { return _mm256_castsi256_ps(Split(_mm256_castps_si256(a), ShiftR128)); }
+    #endif
+  #else
+      typedef __m128 type;
+      static const int size = 4;
+      static type Load(const float *p)           { return _mm_loadu_ps(p); }
+      static void Store(float *p, type v)        { _mm_storeu_ps(p, v); }
+      static type Set(float v)                   { return _mm_set1_ps(v); }
+      static type Add(type a, type b)            { return _mm_add_ps(a, b); }
+      static type Sub(type a, type b)            { return _mm_sub_ps(a, b); }
+      static type Mul(type a, type b)            { return _mm_mul_ps(a, b); }
+      static type Div(type a, type b)            { return _mm_div_ps(a, b); }
+      static type Sqrt(type a)                   { return _mm_sqrt_ps(a); }
+      static type Min(type a, type b)            { return _mm_min_ps(a, b); }
+      static type Max(type a, type b)            { return _mm_max_ps(a, b); }
+      static type And(type a, type b)            { return _mm_and_ps(a, b); }
+      static type AndNot(type a, type b)         { return _mm_andnot_ps(a, b); }
+      static type Or(type a, type b)             { return _mm_or_ps(a, b); }
+      static type CmpLT(type a, type b)          { return _mm_cmplt_ps(a, b); }
+      static type CmpLE(type a, type b)          { return _mm_cmple_ps(a, b); }
+      static type CmpGT(type a, type b)          { return _mm_cmpgt_ps(a, b); }
+      static type CmpGE(type a, type b)          { return _mm_cmpge_ps(a, b); }
+      static type CmpEQ(type a, type b)          { return _mm_cmpeq_ps(a, b); }
+      static type CmpNEQ(type a, type b)         { return _mm_cmpneq_ps(a, b); }
+      static type Blend(type a, type b, type m)  { return _mm_or_ps(_mm_andnot_ps(m, a), _mm_and_ps(m, b)); }
+      static int MoveMask(type m)                { return _mm_movemask_ps(m); }
+      static type Bits(int v)                    { return _mm_castsi128_ps(_mm_set1_epi32(v)); }
+      static type ShiftL(type a)                 { return _mm_castsi128_ps(_mm_slli_epi32(_mm_castps_si128(a), 23)); }
+      static type ShiftR(type a)                 { return _mm_castsi128_ps(_mm_srli_epi32(_mm_castps_si128(a), 23)); }
+  #endif
+
+      /** \brief Round to the nearest integer, |a| must be below 2^22. */
+      static type Round(type a)
+      {
+        const type m = Set(12582912.0f);  // 1.5*2^23
+        return Sub(Add(a, m), m);
+      }
+
+      static type Abs(type a) { return AndNot(Set(-0.0f), a); }
+
+      /** \brief 2^n for an integer n in [-126, 127]. */
+      static type Pow2n(type n) { return ShiftL(Add(n, Set(12582912.0f + 127))); }
+
+      /** \brief The unbiased exponent of a positive normal number. */
+      static type Exponent(type a)
+      {
+        const type m = Set(8388608.0f);  // 2^23
+        return Sub(Or(ShiftR(a), m), Set(8388608.0f + 127));
+      }
+
+      /** \brief The mantissa of a positive normal number, within [1, 2). */
+      static type Mantissa(type a) { return Or(And(a, Bits(0x007FFFFF)), Set(1)); }
+    };
+  } // namespace simd
+} // namespace mu
+
+#endif // defined(MUP_SIMD_AVX) || defined(MUP_SIMD_SSE2)
+
+#endif
@@ -95,9 +95,9 @@ namespace mu
     static T Sinh(T v)  { return sinh(v); }
     static T Cosh(T v)  { return cosh(v); }
     static T Tanh(T v)  { return tanh(v); }
-    static T ASinh(T v) { return log(v + sqrt(v * v + 1)); }
-    static T ACosh(T v) { return log(v + sqrt(v * v - 1)); }
-    static T ATanh(T v) { return ((T)0.5 * log((1 + v) / (1 - v))); }
+    static T ASinh(T v) { return asinh(v); }
+    static T ACosh(T v) { return acosh(v); }
+    static T ATanh(T v) { return atanh(v); }
     static T Log(T v)   { return log(v); } 
     static T Log2(T v)  { return log(v)/log((T)2); } // Logarithm base 2
     static T Log10(T v) { return log10(v); }         // Logarithm base 10
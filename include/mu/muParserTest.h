@@ -50,6 +50,7 @@ namespace mu
     {
     private:
         static int c_iCount;
+        static int c_iCalls;  ///< Number of calls of Counted()
 
         // Multiarg callbacks
         static value_type f1of1(value_type v) { return v;};
@@ -81,6 +82,7 @@ namespace mu
         static value_type sign(value_type v) { return -v; }
         static value_type add(value_type v1, value_type v2) { return v1+v2; }
         static value_type land(value_type v1, value_type v2) { return (int)v1 & (int)v2; }
+        static value_type Counted(value_type v) { ++c_iCalls; return v; }
         
 
         static value_type FirstArg(const value_type* a_afArg, int a_iArgc)
@@ -178,6 +180,19 @@ namespace mu
         int TestStrArg();
         int TestIfThenElse();
         int TestBulkMode();
+        int TestDiff();
+        int TestInterval();
+        int TestProgram();
+        int TestParallel();
+        int TestSharedDef();
+        int TestLongExpr();
+        int TestFusedExpr();
+        int TestFloatEval();
+        int TestVecMath();
+        int TestByteCodeIO();
+        int TestProfile();
+        int TestHoist();
+        int TestLoop();
 
         void Abort() const;
 
@@ -205,6 +220,12 @@ namespace mu
 
         // Test Bulkmode
         int EqnTestBulk(const string_type& a_str, double a_fRes[4], bool a_fPass);
+
+        // Test automatic differentiation
+        int EqnTestDiff(const string_type& a_str, double a_fVar, double a_fRes, double a_fDeriv, double a_fDeriv2, bool a_bSymbolic = true);
+
+        // Test interval evaluation
+        int EqnTestInterval(const string_type& a_str, double a_fLo, double a_fHi, double a_fResLo, double a_fResHi);
     };
   } // namespace Test
 } // namespace mu
@@ -0,0 +1,111 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_THREAD_POOL_H
+#define MU_PARSER_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \file
+    \brief Definition of the thread pool used for evaluating many values at once.
+*/
+
+
+namespace mu
+{
+  /** \brief Work stealing thread pool running index ranges in parallel.
+
+    The pool is shared by all parsers, its threads are started on the first 
+    parallel job. A job is a callback processing the indices [begin, end) of 
+    an array. The range is split evenly between the threads, each thread takes
+    chunks from the front of its own part and steals from the back of the 
+    others once its part is done.
+
+    The chunk size (the grain) is tuned for each job: the calling thread first 
+    runs a few indices alone and measures their cost. Jobs too small to 
+    benefit from several threads are completed right there.
+
+    Running a job does not allocate memory.
+  */
+  class ParserThreadPool
+  {
+  public:
+    /** \brief Callback processing the indices [a_iBegin, a_iEnd). 
+    
+      a_iThread is the id of the running thread, 0 for the calling thread and 
+      below GetNumThreads() for the others.
+    */
+    typedef void (*range_fun_type)(void *a_pCtx, int a_iBegin, int a_iEnd, int a_iThread);
+
+    static ParserThreadPool& Instance();
+
+    void Run(range_fun_type a_pFun, void *a_pCtx, int a_iSize, int a_iMinGrain = 1);
+    int GetNumThreads() const;
+
+  private:
+    /** \brief Part of the range of a job owned by one thread. */
+    struct SQueue
+    {
+      std::mutex Lock;
+      int iBegin;
+      int iEnd;
+    };
+
+    ParserThreadPool();
+   ~ParserThreadPool();
+    ParserThreadPool(const ParserThreadPool&);
+    ParserThreadPool& operator=(const ParserThreadPool&);
+
+    void Start();
+    void WorkerMain(int a_iThread);
+    void Work(int a_iThread);
+    bool TakeChunk(int a_iThread, int &a_iBegin, int &a_iEnd);
+    bool Steal(int a_iThread);
+
+    std::atomic<int> m_iNumThreads;         ///< Number of threads including the caller, lowered by Start() if threads can't be created
+    std::vector<std::thread> m_vWorker;     ///< Worker threads, started on demand
+    std::unique_ptr<SQueue[]> m_pQueue;     ///< Range of each thread for the current job
+
+    std::mutex m_RunLock;                   ///< Serializes jobs submitted by different threads
+    std::mutex m_Lock;                      ///< Protects the job state below
+    std::condition_variable m_cvStart;      ///< Signals a new job or the shutdown to the workers
+    std::condition_variable m_cvDone;       ///< Signals the end of the job to the caller
+    unsigned m_iJob;                        ///< Number of the current job
+    int m_iBusy;                            ///< Number of workers still running the current job
+    bool m_bStop;                           ///< Workers have to quit
+
+    range_fun_type m_pFun;                  ///< Callback of the current job
+    void *m_pCtx;                           ///< Context of the current job
+    int m_iGrain;                           ///< Chunk size of the current job
+    int m_iAlign;                           ///< Chunks start at multiples of this in the current job
+    std::exception_ptr m_pError;            ///< First exception thrown by the current job
+  };
+} // namespace mu
+
+#endif
@@ -216,6 +216,24 @@ namespace mu
         return *this;
       }
 
+      //------------------------------------------------------------------------------
+      /** \brief Make this token the loop variable of a sum or product. 
+      
+          \param a_iIdx Nesting level of the sum or product, zero for the outermost one.
+          \throw nothrow
+      */
+      ParserToken& SetLoopVar(int a_iIdx, const TString &a_strTok)
+      {
+        m_iCode = cmLOAD;
+        m_iType = tpDBL;
+        m_strTok = a_strTok;
+        m_iIdx = a_iIdx;
+
+        m_pTok = 0;
+        m_pCallback.reset(0);
+        return *this;
+      }
+
       //------------------------------------------------------------------------------
       /** \brief Make this token a variable token. 
       
@@ -253,13 +271,14 @@ namespace mu
       /** \brief Return Index associated with the token related data. 
       
           In cmSTRFUNC - This is the index to a string table in the main parser.
+          In cmLOAD - This is the nesting level of the sum or product of a loop variable.
 
-          \throw exception_type if #m_iIdx<0 or #m_iType!=cmSTRING
+          \throw exception_type if #m_iIdx<0 or #m_iType is neither cmSTRING nor cmLOAD
           \return The index the result will take in the Bytecode calculatin array (#m_iIdx).
       */
       int GetIdx() const
       {
-        if (m_iIdx<0 || m_iCode!=cmSTRING )
+        if (m_iIdx<0 || (m_iCode!=cmSTRING && m_iCode!=cmLOAD))
           throw ParserError(ecINTERNAL_ERROR);
 
         return m_iIdx;
@@ -337,6 +356,15 @@ namespace mu
         return (m_pCallback.get()) ? (generic_fun_type)m_pCallback->GetAddr() : 0;
       }
 
+      //------------------------------------------------------------------------------
+      /** \brief Return true if the callback of a function or operator token may
+                 be optimized (i.e. it has no side effects).
+      */
+      bool IsOptimizable() const
+      {
+        return m_pCallback.get() && m_pCallback->IsOptimizable();
+      }
+
       //------------------------------------------------------------------------------
       /** \biref Get value of the token.
         
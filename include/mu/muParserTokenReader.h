@@ -34,9 +34,11 @@
 #include <memory>
 #include <stack>
 #include <string>
+#include <vector>
 
 #include "muParserDef.h"
 #include "muParserToken.h"
+#include "muParserSharedMap.h"
 
 /** \file
     \brief This file contains the parser token reader definition.
@@ -112,16 +114,19 @@ namespace mu
       int ExtractToken(const char_type *a_szCharSet, 
                        string_type &a_strTok, 
                        int a_iPos) const;
+      int ExtractToken(const char_type *a_szCharSet, int a_iPos) const;
       int ExtractOperatorToken(string_type &a_sTok, int a_iPos) const;
 
       bool IsBuiltIn(token_type &a_Tok);
       bool IsArgSep(token_type &a_Tok);
       bool IsEOF(token_type &a_Tok);
       bool IsInfixOpTok(token_type &a_Tok);
+      bool IsLoopTok(token_type &a_Tok);
       bool IsFunTok(token_type &a_Tok);
       bool IsPostOpTok(token_type &a_Tok);
       bool IsOprt(token_type &a_Tok);
       bool IsValTok(token_type &a_Tok);
+      bool IsLoopVarTok(token_type &a_Tok);
       bool IsVarTok(token_type &a_Tok);
       bool IsStrVarTok(token_type &a_Tok);
       bool IsUndefVarTok(token_type &a_Tok);
@@ -132,19 +137,27 @@ namespace mu
 
       token_type& SaveBeforeReturn(const token_type &tok);
 
+      /** \brief Loop variable of a sum or product being read. */
+      struct SLoopVar
+      {
+        string_type Name;   ///< Name of the loop variable
+        int Brackets;       ///< Bracket level of the arguments
+        int ArgSep;         ///< Number of argument separators read, the body follows the second one
+      };
+
       ParserBase *m_pParser;
       string_type m_strFormula;
       int  m_iPos;
       int  m_iSynFlags;
       bool m_bIgnoreUndefVar;
 
-      const funmap_type *m_pFunDef;
-      const funmap_type *m_pPostOprtDef;
-      const funmap_type *m_pInfixOprtDef;
-      const funmap_type *m_pOprtDef;
-      const valmap_type *m_pConstDef;
-      const strmap_type *m_pStrVarDef;
-      varmap_type *m_pVarDef;  ///< The only non const pointer to parser internals
+      const ParserSharedMap<funmap_type> *m_pFunDef;
+      const ParserSharedMap<funmap_type> *m_pPostOprtDef;
+      const ParserSharedMap<funmap_type> *m_pInfixOprtDef;
+      const ParserSharedMap<funmap_type> *m_pOprtDef;
+      const ParserSharedMap<valmap_type> *m_pConstDef;
+      const ParserSharedMap<strmap_type> *m_pStrVarDef;
+      ParserSharedMap<varmap_type> *m_pVarDef;  ///< The only non const pointer to parser internals
       facfun_type m_pFactory;
       void *m_pFactoryData;
       std::list<identfun_type> m_vIdentFun; ///< Value token identification function
@@ -153,6 +166,7 @@ namespace mu
       int m_iBrackets;
       token_type m_lastTok;
       char_type m_cArgSep;     ///< The character used for separating function arguments
+      std::vector<SLoopVar> m_vLoopVar; ///< The sums and products being read, innermost last
   };
 } // namespace mu
 
@@ -0,0 +1,83 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#ifndef MU_PARSER_VEC_MATH_H
+#define MU_PARSER_VEC_MATH_H
+
+#include "muParserDef.h"
+
+/** \file
+    \brief Vectorized versions of the built in math functions.
+*/
+
+
+namespace mu
+{
+  /** \brief Math functions applied to whole arrays with SIMD instructions.
+
+    These are the kernels the array evaluation uses for the built in 
+    functions of mu::Parser, see ParserBase::DefineVecFun. Each function 
+    replaces the values of an array by their image in place.
+
+    The maximum errors measured on random arguments, and for Sin and Cos on
+    the arguments closest to their zeros, against a long double reference 
+    are, in units in the last place of the result type:
+    <ul>
+      <li>Sqrt, Abs: 0.5</li>
+      <li>Exp, Ln: 1</li>
+      <li>Tanh: 1.5</li>
+      <li>Log2, Log10: 2</li>
+      <li>Sin, Cos: 2.5</li>
+    </ul>
+    Arguments outside of the range the approximations are made for are passed
+    to the C library: NaN, infinities, zero, negative values and denormals for
+    the logarithms, |x|>1e6 (6000 for floats) for Sin and Cos and x outside of
+    [-708, 709] ([-87, 88] for floats) for Exp.
+
+    Without SSE2 the functions simply call the C library for every value.
+  */
+  namespace vecmath
+  {
+    void Sqrt(value_type *a_pVal, int a_iSize);
+    void Abs(value_type *a_pVal, int a_iSize);
+    void Exp(value_type *a_pVal, int a_iSize);
+    void Ln(value_type *a_pVal, int a_iSize);
+    void Log2(value_type *a_pVal, int a_iSize);
+    void Log10(value_type *a_pVal, int a_iSize);
+    void Sin(value_type *a_pVal, int a_iSize);
+    void Cos(value_type *a_pVal, int a_iSize);
+    void Tanh(value_type *a_pVal, int a_iSize);
+
+    void Sqrt(float *a_pVal, int a_iSize);
+    void Abs(float *a_pVal, int a_iSize);
+    void Exp(float *a_pVal, int a_iSize);
+    void Ln(float *a_pVal, int a_iSize);
+    void Log2(float *a_pVal, int a_iSize);
+    void Log10(float *a_pVal, int a_iSize);
+    void Sin(float *a_pVal, int a_iSize);
+    void Cos(float *a_pVal, int a_iSize);
+    void Tanh(float *a_pVal, int a_iSize);
+  } // namespace vecmath
+} // namespace mu
+
+#endif
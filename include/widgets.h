@@ -1,6 +1,7 @@
 #ifndef INC_GRAPH_WIDGET
 #define INC_GRAPH_WIDGET
 
+#include <cmath>
 #include <functional>
 #include <numeric>
 #include <vector>
@@ -11,6 +12,70 @@
 namespace GraphAnalyze
 {
 
+/**
+ * Number of samples, or nodes of the previous level, summed up by a node of a
+ * CurveLOD.
+ */
+#define LOD_FANOUT 8
+
+/**
+ * Multi-resolution min/max summary of the ordinates of a curve, so that drawing
+ * it only visits a few nodes per pixel column whatever the number of samples.
+ * The nodes of the first level each cover LOD_FANOUT consecutive samples, those
+ * of the next levels LOD_FANOUT nodes of the previous one, up to a single node.
+ */
+class CurveLOD
+{
+public:
+    /**
+     * Vertical extent of a run of consecutive samples.
+     */
+    typedef struct
+    {
+        /**
+         * Extent of the finite samples before the first non-finite one, of
+         * all the samples if they are all finite. Empty if minY > maxY.
+         */
+        double minY, maxY;
+        /**
+         * Extent of the finite samples after the last non-finite one.
+         */
+        double tailMinY, tailMaxY;
+        /**
+         * Index of the first non-finite sample, or one past the run if there
+         * is none, and index following the last non-finite sample.
+         */
+        size_t headEnd, tailBegin;
+        /**
+         * Whether some of the samples aren't finite.
+         */
+        bool gap;
+        /**
+         * Whether finite samples lie between the first and last non-finite
+         * ones, their extent isn't kept.
+         */
+        bool inner;
+    } Node;
+    /**
+     * Rebuilds the pyramid. Call whenever the ordinates change.
+     * @param   ys  array of ordinates
+     */
+    void build(const std::vector<double> &ys);
+    /**
+     * Number of samples the pyramid was built from.
+     */
+    size_t size() const
+    {
+        return samples;
+    }
+    /**
+     * Nodes of each level, from the finest one.
+     */
+    std::vector<std::vector<Node>> levels;
+private:
+    size_t samples = 0;
+};
+
 /**
  * Structure holding information about the state of the graph of a function.
  */
@@ -29,6 +94,10 @@ typedef struct
      * Tells whether the structure contains enough data to plot a function.
      */
     bool ready = false;
+    /**
+     * Summary of the curve for drawing, built along with the rest.
+     */
+    CurveLOD lod;
     /**
      * Sets the drawing area. If width and height aren't provided, use all of the
      * available space.
@@ -42,17 +111,21 @@ typedef struct
     }
     
     /**
-     * Builds the graph info from arrays of X and Y.
+     * Builds the graph info from arrays of X and Y. Non-finite ordinates, where
+     * the function is undefined or jumps, are left out of the Y range.
      */
     void build(const std::vector<double> &xs, std::vector<double> &ys)
     {
-        static auto minComputer = [](double a, double b) { return std::min(a, b); };
-        static auto maxComputer = [](double a, double b) { return std::max(a, b); };
+        static auto minComputer = [](double a, double b) { return std::isfinite(b) ? std::min(a, b) : a; };
+        static auto maxComputer = [](double a, double b) { return std::isfinite(b) ? std::max(a, b) : a; };
         updateArea();
         minX = std::accumulate(xs.begin(), xs.end(), xs[0], minComputer);
         maxX = std::accumulate(xs.begin(), xs.end(), xs[0], maxComputer);
-        minY = std::accumulate(ys.begin(), ys.end(), ys[0], minComputer);
-        maxY = std::accumulate(ys.begin(), ys.end(), ys[0], maxComputer);
+        minY = std::accumulate(ys.begin(), ys.end(), (double)INFINITY, minComputer);
+        maxY = std::accumulate(ys.begin(), ys.end(), -(double)INFINITY, maxComputer);
+        if(minY > maxY)
+            minY = maxY = 0;
+        lod.build(ys);
         ready = true;
     }
     /**
@@ -92,7 +165,7 @@ typedef struct
 
 /**
  * Draws an interactive graph of the graph info and function values.
- * @param   gi  GraphInfo structure to use. Must be valid
+ * @param   gi  GraphInfo structure to use. Must be valid, built from xs and ys
  * @param   xs  array of abscissae
  * @param   ys  array of ordinates
  * @param   w   widget width
@@ -101,6 +174,20 @@ typedef struct
 void GraphWidget(GraphInfo &gi, std::vector<double> &xs, std::vector<double> &ys,
     int w, int h);
 
+/**
+ * Draws a curve in a graph widget, as the vertical extent of its samples in each
+ * pixel column joined to the next column (M4 decimation). Takes time
+ * proportional to the width of the graph rather than to the number of samples.
+ * Non-finite samples leave gaps.
+ * @param   gi  GraphInfo structure to use. Must be valid
+ * @param   lod summary of ys
+ * @param   xs  array of abscissae, in increasing order
+ * @param   ys  array of ordinates
+ * @param   col color of the curve
+ */
+void PlotCurve(GraphInfo &gi, const CurveLOD &lod, const std::vector<double> &xs,
+    const std::vector<double> &ys, ImU32 col);
+
 /**
  * Lets the user select an area in a graph widget by clicking and dragging with
  * the left mouse button. Writes coordinates in function space.
@@ -119,8 +206,8 @@ bool userSelectArea(GraphInfo &gi, float *startX, float *endX, bool persistent =
 
 /**
  * A special InputText that queries a function that mu::Parser can recognize, and
- * writes it to the given parser. WARNING : be sure to set your parser variables
- * to values that will allow the parser to tell whether a function is valid or not.
+ * writes it to the given parser. The expression is only recompiled when the text
+ * changes, and checking it does not evaluate it.
  * @param   label   label/id of the widget
  * @param   buf     character buffer where to hold the inputted text
  * @param   size    maximum size of the inputted text
@@ -130,6 +217,17 @@ bool userSelectArea(GraphInfo &gi, float *startX, float *endX, bool persistent =
  */
 bool InputFunction(const char *label, char *buf, size_t size, mu::Parser &p, bool *invalid);
 
+/**
+ * Draws the profiling counters of a parser in a collapsing section: time spent
+ * parsing, evaluating and in each callback, and the executed tokens per command.
+ * The counters are only collected when the parser is built with MUP_PROFILING
+ * defined (make PROFILE=1).
+ * @param   label   title of the section
+ * @param   prof    copy of the parser's counters to draw
+ * @return  whether the section's reset button was clicked
+ */
+bool ParserProfileWidget(const char *label, const mu::ParserProfile &prof);
+
 };
 
 /**
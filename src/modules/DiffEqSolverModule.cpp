@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cmath>
 #include <string>
+#include <vector>
 
 #include "imgui.h"
 #include "utils.h"
@@ -37,6 +38,31 @@ void DiffEqSolverModule::solveDiffEq(double boundaryX, double minX, double maxX,
     // v_n-1_n+1 = (b_n - sum(k in 0 ... n-1, a_k_n * v_k_n)) * dx + v_n-1_n
     // for k in 0 ... n-2, v_k_n+1 = v_k+1_n * dx + v_k_n
     
+    // The coefficients only depend on x, so evaluate them for all the steps
+    // at once before running the solver. b and the a functions are fused into
+    // a single program, which loads x and computes the subexpressions they
+    // share only once per step.
+    std::vector<std::string> coefExprs(1, bBuf);
+    for(unsigned int k = 0; k < degree; k++)
+        coefExprs.push_back(aBufs[k]);
+    coefParser.SetFusedExpr(coefExprs);
+    
+    std::vector<double> steps, bs, as[MAX_DIFFEQ_DEGREE];
+    auto evaluateCoefficients = [&]()
+    {
+        double *results[MAX_DIFFEQ_DEGREE + 1];
+        bs.resize(steps.size());
+        results[0] = bs.data();
+        for(unsigned int k = 0; k < degree; k++)
+        {
+            as[k].resize(steps.size());
+            results[k + 1] = as[k].data();
+        }
+        double *var = &x;
+        const double *values = steps.data();
+        coefParser.EvalArray(&var, &values, 1, results, degree + 1, steps.size());
+    };
+    
     xs.clear();
     ys.clear();
     xs.push_back(boundaryX);
@@ -48,18 +74,22 @@ void DiffEqSolverModule::solveDiffEq(double boundaryX, double minX, double maxX,
     // Do it this way for maximum array construction efficiency
     // boundaryX -> minX
     dx *= -1;
+    steps.clear();
     for(x = boundaryX; x > minX; x += dx)
+        steps.push_back(x);
+    evaluateCoefficients();
+    for(unsigned int n = 0; n < steps.size(); n++)
     {
-        xs.push_back(x + dx);
+        xs.push_back(steps[n] + dx);
         // Compute v_n-1_n+1 at the same time as all the other v_k_n
-        nextvs[degree - 1] = bParser.Eval();
+        nextvs[degree - 1] = bs[n];
         for(unsigned int k = 0; k < degree - 1; k++)
         {
-            nextvs[degree - 1] -= aParsers[k].Eval() * vs[k];
+            nextvs[degree - 1] -= as[k][n] * vs[k];
             nextvs[k] = vs[k + 1] * dx + vs[k];
         }
         // Extra iteration for k = n-1
-        nextvs[degree - 1] -= aParsers[degree - 1].Eval() * vs[degree - 1];
+        nextvs[degree - 1] -= as[degree - 1][n] * vs[degree - 1];
         nextvs[degree - 1] *= dx;
         nextvs[degree - 1] += vs[degree - 1];
         // By construction, v_0 = y
@@ -77,16 +107,20 @@ void DiffEqSolverModule::solveDiffEq(double boundaryX, double minX, double maxX,
     
     // boundaryX -> maxX
     dx *= -1;
+    steps.clear();
     for(x = boundaryX; x < maxX; x += dx)
+        steps.push_back(x);
+    evaluateCoefficients();
+    for(unsigned int n = 0; n < steps.size(); n++)
     {
-        xs.push_back(x + dx);
-        nextvs[degree - 1] = bParser.Eval();
+        xs.push_back(steps[n] + dx);
+        nextvs[degree - 1] = bs[n];
         for(unsigned int k = 0; k < degree - 1; k++)
         {
-            nextvs[degree - 1] -= aParsers[k].Eval() * vs[k];
+            nextvs[degree - 1] -= as[k][n] * vs[k];
             nextvs[k] = vs[k + 1] * dx + vs[k];
         }
-        nextvs[degree - 1] -= aParsers[degree - 1].Eval() * vs[degree - 1];
+        nextvs[degree - 1] -= as[degree - 1][n] * vs[degree - 1];
         nextvs[degree - 1] *= dx;
         nextvs[degree - 1] += vs[degree - 1];
         ys.push_back(nextvs[0]);
@@ -168,11 +202,14 @@ void DiffEqSolverModule::render()
             std::string funcName = " =: a" + std::to_string(k) + "(x)";
             valueChanged |= flashWidget(invalids[k], 0xff0000ff,
                 GraphAnalyze::InputFunction(funcName.c_str(), aBufs[k], MAX_FUNC_LENGTH, aParsers[k], &invalids[k]));
+            // Each coefficient must be a single function to be fused
+            invalids[k] |= aParsers[k].GetNumResults() > 1;
             anyInvalid |= invalids[k];
         }
         
         valueChanged |= flashWidget(bInvalid, 0xff0000ff,
             GraphAnalyze::InputFunction(" =: b(x)", bBuf, MAX_FUNC_LENGTH, bParser, &bInvalid));
+        bInvalid |= bParser.GetNumResults() > 1;
         anyInvalid |= bInvalid;
         
         ImGui::TreePop();
@@ -219,8 +256,17 @@ void DiffEqSolverModule::render()
     if(flashButtonWidget(valueChanged, graphButtonColor, ImGui::Button("Solve")) && minX < maxX
         && !anyInvalid)
     {
-        solveDiffEq(boundaryX, minX, maxX, dx);
-        valueChanged = false;
+        try
+        {
+            solveDiffEq(boundaryX, minX, maxX, dx);
+            valueChanged = false;
+        }
+        catch(mu::Parser::exception_type &e)
+        {
+            // The functions passed their own validation but not the fused
+            // program, the previous solution is gone either way
+            gi.ready = false;
+        }
     }
     
     if(gi.ready)
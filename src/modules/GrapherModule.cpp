@@ -1,5 +1,8 @@
 #include "modules.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iomanip>
 #include <sstream>
 #include <vector>
@@ -14,33 +17,487 @@ using namespace GraphAnalyze;
 GrapherModule::GrapherModule(bool *open, int windowWidth, int windowHeight) : open(open), w(windowWidth), h(windowHeight), ism(this)
 {
     p.DefineVar("x", &x);
+    p.EnableJit(true);
     p.SetExpr("0");
+    wp.DefineVar("x", &wx);
+    wp.EnableJit(true);
+    dp.DefineVar("x", &wx);
+    dp.EnableJit(true);
+    dp.SetDiffVar(&wx);
+    // Tells the profile overlay whether the counters are collected at all
+    profile.bEnabled = dprofile.bEnabled = p.GetProfile().bEnabled;
     
     for(int k = 0; k <= PLOT_INTERVALS; k++)
         xs.push_back(2. * k / PLOT_INTERVALS - 1.);
+    worker = std::thread(&GrapherModule::work, this);
+}
+
+GrapherModule::~GrapherModule()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        quit = true;
+        generation++;
+    }
+    jobCond.notify_one();
+    worker.join();
 }
 
 /**
- * Call whenever minX, maxX or the function expression changes.
+ * Call whenever minX, maxX or the function expression changes. Submits a new
+ * evaluation to the worker thread, the current graph stays until it's done.
  */
 void GrapherModule::refreshFunctionData()
 {
-    evaluateFunction();
+    std::lock_guard<std::mutex> lock(jobMutex);
+    pending = GraphJob();
+    pending.id = ++generation;
+    pending.expr = p.GetExpr();
+    pending.minX = minX;
+    pending.maxX = maxX;
+    // Pixel size of the plot, falling back on the window size before the first draw
+    pending.width = gi.size.x > 1 ? gi.size.x : w;
+    pending.height = gi.size.y > 1 ? gi.size.y : h;
+    hasPending = true;
+    submitted = pending.id;
+    jobCond.notify_one();
+}
+
+/**
+ * Drops the evaluation in progress, if any, since it's out of date.
+ */
+void GrapherModule::cancelEvaluation()
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    generation++;
+    hasPending = false;
+    submitted = 0;
+}
+
+/**
+ * The worker thread resets the counters between two jobs, since it owns the
+ * parsers. The overlay shows them reset right away.
+ */
+void GrapherModule::resetProfiles(bool function, bool derivative)
+{
+    mu::ParserProfile empty{};
+    empty.bEnabled = profile.bEnabled;
+    if(function)
+        profile = empty;
+    if(derivative)
+        dprofile = empty;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        resetProfile |= function;
+        resetDProfile |= derivative;
+    }
+    jobCond.notify_one();
+}
+
+/**
+ * Takes in the results of the last evaluation once it's done. Call every frame
+ * from the UI thread.
+ */
+void GrapherModule::collectFunctionData()
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if(!hasFinished)
+        return;
+    hasFinished = false;
+    if(finished.id != submitted)
+        return;
+    if(finished.complete)
+    {
+        submitted = 0;
+        profile = std::move(finished.profile);
+        dprofile = std::move(finished.dprofile);
+    }
+    if(finished.xs.empty())
+        return;
+    xs.swap(finished.xs);
+    ys.swap(finished.ys);
+    dys.swap(finished.dys);
+    roots.swap(finished.roots);
+    needsDouble = finished.needsDouble;
+    discontinuities = finished.discontinuities;
+    evaluated = finished.evaluated;
+    dlod.build(dys);
     gi.build(xs, ys);
 }
 
 /**
- * Builds the arrays of X and Y from this.minX and this.maxX.
+ * Main loop of the worker thread: runs the latest submitted job, and posts
+ * its results unless a newer one came in meanwhile.
  */
-void GrapherModule::evaluateFunction()
+void GrapherModule::work()
 {
-    xs.clear();
-    ys.clear();
-    for(unsigned int k = 0; k <= PLOT_INTERVALS; k++)
+    std::unique_lock<std::mutex> lock(jobMutex);
+    while(true)
     {
-        xs.push_back(x = (maxX - minX) * k / PLOT_INTERVALS + minX);
-        ys.push_back(p.Eval());
+        jobCond.wait(lock, [this] { return quit || hasPending || resetProfile || resetDProfile; });
+        if(quit)
+            return;
+        if(resetProfile)
+            wp.ResetProfile();
+        if(resetDProfile)
+            dp.ResetProfile();
+        resetProfile = resetDProfile = false;
+        if(!hasPending)
+            continue;
+        GraphJob job = std::move(pending);
+        hasPending = false;
+        lock.unlock();
+        progress = 0;
+        bool done;
+        try
+        {
+            if(job.expr != wpExpr)
+            {
+                wp.SetExpr(job.expr);
+                wpExpr = job.expr;
+            }
+            done = evaluateFunction(job);
+            job.complete = true;
+        }
+        catch(mu::Parser::exception_type &e)
+        {
+            job.xs.clear();
+            job.complete = done = true;
+        }
+        if(done)
+        {
+            job.profile = wp.GetProfile();
+            job.dprofile = dp.GetProfile();
+        }
+        lock.lock();
+        if(done && job.id == generation)
+        {
+            finished = std::move(job);
+            hasFinished = true;
+        }
+    }
+}
+
+/**
+ * Hands a copy of the samples of a job in progress over to the UI, which draws
+ * them until better ones come. The derivative and the zeros only come with
+ * the final results.
+ */
+void GrapherModule::postPreview(const GraphJob &job)
+{
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if(job.id != generation)
+        return;
+    finished.id = job.id;
+    finished.xs = job.xs;
+    finished.ys = job.ys;
+    finished.dys.clear();
+    finished.roots.clear();
+    finished.needsDouble = job.needsDouble;
+    finished.discontinuities = job.discontinuities;
+    finished.evaluated = job.evaluated;
+    finished.complete = false;
+    hasFinished = true;
+}
+
+/**
+ * Evaluates the function on the abscissae missing from the cache with
+ * EvalArray, much faster than one Eval per sample. Goes a chunk at a time so
+ * that a stale job stops soon even when the function is slow.
+ */
+bool GrapherModule::evaluateSamples(GraphJob &job, const std::vector<double> &sxs, std::vector<double> &sys,
+    bool derivative)
+{
+    const size_t chunk = 256;
+    // Single and double precision values differ, don't mix them up
+    const bool inDouble = derivative || job.needsDouble;
+    const std::string key = (derivative ? "d/dx " : "") + job.expr + (inDouble ? " (double)" : " (float)");
+    mu::Parser &parser = derivative ? dp : wp;
+    std::vector<size_t> missing;
+    std::vector<double> exs, eys;
+    cache.lookup(key, sxs, sys, missing);
+    for(size_t k = 0; k < missing.size(); k += chunk)
+    {
+        if(job.id != generation)
+            return false;
+        exs.clear();
+        for(size_t i = k; i < std::min(k + chunk, missing.size()); i++)
+            exs.push_back(sxs[missing[i]]);
+        eys.resize(exs.size());
+        if(inDouble)
+            parser.EvalArray(&wx, exs.data(), eys.data(), exs.size());
+        else
+        {
+            xsf.assign(exs.begin(), exs.end());
+            ysf.resize(exs.size());
+            parser.EvalArray(&wx, xsf.data(), ysf.data(), xsf.size());
+            std::copy(ysf.begin(), ysf.end(), eys.begin());
+        }
+        for(size_t i = 0; i < exs.size(); i++)
+            sys[missing[k + i]] = eys[i];
+        cache.store(key, exs, eys);
+        if(!derivative)
+            job.evaluated += exs.size();
     }
+    return true;
+}
+
+/**
+ * Samples the function of a job on its range, in the background.
+ * Starts from a small preview grid, aligned on a power of two so that the
+ * samples of overlapping ranges can be reused from the cache, and halves all
+ * of its segments up to the coarse grid, then halves the segments whose midpoint is further than a
+ * fraction of a pixel from their chord, one batch of midpoints at a time,
+ * until the graph is smooth or the sample budget is spent. A segment that
+ * keeps most of its jump each time it's halved is a discontinuity.
+ * The samples so far are handed over to the UI as soon as the preview grid is
+ * done, then every PLOT_FRAME_BUDGET milliseconds.
+ * @return  false if the job went stale before the end
+ */
+bool GrapherModule::evaluateFunction(GraphJob &job)
+{
+    const double scaleX = job.width / (job.maxX - job.minX),
+        tolerance = 0.25,
+        minWidth = 1. / 64,
+        // Segments wider than the coarse grid's are split whatever their shape
+        gridWidth = (job.maxX - job.minX) / PLOT_COARSE_INTERVALS * 1.5;
+    const unsigned int jumpHalvings = 4;
+    
+    // Between PLOT_PREVIEW_INTERVALS and twice as many intervals, plus the
+    // bounds of the range
+    const double step = std::ldexp(1., (int)std::floor(std::log2((job.maxX - job.minX) / PLOT_PREVIEW_INTERVALS)));
+    job.xs.assign(1, job.minX);
+    for(double k = std::floor(job.minX / step) + 1; k * step < job.maxX; k++)
+        job.xs.push_back(k * step);
+    job.xs.push_back(job.maxX);
+    // The plot is drawn in float anyway, so use the faster single precision
+    // evaluation unless it's off by more than a fraction of a pixel.
+    const SampleCache::View *view = cache.findView(job.expr, job.minX, job.maxX);
+    job.needsDouble = view ? view->needsDouble : wp.EvalFloatError(&wx, job.xs.data(), job.xs.size()) > 1e-4;
+    if(!evaluateSamples(job, job.xs, job.ys))
+        return false;
+    unsigned int evaluations = job.xs.size();
+    job.discontinuities = 0;
+    postPreview(job);
+    std::chrono::steady_clock::time_point lastPreview = std::chrono::steady_clock::now();
+    
+    // The grid tells roughly what's visible, refined along with it
+    double lowY, highY, scaleY;
+    auto measure = [&]()
+    {
+        lowY = INFINITY;
+        highY = -INFINITY;
+        for(double y : job.ys)
+            if(std::isfinite(y))
+            {
+                lowY = std::min(lowY, y);
+                highY = std::max(highY, y);
+            }
+        scaleY = highY > lowY ? job.height / (highY - lowY) : job.height;
+    };
+    
+    typedef struct
+    {
+        // Whether the segment still needs its midpoint checked
+        bool pending;
+        // Deviation of the parent's midpoint in pixels, to spend the budget
+        // on the worst segments first
+        double priority;
+        // Vertical extent in pixels
+        double jump;
+        // How many halvings in a row kept most of the jump
+        unsigned int jumps;
+    } Segment;
+    std::vector<Segment> segs, nsegs;
+    measure();
+    for(size_t k = 0; k + 1 < job.xs.size(); k++)
+        segs.push_back({ true, INFINITY, std::abs(job.ys[k + 1] - job.ys[k]) * scaleY, 0 });
+    
+    std::vector<double> mxs, mys, nxs, nys;
+    std::vector<size_t> todo;
+    // Adds a half of a split segment, or a break if it's a jump too narrow to split
+    auto addHalf = [&](double x0, double y0, double x1, double y1, double deviation, const Segment &parent)
+    {
+        Segment s = { false, deviation, std::abs(y1 - y0) * scaleY, 0 };
+        if(s.jump > parent.jump * 3 / 4)
+            s.jumps = parent.jumps + 1;
+        if((x1 - x0) * scaleX >= minWidth)
+            s.pending = true;
+        // Steep sides of a pole look alike, but they're off the plot
+        else if(s.jumps >= jumpHalvings && s.jump > tolerance
+            && !(y0 > highY && y1 > highY) && !(y0 < lowY && y1 < lowY))
+        {
+            nsegs.push_back(s);
+            nxs.push_back((x0 + x1) / 2);
+            nys.push_back(NAN);
+            job.discontinuities++;
+        }
+        nsegs.push_back(s);
+    };
+    
+    while(evaluations < PLOT_INTERVALS + 1)
+    {
+        if(job.id != generation)
+            return false;
+        progress = (float)evaluations / (PLOT_INTERVALS + 1);
+        if(job.xs.size() <= PLOT_COARSE_INTERVALS + 1)
+            measure();
+        todo.clear();
+        for(size_t k = 0; k < segs.size(); k++)
+            if(segs[k].pending)
+                todo.push_back(k);
+        if(todo.empty())
+            break;
+        size_t left = PLOT_INTERVALS + 1 - evaluations;
+        if(todo.size() > left)
+        {
+            std::nth_element(todo.begin(), todo.begin() + left, todo.end(),
+                [&](size_t a, size_t b) { return segs[a].priority > segs[b].priority; });
+            todo.resize(left);
+            std::sort(todo.begin(), todo.end());
+        }
+        mxs.clear();
+        for(size_t k : todo)
+            mxs.push_back((job.xs[k] + job.xs[k + 1]) / 2);
+        if(!evaluateSamples(job, mxs, mys))
+            return false;
+        evaluations += mxs.size();
+        
+        // Merge the midpoints in, and decide which halves to look at next
+        nxs.clear();
+        nys.clear();
+        nsegs.clear();
+        for(size_t k = 0, t = 0; k < segs.size(); k++)
+        {
+            nxs.push_back(job.xs[k]);
+            nys.push_back(job.ys[k]);
+            if(t == todo.size() || todo[t] != k)
+            {
+                nsegs.push_back(segs[k]);
+                continue;
+            }
+            double xa = job.xs[k], ya = job.ys[k], xb = job.xs[k + 1], yb = job.ys[k + 1],
+                xm = mxs[t], ym = mys[t++],
+                deviation = std::abs(ym - (ya + yb) / 2) * scaleY;
+            bool split, finite = std::isfinite(ya) && std::isfinite(ym) && std::isfinite(yb);
+            if(!finite)
+                deviation = job.height;
+            if(xb - xa > gridWidth)
+                split = true;
+            else if(finite)
+                // Don't bother with what's entirely off the plot
+                split = deviation > tolerance
+                    && !(ya > highY && ym > highY && yb > highY)
+                    && !(ya < lowY && ym < lowY && yb < lowY);
+            else
+                // Look for the edges of the domain of definition
+                split = std::isfinite(ya) != std::isfinite(ym) || std::isfinite(ym) != std::isfinite(yb);
+            if(split)
+            {
+                addHalf(xa, ya, xm, ym, deviation, segs[k]);
+                nxs.push_back(xm);
+                nys.push_back(ym);
+                addHalf(xm, ym, xb, yb, deviation, segs[k]);
+            }
+            else
+            {
+                nsegs.push_back({ false, 0, std::abs(ym - ya) * scaleY, 0 });
+                nxs.push_back(xm);
+                nys.push_back(ym);
+                nsegs.push_back({ false, 0, std::abs(yb - ym) * scaleY, 0 });
+            }
+        }
+        nxs.push_back(job.xs.back());
+        nys.push_back(job.ys.back());
+        job.xs.swap(nxs);
+        job.ys.swap(nys);
+        segs.swap(nsegs);
+        
+        if(std::chrono::steady_clock::now() - lastPreview >= std::chrono::milliseconds(PLOT_FRAME_BUDGET))
+        {
+            postPreview(job);
+            lastPreview = std::chrono::steady_clock::now();
+        }
+    }
+    
+    // The derivative has its own bytecode, no need to go through the function.
+    // It's only compiled again when the function changes.
+    if(job.expr != dpExpr)
+    {
+        dp.SetExpr(job.expr);
+        dpValid = dp.Validate();
+        dpExpr = job.expr;
+    }
+    try
+    {
+        if(!dpValid)
+            job.dys.clear();
+        else if(!evaluateSamples(job, job.xs, job.dys, true))
+            return false;
+    }
+    catch(mu::Parser::exception_type &e)
+    {
+        job.dys.clear();
+    }
+    // The derivative breaks where the function does, at the markers of its
+    // discontinuities as well as outside of its domain
+    for(size_t k = 0; k < job.dys.size(); k++)
+        if(std::isnan(job.ys[k]))
+            job.dys[k] = NAN;
+    if(view)
+    {
+        job.roots = view->roots;
+        return true;
+    }
+    if(!findRoots(job))
+        return false;
+    cache.storeView({ job.expr, job.minX, job.maxX, job.needsDouble, job.roots });
+    return true;
+}
+
+/**
+ * Bisects the graphing range, discarding the parts where the interval
+ * evaluation of the function proves it has no zero, down to the width of a
+ * sample.
+ * @return  false if the job went stale before the end
+ */
+bool GrapherModule::findRoots(GraphJob &job)
+{
+    const double tolerance = (job.maxX - job.minX) / PLOT_INTERVALS;
+    int budget = 16 * PLOT_INTERVALS;
+    std::vector<std::pair<double, double>> todo(1, std::make_pair((double)job.minX, (double)job.maxX));
+    job.roots.clear();
+    try
+    {
+        while(!todo.empty())
+        {
+            if(job.id != generation)
+                return false;
+            std::pair<double, double> range = todo.back();
+            todo.pop_back();
+            double lo, hi;
+            wp.EvalInterval(&wx, range.first, range.second, &lo, &hi);
+            // NaN bounds: the function is undefined on the whole range
+            if(!(lo <= 0 && hi >= 0))
+                continue;
+            // Out of budget, keep the remaining candidates as they are
+            if(range.second - range.first > tolerance && --budget > 0)
+            {
+                double mid = (range.first + range.second) / 2;
+                todo.push_back(std::make_pair(mid, range.second));
+                todo.push_back(std::make_pair(range.first, mid));
+            }
+            else if(!job.roots.empty() && job.roots.back().second >= range.first)
+                job.roots.back().second = range.second;
+            else
+                job.roots.push_back(range);
+        }
+    }
+    catch(mu::Parser::exception_type &e)
+    {
+        job.roots.clear();
+    }
+    return true;
 }
 
 /**
@@ -68,14 +525,16 @@ void GrapherModule::plotTangent(float length)
     {
         ImDrawList *drawList = ImGui::GetWindowDrawList();
         int mouseX = ImGui::GetMousePos().x;
-        int index = (int)((mouseX - gi.pos.x) * PLOT_INTERVALS / gi.size.x);
-        ImVec2 p = gi.scale(xs[index], ys[index]),
-            np = gi.scale(xs[index + 1], ys[index + 1]);
-        ImVec2 df(np.x - p.x, np.y - p.y);
+        // Evaluate the function and its exact derivative under the mouse
+        x = (mouseX - gi.pos.x) * (gi.maxX - gi.minX) / (gi.size.x - 1) + gi.minX;
+        double dy, y = p.EvalDiff(&x, &dy);
+        if(!std::isfinite(y) || !std::isfinite(dy))
+            return;
+        ImVec2 df((gi.size.x - 1) / (gi.maxX - gi.minX), -dy * (gi.size.y - 1) / (gi.maxY - gi.minY));
         float l = sqrt(df.x * df.x + df.y * df.y);
         df.x /= l; df.y /= l;
 
-        ImVec2 origin = gi.scale(xs[index], ys[index]);
+        ImVec2 origin = gi.scale(x, y);
 
         drawList->AddLine(ImVec2(origin.x, gi.pos.y), ImVec2(origin.x, gi.pos.y + gi.size.y),
             0xff0000ff, 1);
@@ -84,7 +543,7 @@ void GrapherModule::plotTangent(float length)
             4);
 
         // Add orthonormal view of the tangent
-        df = ImVec2(xs[index + 1] - xs[index], ys[index + 1] - ys[index]);
+        df = ImVec2(1, dy);
         l = sqrt(df.x * df.x + df.y * df.y);
         df.x /= l; df.y /= l;
 
@@ -109,6 +568,33 @@ void GrapherModule::plotTangent(float length)
     }
 }
 
+/**
+ * Plots the derivative of the function on top of the function's graph, using
+ * the same scale.
+ * /!\ This needs the graph widget to be the last drawn widget.
+ */
+void GrapherModule::plotDerivative()
+{
+    if(dys.size() != xs.size())
+        return;
+    GraphAnalyze::PlotCurve(gi, dlod, xs, dys, 0xffff0000);
+}
+
+/**
+ * Marks the candidate zeros on the X axis.
+ * /!\ This needs the graph widget to be the last drawn widget.
+ */
+void GrapherModule::plotRoots()
+{
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    for(const std::pair<double, double> &range : roots)
+    {
+        ImVec2 a = gi.scale(range.first, 0), b = gi.scale(range.second, 0);
+        drawList->AddLine(ImVec2(a.x - 1, a.y), ImVec2(b.x + 1, b.y), 0xff00aa00, 3);
+        drawList->AddCircle(ImVec2((a.x + b.x) / 2, a.y), 4, 0xff00aa00);
+    }
+}
+
 /**
  * Renders the module.
  */
@@ -162,6 +648,12 @@ void GrapherModule::render()
         ImGui::NewLine();
         static bool displayTangents = false;
         ImGui::Checkbox("Tangents", &displayTangents);
+        static bool displayDerivative = false;
+        ImGui::Checkbox("Derivative", &displayDerivative);
+        static bool displayRoots = false;
+        ImGui::Checkbox("Roots", &displayRoots);
+        static bool displayProfile = false;
+        ImGui::Checkbox("Profiler", &displayProfile);
         if(ImGui::Button("Integrate", buttonSize))
             ism.active = true;
     ImGui::EndGroup();
@@ -169,16 +661,21 @@ void GrapherModule::render()
     ImGui::BeginGroup();
         int startPosGraph = ImGui::GetCursorPosX();
         static bool valueChanged = false;
+        bool edited;
         
         ImGui::PushItemWidth(windowW - startPosGraph - hSpacing * 2 - ImGui::CalcTextSize(" =: f(x)").x);
-        valueChanged |= flashWidget(invalidFunc, 0xff0000ff,
+        edited = flashWidget(invalidFunc, 0xff0000ff,
             GraphAnalyze::InputFunction(" =: f(x)", buf, MAX_FUNC_LENGTH, p, &invalidFunc));
         ImGui::PopItemWidth();
         ImGui::PushItemWidth((windowW - startPosGraph - 20) / 3);
-            valueChanged |= flashWidget(minX >= maxX, 0xff0000ff, ImGui::DragFloat("Min X", &minX, 0.1f, -FLT_MAX, maxX));
+            edited |= flashWidget(minX >= maxX, 0xff0000ff, ImGui::DragFloat("Min X", &minX, 0.1f, -FLT_MAX, maxX));
             ImGui::SameLine();
-            valueChanged |= flashWidget(minX >= maxX, 0xff0000ff, ImGui::DragFloat("Max X", &maxX, 0.1f, minX, FLT_MAX));
+            edited |= flashWidget(minX >= maxX, 0xff0000ff, ImGui::DragFloat("Max X", &maxX, 0.1f, minX, FLT_MAX));
             ImGui::SameLine();
+            // What's being evaluated doesn't match the inputs anymore
+            if(edited && submitted)
+                cancelEvaluation();
+            valueChanged |= edited;
             // Always draw the button, even if the domain is wrong
             ImU32 graphButtonColor = clerp(ImGui::GetStyle().Colors[ImGuiCol_Button],
                 ImGui::GetStyle().Colors[ImGuiCol_ButtonHovered],
@@ -189,15 +686,35 @@ void GrapherModule::render()
                 valueChanged = false;
                 refreshFunctionData();
             }
+            if(submitted)
+            {
+                ImGui::SameLine();
+                ImGui::ProgressBar(progress, ImVec2(-1, 0), "Evaluating...");
+            }
         ImGui::PopItemWidth();
         ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 0.f);
             int bottomY = windowH - buttonSize.y - vSpacing * 2;
             ImVec2 plotSize(windowW - startPosGraph - hSpacing,
                 bottomY - ImGui::GetCursorPosY() - vSpacing);
+            collectFunctionData();
             if(gi.ready)
             {
                 ImGui::PushClipRect(gi.pos, ImVec2(gi.pos.x + gi.size.x, gi.pos.y + gi.size.y), true);
                     GraphAnalyze::GraphWidget(gi, xs, ys, plotSize.x, plotSize.y);
+                    if(needsDouble)
+                        ImGui::GetWindowDrawList()->AddText(ImVec2(gi.pos.x + 4, gi.pos.y + 2), 0xff0080ff,
+                            "Float precision is not enough here, using double");
+                    // Report how much of the sample budget the graph needed
+                    std::ostringstream samples;
+                    samples << xs.size() << " / " << PLOT_INTERVALS + 1 << " samples, " << evaluated << " evaluated";
+                    if(discontinuities)
+                        samples << ", " << discontinuities << " discontinuities";
+                    ImGui::GetWindowDrawList()->AddText(ImVec2(gi.pos.x + 4,
+                        gi.pos.y + gi.size.y - ImGui::GetTextLineHeight() - 2), 0xff888888, samples.str().c_str());
+                    if(displayDerivative)
+                        plotDerivative();
+                    if(displayRoots)
+                        plotRoots();
                     if(hasClick)
                         handleZoom();
                     if(displayTangents)
@@ -226,4 +743,19 @@ void GrapherModule::render()
         ImGui::PopStyleVar();
     ImGui::EndGroup();
     ImGui::End();
+
+    // Overlay telling where the evaluation time goes
+    if(displayProfile)
+    {
+        ImGui::SetNextWindowBgAlpha(0.8f);
+        if(ImGui::Begin("Parser profile", &displayProfile, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings))
+        {
+            // Copies of the worker thread's counters, its parsers are busy
+            bool resetFunction = GraphAnalyze::ParserProfileWidget("f(x)", profile);
+            bool resetDerivative = GraphAnalyze::ParserProfileWidget("f'(x)", dprofile);
+            if(resetFunction || resetDerivative)
+                resetProfiles(resetFunction, resetDerivative);
+        }
+        ImGui::End();
+    }
 }
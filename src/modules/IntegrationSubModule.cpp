@@ -1,5 +1,7 @@
 #include "modules.h"
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <vector>
 
@@ -27,16 +29,15 @@ void IntegrationSubModule::render()
         std::ostringstream ss;
         ss << "Integrating from " << startX << " to " << endX;
         ImGui::Text("%s",ss.str().c_str());
-        double rangeX = parent->gi.maxX - parent->gi.minX;
         std::vector<double> &xs = parent->xs,
             &ys = parent->ys;
-        int minIndex = (int)((std::min(startX, endX) - parent->gi.minX) * PLOT_INTERVALS
-            / rangeX),
-            maxIndex = (int)((std::max(startX, endX) - parent->gi.minX) * PLOT_INTERVALS
-            / rangeX);
+        // The samples aren't evenly spaced, look the bounds up
+        size_t minIndex = std::lower_bound(xs.begin(), xs.end(), std::min(startX, endX)) - xs.begin(),
+            maxIndex = std::lower_bound(xs.begin(), xs.end(), std::max(startX, endX)) - xs.begin();
         double result = 0;
-        for(int k = minIndex; k < maxIndex; k++)
-            result += (ys[k + 1] + ys[k]) * (xs[k + 1] - xs[k]) / 2;
+        for(size_t k = minIndex; k + 1 < xs.size() && k < maxIndex; k++)
+            if(std::isfinite(ys[k]) && std::isfinite(ys[k + 1]))
+                result += (ys[k + 1] + ys[k]) * (xs[k + 1] - xs[k]) / 2;
         if(startX > endX)
             result *= -1;
         ss.str("");
@@ -52,7 +53,8 @@ void IntegrationSubModule::render()
  void IntegrationSubModule::selectionDrawer(float x1, float x2)
 {
     ImDrawList *drawList = ImGui::GetWindowDrawList();
-    std::vector<double> &ys = parent->ys;
+    std::vector<double> &xs = parent->xs,
+        &ys = parent->ys;
 
     float originY = parent->gi.scale(0, 0).y,
         xmin = std::min(x1, x2),
@@ -60,7 +62,9 @@ void IntegrationSubModule::render()
 
     for(float x = xmin; x <= xmax; x += 1.f)
     {
-        int index = (int)((x - parent->gi.pos.x) * PLOT_INTERVALS / parent->gi.size.x);
+        size_t index = std::lower_bound(xs.begin(), xs.end(), parent->gi.unscale(x, 0).x) - xs.begin();
+        if(index >= ys.size() || !std::isfinite(ys[index]))
+            continue;
         float y = parent->gi.scale(0, ys[index]).y;
         drawList->AddLine(ImVec2(x, originY), ImVec2(x, y), 0x880088ff);
     }
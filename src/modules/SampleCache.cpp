@@ -0,0 +1,146 @@
+#include "modules.h"
+
+#include <climits>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace GraphAnalyze;
+
+/**
+ * Writes x as k * 2^-level with k odd, and files it in the tile of its level
+ * holding k.
+ */
+SampleCache::TileKey SampleCache::locate(unsigned int expr, double x, unsigned int *slot)
+{
+    int e;
+    TileKey key = { expr, 0, 0 };
+    // Exact, x = f * 2^e with 0.5 <= |f| < 1 has 53 significant bits
+    std::int64_t k = (std::int64_t)std::ldexp(std::frexp(x, &e), 53);
+    key.level = 53 - e;
+    // Zero gets a level of its own
+    if(k == 0)
+        key.level = INT_MAX;
+    else
+        while(k % 2 == 0)
+        {
+            k /= 2;
+            key.level--;
+        }
+    // Odd k's only, so (k - 1) / 2 numbers them without holes
+    std::int64_t n = (k - 1) / 2;
+    *slot = n & (SAMPLE_CACHE_TILE - 1);
+    key.tile = (n - *slot) / SAMPLE_CACHE_TILE;
+    return key;
+}
+
+unsigned int SampleCache::exprId(const std::string &expr)
+{
+    auto it = exprIds.find(expr);
+    if(it != exprIds.end())
+        return it->second;
+    unsigned int id;
+    if(!freeIds.empty())
+    {
+        id = freeIds.back();
+        freeIds.pop_back();
+        exprNames[id] = expr;
+    }
+    else
+    {
+        id = exprNames.size();
+        exprNames.push_back(expr);
+        exprTiles.push_back(0);
+    }
+    exprIds[expr] = id;
+    return id;
+}
+
+void SampleCache::evict(unsigned int keep)
+{
+    unsigned int id = uses.back().expr;
+    tiles.erase(uses.back());
+    uses.pop_back();
+    if(--exprTiles[id] == 0 && id != keep)
+    {
+        exprIds.erase(exprNames[id]);
+        exprNames[id].clear();
+        freeIds.push_back(id);
+    }
+}
+
+void SampleCache::lookup(const std::string &expr, const std::vector<double> &xs, std::vector<double> &ys,
+    std::vector<size_t> &missing)
+{
+    // Expressions are only numbered once they have samples
+    auto known = exprIds.find(expr);
+    unsigned int slot;
+    ys.resize(xs.size());
+    missing.clear();
+    for(size_t k = 0; k < xs.size(); k++)
+    {
+        if(known == exprIds.end())
+        {
+            missing.push_back(k);
+            continue;
+        }
+        auto it = tiles.find(locate(known->second, xs[k], &slot));
+        if(it == tiles.end() || !(it->second.filled >> slot & 1))
+        {
+            missing.push_back(k);
+            continue;
+        }
+        ys[k] = it->second.ys[slot];
+        uses.splice(uses.begin(), uses, it->second.use);
+    }
+}
+
+void SampleCache::store(const std::string &expr, const std::vector<double> &xs, const std::vector<double> &ys)
+{
+    if(xs.empty())
+        return;
+    unsigned int id = exprId(expr), slot;
+    for(size_t k = 0; k < xs.size(); k++)
+    {
+        TileKey key = locate(id, xs[k], &slot);
+        auto it = tiles.find(key);
+        if(it == tiles.end())
+        {
+            if(tiles.size() >= SAMPLE_CACHE_TILES)
+                evict(id);
+            uses.push_front(key);
+            it = tiles.insert(std::make_pair(key, Tile())).first;
+            it->second.filled = 0;
+            it->second.use = uses.begin();
+            exprTiles[id]++;
+        }
+        else
+            uses.splice(uses.begin(), uses, it->second.use);
+        it->second.filled |= (std::uint64_t)1 << slot;
+        it->second.ys[slot] = ys[k];
+    }
+}
+
+const SampleCache::View *SampleCache::findView(const std::string &expr, double minX, double maxX)
+{
+    for(auto it = views.begin(); it != views.end(); it++)
+        if(it->expr == expr && it->minX == minX && it->maxX == maxX)
+        {
+            views.splice(views.begin(), views, it);
+            return &views.front();
+        }
+    return nullptr;
+}
+
+void SampleCache::storeView(const View &view)
+{
+    for(auto it = views.begin(); it != views.end(); it++)
+        if(it->expr == view.expr && it->minX == view.minX && it->maxX == view.maxX)
+        {
+            views.erase(it);
+            break;
+        }
+    views.push_front(view);
+    if(views.size() > SAMPLE_CACHE_VIEWS)
+        views.pop_back();
+}
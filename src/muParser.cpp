@@ -25,11 +25,14 @@
 */
 #include "muParser.h"
 #include "muParserTemplateMagic.h"
+#include "muParserVecMath.h"
 
 //--- Standard includes ------------------------------------------------------------------------
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
 #include <numeric>
+#include <limits>
 
 /** \brief Pi (what else?). */
 #define PARSER_CONST_PI  3.141592653589793238462643
@@ -48,6 +51,347 @@ using namespace std;
 /** \brief Namespace for mathematical applications. */
 namespace mu
 {
+  namespace
+  {
+    typedef MathImpl<value_type> math;
+
+    //---------------------------------------------------------------------------
+    // Derivative rules of the built in functions used by ParserBase::EvalDiff.
+    // The rules of functions with one argument store f'(x) in g[0] and f''(x) in h[0].
+
+    void DiffSin(const value_type *x, int, value_type *g, value_type *h)   { g[0] = math::Cos(x[0]);  if (h) h[0] = -math::Sin(x[0]); }
+    void DiffCos(const value_type *x, int, value_type *g, value_type *h)   { g[0] = -math::Sin(x[0]); if (h) h[0] = -math::Cos(x[0]); }
+    void DiffTan(const value_type *x, int, value_type *g, value_type *h)   
+    { 
+      value_type t = math::Tan(x[0]);
+      g[0] = 1 + t*t;
+      if (h) h[0] = 2*t*g[0];
+    }
+
+    void DiffASin(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      value_type r = 1 - x[0]*x[0];
+      g[0] = 1/math::Sqrt(r);
+      if (h) h[0] = x[0]*g[0]/r;
+    }
+
+    void DiffACos(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      DiffASin(x, 1, g, h);
+      g[0] = -g[0];
+      if (h) h[0] = -h[0];
+    }
+
+    void DiffATan(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      g[0] = 1/(1 + x[0]*x[0]);
+      if (h) h[0] = -2*x[0]*g[0]*g[0];
+    }
+
+    // atan2(y, x)
+    void DiffATan2(const value_type *a, int, value_type *g, value_type *h)  
+    { 
+      value_type y = a[0], x = a[1], r = x*x + y*y;
+      g[0] =  x/r;
+      g[1] = -y/r;
+      if (h) 
+      {
+        h[0] = -2*x*y/(r*r);
+        h[1] = h[2] = (y*y - x*x)/(r*r);
+        h[3] =  2*x*y/(r*r);
+      }
+    }
+
+    void DiffSinh(const value_type *x, int, value_type *g, value_type *h)  { g[0] = math::Cosh(x[0]); if (h) h[0] = math::Sinh(x[0]); }
+    void DiffCosh(const value_type *x, int, value_type *g, value_type *h)  { g[0] = math::Sinh(x[0]); if (h) h[0] = math::Cosh(x[0]); }
+    void DiffTanh(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      value_type t = math::Tanh(x[0]);
+      g[0] = 1 - t*t;
+      if (h) h[0] = -2*t*g[0];
+    }
+
+    void DiffASinh(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      value_type r = x[0]*x[0] + 1;
+      g[0] = 1/math::Sqrt(r);
+      if (h) h[0] = -x[0]*g[0]/r;
+    }
+
+    void DiffACosh(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      value_type r = x[0]*x[0] - 1;
+      g[0] = 1/math::Sqrt(r);
+      if (h) h[0] = -x[0]*g[0]/r;
+    }
+
+    void DiffATanh(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      g[0] = 1/(1 - x[0]*x[0]);
+      if (h) h[0] = 2*x[0]*g[0]*g[0];
+    }
+
+    void DiffLn(const value_type *x, int, value_type *g, value_type *h)    { g[0] = 1/x[0]; if (h) h[0] = -g[0]*g[0]; }
+    void DiffLog2(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      DiffLn(x, 1, g, h);
+      g[0] /= math::Log((value_type)2);
+      if (h) h[0] /= math::Log((value_type)2);
+    }
+
+    void DiffLog10(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      DiffLn(x, 1, g, h);
+      g[0] /= math::Log((value_type)10);
+      if (h) h[0] /= math::Log((value_type)10);
+    }
+
+    void DiffExp(const value_type *x, int, value_type *g, value_type *h)   { g[0] = math::Exp(x[0]); if (h) h[0] = g[0]; }
+    void DiffSqrt(const value_type *x, int, value_type *g, value_type *h)  
+    { 
+      g[0] = 1/(2*math::Sqrt(x[0]));
+      if (h) h[0] = -g[0]/(2*x[0]);
+    }
+
+    // sign and rint are piecewise constant, abs is piecewise linear
+    void DiffStep(const value_type *, int, value_type *g, value_type *h)   { g[0] = 0; if (h) h[0] = 0; }
+    void DiffAbs(const value_type *x, int, value_type *g, value_type *h)   { g[0] = math::Sign(x[0]); if (h) h[0] = 0; }
+    void DiffUnaryMinus(const value_type *, int, value_type *g, value_type *h) { g[0] = -1; if (h) h[0] = 0; }
+    void DiffUnaryPlus(const value_type *, int, value_type *g, value_type *h)  { g[0] = 1;  if (h) h[0] = 0; }
+
+    //---------------------------------------------------------------------------
+    // Functions with a variable number of arguments are linear in each argument
+    // so the second derivatives are zero.
+    void DiffSum(const value_type *, int n, value_type *g, value_type *h)
+    {
+      for (int i=0; i<n; ++i)
+        g[i] = 1;
+      if (h) 
+        std::fill(h, h + n*n, (value_type)0);
+    }
+
+    void DiffAvg(const value_type *, int n, value_type *g, value_type *h)
+    {
+      for (int i=0; i<n; ++i)
+        g[i] = (value_type)1/n;
+      if (h) 
+        std::fill(h, h + n*n, (value_type)0);
+    }
+
+    // min and max follow the derivative of the selected argument
+    void DiffMin(const value_type *a, int n, value_type *g, value_type *h)
+    {
+      int k = (int)(std::min_element(a, a + n) - a);
+      for (int i=0; i<n; ++i)
+        g[i] = (i==k) ? (value_type)1 : (value_type)0;
+      if (h) 
+        std::fill(h, h + n*n, (value_type)0);
+    }
+
+    void DiffMax(const value_type *a, int n, value_type *g, value_type *h)
+    {
+      int k = (int)(std::max_element(a, a + n) - a);
+      for (int i=0; i<n; ++i)
+        g[i] = (i==k) ? (value_type)1 : (value_type)0;
+      if (h) 
+        std::fill(h, h + n*n, (value_type)0);
+    }
+
+    //---------------------------------------------------------------------------
+    // Interval rules of the built in functions used by ParserBase::EvalInterval.
+    // The library functions are not correctly rounded, so the bounds computed 
+    // from them are widened by a few ulps. Points where a function is undefined 
+    // are ignored, empty results have NaN bounds.
+
+    const value_type s_fInf = std::numeric_limits<value_type>::infinity(),
+                     s_fPi  = (value_type)PARSER_CONST_PI;
+
+    value_type Down(value_type v)
+    {
+      return (v>-s_fInf && v<s_fInf) ? v - std::fabs(v) * 4 * std::numeric_limits<value_type>::epsilon() 
+                                         - std::numeric_limits<value_type>::denorm_min() : v;
+    }
+
+    value_type Up(value_type v) 
+    { 
+      return -Down(-v); 
+    }
+
+    void SetRange(value_type lo, value_type hi, value_type *rlo, value_type *rhi)
+    {
+      *rlo = Down(lo);
+      *rhi = Up(hi);
+    }
+
+    // Range of a monotonic function restricted to its domain [dlo, dhi].
+    void Monotonic(value_type (*f)(value_type), bool bIncreasing, value_type dlo, value_type dhi, 
+                   const value_type *lo, const value_type *hi, value_type *rlo, value_type *rhi)
+    {
+      value_type a = std::max(lo[0], dlo), 
+                 b = std::min(hi[0], dhi);
+      if (!(a<=b))
+      {
+        *rlo = *rhi = std::numeric_limits<value_type>::quiet_NaN();
+        return;
+      }
+
+      if (bIncreasing)
+        SetRange(f(a), f(b), rlo, rhi);
+      else
+        SetRange(f(b), f(a), rlo, rhi);
+    }
+
+    // Check if [lo, hi] contains offset + k*period for an integer k. The test is
+    // conservative, points within the rounding error are reported as contained.
+    bool HasPeriodicPoint(value_type lo, value_type hi, value_type offset, value_type period)
+    {
+      value_type slack = (std::fabs(lo) + std::fabs(hi) + period) * 8 * std::numeric_limits<value_type>::epsilon(),
+                 k = std::ceil((lo - slack - offset) / period);
+      return offset + k * period <= hi + slack;
+    }
+
+    // sin and cos are periodic, their extrema are added if the interval contains them
+    void Periodic(value_type (*f)(value_type), value_type fMax, value_type fMin, 
+                  const value_type *lo, const value_type *hi, value_type *rlo, value_type *rhi)
+    {
+      if (!(hi[0] - lo[0] < 2 * s_fPi))
+      {
+        *rlo = -1;
+        *rhi = 1;
+        return;
+      }
+
+      value_type a = f(lo[0]), b = f(hi[0]);
+      *rlo = HasPeriodicPoint(lo[0], hi[0], fMin, 2 * s_fPi) ? -1 : std::max(Down(std::min(a, b)), (value_type)-1);
+      *rhi = HasPeriodicPoint(lo[0], hi[0], fMax, 2 * s_fPi) ?  1 : std::min(Up(std::max(a, b)), (value_type)1);
+    }
+
+    void IntervalSin(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Periodic(math::Sin, s_fPi/2, -s_fPi/2, lo, hi, rlo, rhi); }
+    void IntervalCos(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Periodic(math::Cos, 0, s_fPi, lo, hi, rlo, rhi); }
+    void IntervalTan(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  
+    { 
+      if (!(hi[0] - lo[0] < s_fPi) || HasPeriodicPoint(lo[0], hi[0], s_fPi/2, s_fPi))
+      {
+        *rlo = -s_fInf;
+        *rhi = s_fInf;
+      }
+      else
+        SetRange(math::Tan(lo[0]), math::Tan(hi[0]), rlo, rhi);
+    }
+
+    void IntervalASin(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Monotonic(math::ASin, true, -1, 1, lo, hi, rlo, rhi); }
+    void IntervalACos(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Monotonic(math::ACos, false, -1, 1, lo, hi, rlo, rhi); }
+    void IntervalATan(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Monotonic(math::ATan, true, -s_fInf, s_fInf, lo, hi, rlo, rhi); }
+
+    // atan2(y, x) is continuous unless the box touches the branch cut along 
+    // the negative x axis, the extreme angles are then taken at its corners.
+    void IntervalATan2(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  
+    { 
+      if (lo[1]<=0 && lo[0]<=0 && hi[0]>=0)
+      {
+        SetRange(-s_fPi, s_fPi, rlo, rhi);
+        return;
+      }
+
+      value_type c[4] = { math::ATan2(lo[0], lo[1]), math::ATan2(lo[0], hi[1]), 
+                          math::ATan2(hi[0], lo[1]), math::ATan2(hi[0], hi[1]) };
+      SetRange(*std::min_element(c, c+4), *std::max_element(c, c+4), rlo, rhi);
+    }
+
+    void IntervalSinh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Monotonic(math::Sinh, true, -s_fInf, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalCosh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  
+    { 
+      value_type a = math::Cosh(lo[0]), b = math::Cosh(hi[0]);
+      *rlo = (lo[0]<=0 && hi[0]>=0) ? 1 : std::max(Down(std::min(a, b)), (value_type)1);
+      *rhi = Up(std::max(a, b));
+    }
+
+    void IntervalTanh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  
+    { 
+      Monotonic(math::Tanh, true, -s_fInf, s_fInf, lo, hi, rlo, rhi); 
+      *rlo = std::max(*rlo, (value_type)-1);
+      *rhi = std::min(*rhi, (value_type)1);
+    }
+
+    void IntervalASinh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi) { Monotonic(math::ASinh, true, -s_fInf, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalACosh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi) { Monotonic(math::ACosh, true, 1, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalATanh(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi) { Monotonic(math::ATanh, true, -1, 1, lo, hi, rlo, rhi); }
+    void IntervalLog2(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { Monotonic(math::Log2, true, 0, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalLog10(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi) { Monotonic(math::Log10, true, 0, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalLn(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)    { Monotonic(math::Log, true, 0, s_fInf, lo, hi, rlo, rhi); }
+    void IntervalExp(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)   
+    { 
+      Monotonic(math::Exp, true, -s_fInf, s_fInf, lo, hi, rlo, rhi); 
+      *rlo = std::max(*rlo, (value_type)0);
+    }
+
+    void IntervalSqrt(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  
+    { 
+      // sqrt is correctly rounded, no widening needed
+      value_type a = std::max(lo[0], (value_type)0);
+      *rlo = (a<=hi[0]) ? math::Sqrt(a) : std::numeric_limits<value_type>::quiet_NaN();
+      *rhi = (a<=hi[0]) ? math::Sqrt(hi[0]) : std::numeric_limits<value_type>::quiet_NaN();
+    }
+
+    // sign and rint are monotonic and exact
+    void IntervalSign(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { *rlo = math::Sign(lo[0]); *rhi = math::Sign(hi[0]); }
+    void IntervalRint(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { *rlo = math::Rint(lo[0]); *rhi = math::Rint(hi[0]); }
+    void IntervalAbs(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)   
+    { 
+      if (lo[0]>=0)
+      {
+        *rlo = lo[0];
+        *rhi = hi[0];
+      }
+      else if (hi[0]<=0)
+      {
+        *rlo = -hi[0];
+        *rhi = -lo[0];
+      }
+      else
+      {
+        *rlo = 0;
+        *rhi = std::max(-lo[0], hi[0]);
+      }
+    }
+
+    void IntervalUnaryMinus(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi) { *rlo = -hi[0]; *rhi = -lo[0]; }
+    void IntervalUnaryPlus(const value_type *lo, const value_type *hi, int, value_type *rlo, value_type *rhi)  { *rlo = lo[0];  *rhi = hi[0];  }
+
+    //---------------------------------------------------------------------------
+    // Each addition of sum and avg is rounded outwards.
+    void IntervalSum(const value_type *lo, const value_type *hi, int n, value_type *rlo, value_type *rhi)
+    {
+      value_type a = 0, b = 0;
+      for (int i=0; i<n; ++i)
+      {
+        a = std::nextafter(a + lo[i], -s_fInf);
+        b = std::nextafter(b + hi[i], s_fInf);
+      }
+
+      *rlo = a;
+      *rhi = b;
+    }
+
+    void IntervalAvg(const value_type *lo, const value_type *hi, int n, value_type *rlo, value_type *rhi)
+    {
+      IntervalSum(lo, hi, n, rlo, rhi);
+      *rlo = std::nextafter(*rlo / n, -s_fInf);
+      *rhi = std::nextafter(*rhi / n, s_fInf);
+    }
+
+    void IntervalMin(const value_type *lo, const value_type *hi, int n, value_type *rlo, value_type *rhi)
+    {
+      *rlo = *std::min_element(lo, lo + n);
+      *rhi = *std::min_element(hi, hi + n);
+    }
+
+    void IntervalMax(const value_type *lo, const value_type *hi, int n, value_type *rlo, value_type *rhi)
+    {
+      *rlo = *std::max_element(lo, lo + n);
+      *rhi = *std::max_element(hi, hi + n);
+    }
+  } // anonymous namespace
 
 
   //---------------------------------------------------------------------------
@@ -213,29 +557,159 @@ namespace mu
   */
   int Parser::IsVal(const char_type* a_szExpr, int *a_iPos, value_type *a_fVal)
   {
+    const std::numpunct<char_type> &punct = std::use_facet< std::numpunct<char_type> >(Parser::s_locale);
+    const char_type cDecPoint = punct.decimal_point(),
+                    cThousandsSep = punct.thousands_sep();
+
+    // Find the characters that may belong to the number. Only these are 
+    // given to the stream, giving it the rest of the expression would make 
+    // parsing quadratic in the expression length.
+    int iLen = 0;
+    bool bDigit = false;
+    for (;; ++iLen)
+    {
+      char_type c = a_szExpr[iLen];
+      if (c>='0' && c<='9')
+      {
+        bDigit = true;
+        continue;
+      }
+
+      if ( c=='e' || c=='E' || c==cDecPoint || (cThousandsSep && c==cThousandsSep) )
+        continue;
+
+      if ( (c=='+' || c=='-') && (iLen==0 || a_szExpr[iLen-1]=='e' || a_szExpr[iLen-1]=='E') )
+        continue;
+
+      break;
+    }
+
+    if (!bDigit)
+      return 0;
+
     value_type fVal(0);
+    if (IsSimpleVal(a_szExpr, iLen, cDecPoint, &fVal))
+    {
+      *a_iPos += iLen;
+      *a_fVal = fVal;
+      return 1;
+    }
 
-    stringstream_type stream(a_szExpr);
-    stream.seekg(0);        // todo:  check if this really is necessary
+    stringstream_type stream(string_type(a_szExpr, iLen));
     stream.imbue(Parser::s_locale);
     stream >> fVal;
-    stringstream_type::pos_type iEnd = stream.tellg(); // Position after reading
+    if (stream.fail())
+      return 0;
 
-    if (iEnd==(stringstream_type::pos_type)-1)
+    // Reading up to the end of the stream leaves it unable to report the position
+    int iEnd = stream.eof() ? iLen : (int)stream.tellg();
+    if (iEnd<=0)
       return 0;
 
-    *a_iPos += (int)iEnd;
+    *a_iPos += iEnd;
     *a_fVal = fVal;
     return 1;
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Convert a number that is exactly representable without a stream.
+      \param [in] a_szVal The characters of the number.
+      \param [in] a_iLen The number of characters.
+      \param [in] a_cDecPoint The decimal separator.
+      \param [out] a_fVal The value.
+      \return true if the number was converted.
+
+    Numbers of the form digits[.digits][e[+-]digits] with a mantissa and a power 
+    of ten that are both exact floating point numbers are converted by a single 
+    multiplication or division, the result is correctly rounded. All others are 
+    left to the stream.
+  */
+  bool Parser::IsSimpleVal(const char_type *a_szVal, int a_iLen, char_type a_cDecPoint, value_type *a_fVal)
+  {
+    const int iMantBits = std::numeric_limits<value_type>::digits,
+              iMaxPow = (iMantBits>=53) ? 22 : (iMantBits>=24) ? 10 : 0;
+    const unsigned long long iMaxMant = 1ULL << std::min(iMantBits, 59);
+
+    unsigned long long iMant = 0;
+    int i = 0, nDigits = 0, iExp = 0;
+    bool bFrac = false;
+    for (; i<a_iLen; ++i)
+    {
+      char_type c = a_szVal[i];
+      if (c>='0' && c<='9')
+      {
+        if (iMant>iMaxMant)
+          return false;
+
+        iMant = iMant * 10 + (c - '0');
+        iExp -= bFrac;
+        ++nDigits;
+      }
+      else if (c==a_cDecPoint && !bFrac)
+        bFrac = true;
+      else
+        break;
+    }
+
+    if (nDigits==0 || iMant>iMaxMant)
+      return false;
+
+    if (i<a_iLen)
+    {
+      if (a_szVal[i]!='e' && a_szVal[i]!='E')
+        return false;
+
+      ++i;
+      bool bNeg = (i<a_iLen && a_szVal[i]=='-');
+      if (i<a_iLen && (a_szVal[i]=='-' || a_szVal[i]=='+'))
+        ++i;
+
+      if (i==a_iLen)
+        return false;
+
+      int iPow = 0;
+      for (; i<a_iLen; ++i)
+      {
+        char_type c = a_szVal[i];
+        if (c<'0' || c>'9' || iPow>1000)
+          return false;
+
+        iPow = iPow * 10 + (c - '0');
+      }
+
+      iExp += bNeg ? -iPow : iPow;
+    }
+
+    if (iExp<-iMaxPow || iExp>iMaxPow)
+      return false;
+
+    value_type fPow = 1;
+    for (int k=0; k<std::abs(iExp); ++k)
+      fPow *= 10;
+
+    *a_fVal = (iExp<0) ? (value_type)iMant / fPow : (value_type)iMant * fPow;
+    return true;
+  }
+
+
 
   //---------------------------------------------------------------------------
   /** \brief Constructor. 
 
-    Call ParserBase class constructor and trigger Function, Operator and Constant initialization.
+    The parser starts as a copy of the parser holding the built in functions, 
+    operators and constants, it shares their definitions until it defines its 
+    own.
   */
   Parser::Parser()
+    :ParserBase(Builtin())
+  {}
+
+  //---------------------------------------------------------------------------
+  /** \brief Constructor of the parser holding the built in definitions. 
+
+    Call ParserBase class constructor and trigger Function, Operator and Constant initialization.
+  */
+  Parser::Parser(SBuiltinTag)
     :ParserBase()
   {
     AddValIdent(IsVal);
@@ -246,6 +720,14 @@ namespace mu
     InitOprt();
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Return the parser holding the built in definitions, it is created on first use. */
+  const Parser& Parser::Builtin()
+  {
+    static const Parser s_Builtin((SBuiltinTag()));
+    return s_Builtin;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Define the character sets. 
       \sa DefineNameChars, DefineOprtChars, DefineInfixOprtChars
@@ -307,6 +789,71 @@ namespace mu
       DefineFun(_T("avg"), Avg);
       DefineFun(_T("min"), Min);
       DefineFun(_T("max"), Max);
+
+      // Derivative rules, the variadic functions are differentiated numerically by SetDiffVar
+      DefineDiff(Sin, DiffSin, _T("cos(x)"));
+      DefineDiff(Cos, DiffCos, _T("-sin(x)"));
+      DefineDiff(Tan, DiffTan, _T("1+tan(x)^2"));
+      DefineDiff(ASin, DiffASin, _T("1/sqrt(1-x^2)"));
+      DefineDiff(ACos, DiffACos, _T("-1/sqrt(1-x^2)"));
+      DefineDiff(ATan, DiffATan, _T("1/(1+x^2)"));
+      DefineDiff(ATan2, DiffATan2, _T("x2/(x1^2+x2^2), -x1/(x1^2+x2^2)"));
+      DefineDiff(Sinh, DiffSinh, _T("cosh(x)"));
+      DefineDiff(Cosh, DiffCosh, _T("sinh(x)"));
+      DefineDiff(Tanh, DiffTanh, _T("1-tanh(x)^2"));
+      DefineDiff(ASinh, DiffASinh, _T("1/sqrt(x^2+1)"));
+      DefineDiff(ACosh, DiffACosh, _T("1/sqrt(x^2-1)"));
+      DefineDiff(ATanh, DiffATanh, _T("1/(1-x^2)"));
+      DefineDiff(Log2, DiffLog2, _T("1/(x*ln(2))"));
+      DefineDiff(Log10, DiffLog10, _T("1/(x*ln(10))"));
+      DefineDiff(Ln, DiffLn, _T("1/x"));
+      DefineDiff(Exp, DiffExp, _T("exp(x)"));
+      DefineDiff(Sqrt, DiffSqrt, _T("0.5/sqrt(x)"));
+      DefineDiff(Sign, DiffStep, _T("0"));
+      DefineDiff(Rint, DiffStep, _T("0"));
+      DefineDiff(Abs, DiffAbs, _T("sign(x)"));
+      DefineDiff(Sum, DiffSum);
+      DefineDiff(Avg, DiffAvg);
+      DefineDiff(Min, DiffMin);
+      DefineDiff(Max, DiffMax);
+
+      // Interval rules
+      DefineInterval(Sin, IntervalSin);
+      DefineInterval(Cos, IntervalCos);
+      DefineInterval(Tan, IntervalTan);
+      DefineInterval(ASin, IntervalASin);
+      DefineInterval(ACos, IntervalACos);
+      DefineInterval(ATan, IntervalATan);
+      DefineInterval(ATan2, IntervalATan2);
+      DefineInterval(Sinh, IntervalSinh);
+      DefineInterval(Cosh, IntervalCosh);
+      DefineInterval(Tanh, IntervalTanh);
+      DefineInterval(ASinh, IntervalASinh);
+      DefineInterval(ACosh, IntervalACosh);
+      DefineInterval(ATanh, IntervalATanh);
+      DefineInterval(Log2, IntervalLog2);
+      DefineInterval(Log10, IntervalLog10);
+      DefineInterval(Ln, IntervalLn);
+      DefineInterval(Exp, IntervalExp);
+      DefineInterval(Sqrt, IntervalSqrt);
+      DefineInterval(Sign, IntervalSign);
+      DefineInterval(Rint, IntervalRint);
+      DefineInterval(Abs, IntervalAbs);
+      DefineInterval(Sum, IntervalSum);
+      DefineInterval(Avg, IntervalAvg);
+      DefineInterval(Min, IntervalMin);
+      DefineInterval(Max, IntervalMax);
+
+      // Array versions
+      DefineVecFun(Sin, vecmath::Sin, vecmath::Sin);
+      DefineVecFun(Cos, vecmath::Cos, vecmath::Cos);
+      DefineVecFun(Tanh, vecmath::Tanh, vecmath::Tanh);
+      DefineVecFun(Log2, vecmath::Log2, vecmath::Log2);
+      DefineVecFun(Log10, vecmath::Log10, vecmath::Log10);
+      DefineVecFun(Ln, vecmath::Ln, vecmath::Ln);
+      DefineVecFun(Exp, vecmath::Exp, vecmath::Exp);
+      DefineVecFun(Sqrt, vecmath::Sqrt, vecmath::Sqrt);
+      DefineVecFun(Abs, vecmath::Abs, vecmath::Abs);
     }
   }
 
@@ -331,6 +878,11 @@ namespace mu
   {
     DefineInfixOprt(_T("-"), UnaryMinus);
     DefineInfixOprt(_T("+"), UnaryPlus);
+
+    DefineDiff(UnaryMinus, DiffUnaryMinus, _T("-1"));
+    DefineDiff(UnaryPlus, DiffUnaryPlus, _T("1"));
+    DefineInterval(UnaryMinus, IntervalUnaryMinus);
+    DefineInterval(UnaryPlus, IntervalUnaryPlus);
   }
 
   //---------------------------------------------------------------------------
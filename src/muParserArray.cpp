@@ -0,0 +1,991 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+
+#include "muParserBase.h"
+#include "muParserSimd.h"
+#include "muParserTemplateMagic.h"
+#include "muParserThreadPool.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+/** \file
+    \brief Implementation of the array evaluation mode of the bytecode.
+
+    Instead of running the bytecode once per value the array mode runs every
+    token over a block of lanes. Built in operators are computed with SIMD 
+    kernels, function callbacks are called lane by lane.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    /** \brief Number of lanes processed by a single pass over the bytecode. */
+    const int s_iBlockSize = 64;
+
+    //------------------------------------------------------------------------------
+    /** \brief Operations on blocks of s_iBlockSize values.
+
+      This is the portable version, value_type==double is specialized below.
+    */
+    template<typename TValue>
+    struct BlockOps
+    {
+      static void Fill(TValue *a, TValue v)                     { for (int i=0; i<s_iBlockSize; ++i) a[i] = v; }
+      static void Copy(TValue *a, const TValue *b)              { for (int i=0; i<s_iBlockSize; ++i) a[i] = b[i]; }
+      static void Add(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] += b[i]; }
+      static void Sub(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] -= b[i]; }
+      static void Mul(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] *= b[i]; }
+      static void Div(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] /= b[i]; }
+      static void MulAdd(TValue *a, const TValue *b, TValue m, TValue c) { for (int i=0; i<s_iBlockSize; ++i) a[i] = b[i]*m + c; }
+      static void Pow2(TValue *a, const TValue *b)              { for (int i=0; i<s_iBlockSize; ++i) a[i] = b[i]*b[i]; }
+      static void Pow3(TValue *a, const TValue *b)              { for (int i=0; i<s_iBlockSize; ++i) a[i] = b[i]*b[i]*b[i]; }
+      static void Pow4(TValue *a, const TValue *b)              { for (int i=0; i<s_iBlockSize; ++i) a[i] = b[i]*b[i]*b[i]*b[i]; }
+      static void LT(TValue *a, const TValue *b)                { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] <  b[i]; }
+      static void LE(TValue *a, const TValue *b)                { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] <= b[i]; }
+      static void GT(TValue *a, const TValue *b)                { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] >  b[i]; }
+      static void GE(TValue *a, const TValue *b)                { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] >= b[i]; }
+      static void EQ(TValue *a, const TValue *b)                { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] == b[i]; }
+      static void NEQ(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] != b[i]; }
+      static void LAnd(TValue *a, const TValue *b)              { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] && b[i]; }
+      static void LOr(TValue *a, const TValue *b)               { for (int i=0; i<s_iBlockSize; ++i) a[i] = a[i] || b[i]; }
+      static void Select(TValue *a, const TValue *m, const TValue *b) { for (int i=0; i<s_iBlockSize; ++i) a[i] = (m[i]!=0) ? b[i] : a[i]; }
+    };
+
+#if defined(MUP_SIMD_AVX) || defined(MUP_SIMD_SSE2)
+
+    //------------------------------------------------------------------------------
+    /** \brief SIMD version of the block operations. 
+    
+      Comparisons yield all bits set for true, masking with 1.0 turns this into 
+      the 1/0 values the scalar evaluation produces.
+    */
+    template<typename TValue, typename TVec>
+    struct SimdBlockOps
+    {
+      typedef typename TVec::type vec_type;
+      typedef vec_type (*binop_type)(vec_type, vec_type);
+      static const int s_iVecSize = TVec::size;
+
+      template<binop_type TOp>
+      static void Apply(TValue *a, const TValue *b)
+      {
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TOp(TVec::Load(a+i), TVec::Load(b+i)));
+      }
+
+      template<binop_type TCmp>
+      static void Compare(TValue *a, const TValue *b)
+      {
+        const vec_type one = TVec::Set(1);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::And(TCmp(TVec::Load(a+i), TVec::Load(b+i)), one));
+      }
+
+      static void Fill(TValue *a, TValue v)
+      {
+        const vec_type x = TVec::Set(v);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, x);
+      }
+
+      static void Copy(TValue *a, const TValue *b)
+      {
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::Load(b+i));
+      }
+
+      static void Add(TValue *a, const TValue *b) { Apply<TVec::Add>(a, b); }
+      static void Sub(TValue *a, const TValue *b) { Apply<TVec::Sub>(a, b); }
+      static void Mul(TValue *a, const TValue *b) { Apply<TVec::Mul>(a, b); }
+      static void Div(TValue *a, const TValue *b) { Apply<TVec::Div>(a, b); }
+
+      static void MulAdd(TValue *a, const TValue *b, TValue m, TValue c)
+      {
+        const vec_type vm = TVec::Set(m), vc = TVec::Set(c);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::Add(TVec::Mul(TVec::Load(b+i), vm), vc));
+      }
+
+      static void Pow2(TValue *a, const TValue *b)
+      {
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+        {
+          vec_type x = TVec::Load(b+i);
+          TVec::Store(a+i, TVec::Mul(x, x));
+        }
+      }
+
+      static void Pow3(TValue *a, const TValue *b)
+      {
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+        {
+          vec_type x = TVec::Load(b+i);
+          TVec::Store(a+i, TVec::Mul(TVec::Mul(x, x), x));
+        }
+      }
+
+      static void Pow4(TValue *a, const TValue *b)
+      {
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+        {
+          vec_type x = TVec::Load(b+i);
+          TVec::Store(a+i, TVec::Mul(TVec::Mul(TVec::Mul(x, x), x), x));
+        }
+      }
+
+      static void LT(TValue *a, const TValue *b)  { Compare<TVec::CmpLT>(a, b); }
+      static void LE(TValue *a, const TValue *b)  { Compare<TVec::CmpLE>(a, b); }
+      static void GT(TValue *a, const TValue *b)  { Compare<TVec::CmpGT>(a, b); }
+      static void GE(TValue *a, const TValue *b)  { Compare<TVec::CmpGE>(a, b); }
+      static void EQ(TValue *a, const TValue *b)  { Compare<TVec::CmpEQ>(a, b); }
+      static void NEQ(TValue *a, const TValue *b) { Compare<TVec::CmpNEQ>(a, b); }
+
+      static void LAnd(TValue *a, const TValue *b)
+      {
+        const vec_type zero = TVec::Set(0), one = TVec::Set(1);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::And(TVec::And(TVec::CmpNEQ(TVec::Load(a+i), zero), TVec::CmpNEQ(TVec::Load(b+i), zero)), one));
+      }
+
+      static void LOr(TValue *a, const TValue *b)
+      {
+        const vec_type zero = TVec::Set(0), one = TVec::Set(1);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::And(TVec::Or(TVec::CmpNEQ(TVec::Load(a+i), zero), TVec::CmpNEQ(TVec::Load(b+i), zero)), one));
+      }
+
+      static void Select(TValue *a, const TValue *m, const TValue *b)
+      {
+        const vec_type zero = TVec::Set(0);
+        for (int i=0; i<s_iBlockSize; i+=s_iVecSize)
+          TVec::Store(a+i, TVec::Blend(TVec::Load(a+i), TVec::Load(b+i), TVec::CmpNEQ(TVec::Load(m+i), zero)));
+      }
+    };
+
+    template<> struct BlockOps<double> : SimdBlockOps<double, simd::VecDouble> {};
+    template<> struct BlockOps<float>  : SimdBlockOps<float, simd::VecFloat> {};
+#endif
+
+    //------------------------------------------------------------------------------
+    /** \brief State of an if-then-else clause while evaluating a block. */
+    enum EIfMode
+    {
+      ifTRUE,   ///< The condition is true in all lanes, only the if branch is evaluated
+      ifFALSE,  ///< The condition is false in all lanes, only the else branch is evaluated
+      ifMIXED   ///< Both branches are evaluated and merged according to the condition
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief Array versions of a callback, both NULL if it has none. */
+    typedef std::pair<vec_fun_type, vec_funf_type> vec_fun_pair;
+
+    //------------------------------------------------------------------------------
+    /** \brief Apply the array version of a callback to the first lanes of a block.
+        \param a_Fun The array versions of the callback.
+        \param a_bFast Use the single precision version for double values.
+        \param a_pVal The lanes of the block, overwritten by the result.
+        \param a_iSize Number of lanes to compute.
+    */
+    void ApplyVecFun(const vec_fun_pair &a_Fun, bool a_bFast, double *a_pVal, int a_iSize)
+    {
+      if (!a_bFast)
+      {
+        a_Fun.first(a_pVal, a_iSize);
+        return;
+      }
+
+      float aTmp[s_iBlockSize];
+      for (int i=0; i<a_iSize; ++i)
+        aTmp[i] = (float)a_pVal[i];
+      a_Fun.second(aTmp, a_iSize);
+      for (int i=0; i<a_iSize; ++i)
+        a_pVal[i] = aTmp[i];
+    }
+
+    void ApplyVecFun(const vec_fun_pair &a_Fun, bool /*a_bFast*/, float *a_pVal, int a_iSize)
+    {
+      a_Fun.second(a_pVal, a_iSize);
+    }
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Arguments and scratch memory of an array evaluation.
+
+    Every thread of the pool gets its own slice of the scratch buffers.
+  */
+  template<typename TValue>
+  struct ParserBase::SArrayJob
+  {
+    const ParserBase *pParser;
+    const SToken *pRPN;                ///< The bytecode evaluated, see SetSweepVars
+    const int *pBinding;               ///< Index of the input array bound to each token, -1 if none
+    const TValue * const *pValues;
+    int iNumVar;
+    TValue * const *pResults;          ///< One output array per result
+    int iNumResults;
+    int iSize;
+    int nIf;
+    std::size_t nStack;
+    std::size_t nBufSize;              ///< Size of the value buffer of a thread
+    std::size_t nArgSize;              ///< Size of the argument buffer of a thread
+    TValue *pBuf;
+    EIfMode *pIfMode;
+    const TValue **pIn;
+    value_type *pArg;                  ///< Arguments of callbacks, always in double precision
+    const vec_fun_pair *pVecFun;       ///< Array versions of the callback of each token
+    bool bFastMath;
+  };
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the expression for an array of values of a single variable.
+      \param a_pVar Pointer to the variable as passed to DefineVar.
+      \param a_pValues The values the variable takes, one per result.
+      \param [out] a_pResults Array receiving the results.
+      \param a_iSize Number of values to compute.
+      \sa EvalArray(value_type* const*, const value_type* const*, int, value_type*, int)
+  */
+  void ParserBase::EvalArray(value_type *a_pVar, 
+                             const value_type *a_pValues, 
+                             value_type *a_pResults, 
+                             int a_iSize) const
+  {
+    EvalArray(&a_pVar, &a_pValues, 1, a_pResults, a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the expression for arrays of variable values.
+      \param a_pVar Pointers to the variables bound to input arrays.
+      \param a_pValues One input array per bound variable.
+      \param a_iNumVar Number of bound variables.
+      \param [out] a_pResults Array receiving the results.
+      \param a_iSize Number of values to compute, all input arrays must be that long.
+      \sa EvalArray(value_type* const*, const value_type* const*, int, value_type* const*, int, int)
+
+    Result i is the value of the expression when the bound variables take the
+    value at index i of their array. Variables that are not bound keep their 
+    current value for all results. The bytecode is run over blocks of values at
+    once so that the dispatch cost of each token is shared by the whole block
+    and built in operators can use SIMD instructions. Callbacks with an array 
+    version (see DefineVecFun) are applied to whole blocks, their results may
+    differ from Eval within the bounds documented in mu::vecmath or EnableFastMath.
+    Other callbacks are still called once per value. Large arrays are split between the threads 
+    of the ParserThreadPool unless the expression uses callbacks with side 
+    effects, string functions or bulk functions.
+    
+    Expressions containing assignments are evaluated value by value.
+
+    \attention If-then-else clauses whose condition differs within a block are 
+               evaluated on both branches, their callbacks may be called for 
+               values that don't need them.
+  */
+  void ParserBase::EvalArray(value_type * const *a_pVar, 
+                             const value_type * const *a_pValues, 
+                             int a_iNumVar,
+                             value_type *a_pResults, 
+                             int a_iSize) const
+  {
+    EvalArray(a_pVar, a_pValues, a_iNumVar, &a_pResults, 1, a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the results of a multiple result expression for arrays of 
+             variable values.
+      \param a_pVar Pointers to the variables bound to input arrays.
+      \param a_pValues One input array per bound variable.
+      \param a_iNumVar Number of bound variables.
+      \param [out] a_pResults One output array per result.
+      \param a_iNumResults Number of output arrays.
+      \param a_iSize Number of values to compute, all arrays must be that long.
+      \throw ParserException if the expression has less than a_iNumResults results.
+
+    The output arrays receive the last a_iNumResults comma separated results 
+    of the expression in order, a_pResults[0] gets the first result if all of 
+    them are requested. All results are computed by a single pass over the 
+    bytecode, see SetFusedExpr for compiling several expressions into one.
+  */
+  void ParserBase::EvalArray(value_type * const *a_pVar, 
+                             const value_type * const *a_pValues, 
+                             int a_iNumVar,
+                             value_type * const *a_pResults, 
+                             int a_iNumResults,
+                             int a_iSize) const
+  {
+    EvalArrayImpl(a_pVar, a_pValues, a_iNumVar, a_pResults, a_iNumResults, a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the expression in single precision for an array of values 
+             of a single variable.
+      \sa EvalArray(value_type*, const value_type*, value_type*, int)
+  */
+  void ParserBase::EvalArray(value_type *a_pVar, 
+                             const float *a_pValues, 
+                             float *a_pResults, 
+                             int a_iSize) const
+  {
+    EvalArrayImpl(&a_pVar, &a_pValues, 1, &a_pResults, 1, a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the results of an expression in single precision for arrays
+             of variable values.
+      \param a_pVar Pointers to the variables bound to input arrays.
+      \param a_pValues One input array per bound variable.
+      \param a_iNumVar Number of bound variables.
+      \param [out] a_pResults One output array per result.
+      \param a_iNumResults Number of output arrays.
+      \param a_iSize Number of values to compute, all arrays must be that long.
+      \throw ParserException if the expression has less than a_iNumResults results.
+
+    This works like the double precision version except that the blocks of 
+    values are floats: a SIMD register holds twice as many lanes and the 
+    scratch memory is halved. Constants and unbound variables are rounded to 
+    float, function callbacks are still called in double precision and their 
+    results rounded. Use EvalFloatError to check whether the precision is 
+    sufficient for an expression.
+  */
+  void ParserBase::EvalArray(value_type * const *a_pVar, 
+                             const float * const *a_pValues, 
+                             int a_iNumVar,
+                             float * const *a_pResults, 
+                             int a_iNumResults,
+                             int a_iSize) const
+  {
+    EvalArrayImpl(a_pVar, a_pValues, a_iNumVar, a_pResults, a_iNumResults, a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Estimate the error of the single precision array evaluation.
+      \param a_pVar Pointer to the variable bound to the values.
+      \param a_pValues The values the variable takes.
+      \param a_iSize Number of values.
+      \return The largest difference between the single and the double precision 
+              results relative to the largest magnitude of the double precision 
+              results. It is infinite if the two precisions disagree on which 
+              results are finite.
+
+    At most 256 values spread evenly over the array are evaluated in both 
+    precisions. The rounding of the values themselves to float is part of the 
+    error, so narrow ranges far from zero are detected as well. For plotting an 
+    error below 1e-4 is well under the size of a pixel.
+  */
+  value_type ParserBase::EvalFloatError(value_type *a_pVar, 
+                                        const value_type *a_pValues, 
+                                        int a_iSize) const
+  {
+    const int nSamples = std::min(a_iSize, 4 * s_iBlockSize);
+    if (nSamples<=0)
+      return 0;
+
+    std::vector<value_type> vX(nSamples), vRes(nSamples);
+    std::vector<float> vXf(nSamples), vResf(nSamples);
+    for (int i=0; i<nSamples; ++i)
+    {
+      vX[i] = a_pValues[(nSamples>1) ? (long long)i * (a_iSize - 1) / (nSamples - 1) : 0];
+      vXf[i] = (float)vX[i];
+    }
+
+    EvalArray(a_pVar, &vX[0], &vRes[0], nSamples);
+    EvalArray(a_pVar, &vXf[0], &vResf[0], nSamples);
+
+    value_type fScale = 0, fMaxErr = 0;
+    for (int i=0; i<nSamples; ++i)
+    {
+      bool bFinite = std::isfinite(vRes[i]), 
+           bFinitef = std::isfinite(vResf[i]);
+      if (bFinite!=bFinitef)
+        return std::numeric_limits<value_type>::infinity();
+
+      if (bFinite)
+      {
+        fScale = std::max(fScale, std::fabs(vRes[i]));
+        fMaxErr = std::max(fMaxErr, std::fabs(vRes[i] - vResf[i]));
+      }
+    }
+
+    return (fScale>0) ? fMaxErr / fScale : fMaxErr;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief The array evaluation for values of type TValue.
+      \sa EvalArray(value_type* const*, const value_type* const*, int, value_type* const*, int, int)
+  */
+  template<typename TValue>
+  void ParserBase::EvalArrayImpl(value_type * const *a_pVar, 
+                                 const TValue * const *a_pValues, 
+                                 int a_iNumVar,
+                                 TValue * const *a_pResults, 
+                                 int a_iNumResults,
+                                 int a_iSize) const
+  {
+    // Create the bytecode if necessary
+    if (m_pParseFormula==&ParserBase::ParseString)
+      ParseString();
+
+    if (a_iNumResults>m_nFinalResultIdx)
+      Error(ecTOO_FEW_RESULTS);
+
+    // Use the bytecode reading the hoisted subexpressions unless they depend 
+    // on a bound variable
+    const ParserByteCode *pCode = &m_vRPN;
+    if (m_vHoisted.size())
+    {
+      bool bHoisted = true;
+      for (std::size_t i=0; i<m_vParam.size(); ++i)
+      {
+        for (int k=0; k<a_iNumVar; ++k)
+          bHoisted = bHoisted && m_vParam[i].first!=a_pVar[k];
+      }
+
+      if (bHoisted)
+      {
+        UpdateHoisted();
+        pCode = &m_vHoistedRPN;
+      }
+    }
+
+    const SToken *pRPN = pCode->GetBase();
+    std::size_t nTok = pCode->GetSize();
+
+    // Resolve the bound variables and check for tokens the array mode can't handle
+    std::vector<int> vBinding(nTok + 1, -1);
+    std::vector<vec_fun_pair> vVecFun(nTok + 1, vec_fun_pair((vec_fun_type)0, (vec_funf_type)0));
+    int nIf = 0, nMaxArg = 0;
+    bool bAssign = false,
+         bParallel = true;  // callbacks without side effects can run on any thread
+    for (std::size_t i=0; i<nTok; ++i)
+    {
+      switch(pRPN[i].Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+            for (int k=0; k<a_iNumVar; ++k)
+            {
+              if (pRPN[i].Val.ptr==a_pVar[k])
+                vBinding[i] = k;
+            }
+            break;
+
+      case cmFUNC:
+            nMaxArg = std::max(nMaxArg, std::abs(pRPN[i].Fun.argc));
+            bParallel = bParallel && pRPN[i].Fun.opt;
+            if (pRPN[i].Fun.argc==1)
+            {
+              vecfunmap_type::const_iterator item = m_VecFunDef.find(pRPN[i].Fun.ptr);
+              if (item!=m_VecFunDef.end())
+                vVecFun[i] = item->second;
+            }
+            break;
+
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            bParallel = false; 
+            break;
+
+      case cmIF:     ++nIf;         break;
+      case cmASSIGN: bAssign = true; break;
+      default:       break;
+      }
+    }
+
+    // Assignments write to the variables, only the scalar evaluation can
+    // deal with this properly.
+    if (bAssign)
+    {
+      std::vector<value_type> vSave(a_iNumVar);
+      for (int k=0; k<a_iNumVar; ++k)
+        vSave[k] = *a_pVar[k];
+
+      int iFirst = m_nFinalResultIdx - a_iNumResults + 1;
+      for (int i=0; i<a_iSize; ++i)
+      {
+        for (int k=0; k<a_iNumVar; ++k)
+          *a_pVar[k] = a_pValues[k][i];
+
+        (this->*m_pParseFormula)();
+        for (int k=0; k<a_iNumResults; ++k)
+          a_pResults[k][i] = (TValue)m_vStackBuffer[iFirst + k];
+      }
+
+      for (int k=0; k<a_iNumVar; ++k)
+        *a_pVar[k] = vSave[k];
+
+      return;
+    }
+
+    // Scratch memory of each thread: the value stack, a mask and a saved 
+    // branch value per if-then-else clause and room for padding the inputs 
+    // of the last block.
+    ParserThreadPool &pool = ParserThreadPool::Instance();
+    int nThreads = bParallel ? pool.GetNumThreads() : 1;
+    std::size_t nStack = pCode->GetMaxStackSize();
+    std::size_t nBufSize = (nStack + 2*nIf + a_iNumVar) * s_iBlockSize;
+    std::vector<TValue> vBuf(nBufSize * nThreads);
+    std::vector<const TValue*> vIn(a_iNumVar * nThreads + 1);
+    std::vector<EIfMode> vIfMode(nIf * nThreads + 1);
+    std::vector<value_type> vArg(nMaxArg * nThreads + 1);
+
+    SArrayJob<TValue> job = { this, pRPN, &vBinding[0], a_pValues, a_iNumVar, a_pResults, a_iNumResults, a_iSize, 
+                      nIf, nStack, nBufSize, (std::size_t)nMaxArg,
+                      &vBuf[0], &vIfMode[0], &vIn[0], &vArg[0], &vVecFun[0], m_bFastMath };
+
+    int nBlocks = (a_iSize + s_iBlockSize - 1) / s_iBlockSize;
+    if (bParallel)
+      pool.Run(&ParserBase::ArrayRange<TValue>, &job, nBlocks);
+    else
+      EvalArrayBlocks(job, 0, nBlocks, 0);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate a range of blocks of an array job, called by the thread pool. */
+  template<typename TValue>
+  void ParserBase::ArrayRange(void *a_pJob, int a_iBegin, int a_iEnd, int a_iThread)
+  {
+    const SArrayJob<TValue> &job = *static_cast<SArrayJob<TValue>*>(a_pJob);
+    job.pParser->EvalArrayBlocks(job, a_iBegin, a_iEnd, a_iThread);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Run the bytecode over the blocks [a_iBegin, a_iEnd) of an array job.
+      \param a_Job The arguments of EvalArray.
+      \param a_iBegin Index of the first block.
+      \param a_iEnd Index past the last block.
+      \param a_iThread Id of the calling thread, selects the scratch memory.
+  */
+  template<typename TValue>
+  void ParserBase::EvalArrayBlocks(const SArrayJob<TValue> &a_Job, int a_iBegin, int a_iEnd, int a_iThread) const
+  {
+    typedef BlockOps<TValue> ops;
+
+    const SToken *pRPN = a_Job.pRPN;
+    const int *vBinding = a_Job.pBinding;
+    const TValue * const *pValues = a_Job.pValues;
+    const TValue **vIn = a_Job.pIn + a_iThread * a_Job.iNumVar;
+    EIfMode *vIfMode = a_Job.pIfMode + a_iThread * a_Job.nIf;
+    value_type *vArg = a_Job.pArg + a_iThread * a_Job.nArgSize;
+    int nVar = a_Job.iNumVar,
+        iSize = a_Job.iSize;
+
+#if defined(MUP_PROFILING)
+    ParserProfileCounters *pProfile = GetProfileCounters(a_iThread);
+    ParserProfileTimer::clock_type::time_point start = ParserProfileTimer::clock_type::now();
+#endif
+
+    TValue *Stack = a_Job.pBuf + a_iThread * a_Job.nBufSize,
+               *IfBuf = Stack + a_Job.nStack * s_iBlockSize,
+               *PadBuf = IfBuf + 2 * a_Job.nIf * s_iBlockSize;
+
+    for (int iStart=a_iBegin*s_iBlockSize; iStart<a_iEnd*s_iBlockSize; iStart+=s_iBlockSize)
+    {
+      int nLanes = std::min(s_iBlockSize, iSize - iStart);
+      
+      // The lanes of the last block that are not needed are padded with the
+      // first value of the block in order to keep them in the function domain.
+      for (int k=0; k<nVar; ++k)
+      {
+        if (nLanes==s_iBlockSize)
+        {
+          vIn[k] = pValues[k] + iStart;
+        }
+        else
+        {
+          TValue *pPad = PadBuf + k * s_iBlockSize;
+          std::copy(pValues[k] + iStart, pValues[k] + iStart + nLanes, pPad);
+          std::fill(pPad + nLanes, pPad + s_iBlockSize, pValues[k][iStart]);
+          vIn[k] = pPad;
+        }
+      }
+
+      int sidx(0), iIf(0);
+#if defined(MUP_PROFILING)
+      ParserProfileTimer timer(pProfile);
+#endif
+      for (const SToken *pTok = pRPN; pTok->Cmd!=cmEND ; ++pTok)
+      {
+        TValue *pTop = Stack + sidx * s_iBlockSize;
+        int iBind = vBinding[pTok - pRPN];
+#if defined(MUP_PROFILING)
+        timer.Next(pTok, nLanes);
+#endif
+
+        switch (pTok->Cmd)
+        {
+        // built in binary operators
+        case  cmLE:   --sidx; ops::LE (pTop - s_iBlockSize, pTop); continue;
+        case  cmGE:   --sidx; ops::GE (pTop - s_iBlockSize, pTop); continue;
+        case  cmNEQ:  --sidx; ops::NEQ(pTop - s_iBlockSize, pTop); continue;
+        case  cmEQ:   --sidx; ops::EQ (pTop - s_iBlockSize, pTop); continue;
+        case  cmLT:   --sidx; ops::LT (pTop - s_iBlockSize, pTop); continue;
+        case  cmGT:   --sidx; ops::GT (pTop - s_iBlockSize, pTop); continue;
+        case  cmADD:  --sidx; ops::Add(pTop - s_iBlockSize, pTop); continue;
+        case  cmSUB:  --sidx; ops::Sub(pTop - s_iBlockSize, pTop); continue;
+        case  cmMUL:  --sidx; ops::Mul(pTop - s_iBlockSize, pTop); continue;
+        case  cmDIV:  --sidx; 
+
+  #if defined(MUP_MATH_EXCEPTIONS)
+                      for (int i=0; i<nLanes; ++i)
+                      {
+                        if (pTop[i]==0)
+                          Error(ecDIV_BY_ZERO);
+                      }
+  #endif
+                      ops::Div(pTop - s_iBlockSize, pTop); 
+                      continue;
+
+        case  cmPOW:  
+                      --sidx; 
+                      for (int i=0; i<nLanes; ++i)
+                        pTop[i - s_iBlockSize] = (TValue)MathImpl<value_type>::Pow(pTop[i - s_iBlockSize], pTop[i]);
+                      continue;
+
+        case  cmLAND: --sidx; ops::LAnd(pTop - s_iBlockSize, pTop); continue;
+        case  cmLOR:  --sidx; ops::LOr (pTop - s_iBlockSize, pTop); continue;
+
+        case  cmIF:
+              {
+                int nTrue(0);
+                for (int i=0; i<nLanes; ++i)
+                  nTrue += (pTop[i]!=0);
+                --sidx;
+
+                if (nTrue==nLanes)
+                {
+                  vIfMode[iIf++] = ifTRUE;
+                }
+                else if (nTrue==0)
+                {
+                  vIfMode[iIf++] = ifFALSE;
+                  pTok += pTok->Oprt.offset;
+                }
+                else
+                {
+                  ops::Copy(IfBuf + 2 * iIf * s_iBlockSize, pTop);  // the mask
+                  vIfMode[iIf++] = ifMIXED;
+                }
+              }
+              continue;
+
+        case  cmELSE:
+              if (vIfMode[iIf-1]==ifMIXED)
+              {
+                // keep the result of the if branch and evaluate the else branch
+                ops::Copy(IfBuf + (2 * (iIf-1) + 1) * s_iBlockSize, pTop);
+                --sidx;
+              }
+              else
+              {
+                // skipping the else branch skips the endif token as well
+                --iIf;
+                pTok += pTok->Oprt.offset;
+              }
+              continue;
+
+        case  cmENDIF:
+              --iIf;
+              if (vIfMode[iIf]==ifMIXED)
+                ops::Select(pTop, IfBuf + 2 * iIf * s_iBlockSize, IfBuf + (2 * iIf + 1) * s_iBlockSize);
+              continue;
+
+        // value and variable tokens
+        case  cmVAR:    
+              ++sidx;
+              if (iBind>=0)
+                ops::Copy(pTop + s_iBlockSize, vIn[iBind]);
+              else
+                ops::Fill(pTop + s_iBlockSize, (TValue)*pTok->Val.ptr);
+              continue;
+
+        case  cmVAL:    
+              ++sidx;
+              ops::Fill(pTop + s_iBlockSize, (TValue)pTok->Val.data2);
+              continue;
+
+        case  cmVARPOW2: 
+        case  cmVARPOW3: 
+        case  cmVARPOW4: 
+              ++sidx;
+              pTop += s_iBlockSize;
+              if (iBind>=0)
+                ops::Copy(pTop, vIn[iBind]);
+              else
+                ops::Fill(pTop, (TValue)*pTok->Val.ptr);
+
+              if (pTok->Cmd==cmVARPOW2)
+                ops::Pow2(pTop, pTop);
+              else if (pTok->Cmd==cmVARPOW3)
+                ops::Pow3(pTop, pTop);
+              else
+                ops::Pow4(pTop, pTop);
+              continue;
+
+        case  cmVARMUL:  
+              ++sidx;
+              pTop += s_iBlockSize;
+              if (iBind>=0)
+                ops::MulAdd(pTop, vIn[iBind], (TValue)pTok->Val.data, (TValue)pTok->Val.data2);
+              else
+                ops::Fill(pTop, (TValue)(*pTok->Val.ptr * pTok->Val.data + pTok->Val.data2));
+              continue;
+
+        // temporaries holding common subexpressions
+        case  cmSTORE:
+              ops::Copy(Stack + pTok->Oprt.offset * s_iBlockSize, pTop);
+              continue;
+
+        case  cmLOAD:
+              ++sidx;
+              ops::Copy(pTop + s_iBlockSize, Stack + pTok->Oprt.offset * s_iBlockSize);
+              continue;
+
+        // sums and products: all lanes run the body until the last one is 
+        // done, the lanes that are done stop accumulating
+        case  cmLOOP:
+              {
+                TValue *pVar = pTop - s_iBlockSize,
+                       *pAcc = pTop + s_iBlockSize,
+                       fInit = (pTok->Oprt.code==cmMUL) ? 1 : 0;
+                bool bAny = false;
+                for (int i=0; i<nLanes; ++i)
+                {
+                  TValue fCount = std::floor(pTop[i] - pVar[i]) + 1;
+                  bool bValid = fCount<=MUP_LOOP_MAX;
+                  pTop[i] = (bValid && fCount>0) ? fCount : 0;
+                  pAcc[i] = (bValid || fCount<=0) ? fInit : std::numeric_limits<TValue>::quiet_NaN();
+                  bAny |= pTop[i]>0;
+                }
+
+                if (bAny)
+                {
+                  ++sidx;
+                  continue;
+                }
+
+                --sidx;
+                ops::Copy(pVar, pAcc);
+                pTok += pTok->Oprt.offset;
+              }
+              continue;
+
+        case  cmENDLOOP:
+              {
+                --sidx;
+                TValue *pAcc = pTop - s_iBlockSize,
+                       *pCount = pAcc - s_iBlockSize,
+                       *pVar = pCount - s_iBlockSize;
+                int nActive = 0;
+                for (int i=0; i<nLanes; ++i)
+                  nActive += pCount[i]>0;
+
+                if (nActive==nLanes)
+                {
+                  if (pTok->Oprt.code==cmMUL)
+                    ops::Mul(pAcc, pTop);
+                  else
+                    ops::Add(pAcc, pTop);
+                }
+                else
+                {
+                  for (int i=0; i<nLanes; ++i)
+                  {
+                    if (pCount[i]>0)
+                      pAcc[i] = (pTok->Oprt.code==cmMUL) ? pAcc[i] * pTop[i] : pAcc[i] + pTop[i];
+                  }
+                }
+
+                bool bAny = false;
+                for (int i=0; i<nLanes; ++i)
+                {
+                  pCount[i] = std::max(pCount[i] - 1, (TValue)0);
+                  pVar[i] += 1;
+                  bAny |= pCount[i]>0;
+                }
+
+                if (bAny)
+                {
+                  pTok -= pTok->Oprt.offset;
+                  continue;
+                }
+
+                sidx -= 2;
+                ops::Copy(pVar, pAcc);
+              }
+              continue;
+
+        // Next is treatment of numeric functions
+        case  cmFUNC:
+              {
+                int iArgCount = pTok->Fun.argc;
+
+                if (iArgCount==0)
+                {
+                  pTop += s_iBlockSize;
+                  ++sidx;
+                  for (int i=0; i<nLanes; ++i)
+                    pTop[i] = (*(fun_type0)pTok->Fun.ptr)();
+                  continue;
+                }
+                else if (iArgCount==1)
+                {
+                  const vec_fun_pair &vecFun = a_Job.pVecFun[pTok - pRPN];
+                  if (vecFun.first)
+                  {
+                    ApplyVecFun(vecFun, a_Job.bFastMath, pTop, nLanes);
+                    continue;
+                  }
+
+                  fun_type1 pFun = (fun_type1)pTok->Fun.ptr;
+                  for (int i=0; i<nLanes; ++i)
+                    pTop[i] = pFun(pTop[i]);
+                  continue;
+                }
+                else if (iArgCount==2)
+                {
+                  fun_type2 pFun = (fun_type2)pTok->Fun.ptr;
+                  --sidx;
+                  pTop -= s_iBlockSize;
+                  for (int i=0; i<nLanes; ++i)
+                    pTop[i] = pFun(pTop[i], pTop[i + s_iBlockSize]);
+                  continue;
+                }
+
+                // Functions with more arguments get them gathered per lane
+                int nArg = (iArgCount>0) ? iArgCount : -iArgCount;
+                sidx -= nArg - 1;
+                pTop = Stack + sidx * s_iBlockSize;
+                for (int i=0; i<nLanes; ++i)
+                {
+                  for (int k=0; k<nArg; ++k)
+                    vArg[k] = pTop[k * s_iBlockSize + i];
+
+                  value_type *a = vArg;
+                  switch(iArgCount)
+                  {
+                  case 3:  pTop[i] = (*(fun_type3)pTok->Fun.ptr)(a[0], a[1], a[2]); break;
+                  case 4:  pTop[i] = (*(fun_type4)pTok->Fun.ptr)(a[0], a[1], a[2], a[3]); break;
+                  case 5:  pTop[i] = (*(fun_type5)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4]); break;
+                  case 6:  pTop[i] = (*(fun_type6)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+                  case 7:  pTop[i] = (*(fun_type7)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+                  case 8:  pTop[i] = (*(fun_type8)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]); break;
+                  case 9:  pTop[i] = (*(fun_type9)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]); break;
+                  case 10: pTop[i] = (*(fun_type10)pTok->Fun.ptr)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]); break;
+                  default:
+                    if (iArgCount>0) // function with variable arguments store the number as a negative value
+                      Error(ecINTERNAL_ERROR, 1);
+
+                    pTop[i] = (*(multfun_type)pTok->Fun.ptr)(a, nArg);
+                    break;
+                  }
+                }
+              }
+              continue;
+
+        // Next is treatment of string functions
+        case  cmFUNC_STR:
+              {
+                sidx -= pTok->Fun.argc -1;
+                pTop = Stack + sidx * s_iBlockSize;
+
+                // The index of the string argument in the string table
+                int iIdxStack = pTok->Fun.idx;  
+                MUP_ASSERT( iIdxStack>=0 && iIdxStack<(int)m_vStringBuf.size() );
+                const char_type *szStr = m_vStringBuf[iIdxStack].c_str();
+
+                for (int i=0; i<nLanes; ++i)
+                {
+                  switch(pTok->Fun.argc)  // switch according to argument count
+                  {
+                  case 0: pTop[i] = (*(strfun_type1)pTok->Fun.ptr)(szStr); break;
+                  case 1: pTop[i] = (*(strfun_type2)pTok->Fun.ptr)(szStr, pTop[i]); break;
+                  case 2: pTop[i] = (*(strfun_type3)pTok->Fun.ptr)(szStr, pTop[i], pTop[i + s_iBlockSize]); break;
+                  }
+                }
+              }
+              continue;
+
+        case  cmFUNC_BULK:
+              {
+                int iArgCount = pTok->Fun.argc;
+                sidx -= iArgCount - 1;
+                pTop = Stack + sidx * s_iBlockSize;
+
+                for (int i=0; i<nLanes; ++i)
+                {
+                  const TValue *a = pTop + i;
+                  int nOffset = iStart + i;
+                  const int n = s_iBlockSize;
+
+                  switch(iArgCount)  
+                  {
+                  case 0:  pTop[i] = (*(bulkfun_type0 )pTok->Fun.ptr)(nOffset, 0); break;
+                  case 1:  pTop[i] = (*(bulkfun_type1 )pTok->Fun.ptr)(nOffset, 0, a[0]); break;
+                  case 2:  pTop[i] = (*(bulkfun_type2 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n]); break;
+                  case 3:  pTop[i] = (*(bulkfun_type3 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n]); break;
+                  case 4:  pTop[i] = (*(bulkfun_type4 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n]); break;
+                  case 5:  pTop[i] = (*(bulkfun_type5 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n]); break;
+                  case 6:  pTop[i] = (*(bulkfun_type6 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n], a[5*n]); break;
+                  case 7:  pTop[i] = (*(bulkfun_type7 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n], a[5*n], a[6*n]); break;
+                  case 8:  pTop[i] = (*(bulkfun_type8 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n], a[5*n], a[6*n], a[7*n]); break;
+                  case 9:  pTop[i] = (*(bulkfun_type9 )pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n], a[5*n], a[6*n], a[7*n], a[8*n]); break;
+                  case 10: pTop[i] = (*(bulkfun_type10)pTok->Fun.ptr)(nOffset, 0, a[0], a[n], a[2*n], a[3*n], a[4*n], a[5*n], a[6*n], a[7*n], a[8*n], a[9*n]); break;
+                  default:
+                    Error(ecINTERNAL_ERROR, 2);
+                  }
+                }
+              }
+              continue;
+
+        default:
+              Error(ecINTERNAL_ERROR, 3);
+              return;
+        } // switch CmdCode
+      } // for all bytecode tokens
+
+      // the requested results are the topmost values of the stack
+      for (int k=0; k<a_Job.iNumResults; ++k)
+      {
+        const TValue *pRes = Stack + (m_nFinalResultIdx - a_Job.iNumResults + 1 + k) * s_iBlockSize;
+        std::copy(pRes, pRes + nLanes, a_Job.pResults[k] + iStart);
+      }
+
+#if defined(MUP_PROFILING)
+      if (pProfile)
+        pProfile->nEval += nLanes;
+#endif
+    } // for all blocks
+
+#if defined(MUP_PROFILING)
+    if (pProfile)
+      pProfile->fEvalTime += std::chrono::duration<double>(ParserProfileTimer::clock_type::now() - start).count();
+#endif
+  }
+} // namespace mu
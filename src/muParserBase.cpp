@@ -36,9 +36,7 @@
 #include <sstream>
 #include <locale>
 
-#ifdef MUP_USE_OPENMP
-  #include <omp.h>
-#endif
+#include "muParserThreadPool.h"
 
 using namespace std;
 
@@ -69,7 +67,24 @@ namespace mu
     _T(")"),   _T("?"),  _T(":"), 0 
   };
 
-  const int ParserBase::s_MaxNumOpenMPThreads = 16;
+
+  namespace
+  {
+    //------------------------------------------------------------------------------
+    /** \brief Variable access of the interpreter through the bound pointers. 
+    
+      In bulk mode the variables are arrays, nOffset selects the element.
+    */
+    struct SBoundVar
+    {
+      int nOffset;
+
+      value_type& operator()(const SToken*, value_type *a_pVar) const
+      {
+        return *(a_pVar + nOffset);
+      }
+    };
+  } // anonymous namespace
 
   //------------------------------------------------------------------------------
   /** \brief Constructor.
@@ -79,6 +94,8 @@ namespace mu
   ParserBase::ParserBase()
     :m_pParseFormula(&ParserBase::ParseString)
     ,m_vRPN()
+    ,m_Jit()
+    ,m_RegCode()
     ,m_vStringBuf()
     ,m_pTokenReader()
     ,m_FunDef()
@@ -88,12 +105,28 @@ namespace mu
     ,m_ConstDef()
     ,m_StrVarDef()
     ,m_VarDef()
+    ,m_DiffDef()
+    ,m_DiffExprDef()
+    ,m_pDiffVar(NULL)
+    ,m_iDiffOrder(0)
+    ,m_IntervalDef()
+    ,m_VecFunDef()
     ,m_bBuiltInOp(true)
+    ,m_bEnableJit(false)
+    ,m_bEnableRegCode(false)
+    ,m_bFastMath(false)
     ,m_sNameChars()
     ,m_sOprtChars()
     ,m_sInfixOprtChars()
     ,m_nIfElseCounter(0)
     ,m_vStackBuffer()
+    ,m_vPrologue()
+    ,m_vHoistedRPN()
+    ,m_vHoisted()
+    ,m_vPrologueStack()
+    ,m_vParam()
+    ,m_bHoistedValid(false)
+    ,m_pParseHoisted(&ParserBase::ParseCmdCode)
     ,m_nFinalResultIdx(0)
   {
     InitTokenReader();
@@ -108,6 +141,8 @@ namespace mu
   ParserBase::ParserBase(const ParserBase &a_Parser)
     :m_pParseFormula(&ParserBase::ParseString)
     ,m_vRPN()
+    ,m_Jit()
+    ,m_RegCode()
     ,m_vStringBuf()
     ,m_pTokenReader()
     ,m_FunDef()
@@ -117,11 +152,27 @@ namespace mu
     ,m_ConstDef()
     ,m_StrVarDef()
     ,m_VarDef()
+    ,m_DiffDef()
+    ,m_DiffExprDef()
+    ,m_pDiffVar(NULL)
+    ,m_iDiffOrder(0)
+    ,m_IntervalDef()
+    ,m_VecFunDef()
     ,m_bBuiltInOp(true)
+    ,m_bEnableJit(false)
+    ,m_bEnableRegCode(false)
+    ,m_bFastMath(false)
     ,m_sNameChars()
     ,m_sOprtChars()
     ,m_sInfixOprtChars()
     ,m_nIfElseCounter(0)
+    ,m_vPrologue()
+    ,m_vHoistedRPN()
+    ,m_vHoisted()
+    ,m_vPrologueStack()
+    ,m_vParam()
+    ,m_bHoistedValid(false)
+    ,m_pParseHoisted(&ParserBase::ParseCmdCode)
   {
     m_pTokenReader.reset(new token_reader_type(this));
     Assign(a_Parser);
@@ -166,6 +217,9 @@ namespace mu
     m_ConstDef        = a_Parser.m_ConstDef;         // Copy user define constants
     m_VarDef          = a_Parser.m_VarDef;           // Copy user defined variables
     m_bBuiltInOp      = a_Parser.m_bBuiltInOp;
+    m_bEnableJit      = a_Parser.m_bEnableJit;
+    m_bEnableRegCode  = a_Parser.m_bEnableRegCode;
+    m_bFastMath       = a_Parser.m_bFastMath;
     m_vStringBuf      = a_Parser.m_vStringBuf;
     m_vStackBuffer    = a_Parser.m_vStackBuffer;
     m_nFinalResultIdx = a_Parser.m_nFinalResultIdx;
@@ -179,6 +233,13 @@ namespace mu
     m_PostOprtDef = a_Parser.m_PostOprtDef;   // post value unary operators
     m_InfixOprtDef = a_Parser.m_InfixOprtDef; // unary operators for infix notation
     m_OprtDef = a_Parser.m_OprtDef;           // binary operators
+    m_DiffDef = a_Parser.m_DiffDef;           // derivative rules
+    m_DiffExprDef = a_Parser.m_DiffExprDef;
+    m_pDiffVar = a_Parser.m_pDiffVar;
+    m_iDiffOrder = a_Parser.m_iDiffOrder;
+    m_IntervalDef = a_Parser.m_IntervalDef;   // interval rules
+    m_VecFunDef = a_Parser.m_VecFunDef;       // array versions of the callbacks
+    m_vSweepVar = a_Parser.m_vSweepVar;
 
     m_sNameChars = a_Parser.m_sNameChars;
     m_sOprtChars = a_Parser.m_sOprtChars;
@@ -250,6 +311,13 @@ namespace mu
     m_pParseFormula = &ParserBase::ParseString;
     m_vStringBuf.clear();
     m_vRPN.clear();
+    m_Jit.Clear();
+    m_RegCode.clear();
+    m_vPrologue.clear();
+    m_vHoistedRPN.clear();
+    m_vHoisted.clear();
+    m_vParam.clear();
+    m_bHoistedValid = false;
     m_pTokenReader->ReInit();
     m_nIfElseCounter = 0;
   }
@@ -293,12 +361,6 @@ namespace mu
   #endif
 #endif
 
-#ifdef MUP_USE_OPENMP
-      ss << _T("; OPENMP");
-//#else
-//      ss << _T("; NO_OPENMP");
-#endif
-
 #if defined(MUP_MATH_EXCEPTIONS)
       ss << _T("; MATHEXC");
 //#else
@@ -337,13 +399,13 @@ namespace mu
   /** \brief Add a function or operator callback to the parser. */
   void ParserBase::AddCallback( const string_type &a_strName,
                                 const ParserCallback &a_Callback, 
-                                funmap_type &a_Storage,
+                                ParserSharedMap<funmap_type> &a_Storage,
                                 const char_type *a_szCharSet )
   {
     if (a_Callback.GetAddr()==0)
         Error(ecINVALID_FUN_PTR);
 
-    const funmap_type *pFunMap = &a_Storage;
+    const ParserSharedMap<funmap_type> *pFunMap = &a_Storage;
 
     // Check for conflicting operator or function names
     if ( pFunMap!=&m_FunDef && m_FunDef.find(a_strName)!=m_FunDef.end() )
@@ -425,6 +487,34 @@ namespace mu
     ReInit();
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Set several expressions that are compiled into a single program.
+      \param a_vExpr The expressions, each of them must have a single result.
+
+    The expressions are joined into one comma separated expression, result k 
+    of Eval(int&) and of the multiple result EvalArray belongs to a_vExpr[k].
+    As they are compiled together the variable loads, common subexpressions 
+    and optimizable function calls shared by the expressions are computed only 
+    once per evaluation.
+
+    Every expression is put in brackets, an expression that has comma separated 
+    results of its own raises ecUNEXPECTED_ARG. Error positions refer to the 
+    fused expression returned by GetExpr.
+  */
+  void ParserBase::SetFusedExpr(const std::vector<string_type> &a_vExpr)
+  {
+    string_type sExpr;
+    for (std::size_t i=0; i<a_vExpr.size(); ++i)
+    {
+      if (i>0)
+        sExpr += m_pTokenReader->GetArgSep();
+
+      sExpr += _T("(") + a_vExpr[i] + _T(")");
+    }
+
+    SetExpr(sExpr);
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Get the default symbols used for the built in operators. 
       \sa c_DefaultOprt
@@ -711,14 +801,14 @@ namespace mu
   /** \brief Return a map containing the used variables only. */
   const varmap_type& ParserBase::GetVar() const
   {
-    return m_VarDef;
+    return m_VarDef.Get();
   }
 
   //---------------------------------------------------------------------------
   /** \brief Return a map containing all parser constants. */
   const valmap_type& ParserBase::GetConst() const
   {
-    return m_ConstDef;
+    return m_ConstDef.Get();
   }
 
   //---------------------------------------------------------------------------
@@ -734,7 +824,7 @@ namespace mu
   */
   const funmap_type& ParserBase::GetFunDef() const
   {
-    return m_FunDef;
+    return m_FunDef.Get();
   }
 
   //---------------------------------------------------------------------------
@@ -858,7 +948,7 @@ namespace mu
           if (funTok.GetArgCount()==-1 && iArgCount==0)
             Error(ecTOO_FEW_PARAMS, m_pTokenReader->GetPos(), funTok.GetAsString());
 
-          m_vRPN.AddFun(funTok.GetFuncAddr(), (funTok.GetArgCount()==-1) ? -iArgNumerical : iArgNumerical);
+          m_vRPN.AddFun(funTok.GetFuncAddr(), (funTok.GetArgCount()==-1) ? -iArgNumerical : iArgNumerical, funTok.IsOptimizable());
           break;
     default:
         break;
@@ -1000,177 +1090,103 @@ namespace mu
     return ParseCmdCodeBulk(0, 0);
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Run the machine code compiled from the bytecode.
+      \sa EnableJit
+  */
+  value_type ParserBase::ParseCmdCodeJit() const
+  {
+    m_Jit.Run(&m_vStackBuffer[0]);
+    return m_vStackBuffer[m_nFinalResultIdx];
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the register code translated from the bytecode.
+      \sa EnableRegisterCode
+  */
+  value_type ParserBase::ParseRegisterCode() const
+  {
+    value_type *pFrame = &m_vRegFrame[0];
+    value_type fRes = m_RegCode.Run(pFrame);
+
+    // The results of comma separated expressions are expected on the stack
+    value_type *Stack = &m_vStackBuffer[0];
+    for (int i=1; i<=m_nFinalResultIdx; ++i)
+      Stack[i] = pFrame[i];
+
+    return fRes;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Evaluate the RPN. 
       \param nOffset The offset added to variable addresses (for bulk mode)
-      \param nThreadID OpenMP Thread id of the calling thread
+      \param nThreadID Id of the calling thread in the bulk mode thread pool
   */
   value_type ParserBase::ParseCmdCodeBulk(int nOffset, int nThreadID) const
   {
-    assert(nThreadID<=s_MaxNumOpenMPThreads);
+    return RunCmdCode(m_vRPN, nOffset, nThreadID);
+  }
 
-    // Note: The check for nOffset==0 and nThreadID here is not necessary but 
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the bytecode reading the hoisted subexpressions. 
+      \sa SetSweepVars
+  */
+  value_type ParserBase::ParseHoistedCmdCode() const
+  {
+    return RunCmdCode(m_vHoistedRPN, 0, 0);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Run the interpreter on a bytecode of the expression. 
+      \param a_Code Either the bytecode or the bytecode reading hoisted values.
+      \param nOffset The offset added to variable addresses (for bulk mode)
+      \param nThreadID Id of the calling thread in the bulk mode thread pool
+  */
+  value_type ParserBase::RunCmdCode(const ParserByteCode &a_Code, int nOffset, int nThreadID) const
+  {
+    // Note: The check for nThreadID here is not necessary but 
     //       brings a minor performance gain when not in bulk mode.
-    value_type *Stack = ((nOffset==0) && (nThreadID==0)) ? &m_vStackBuffer[0] : &m_vStackBuffer[nThreadID * (m_vStackBuffer.size() / s_MaxNumOpenMPThreads)];
-    value_type buf;
-    int sidx(0);
-    for (const SToken *pTok = m_vRPN.GetBase(); pTok->Cmd!=cmEND ; ++pTok)
+    value_type *Stack = (nThreadID==0) ? &m_vStackBuffer[0] : &m_vStackBuffer[nThreadID * a_Code.GetMaxStackSize()];
+    SBoundVar var = { nOffset };
+
+#if defined(MUP_PROFILING)
+    ParserProfileCounters *pProfile = GetProfileCounters(nThreadID);
+    ParserProfileTimer::clock_type::time_point start = ParserProfileTimer::clock_type::now();
+    value_type fRes = RunByteCode(a_Code.GetBase(), Stack, var, m_vStringBuf.empty() ? NULL : &m_vStringBuf[0], nOffset, nThreadID, pProfile);
+    if (pProfile)
     {
-      switch (pTok->Cmd)
-      {
-      // built in binary operators
-      case  cmLE:   --sidx; Stack[sidx]  = Stack[sidx] <= Stack[sidx+1]; continue;
-      case  cmGE:   --sidx; Stack[sidx]  = Stack[sidx] >= Stack[sidx+1]; continue;
-      case  cmNEQ:  --sidx; Stack[sidx]  = Stack[sidx] != Stack[sidx+1]; continue;
-      case  cmEQ:   --sidx; Stack[sidx]  = Stack[sidx] == Stack[sidx+1]; continue;
-      case  cmLT:   --sidx; Stack[sidx]  = Stack[sidx] < Stack[sidx+1];  continue;
-      case  cmGT:   --sidx; Stack[sidx]  = Stack[sidx] > Stack[sidx+1];  continue;
-      case  cmADD:  --sidx; Stack[sidx] += Stack[1+sidx]; continue;
-      case  cmSUB:  --sidx; Stack[sidx] -= Stack[1+sidx]; continue;
-      case  cmMUL:  --sidx; Stack[sidx] *= Stack[1+sidx]; continue;
-      case  cmDIV:  --sidx;
-
-  #if defined(MUP_MATH_EXCEPTIONS)
-                  if (Stack[1+sidx]==0)
-                    Error(ecDIV_BY_ZERO);
-  #endif
-                  Stack[sidx] /= Stack[1+sidx]; 
-                  continue;
-
-      case  cmPOW: 
-              --sidx; Stack[sidx] = MathImpl<value_type>::Pow(Stack[sidx], Stack[1+sidx]);
-              continue;
-
-      case  cmLAND: --sidx; Stack[sidx]  = Stack[sidx] && Stack[sidx+1]; continue;
-      case  cmLOR:  --sidx; Stack[sidx]  = Stack[sidx] || Stack[sidx+1]; continue;
-
-      case  cmASSIGN: 
-          // Bugfix for Bulkmode:
-          // for details see:
-          //    https://groups.google.com/forum/embed/?place=forum/muparser-dev&showsearch=true&showpopout=true&showtabs=false&parenturl=http://muparser.beltoforion.de/mup_forum.html&afterlogin&pli=1#!topic/muparser-dev/szgatgoHTws
-          --sidx; Stack[sidx] = *(pTok->Oprt.ptr + nOffset) = Stack[sidx + 1]; continue;
-          // original code:
-          //--sidx; Stack[sidx] = *pTok->Oprt.ptr = Stack[sidx+1]; continue;
-
-      //case  cmBO:  // unused, listed for compiler optimization purposes
-      //case  cmBC:
-      //      MUP_FAIL(INVALID_CODE_IN_BYTECODE);
-      //      continue;
-
-      case  cmIF:
-            if (Stack[sidx--]==0)
-              pTok += pTok->Oprt.offset;
-            continue;
-
-      case  cmELSE:
-            pTok += pTok->Oprt.offset;
-            continue;
-
-      case  cmENDIF:
-            continue;
-
-      //case  cmARG_SEP:
-      //      MUP_FAIL(INVALID_CODE_IN_BYTECODE);
-      //      continue;
-
-      // value and variable tokens
-      case  cmVAR:    Stack[++sidx] = *(pTok->Val.ptr + nOffset);  continue;
-      case  cmVAL:    Stack[++sidx] =  pTok->Val.data2;  continue;
-      
-      case  cmVARPOW2: buf = *(pTok->Val.ptr + nOffset);
-                       Stack[++sidx] = buf*buf;
-                       continue;
-
-      case  cmVARPOW3: buf = *(pTok->Val.ptr + nOffset);
-                       Stack[++sidx] = buf*buf*buf;
-                       continue;
+      pProfile->nEval += 1;
+      pProfile->fEvalTime += std::chrono::duration<double>(ParserProfileTimer::clock_type::now() - start).count();
+    }
+    return fRes;
+#else
+    return RunByteCode(a_Code.GetBase(), Stack, var, m_vStringBuf.empty() ? NULL : &m_vStringBuf[0], nOffset, nThreadID);
+#endif
+  }
 
-      case  cmVARPOW4: buf = *(pTok->Val.ptr + nOffset);
-                       Stack[++sidx] = buf*buf*buf*buf;
-                       continue;
-      
-      case  cmVARMUL:  Stack[++sidx] = *(pTok->Val.ptr + nOffset) * pTok->Val.data + pTok->Val.data2;
-                       continue;
-
-      // Next is treatment of numeric functions
-      case  cmFUNC:
-            {
-              int iArgCount = pTok->Fun.argc;
-
-              // switch according to argument count
-              switch(iArgCount)  
-              {
-              case 0: sidx += 1; Stack[sidx] = (*(fun_type0)pTok->Fun.ptr)(); continue;
-              case 1:            Stack[sidx] = (*(fun_type1)pTok->Fun.ptr)(Stack[sidx]);   continue;
-              case 2: sidx -= 1; Stack[sidx] = (*(fun_type2)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1]); continue;
-              case 3: sidx -= 2; Stack[sidx] = (*(fun_type3)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2]); continue;
-              case 4: sidx -= 3; Stack[sidx] = (*(fun_type4)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3]); continue;
-              case 5: sidx -= 4; Stack[sidx] = (*(fun_type5)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4]); continue;
-              case 6: sidx -= 5; Stack[sidx] = (*(fun_type6)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5]); continue;
-              case 7: sidx -= 6; Stack[sidx] = (*(fun_type7)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6]); continue;
-              case 8: sidx -= 7; Stack[sidx] = (*(fun_type8)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7]); continue;
-              case 9: sidx -= 8; Stack[sidx] = (*(fun_type9)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8]); continue;
-              case 10:sidx -= 9; Stack[sidx] = (*(fun_type10)pTok->Fun.ptr)(Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8], Stack[sidx+9]); continue;
-              default:
-                if (iArgCount>0) // function with variable arguments store the number as a negative value
-                  Error(ecINTERNAL_ERROR, 1);
-
-                sidx -= -iArgCount - 1;
-                Stack[sidx] =(*(multfun_type)pTok->Fun.ptr)(&Stack[sidx], -iArgCount);
-                continue;
-              }
-            }
-
-      // Next is treatment of string functions
-      case  cmFUNC_STR:
-            {
-              sidx -= pTok->Fun.argc -1;
-
-              // The index of the string argument in the string table
-              int iIdxStack = pTok->Fun.idx;  
-              MUP_ASSERT( iIdxStack>=0 && iIdxStack<(int)m_vStringBuf.size() );
-
-              switch(pTok->Fun.argc)  // switch according to argument count
-              {
-              case 0: Stack[sidx] = (*(strfun_type1)pTok->Fun.ptr)(m_vStringBuf[iIdxStack].c_str()); continue;
-              case 1: Stack[sidx] = (*(strfun_type2)pTok->Fun.ptr)(m_vStringBuf[iIdxStack].c_str(), Stack[sidx]); continue;
-              case 2: Stack[sidx] = (*(strfun_type3)pTok->Fun.ptr)(m_vStringBuf[iIdxStack].c_str(), Stack[sidx], Stack[sidx+1]); continue;
-              }
-
-              continue;
-            }
-
-        case  cmFUNC_BULK:
-              {
-                int iArgCount = pTok->Fun.argc;
-
-                // switch according to argument count
-                switch(iArgCount)  
-                {
-                case 0: sidx += 1; Stack[sidx] = (*(bulkfun_type0 )pTok->Fun.ptr)(nOffset, nThreadID); continue;
-                case 1:            Stack[sidx] = (*(bulkfun_type1 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx]); continue;
-                case 2: sidx -= 1; Stack[sidx] = (*(bulkfun_type2 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1]); continue;
-                case 3: sidx -= 2; Stack[sidx] = (*(bulkfun_type3 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2]); continue;
-                case 4: sidx -= 3; Stack[sidx] = (*(bulkfun_type4 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3]); continue;
-                case 5: sidx -= 4; Stack[sidx] = (*(bulkfun_type5 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4]); continue;
-                case 6: sidx -= 5; Stack[sidx] = (*(bulkfun_type6 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5]); continue;
-                case 7: sidx -= 6; Stack[sidx] = (*(bulkfun_type7 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6]); continue;
-                case 8: sidx -= 7; Stack[sidx] = (*(bulkfun_type8 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7]); continue;
-                case 9: sidx -= 8; Stack[sidx] = (*(bulkfun_type9 )pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8]); continue;
-                case 10:sidx -= 9; Stack[sidx] = (*(bulkfun_type10)pTok->Fun.ptr)(nOffset, nThreadID, Stack[sidx], Stack[sidx+1], Stack[sidx+2], Stack[sidx+3], Stack[sidx+4], Stack[sidx+5], Stack[sidx+6], Stack[sidx+7], Stack[sidx+8], Stack[sidx+9]); continue;
-                default:
-                  Error(ecINTERNAL_ERROR, 2);
-                  continue;
-                }
-              }
+  //---------------------------------------------------------------------------
+  /** \brief Create a compiled program of the expression.
+      \return The program, it can be evaluated from several threads.
+      \throw ParserException if the expression is invalid.
+      \sa ParserProgram
 
-        default:
-              Error(ecINTERNAL_ERROR, 3);
-              return 0;
-      } // switch CmdCode
-    } // for all bytecode tokens
+    The program is not affected by later changes of the parser, it must be 
+    compiled again to pick up a new expression or new variables.
+  */
+  ParserProgram ParserBase::Compile() const
+  {
+    try
+    {
+      if (m_pParseFormula==&ParserBase::ParseString)
+        CompileString();
+    }
+    catch(ParserError &exc)
+    {
+      exc.SetFormula(m_pTokenReader->GetExpr());
+      throw;
+    }
 
-    return Stack[m_nFinalResultIdx];  
+    return ParserProgram(m_vRPN, m_vStringBuf, m_nFinalResultIdx);
   }
 
   //---------------------------------------------------------------------------
@@ -1184,6 +1200,15 @@ namespace mu
     token_type opta, opt;  // for storing operators
     token_type val, tval;  // for storing value
 
+    // The sums and products being parsed, innermost last
+    struct SLoop
+    {
+      int Depth;        ///< Size of stArgCount while reading the arguments
+      ECmdCode Oprt;    ///< cmADD for a sum, cmMUL for a product
+      int Var;          ///< Stack index of the loop variable
+    };
+    std::vector<SLoop> vLoop;
+
     ReInit();
     
     // The outermost counter counts the number of separated items
@@ -1215,6 +1240,17 @@ namespace mu
                 m_vRPN.AddVal( opt.GetVal() );
                 break;
 
+        case cmLOAD:
+                {
+                  // The loop variable of a sum or product, its value is 
+                  // not known while parsing.
+                  token_type tok;
+                  tok.SetVal(1);
+                  stVal.push(tok);
+                  m_vRPN.AddLoad(vLoop[opt.GetIdx()].Var);
+                }
+                break;
+
         case cmELSE:
                 m_nIfElseCounter--;
                 if (m_nIfElseCounter<0)
@@ -1231,8 +1267,12 @@ namespace mu
                   Error(ecUNEXPECTED_ARG_SEP, m_pTokenReader->GetPos());
 
                 ++stArgCount.top();
-                // Falls through.
-                // intentional (no break!)
+                ApplyRemainingOprt(stOpt, stVal);
+
+                // The bounds of a sum or product are complete, the body follows
+                if (vLoop.size() && vLoop.back().Depth==(int)stArgCount.size() && stArgCount.top()==3)
+                  vLoop.back().Var = m_vRPN.AddLoop(vLoop.back().Oprt);
+                break;
 
         case cmEND:
                 ApplyRemainingOprt(stOpt, stVal);
@@ -1266,15 +1306,39 @@ namespace mu
                     if (iArgCount>1 && ( stOpt.size()==0 || 
                                         (stOpt.top().GetCode()!=cmFUNC && 
                                          stOpt.top().GetCode()!=cmFUNC_BULK && 
-                                         stOpt.top().GetCode()!=cmFUNC_STR) ) )
+                                         stOpt.top().GetCode()!=cmFUNC_STR &&
+                                         stOpt.top().GetCode()!=cmLOOP) ) )
                       Error(ecUNEXPECTED_ARG, m_pTokenReader->GetPos());
                     
                     // The opening bracket was popped from the stack now check if there
                     // was a function before this bracket
-                    if (stOpt.size() && 
-                        stOpt.top().GetCode()!=cmOPRT_INFIX && 
-                        stOpt.top().GetCode()!=cmOPRT_BIN && 
-                        stOpt.top().GetFuncAddr()!=0)
+                    if (stOpt.size() && stOpt.top().GetCode()==cmLOOP)
+                    {
+                      // The bounds and the body of a sum or product
+                      token_type loopTok = stOpt.pop();
+                      if (iArgCount<3)
+                        Error(ecTOO_FEW_PARAMS, m_pTokenReader->GetPos()-1, loopTok.GetAsString());
+
+                      if (iArgCount>3)
+                        Error(ecTOO_MANY_PARAMS, m_pTokenReader->GetPos()-1, loopTok.GetAsString());
+
+                      for (int i=0; i<3; ++i)
+                      {
+                        if (stVal.pop().GetType()!=tpDBL)
+                          Error(ecVAL_EXPECTED, m_pTokenReader->GetPos()-1, loopTok.GetAsString());
+                      }
+
+                      m_vRPN.AddEndLoop(vLoop.back().Oprt);
+                      vLoop.pop_back();
+
+                      token_type tok;
+                      tok.SetVal(1);
+                      stVal.push(tok);
+                    }
+                    else if (stOpt.size() && 
+                             stOpt.top().GetCode()!=cmOPRT_INFIX && 
+                             stOpt.top().GetCode()!=cmOPRT_BIN && 
+                             stOpt.top().GetFuncAddr()!=0)
                     {
                       ApplyFunc(stOpt, stVal, iArgCount);
                     }
@@ -1356,6 +1420,20 @@ namespace mu
                 stOpt.push(opt);
                 break;
 
+        case cmLOOP:
+                {
+                  // The token includes the opening bracket of the arguments
+                  SLoop loop = { (int)stArgCount.size() + 1, (opt.GetAsString()==_T("prod")) ? cmMUL : cmADD, -1 };
+                  vLoop.push_back(loop);
+
+                  token_type tok;
+                  tok.Set(cmBO, _T("("));
+                  stArgCount.push(1);
+                  stOpt.push(opt);
+                  stOpt.push(tok);
+                }
+                break;
+
         case cmOPRT_INFIX:
         case cmFUNC:
         case cmFUNC_BULK:
@@ -1404,7 +1482,77 @@ namespace mu
     if (stVal.top().GetType()!=tpDBL)
       Error(ecSTR_RESULT);
 
-    m_vStackBuffer.resize(m_vRPN.GetMaxStackSize() * s_MaxNumOpenMPThreads);
+    if (m_pDiffVar)
+      CreateDiffRPN();
+
+    m_vStackBuffer.resize(m_vRPN.GetMaxStackSize());
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Create the bytecode and select the routine evaluating it.
+
+    After this #m_pParseFormula points to the fastest available evaluation 
+    routine: the machine code, the register code or the bytecode interpreter.
+  */
+  void ParserBase::CompileString() const
+  {
+#if defined(MUP_PROFILING)
+    ParserProfileTimer::clock_type::time_point start = ParserProfileTimer::clock_type::now();
+#endif
+
+    CreateRPN();
+    CompileByteCode();
+
+#if defined(MUP_PROFILING)
+    m_vProfile[0].nParse += 1;
+    m_vProfile[0].fParseTime += std::chrono::duration<double>(ParserProfileTimer::clock_type::now() - start).count();
+#endif
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Select the routine evaluating the bytecode.
+
+    Translates the bytecode to machine code or register code if enabled and 
+    points #m_pParseFormula to the result. Builds with MUP_PROFILING always 
+    use the instrumented interpreter. If sweep variables are set the 
+    subexpressions of the parameters are hoisted first and the routine 
+    evaluates the remaining bytecode, see SetSweepVars().
+  */
+  void ParserBase::CompileByteCode() const
+  {
+    HoistInvariants();
+
+#if defined(MUP_PROFILING)
+    // Only the interpreter and the array evaluation have counters
+    std::size_t nThreads = ParserThreadPool::Instance().GetNumThreads();
+    if (m_vProfile.size() < nThreads)
+      m_vProfile.resize(nThreads);
+
+    m_pParseFormula = &ParserBase::ParseCmdCode;
+#else
+    const ParserByteCode &code = (m_vHoisted.empty()) ? m_vRPN : m_vHoistedRPN;
+    if (m_bEnableJit && m_Jit.Compile(code))
+    {
+      m_pParseFormula = &ParserBase::ParseCmdCodeJit;
+    }
+    else if (m_bEnableRegCode && m_RegCode.Compile(code))
+    {
+      if (ParserBase::g_DbgDumpCmdCode)
+        m_RegCode.AsciiDump();
+
+      m_vRegFrame.resize(m_RegCode.GetFrameSize());
+      m_RegCode.InitFrame(&m_vRegFrame[0]);
+      m_pParseFormula = &ParserBase::ParseRegisterCode;
+    }
+    else
+      m_pParseFormula = &ParserBase::ParseCmdCode;
+#endif
+
+    if (m_vHoisted.size())
+    {
+      m_pParseHoisted = (m_pParseFormula==&ParserBase::ParseCmdCode) ? &ParserBase::ParseHoistedCmdCode : m_pParseFormula;
+      m_pParseFormula = &ParserBase::ParseHoisted;
+    }
   }
 
   //---------------------------------------------------------------------------
@@ -1420,8 +1568,7 @@ namespace mu
   {
     try
     {
-      CreateRPN();
-      m_pParseFormula = &ParserBase::ParseCmdCode;
+      CompileString();
       return (this->*m_pParseFormula)(); 
     }
     catch(ParserError &exc)
@@ -1431,6 +1578,33 @@ namespace mu
     }
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Check the expression for errors without evaluating it.
+      \param a_pError [out] The error found in the expression, pass NULL if it
+                       is not needed.
+      \return true if the expression is valid.
+
+    The bytecode is created if it does not exist yet, so the next evaluation 
+    of a valid expression won't parse the string again. Unlike the evaluation 
+    functions this does not throw on syntax errors.
+  */
+  bool ParserBase::Validate(ParserError *a_pError) const
+  {
+    try
+    {
+      if (m_pParseFormula==&ParserBase::ParseString)
+        CompileString();
+      return true;
+    }
+    catch(ParserError &exc)
+    {
+      exc.SetFormula(m_pTokenReader->GetExpr());
+      if (a_pError)
+        *a_pError = exc;
+      return false;
+    }
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Create an error containing the parse error position.
 
@@ -1467,10 +1641,9 @@ namespace mu
   */
   void ParserBase::RemoveVar(const string_type &a_strVarName)
   {
-    varmap_type::iterator item = m_VarDef.find(a_strVarName);
-    if (item!=m_VarDef.end())
+    if (m_VarDef.find(a_strVarName)!=m_VarDef.end())
     {
-      m_VarDef.erase(item);
+      m_VarDef.erase(a_strVarName);
       ReInit();
     }
   }
@@ -1544,6 +1717,52 @@ namespace mu
     ReInit();
   }
 
+  //------------------------------------------------------------------------------
+  /** \brief Enable or disable the compilation of the bytecode to machine code. 
+      \post Resets the parser to string parser mode.
+      \throw nothrow
+
+    If enabled the bytecode is translated into native code once the expression
+    has been parsed. This removes the dispatch cost of the interpreter for each 
+    token. Expressions the compiler can't handle (i.e. string or bulk functions)
+    as well as platforms other than x86-64 silently use the interpreter.
+  */
+  void ParserBase::EnableJit(bool a_bIsOn)
+  {
+    m_bEnableJit = a_bIsOn;
+    ReInit();
+  }
+
+  //------------------------------------------------------------------------------
+  /** \brief Enable or disable the evaluation of register code. 
+      \post Resets the parser to string parser mode.
+      \throw nothrow
+
+    If enabled the bytecode is translated into compact register code with fused
+    instructions once the expression has been parsed. The JIT takes precedence
+    if both are enabled. Expressions with string or bulk functions are always 
+    evaluated by the bytecode interpreter.
+  */
+  void ParserBase::EnableRegisterCode(bool a_bIsOn)
+  {
+    m_bEnableRegCode = a_bIsOn;
+    ReInit();
+  }
+
+  //------------------------------------------------------------------------------
+  /** \brief Enable or disable fast math functions in the array evaluation. 
+      \throw nothrow
+
+    If enabled EvalArray computes the functions with an array version in single
+    precision even if the values are doubles. The results of these functions are
+    then accurate to about 1e-7 relative to their value instead of the bounds 
+    documented in mu::vecmath. Scalar evaluation is not affected.
+  */
+  void ParserBase::EnableFastMath(bool a_bIsOn)
+  {
+    m_bFastMath = a_bIsOn;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Enable the dumping of bytecode and stack content on the console. 
       \param bDumpCmd Flag to enable dumping of the current bytecode to the console.
@@ -1728,56 +1947,36 @@ namespace mu
       throw ParserError(ecUNREASONABLE_NUMBER_OF_COMPUTATIONS);
     }
 */
-    CreateRPN();
-
-    int i = 0;
-
-#ifdef MUP_USE_OPENMP
-//#define DEBUG_OMP_STUFF
-    #ifdef DEBUG_OMP_STUFF
-    int *pThread = new int[nBulkSize];
-    int *pIdx = new int[nBulkSize];
-    #endif
+    if (m_pParseFormula==&ParserBase::ParseString)
+      CompileString();
 
-    int nMaxThreads = std::min(omp_get_max_threads(), s_MaxNumOpenMPThreads);
-	int nThreadID = 0, ct = 0;
-    omp_set_num_threads(nMaxThreads);
-
-    #pragma omp parallel for schedule(static, nBulkSize/nMaxThreads) private(nThreadID)
-    for (i=0; i<nBulkSize; ++i)
+    // Callbacks with side effects are not run in parallel, bulk functions 
+    // receive the thread id and are expected to cope with it.
+    bool bParallel = true;
+    for (const SToken *pTok = m_vRPN.GetBase(); pTok->Cmd!=cmEND; ++pTok)
     {
-      nThreadID = omp_get_thread_num();
-      results[i] = ParseCmdCodeBulk(i, nThreadID);
-
-      #ifdef DEBUG_OMP_STUFF
-      #pragma omp critical
-      {
-        pThread[ct] = nThreadID;  
-        pIdx[ct] = i; 
-        ct++;
-      }
-      #endif
+      if ((pTok->Cmd==cmFUNC && !pTok->Fun.opt) || pTok->Cmd==cmFUNC_STR)
+        bParallel = false;
     }
 
-#ifdef DEBUG_OMP_STUFF
-    FILE *pFile = fopen("bulk_dbg.txt", "w");
-    for (i=0; i<nBulkSize; ++i)
+    SBulkJob job = { this, results };
+    if (!bParallel)
     {
-      fprintf(pFile, "idx: %d  thread: %d \n", pIdx[i], pThread[i]);
+      BulkRange(&job, 0, nBulkSize, 0);
+      return;
     }
-    
-    delete [] pIdx;
-    delete [] pThread;
-
-    fclose(pFile);
-#endif
 
-#else
-    for (i=0; i<nBulkSize; ++i)
-    {
-      results[i] = ParseCmdCodeBulk(i, 0);
-    }
-#endif
+    ParserThreadPool &pool = ParserThreadPool::Instance();
+    m_vStackBuffer.resize(std::max(m_vStackBuffer.size(), m_vRPN.GetMaxStackSize() * pool.GetNumThreads()));
+    pool.Run(&ParserBase::BulkRange, &job, nBulkSize);
+  }
 
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate a range of a bulk job, called by the thread pool. */
+  void ParserBase::BulkRange(void *a_pJob, int a_iBegin, int a_iEnd, int a_iThread)
+  {
+    const SBulkJob &job = *static_cast<SBulkJob*>(a_pJob);
+    for (int i=a_iBegin; i<a_iEnd; ++i)
+      job.pResults[i] = job.pParser->ParseCmdCodeBulk(i, a_iThread);
   }
 } // namespace mu
@@ -27,10 +27,15 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <set>
 #include <string>
 #include <stack>
 #include <vector>
 #include <iostream>
+#include <limits>
+#include <unordered_map>
 
 #include "muParserDef.h"
 #include "muParserError.h"
@@ -41,6 +46,1183 @@
 
 namespace mu
 {
+  namespace
+  {
+    typedef std::vector<SToken> rpn_type;
+
+    //------------------------------------------------------------------------------
+    /** \brief Node of the expression graph built by ParserByteCode::Optimize(). */
+    struct SNode
+    {
+      SToken Tok;             ///< Token computing the node, the complete token for leaves
+      std::vector<int> Arg;   ///< Argument nodes, for cmIF the condition, then and else value
+      int  Scope;             ///< Conditional scope the node was created in
+      int  ThenScope;         ///< Scope of the then branch (cmIF only)
+      int  ElseScope;         ///< Scope of the else branch (cmIF only)
+      bool Pure;              ///< The node has no side effects and may be shared
+      int  Uses;              ///< Number of references to the node
+      int  Temp;              ///< Index of the temporary holding the node value or -1
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief Hash consed expression graph of a bytecode.
+
+      Identical pure subexpressions are mapped to the same node while the graph 
+      is built. A node created inside a branch of an if-then-else construct
+      is only shared by code of the same branch since the branch may not be 
+      evaluated at all. Conditional scopes are kept in a tree for this purpose.
+    */
+    class ExprGraph
+    {
+    public:
+
+      ExprGraph()
+        :m_vNode()
+        ,m_Bucket()
+        ,m_vScopeParent(1, -1)
+        ,m_iScope(0)
+        ,m_iTemps(0)
+        ,m_pDiffVar(NULL)
+        ,m_pRule(NULL)
+        ,m_pArg(NULL)
+        ,m_iNumArg(0)
+        ,m_Deriv()
+      {}
+
+      bool Build(const rpn_type &a_vRPN, 
+                 std::vector<int> &a_vRoot, 
+                 const std::vector<int> *a_pArgNode = NULL);
+      bool Emit(const std::vector<int> &a_vRoot, rpn_type &a_vRPN, int &a_iTemps);
+      void FindInvariants(const std::vector<int> &a_vRoot, 
+                          const std::set<const value_type*> &a_SweepVar, 
+                          std::vector<int> &a_vHoist) const;
+      void MakeVarLeaf(int a_iNode, value_type *a_pVar);
+
+      void SetDiffVar(value_type *a_pVar, 
+                      const ParserByteCode::rulemap_type &a_Rule, 
+                      const value_type *a_pArg, 
+                      int a_iNumArg);
+      int  Diff(int a_iNode);
+
+    private:
+
+      std::vector<SNode> m_vNode;
+      std::unordered_map<std::size_t, std::vector<int> > m_Bucket;
+      std::vector<int> m_vScopeParent;
+      int m_iScope;
+      int m_iTemps;
+
+      value_type *m_pDiffVar;                     ///< Variable of the derivatives created by Diff()
+      const ParserByteCode::rulemap_type *m_pRule; ///< Partial derivatives of the callbacks
+      const value_type *m_pArg;                   ///< Placeholders of the callback arguments in m_pRule
+      int m_iNumArg;                              ///< Number of placeholders
+      std::unordered_map<int, int> m_Deriv;       ///< Derivatives of the nodes already differentiated
+
+      static bool IsLeaf(ECmdCode a_iCode)
+      {
+        return a_iCode==cmVAL || a_iCode==cmVAR || a_iCode==cmVARPOW2 || 
+               a_iCode==cmVARPOW3 || a_iCode==cmVARPOW4 || a_iCode==cmVARMUL;
+      }
+
+      static bool IsCommutative(ECmdCode a_iCode)
+      {
+        return a_iCode==cmADD || a_iCode==cmMUL || a_iCode==cmEQ || 
+               a_iCode==cmNEQ || a_iCode==cmLAND || a_iCode==cmLOR;
+      }
+
+      bool IsVal(int a_iNode) const
+      {
+        return m_vNode[a_iNode].Tok.Cmd==cmVAL;
+      }
+
+      value_type GetVal(int a_iNode) const
+      {
+        return m_vNode[a_iNode].Tok.Val.data2;
+      }
+
+      int NewScope(int a_iParent)
+      {
+        m_vScopeParent.push_back(a_iParent);
+        return (int)m_vScopeParent.size()-1;
+      }
+
+      bool IsZero(int a_iNode) const
+      {
+        return IsVal(a_iNode) && GetVal(a_iNode)==0;
+      }
+
+      /** \brief Check if a node created in scope a_iScope may be used in scope a_iFrom. */
+      bool IsVisible(int a_iScope, int a_iFrom) const
+      {
+        for (int s=a_iFrom; s!=-1; s=m_vScopeParent[s])
+        {
+          if (s==a_iScope)
+            return true;
+        }
+        return false;
+      }
+
+      std::vector<int> SortedArgs(const SNode &a_Node) const;
+      std::size_t Hash(const SNode &a_Node) const;
+      bool Equal(const SNode &a_Node1, const SNode &a_Node2) const;
+      int  Insert(SNode &a_Node);
+
+      int  Leaf(const SToken &a_Tok);
+      int  Val(value_type a_fVal);
+      int  VarLeaf(ECmdCode a_iCode, value_type *a_pVar, value_type a_fMul);
+      int  Bin(ECmdCode a_iCode, int a_iArg1, int a_iArg2);
+      int  Power(int a_iBase, int a_iExp);
+      int  Op(const SToken &a_Tok, const std::vector<int> &a_vArg);
+      bool Fold(const SToken &a_Tok, const std::vector<int> &a_vArg, value_type &a_fRes) const;
+      int  Subst(const SToken &a_Tok, const std::vector<int> &a_vArgNode);
+
+      int  Plus(int a_iArg1, int a_iArg2);
+      int  Minus(int a_iArg1, int a_iArg2);
+      int  Times(int a_iArg1, int a_iArg2);
+      int  Quot(int a_iArg1, int a_iArg2);
+      int  DiffNode(int a_iNode);
+      int  DiffFun(int a_iNode);
+      int  Partial(int a_iNode, int a_iArg);
+
+      bool IsVariant(int a_iNode, 
+                     const std::set<const value_type*> &a_SweepVar, 
+                     std::vector<int> &a_vVariant) const;
+      void CountUses(int a_iNode, std::vector<bool> &a_vVisited);
+      bool EmitNode(int a_iNode, int a_iScope, rpn_type &a_vRPN);
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief Apply a built in binary operator the same way the bytecode interpreter does. */
+    value_type ApplyBinOp(ECmdCode a_iCode, value_type x, value_type y)
+    {
+      switch(a_iCode)
+      {
+      case cmLE:   return x <= y;
+      case cmGE:   return x >= y;
+      case cmNEQ:  return x != y;
+      case cmEQ:   return x == y;
+      case cmLT:   return x < y;
+      case cmGT:   return x > y;
+      case cmADD:  return x + y;
+      case cmSUB:  return x - y;
+      case cmMUL:  return x * y;
+      case cmDIV:  return x / y;
+      case cmPOW:  return MathImpl<value_type>::Pow(x, y);
+      case cmLAND: return x && y;
+      case cmLOR:  return x || y;
+      default:     return 0;
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    void HashBytes(std::size_t &a_iHash, const void *a_pData, std::size_t a_iSize)
+    {
+      const unsigned char *p = (const unsigned char*)a_pData;
+      for (std::size_t i=0; i<a_iSize; ++i)
+        a_iHash = (a_iHash ^ p[i]) * 1099511628211ULL;
+    }
+
+    //------------------------------------------------------------------------------
+    std::vector<int> ExprGraph::SortedArgs(const SNode &a_Node) const
+    {
+      std::vector<int> vArg(a_Node.Arg);
+      if (IsCommutative(a_Node.Tok.Cmd))
+        std::sort(vArg.begin(), vArg.end());
+
+      return vArg;
+    }
+
+    //------------------------------------------------------------------------------
+    std::size_t ExprGraph::Hash(const SNode &a_Node) const
+    {
+      std::size_t h = 14695981039346656037ULL;
+      const SToken &tok = a_Node.Tok;
+      HashBytes(h, &tok.Cmd, sizeof(tok.Cmd));
+
+      if (IsLeaf(tok.Cmd))
+      {
+        HashBytes(h, &tok.Val.ptr, sizeof(tok.Val.ptr));
+        HashBytes(h, &tok.Val.data, sizeof(tok.Val.data));
+        HashBytes(h, &tok.Val.data2, sizeof(tok.Val.data2));
+      }
+      else if (tok.Cmd==cmFUNC)
+      {
+        HashBytes(h, &tok.Fun.ptr, sizeof(tok.Fun.ptr));
+        HashBytes(h, &tok.Fun.argc, sizeof(tok.Fun.argc));
+      }
+
+      std::vector<int> vArg = SortedArgs(a_Node);
+      if (vArg.size())
+        HashBytes(h, &vArg[0], vArg.size()*sizeof(int));
+
+      return h;
+    }
+
+    //------------------------------------------------------------------------------
+    bool ExprGraph::Equal(const SNode &a_Node1, const SNode &a_Node2) const
+    {
+      const SToken &t1 = a_Node1.Tok,
+                   &t2 = a_Node2.Tok;
+      if (t1.Cmd!=t2.Cmd)
+        return false;
+
+      // Values are compared bitwise in order to distinguish 0 and -0
+      if (IsLeaf(t1.Cmd))
+        return t1.Val.ptr==t2.Val.ptr &&
+               memcmp(&t1.Val.data, &t2.Val.data, sizeof(value_type))==0 &&
+               memcmp(&t1.Val.data2, &t2.Val.data2, sizeof(value_type))==0;
+
+      if (t1.Cmd==cmFUNC && (t1.Fun.ptr!=t2.Fun.ptr || t1.Fun.argc!=t2.Fun.argc))
+        return false;
+
+      return SortedArgs(a_Node1)==SortedArgs(a_Node2);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Add a node to the graph or return an equivalent node visible in the current scope. */
+    int ExprGraph::Insert(SNode &a_Node)
+    {
+      // Leaves are never stored in temporaries so they may be used in any scope
+      a_Node.Scope = (IsLeaf(a_Node.Tok.Cmd)) ? 0 : m_iScope;
+      a_Node.Uses = 0;
+      a_Node.Temp = -1;
+
+      if (a_Node.Pure)
+      {
+        std::vector<int> &vBucket = m_Bucket[Hash(a_Node)];
+        for (std::size_t i=0; i<vBucket.size(); ++i)
+        {
+          const SNode &node = m_vNode[vBucket[i]];
+          if (IsVisible(node.Scope, m_iScope) && Equal(node, a_Node))
+            return vBucket[i];
+        }
+        vBucket.push_back((int)m_vNode.size());
+      }
+
+      m_vNode.push_back(a_Node);
+      return (int)m_vNode.size()-1;
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Leaf(const SToken &a_Tok)
+    {
+      SNode node;
+      node.Tok = a_Tok;
+      node.ThenScope = node.ElseScope = -1;
+      node.Pure = true;
+      return Insert(node);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Val(value_type a_fVal)
+    {
+      SToken tok = SToken();
+      tok.Cmd = cmVAL;
+      tok.Val.ptr   = NULL;
+      tok.Val.data  = 0;
+      tok.Val.data2 = a_fVal;
+      return Leaf(tok);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::VarLeaf(ECmdCode a_iCode, value_type *a_pVar, value_type a_fMul)
+    {
+      SToken tok = SToken();
+      tok.Cmd = a_iCode;
+      tok.Val.ptr   = a_pVar;
+      tok.Val.data  = a_fMul;
+      tok.Val.data2 = 0;
+      return Leaf(tok);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Bin(ECmdCode a_iCode, int a_iArg1, int a_iArg2)
+    {
+      SToken tok = SToken();
+      tok.Cmd = a_iCode;
+      std::vector<int> vArg(2);
+      vArg[0] = a_iArg1;
+      vArg[1] = a_iArg2;
+      return Op(tok, vArg);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create a chain of multiplications computing a_iBase^a_iExp (a_iExp>0). */
+    int ExprGraph::Power(int a_iBase, int a_iExp)
+    {
+      if (a_iExp==1)
+        return a_iBase;
+
+      const SToken &base = m_vNode[a_iBase].Tok;
+      if (base.Cmd==cmVAR && a_iExp<=4)
+      {
+        static const ECmdCode code[] = { cmVARPOW2, cmVARPOW3, cmVARPOW4 };
+        return VarLeaf(code[a_iExp-2], base.Val.ptr, 1);
+      }
+
+      int iHalf = Power(a_iBase, a_iExp/2);
+      int iRes = Bin(cmMUL, iHalf, iHalf);
+      return (a_iExp & 1) ? Bin(cmMUL, iRes, a_iBase) : iRes;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Evaluate a token with constant arguments at compile time. 
+        \return true if the token could be evaluated.
+    */
+    bool ExprGraph::Fold(const SToken &a_Tok, const std::vector<int> &a_vArg, value_type &a_fRes) const
+    {
+      value_type v[4];
+      for (std::size_t i=0; i<a_vArg.size() && i<4; ++i)
+        v[i] = GetVal(a_vArg[i]);
+
+      if (a_Tok.Cmd<=cmLOR)
+      {
+#if defined(MUP_MATH_EXCEPTIONS)
+        if (a_Tok.Cmd==cmDIV && v[1]==0)
+          return false;
+#endif
+        a_fRes = ApplyBinOp(a_Tok.Cmd, v[0], v[1]);
+        return true;
+      }
+
+      switch(a_Tok.Fun.argc)
+      {
+      case 0: a_fRes = (*(fun_type0)a_Tok.Fun.ptr)(); return true;
+      case 1: a_fRes = (*(fun_type1)a_Tok.Fun.ptr)(v[0]); return true;
+      case 2: a_fRes = (*(fun_type2)a_Tok.Fun.ptr)(v[0], v[1]); return true;
+      case 3: a_fRes = (*(fun_type3)a_Tok.Fun.ptr)(v[0], v[1], v[2]); return true;
+      case 4: a_fRes = (*(fun_type4)a_Tok.Fun.ptr)(v[0], v[1], v[2], v[3]); return true;
+      default:
+        if (a_Tok.Fun.argc>0)
+          return false;
+
+        // function with variable arguments
+        {
+          std::vector<value_type> vArg(a_vArg.size());
+          for (std::size_t i=0; i<a_vArg.size(); ++i)
+            vArg[i] = GetVal(a_vArg[i]);
+
+          a_fRes = (*(multfun_type)a_Tok.Fun.ptr)(&vArg[0], (int)vArg.size());
+          return true;
+        }
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create an operator or function node applying algebraic simplifications. */
+    int ExprGraph::Op(const SToken &a_Tok, const std::vector<int> &a_vArg)
+    {
+      ECmdCode iCode = a_Tok.Cmd;
+      bool bPure = iCode!=cmFUNC_STR && iCode!=cmFUNC_BULK && (iCode!=cmFUNC || a_Tok.Fun.opt),
+           bConst = true;
+      for (std::size_t i=0; i<a_vArg.size(); ++i)
+      {
+        bPure &= m_vNode[a_vArg[i]].Pure;
+        bConst &= IsVal(a_vArg[i]);
+      }
+
+      value_type fRes;
+      if (bPure && bConst && (iCode<=cmLOR || iCode==cmFUNC) && Fold(a_Tok, a_vArg, fRes))
+        return Val(fRes);
+
+      if (iCode<=cmLOR)
+      {
+        int a = a_vArg[0],
+            b = a_vArg[1];
+        const SToken &ta = m_vNode[a].Tok,
+                     &tb = m_vNode[b].Tok;
+
+        switch(iCode)
+        {
+        case cmPOW:
+              // Small integer exponents: x^n -> x*x*...*x 
+              if (IsVal(b) && std::abs(GetVal(b))<=16 && GetVal(b)==(int)GetVal(b))
+              {
+                int n = (int)GetVal(b);
+                if (n==0 && m_vNode[a].Pure)
+                  return Val(1);
+                else if (n>0)
+                  return Power(a, n);
+#if !defined(MUP_MATH_EXCEPTIONS)
+                else if (n<0)
+                  return Bin(cmDIV, Val(1), Power(a, -n));
+#endif
+              }
+              break;
+
+        case cmMUL:
+              if (IsVal(b) && GetVal(b)==1)
+                return a;
+              if (IsVal(a) && GetVal(a)==1)
+                return b;
+              if (ta.Cmd==cmVAR && tb.Cmd==cmVAR && ta.Val.ptr==tb.Val.ptr)
+                return VarLeaf(cmVARPOW2, ta.Val.ptr, 1);
+              if (ta.Cmd==cmVAR && tb.Cmd==cmVAL)
+                return VarLeaf(cmVARMUL, ta.Val.ptr, tb.Val.data2);
+              if (ta.Cmd==cmVAL && tb.Cmd==cmVAR)
+                return VarLeaf(cmVARMUL, tb.Val.ptr, ta.Val.data2);
+              break;
+
+        case cmDIV:
+              // x/c -> x*(1/c)
+              if (IsVal(b))
+              {
+                value_type c = GetVal(b),
+                           r = 1/c;
+                if (c!=0 && std::isfinite(c) &&
+                    r!=0 && std::isfinite(r))
+                  return Bin(cmMUL, a, Val(r));
+              }
+              break;
+
+        case cmSUB:
+              if (IsVal(b) && GetVal(b)==0 && !std::signbit(GetVal(b)))
+                return a;
+              break;
+
+        default:
+              break;
+        }
+      }
+
+      SNode node;
+      node.Tok = a_Tok;
+      node.Arg = a_vArg;
+      node.ThenScope = node.ElseScope = -1;
+      node.Pure = bPure;
+      return Insert(node);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Build the graph from the bytecode. 
+        \param a_vRoot [out] The nodes computing the final results.
+        \param a_pArgNode Nodes replacing the placeholder variables of a derivative 
+                          rule or NULL, see SetDiffVar()
+        \return false if the bytecode contains tokens that can't be optimized.
+    */
+    bool ExprGraph::Build(const rpn_type &a_vRPN, 
+                          std::vector<int> &a_vRoot, 
+                          const std::vector<int> *a_pArgNode)
+    {
+      struct SIfFrame
+      {
+        int Cond;
+        int Then;
+        int Parent;
+        int ThenScope;
+        int ElseScope;
+        int Depth;
+        int Const;    ///< -1 for a non constant condition, 1 if the then branch is taken, 0 otherwise
+        bool Else;
+      };
+
+      std::vector<int> &stVal = a_vRoot;
+      std::vector<SIfFrame> stIf;
+      std::unordered_map<int, int> mapTemp;
+
+      for (std::size_t i=0; i<a_vRPN.size() && a_vRPN[i].Cmd!=cmEND; ++i)
+      {
+        const SToken &tok = a_vRPN[i];
+        int iArgc = 0;
+
+        switch(tok.Cmd)
+        {
+        case cmVAL:
+        case cmVAR:
+        case cmVARPOW2:
+        case cmVARPOW3:
+        case cmVARPOW4:
+        case cmVARMUL:
+              {
+                int iLeaf = (a_pArgNode) ? Subst(tok, *a_pArgNode) : Leaf(tok);
+                if (iLeaf<0)
+                  return false;
+
+                stVal.push_back(iLeaf);
+              }
+              continue;
+
+        case cmSTORE:
+              if (stVal.empty())
+                return false;
+
+              mapTemp[tok.Oprt.offset] = stVal.back();
+              continue;
+
+        case cmLOAD:
+              if (mapTemp.find(tok.Oprt.offset)==mapTemp.end())
+                return false;
+
+              stVal.push_back(mapTemp[tok.Oprt.offset]);
+              continue;
+
+        case cmIF:
+              {
+                if (stVal.empty())
+                  return false;
+
+                SIfFrame frame;
+                frame.Cond = stVal.back();
+                stVal.pop_back();
+                frame.Then = -1;
+                frame.Parent = m_iScope;
+                frame.Depth = (int)stVal.size();
+                frame.Else = false;
+                frame.Const = (IsVal(frame.Cond)) ? (GetVal(frame.Cond)!=0 || std::isnan(GetVal(frame.Cond))) : -1;
+
+                // A branch that is always taken stays in the current scope, 
+                // everything else gets a new one
+                frame.ThenScope = (frame.Const==1) ? m_iScope : NewScope(m_iScope);
+                frame.ElseScope = (frame.Const==0) ? m_iScope : NewScope(m_iScope);
+                m_iScope = frame.ThenScope;
+                stIf.push_back(frame);
+              }
+              continue;
+
+        case cmELSE:
+              if (stIf.empty() || stIf.back().Else || (int)stVal.size()!=stIf.back().Depth+1)
+                return false;
+
+              stIf.back().Then = stVal.back();
+              stIf.back().Else = true;
+              stVal.pop_back();
+              m_iScope = stIf.back().ElseScope;
+              continue;
+
+        case cmENDIF:
+              {
+                if (stIf.empty() || !stIf.back().Else || (int)stVal.size()!=stIf.back().Depth+1)
+                  return false;
+
+                SIfFrame frame = stIf.back();
+                stIf.pop_back();
+                m_iScope = frame.Parent;
+
+                int iElse = stVal.back();
+                stVal.pop_back();
+                if (frame.Const!=-1)
+                {
+                  // Constant condition: drop the dead branch
+                  stVal.push_back((frame.Const) ? frame.Then : iElse);
+                  continue;
+                }
+
+                SNode node;
+                node.Tok = tok;
+                node.Tok.Cmd = cmIF;
+                node.Arg.push_back(frame.Cond);
+                node.Arg.push_back(frame.Then);
+                node.Arg.push_back(iElse);
+                node.ThenScope = frame.ThenScope;
+                node.ElseScope = frame.ElseScope;
+                node.Pure = m_vNode[frame.Cond].Pure && m_vNode[frame.Then].Pure && m_vNode[iElse].Pure;
+                stVal.push_back(Insert(node));
+              }
+              continue;
+
+        case cmFUNC:
+              iArgc = (tok.Fun.argc>=0) ? tok.Fun.argc : -tok.Fun.argc;
+              break;
+
+        case cmFUNC_STR:
+        case cmFUNC_BULK:
+              iArgc = tok.Fun.argc;
+              break;
+
+        default:
+              if (tok.Cmd>cmLOR)
+                return false;
+
+              iArgc = 2;
+              break;
+        }
+
+        if ((int)stVal.size()<iArgc)
+          return false;
+
+        std::vector<int> vArg(stVal.end()-iArgc, stVal.end());
+        stVal.resize(stVal.size()-iArgc);
+        stVal.push_back(Op(tok, vArg));
+      }
+
+      return stIf.empty() && stVal.size()>0;
+    }
+
+    //------------------------------------------------------------------------------
+    void ExprGraph::CountUses(int a_iNode, std::vector<bool> &a_vVisited)
+    {
+      std::vector<int> stNode(1, a_iNode);
+      while (stNode.size())
+      {
+        int iNode = stNode.back();
+        stNode.pop_back();
+
+        ++m_vNode[iNode].Uses;
+        if (a_vVisited[iNode])
+          continue;
+
+        a_vVisited[iNode] = true;
+        const std::vector<int> &vArg = m_vNode[iNode].Arg;
+        stNode.insert(stNode.end(), vArg.begin(), vArg.end());
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Write the bytecode of a node. 
+    
+      Shared nodes are computed once and stored in a temporary with cmSTORE,
+      further uses read the temporary with cmLOAD. The temporary must be written
+      in the scope the node was created in, otherwise it could be read in a 
+      branch where it was never computed. If-then-else nodes differentiated by 
+      Diff() share the scopes of the original node, this is safe since both
+      read the same condition.
+    */
+    bool ExprGraph::EmitNode(int a_iNode, int a_iScope, rpn_type &a_vRPN)
+    {
+      // The graph is walked with an explicit stack, a recursion would overflow 
+      // the call stack for deep expression trees. Step i of a node writes its 
+      // i-th argument, the last step writes the node itself.
+      struct SStep
+      {
+        int  Node;
+        int  Scope;
+        int  Arg;
+        bool Temp;
+      };
+
+      std::vector<SStep> stStep;
+      SStep step = { a_iNode, a_iScope, 0, false };
+      stStep.push_back(step);
+
+      while (stStep.size())
+      {
+        SStep &top = stStep.back();
+        SNode &node = m_vNode[top.Node];
+
+        if (top.Arg==0)
+        {
+          bool bTemp = node.Uses>1 && !IsLeaf(node.Tok.Cmd);
+          if (bTemp && node.Temp>=0 && IsVisible(node.Scope, top.Scope))
+          {
+            SToken tok = SToken();
+            tok.Cmd = cmLOAD;
+            tok.Oprt.ptr = NULL;
+            tok.Oprt.offset = node.Temp;
+            a_vRPN.push_back(tok);
+            stStep.pop_back();
+            continue;
+          }
+
+          // A node first needed in an inner scope is computed there without being stored
+          top.Temp = bTemp && node.Temp<0 && node.Scope==top.Scope;
+        }
+
+        if (top.Arg<(int)node.Arg.size())
+        {
+          // The condition of an if-then-else is followed by the two branches
+          step.Scope = top.Scope;
+          if (node.Tok.Cmd==cmIF && top.Arg>0)
+          {
+            SToken tok = SToken();
+            tok.Cmd = (top.Arg==1) ? cmIF : cmELSE;
+            a_vRPN.push_back(tok);
+            step.Scope = (top.Arg==1) ? node.ThenScope : node.ElseScope;
+          }
+
+          step.Node = node.Arg[top.Arg++];
+          stStep.push_back(step);
+          continue;
+        }
+
+        if (node.Tok.Cmd==cmIF)
+        {
+          SToken tok = SToken();
+          tok.Cmd = cmENDIF;
+          a_vRPN.push_back(tok);
+        }
+        else
+          a_vRPN.push_back(node.Tok);
+
+        if (top.Temp)
+        {
+          SToken tok = SToken();
+          node.Temp = m_iTemps++;
+          tok.Cmd = cmSTORE;
+          tok.Oprt.ptr = NULL;
+          tok.Oprt.offset = node.Temp;
+          a_vRPN.push_back(tok);
+        }
+
+        stStep.pop_back();
+      }
+
+      return true;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Write the bytecode of the graph.
+        \param a_iTemps [out] Number of temporaries used by cmSTORE and cmLOAD
+    */
+    bool ExprGraph::Emit(const std::vector<int> &a_vRoot, rpn_type &a_vRPN, int &a_iTemps)
+    {
+      // The graph may be emitted more than once, see ParserByteCode::Hoist()
+      for (std::size_t i=0; i<m_vNode.size(); ++i)
+      {
+        m_vNode[i].Uses = 0;
+        m_vNode[i].Temp = -1;
+      }
+      m_iTemps = 0;
+
+      std::vector<bool> vVisited(m_vNode.size(), false);
+      for (std::size_t i=0; i<a_vRoot.size(); ++i)
+        CountUses(a_vRoot[i], vVisited);
+
+      for (std::size_t i=0; i<a_vRoot.size(); ++i)
+      {
+        if (!EmitNode(a_vRoot[i], 0, a_vRPN))
+          return false;
+      }
+
+      a_iTemps = m_iTemps;
+      return true;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Check if the value of a node changes with the sweep variables.
+        \param a_vVariant Cache of the results, -1 for nodes not checked yet
+    
+      Nodes with side effects are treated as variant since they must run for
+      every evaluation.
+    */
+    bool ExprGraph::IsVariant(int a_iNode, 
+                              const std::set<const value_type*> &a_SweepVar, 
+                              std::vector<int> &a_vVariant) const
+    {
+      // A node is checked once all of its arguments have been checked
+      std::vector<int> stNode(1, a_iNode);
+      while (stNode.size())
+      {
+        int iNode = stNode.back();
+        if (a_vVariant[iNode]!=-1)
+        {
+          stNode.pop_back();
+          continue;
+        }
+
+        const SNode &node = m_vNode[iNode];
+        bool bReady = true;
+        for (std::size_t i=0; i<node.Arg.size(); ++i)
+        {
+          if (a_vVariant[node.Arg[i]]==-1)
+          {
+            stNode.push_back(node.Arg[i]);
+            bReady = false;
+          }
+        }
+
+        if (!bReady)
+          continue;
+
+        bool bVariant = !node.Pure;
+        if (IsLeaf(node.Tok.Cmd))
+          bVariant = node.Tok.Cmd!=cmVAL && a_SweepVar.count(node.Tok.Val.ptr)!=0;
+
+        for (std::size_t i=0; i<node.Arg.size(); ++i)
+          bVariant |= a_vVariant[node.Arg[i]]!=0;
+
+        a_vVariant[iNode] = bVariant;
+        stNode.pop_back();
+      }
+
+      return a_vVariant[a_iNode]!=0;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Find the largest subexpressions that don't depend on the sweep variables.
+        \param a_vRoot The nodes computing the final results.
+        \param a_SweepVar The variables varying from one evaluation to the next.
+        \param a_vHoist [out] The invariant nodes, leaves are not included since 
+                        reading them is as cheap as reading a hoisted value.
+    */
+    void ExprGraph::FindInvariants(const std::vector<int> &a_vRoot, 
+                                   const std::set<const value_type*> &a_SweepVar, 
+                                   std::vector<int> &a_vHoist) const
+    {
+      std::vector<int> vVariant(m_vNode.size(), -1);
+      std::vector<bool> vVisited(m_vNode.size(), false);
+      std::vector<int> stNode(a_vRoot.rbegin(), a_vRoot.rend());
+      while (stNode.size())
+      {
+        int iNode = stNode.back();
+        stNode.pop_back();
+        if (vVisited[iNode])
+          continue;
+
+        vVisited[iNode] = true;
+        const SNode &node = m_vNode[iNode];
+        if (IsLeaf(node.Tok.Cmd))
+          continue;
+
+#if defined(MUP_MATH_EXCEPTIONS)
+        // The prologue computes its values unconditionally, this must not 
+        // raise errors of branches that are never taken.
+        bool bHoist = node.Scope==0 && !IsVariant(iNode, a_SweepVar, vVariant);
+#else
+        bool bHoist = !IsVariant(iNode, a_SweepVar, vVariant);
+#endif
+        if (bHoist)
+        {
+          a_vHoist.push_back(iNode);
+          continue;
+        }
+
+        for (std::size_t i=node.Arg.size(); i>0; --i)
+          stNode.push_back(node.Arg[i-1]);
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Turn a node into a leaf reading a variable. */
+    void ExprGraph::MakeVarLeaf(int a_iNode, value_type *a_pVar)
+    {
+      SNode &node = m_vNode[a_iNode];
+      node.Tok.Cmd = cmVAR;
+      node.Tok.Val.ptr   = a_pVar;
+      node.Tok.Val.data  = 1;
+      node.Tok.Val.data2 = 0;
+      node.Arg.clear();
+      node.ThenScope = node.ElseScope = -1;
+      node.Scope = 0;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Prepare the graph for Diff().
+        \param a_pVar The variable of the derivatives
+        \param a_Rule Bytecode of the partial derivatives of callbacks. The results
+                      of a rule are the partial derivatives with respect to each 
+                      argument, written in terms of placeholder variables.
+        \param a_pArg Array of the placeholder variables of the rules
+        \param a_iNumArg Number of placeholder variables
+    */
+    void ExprGraph::SetDiffVar(value_type *a_pVar, 
+                               const ParserByteCode::rulemap_type &a_Rule, 
+                               const value_type *a_pArg, 
+                               int a_iNumArg)
+    {
+      m_pDiffVar = a_pVar;
+      m_pRule = &a_Rule;
+      m_pArg = a_pArg;
+      m_iNumArg = a_iNumArg;
+      m_Deriv.clear();
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create the node of a placeholder variable of a derivative rule. 
+        \return The node or -1 if the token refers to an unknown variable.
+    */
+    int ExprGraph::Subst(const SToken &a_Tok, const std::vector<int> &a_vArgNode)
+    {
+      if (a_Tok.Cmd==cmVAL)
+        return Leaf(a_Tok);
+
+      int iArg = -1;
+      for (int i=0; i<m_iNumArg && i<(int)a_vArgNode.size(); ++i)
+      {
+        if (a_Tok.Val.ptr==m_pArg+i)
+          iArg = a_vArgNode[i];
+      }
+
+      if (iArg<0)
+        return -1;
+
+      switch(a_Tok.Cmd)
+      {
+      case cmVAR:     return iArg;
+      case cmVARPOW2: return Power(iArg, 2);
+      case cmVARPOW3: return Power(iArg, 3);
+      case cmVARPOW4: return Power(iArg, 4);
+      case cmVARMUL:  return Plus(Times(iArg, Val(a_Tok.Val.data)), Val(a_Tok.Val.data2));
+      default:        return -1;
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create a sum, x+0 and 0+x are replaced by x. 
+    
+      Plus(), Minus(), Times() and Quot() are used for building derivatives. Unlike 
+      Op() they treat zero as an exact symbolic value, 0*x is replaced by 0 even 
+      though it is NaN for an infinite x.
+    */
+    int ExprGraph::Plus(int a_iArg1, int a_iArg2)
+    {
+      if (IsZero(a_iArg1))
+        return a_iArg2;
+      if (IsZero(a_iArg2))
+        return a_iArg1;
+      return Bin(cmADD, a_iArg1, a_iArg2);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Minus(int a_iArg1, int a_iArg2)
+    {
+      if (IsZero(a_iArg2))
+        return a_iArg1;
+      if (IsZero(a_iArg1))
+        return Times(Val(-1), a_iArg2);
+      return Bin(cmSUB, a_iArg1, a_iArg2);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Times(int a_iArg1, int a_iArg2)
+    {
+      if (IsZero(a_iArg1) || IsZero(a_iArg2))
+        return Val(0);
+      return Bin(cmMUL, a_iArg1, a_iArg2);
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::Quot(int a_iArg1, int a_iArg2)
+    {
+      if (IsZero(a_iArg1))
+        return Val(0);
+      return Bin(cmDIV, a_iArg1, a_iArg2);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create the derivative of a node with respect to the variable set by SetDiffVar(). 
+    
+      The derivative only depends on the node and its arguments, it is created in
+      the scope of the node so that it can be shared by every user of the node.
+    */
+    int ExprGraph::Diff(int a_iNode)
+    {
+      std::unordered_map<int, int>::const_iterator it = m_Deriv.find(a_iNode);
+      if (it!=m_Deriv.end())
+        return it->second;
+
+      // The arguments are differentiated first using an explicit stack so that
+      // DiffNode() finds their derivatives in m_Deriv instead of recursing.
+      std::vector<int> stNode(1, a_iNode);
+      while (stNode.size())
+      {
+        int iNode = stNode.back();
+        if (m_Deriv.count(iNode))
+        {
+          stNode.pop_back();
+          continue;
+        }
+
+        const SNode &node = m_vNode[iNode];
+        std::size_t iFirst = node.Arg.size();
+        switch(node.Tok.Cmd)
+        {
+        case cmADD:
+        case cmSUB:
+        case cmMUL:
+        case cmDIV:
+        case cmPOW:
+        case cmFUNC:
+        case cmFUNC_STR:
+        case cmFUNC_BULK: iFirst = 0; break;
+        case cmIF:        iFirst = 1; break;  // the condition is not differentiated
+        default:          break;
+        }
+
+        bool bReady = true;
+        for (std::size_t i=iFirst; i<node.Arg.size(); ++i)
+        {
+          if (!m_Deriv.count(node.Arg[i]))
+          {
+            stNode.push_back(node.Arg[i]);
+            bReady = false;
+          }
+        }
+
+        if (!bReady)
+          continue;
+
+        int iScope = m_iScope;
+        m_iScope = node.Scope;
+        int iRes = DiffNode(iNode);
+        m_iScope = iScope;
+
+        m_Deriv[iNode] = iRes;
+        stNode.pop_back();
+      }
+
+      return m_Deriv[a_iNode];
+    }
+
+    //------------------------------------------------------------------------------
+    int ExprGraph::DiffNode(int a_iNode)
+    {
+      // Copy the node, the node vector grows while the derivative is built
+      const SNode node = m_vNode[a_iNode];
+      const SToken &tok = node.Tok;
+
+      switch(tok.Cmd)
+      {
+      case cmVAL:
+            return Val(0);
+
+      case cmVAR:
+            return Val((tok.Val.ptr==m_pDiffVar) ? 1 : 0);
+
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+            {
+              if (tok.Val.ptr!=m_pDiffVar)
+                return Val(0);
+
+              int n = (tok.Cmd==cmVARPOW2) ? 2 : (tok.Cmd==cmVARPOW3) ? 3 : 4;
+              return Times(Val(n), Power(VarLeaf(cmVAR, tok.Val.ptr, 1), n-1));
+            }
+
+      case cmVARMUL:
+            return Val((tok.Val.ptr==m_pDiffVar) ? tok.Val.data : 0);
+
+      case cmADD:
+            return Plus(Diff(node.Arg[0]), Diff(node.Arg[1]));
+
+      case cmSUB:
+            return Minus(Diff(node.Arg[0]), Diff(node.Arg[1]));
+
+      case cmMUL:
+            {
+              int a = node.Arg[0],
+                  b = node.Arg[1];
+              return Plus(Times(Diff(a), b), Times(a, Diff(b)));
+            }
+
+      case cmDIV:
+            {
+              // (a/b)' = (a' - (a/b)*b')/b
+              int a = node.Arg[0],
+                  b = node.Arg[1];
+              return Quot(Minus(Diff(a), Times(a_iNode, Diff(b))), b);
+            }
+
+      case cmPOW:
+            {
+              int a  = node.Arg[0],
+                  b  = node.Arg[1],
+                  da = Diff(a),
+                  db = Diff(b),
+                  iRes = Val(0);
+
+              // d(a^b)/da = b*a^(b-1)
+              if (!IsZero(da))
+              {
+                int iExp = (IsVal(b)) ? Val(GetVal(b)-1) : Minus(b, Val(1));
+                iRes = Times(Times(b, Bin(cmPOW, a, iExp)), da);
+              }
+
+              // d(a^b)/db = a^b*ln(a), the logarithm is only known for a constant base
+              if (!IsZero(db))
+              {
+                int iPartial = (IsVal(a)) ? Times(a_iNode, Val(std::log(GetVal(a)))) : Partial(a_iNode, 1);
+                iRes = Plus(iRes, Times(iPartial, db));
+              }
+
+              return iRes;
+            }
+
+      case cmIF:
+            {
+              int dt = Diff(node.Arg[1]),
+                  de = Diff(node.Arg[2]);
+              if (IsZero(dt) && IsZero(de))
+                return Val(0);
+
+              SNode res;
+              res.Tok = tok;
+              res.Arg.push_back(node.Arg[0]);
+              res.Arg.push_back(dt);
+              res.Arg.push_back(de);
+              res.ThenScope = node.ThenScope;
+              res.ElseScope = node.ElseScope;
+              res.Pure = m_vNode[node.Arg[0]].Pure && m_vNode[dt].Pure && m_vNode[de].Pure;
+              return Insert(res);
+            }
+
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            return DiffFun(a_iNode);
+
+      default:
+            // Comparison and logical operators are piecewise constant
+            return Val(0);
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Differentiate a function node with the chain rule. 
+    
+      The partial derivatives come from the rule of the callback if there is one, 
+      otherwise they are approximated by central differences.
+    */
+    int ExprGraph::DiffFun(int a_iNode)
+    {
+      const SNode node = m_vNode[a_iNode];
+      std::size_t iArgc = node.Arg.size();
+
+      std::vector<int> vPartial;
+      if (node.Tok.Cmd==cmFUNC && m_pRule)
+      {
+        ParserByteCode::rulemap_type::const_iterator it = m_pRule->find(node.Tok.Fun.ptr);
+        if (it!=m_pRule->end())
+        {
+          rpn_type vRule(it->second.GetBase(), it->second.GetBase() + it->second.GetSize());
+          int iScope = m_iScope;
+          if (!Build(vRule, vPartial, &node.Arg) || vPartial.size()!=iArgc)
+            vPartial.clear();
+          m_iScope = iScope;
+        }
+      }
+
+      int iRes = Val(0);
+      for (std::size_t i=0; i<iArgc; ++i)
+      {
+        int d = Diff(node.Arg[i]);
+        if (IsZero(d))
+          continue;
+
+        int p = (vPartial.size()) ? vPartial[i] : Partial(a_iNode, (int)i);
+        iRes = Plus(iRes, Times(p, d));
+      }
+
+      return iRes;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Create a central difference approximating the partial derivative of 
+               a node with respect to one of its arguments. 
+    */
+    int ExprGraph::Partial(int a_iNode, int a_iArg)
+    {
+      static const value_type fStep = std::pow(std::numeric_limits<value_type>::epsilon(), (value_type)1/3);
+
+      const SNode node = m_vNode[a_iNode];
+      int u = node.Arg[a_iArg];
+
+      // The step grows with the magnitude of the argument: h = c*sqrt(u^2+1)
+      int h  = Times(Val(fStep), Bin(cmPOW, Plus(Times(u, u), Val(1)), Val(0.5))),
+          up = Plus(u, h),
+          um = Minus(u, h);
+
+      std::vector<int> vArg(node.Arg);
+      vArg[a_iArg] = up;
+      int fp = Op(node.Tok, vArg);
+      vArg[a_iArg] = um;
+      int fm = Op(node.Tok, vArg);
+
+      // Divide by the actual distance of the arguments to cancel rounding errors
+      return Quot(Minus(fp, fm), Minus(up, um));
+    }
+  } // anonymous namespace
+
   //---------------------------------------------------------------------------
   /** \brief Bytecode default constructor. */
   ParserByteCode::ParserByteCode()
@@ -48,6 +1230,7 @@ namespace mu
     ,m_iMaxStackSize(0)
     ,m_vRPN()
     ,m_bEnableOptimizer(true)
+    ,m_iTokensSaved(0)
   {
     m_vRPN.reserve(50);
   }
@@ -90,9 +1273,11 @@ namespace mu
       return;
 
     m_iStackPos = a_ByteCode.m_iStackPos;
+    m_stIfStackPos = a_ByteCode.m_stIfStackPos;
     m_vRPN = a_ByteCode.m_vRPN;
     m_iMaxStackSize = a_ByteCode.m_iMaxStackSize;
 	m_bEnableOptimizer = a_ByteCode.m_bEnableOptimizer;
+    m_iTokensSaved = a_ByteCode.m_iTokensSaved;
   }
 
   //---------------------------------------------------------------------------
@@ -106,7 +1291,7 @@ namespace mu
     m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
 
     // optimization does not apply
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd       = cmVAR;
     tok.Val.ptr   = a_pVar;
     tok.Val.data  = 1;
@@ -133,7 +1318,7 @@ namespace mu
     m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
 
     // If optimization does not apply
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd = cmVAL;
     tok.Val.ptr   = NULL;
     tok.Val.data  = 0;
@@ -313,11 +1498,14 @@ namespace mu
       }
     }
 
+    // The operator replaces two values by one whether it was folded or not.
+    // The position must stay exact, it locates the loop variables (see AddLoop).
+    --m_iStackPos;
+
     // If optimization can't be applied just write the value
     if (!bOptimized)
     {
-      --m_iStackPos;
-      SToken tok;
+      SToken tok = SToken();
       tok.Cmd = a_Oprt;
       m_vRPN.push_back(tok);
     }
@@ -326,11 +1514,79 @@ namespace mu
   //---------------------------------------------------------------------------
   void ParserByteCode::AddIfElse(ECmdCode a_Oprt)
   {
-    SToken tok;
+    // Only one branch is run, both start with the condition removed
+    switch(a_Oprt)
+    {
+    case cmIF:    m_stIfStackPos.push(--m_iStackPos); break;
+    case cmELSE:  m_iStackPos = m_stIfStackPos.top(); break;
+    case cmENDIF: m_stIfStackPos.pop(); break;
+    default:      break;
+    }
+
+    SToken tok = SToken();
     tok.Cmd = a_Oprt;
     m_vRPN.push_back(tok);
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Add the start of the body of a sum or product.
+      \param a_Oprt cmADD for a sum, cmMUL for a product
+      \return Stack index of the loop variable, see AddLoad.
+
+      The lower and the upper bound must be on top of the stack. The slot of the
+      lower bound holds the loop variable while the body is run, the slot of the
+      upper bound the number of iterations left. The body computes the value of 
+      an iteration on top of the accumulated result.
+
+      \sa AddEndLoop
+  */
+  int ParserByteCode::AddLoop(ECmdCode a_Oprt)
+  {
+    ++m_iStackPos;
+    m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
+
+    SToken tok = SToken();
+    tok.Cmd = cmLOOP;
+    tok.Oprt.ptr = NULL;
+    tok.Oprt.offset = 0;
+    tok.Oprt.code = a_Oprt;
+    m_vRPN.push_back(tok);
+
+    return (int)m_iStackPos - 2;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Add the end of the body of a sum or product. 
+  
+      The loop variable, the iteration count, the accumulated result and the 
+      value of the body are replaced by the result.
+  */
+  void ParserByteCode::AddEndLoop(ECmdCode a_Oprt)
+  {
+    m_iStackPos -= 3;
+
+    SToken tok = SToken();
+    tok.Cmd = cmENDLOOP;
+    tok.Oprt.ptr = NULL;
+    tok.Oprt.offset = 0;
+    tok.Oprt.code = a_Oprt;
+    m_vRPN.push_back(tok);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Push the value at a given stack index, i.e. a loop variable. */
+  void ParserByteCode::AddLoad(int a_iIdx)
+  {
+    ++m_iStackPos;
+    m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
+
+    SToken tok = SToken();
+    tok.Cmd = cmLOAD;
+    tok.Oprt.ptr = NULL;
+    tok.Oprt.offset = a_iIdx;
+    m_vRPN.push_back(tok);
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Add an assignment operator
     
@@ -346,7 +1602,7 @@ namespace mu
   {
     --m_iStackPos;
 
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd = cmASSIGN;
     tok.Oprt.ptr = a_pVar;
     m_vRPN.push_back(tok);
@@ -357,8 +1613,9 @@ namespace mu
 
       \param a_iArgc Number of arguments, negative numbers indicate multiarg functions.
       \param a_pFun Pointer to function callback.
+      \param a_bOptimize true if the function has no side effects.
   */
-  void ParserByteCode::AddFun(generic_fun_type a_pFun, int a_iArgc)
+  void ParserByteCode::AddFun(generic_fun_type a_pFun, int a_iArgc, bool a_bOptimize)
   {
     if (a_iArgc>=0)
     {
@@ -371,10 +1628,11 @@ namespace mu
     }
     m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
 
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd = cmFUNC;
     tok.Fun.argc = a_iArgc;
     tok.Fun.ptr = a_pFun;
+    tok.Fun.opt = a_bOptimize;
     m_vRPN.push_back(tok);
   }
 
@@ -389,10 +1647,11 @@ namespace mu
     m_iStackPos = m_iStackPos - a_iArgc + 1; 
     m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
 
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd = cmFUNC_BULK;
     tok.Fun.argc = a_iArgc;
     tok.Fun.ptr = a_pFun;
+    tok.Fun.opt = false;
     m_vRPN.push_back(tok);
   }
 
@@ -408,16 +1667,99 @@ namespace mu
   {
     m_iStackPos = m_iStackPos - a_iArgc + 1;
 
-    SToken tok;
+    SToken tok = SToken();
     tok.Cmd = cmFUNC_STR;
     tok.Fun.argc = a_iArgc;
     tok.Fun.idx = a_iIdx;
     tok.Fun.ptr = a_pFun;
+    tok.Fun.opt = false;
     m_vRPN.push_back(tok);
 
     m_iMaxStackSize = std::max(m_iMaxStackSize, (size_t)m_iStackPos);
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Eliminate common subexpressions and simplify the bytecode.
+
+      The bytecode is turned into a hash consed expression graph. Identical 
+      subexpressions calling only optimizable functions are computed once, 
+      stored in a temporary (cmSTORE) and read back where they are used again 
+      (cmLOAD). While building the graph the following simplifications are 
+      applied:
+      <ul>
+        <li>operators and optimizable functions with constant arguments are folded</li>
+        <li>x^n with an integer constant |n|<=16 is turned into multiplications</li>
+        <li>x/c is turned into x*(1/c)</li>
+        <li>x*1 and x-0 are replaced by x</li>
+        <li>the dead branch of an if-then-else with a constant condition is removed</li>
+      </ul>
+
+      Temporaries are located above the highest stack position used by the 
+      bytecode. Expressions with assignments are left untouched, as is the 
+      bytecode if the optimization fails for any reason.
+  */
+  void ParserByteCode::Optimize()
+  {
+    m_iTokensSaved = 0;
+    for (std::size_t i=0; i<m_vRPN.size(); ++i)
+    {
+      if (m_vRPN[i].Cmd==cmASSIGN)
+        return;
+    }
+
+    ExprGraph graph;
+    std::vector<int> vRoot;
+    rpn_type vRPN;
+    int iTemps = 0;
+    if (!graph.Build(m_vRPN, vRoot) || !graph.Emit(vRoot, vRPN, iTemps))
+      return;
+
+    m_iTokensSaved = (int)m_vRPN.size() - (int)vRPN.size();
+    SetCode(vRPN, iTemps);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Replace the bytecode by bytecode created from an expression graph.
+      \param a_vRPN The new bytecode, swapped with the current one
+      \param a_iTemps Number of temporaries used by cmSTORE and cmLOAD
+
+      Temporaries are numbered from zero in a_vRPN, they are moved right 
+      above the highest stack position.
+  */
+  void ParserByteCode::SetCode(rpn_type &a_vRPN, int a_iTemps)
+  {
+    // Determine the stack size of the new bytecode
+    ParserStack<int> stDepth;
+    int iStackPos = 0, 
+        iMaxStackPos = 0;
+    for (std::size_t i=0; i<a_vRPN.size(); ++i)
+    {
+      const SToken &tok = a_vRPN[i];
+      switch(tok.Cmd)
+      {
+      case cmIF:       --iStackPos; stDepth.push(iStackPos); break;
+      case cmELSE:     iStackPos = stDepth.top(); break;
+      case cmENDIF:    stDepth.pop(); break;
+      case cmSTORE:    break;
+      case cmFUNC:     iStackPos += 1 - ((tok.Fun.argc>=0) ? tok.Fun.argc : -tok.Fun.argc); break;
+      case cmFUNC_STR:
+      case cmFUNC_BULK:iStackPos += 1 - tok.Fun.argc; break;
+      default:         iStackPos += (tok.Cmd<=cmLOR) ? -1 : 1; break;
+      }
+      iMaxStackPos = std::max(iMaxStackPos, iStackPos);
+    }
+
+    // Temporaries are placed right above the stack
+    for (std::size_t i=0; i<a_vRPN.size(); ++i)
+    {
+      if (a_vRPN[i].Cmd==cmSTORE || a_vRPN[i].Cmd==cmLOAD)
+        a_vRPN[i].Oprt.offset += iMaxStackPos + 1;
+    }
+
+    m_iMaxStackSize = iMaxStackPos + a_iTemps;
+    m_vRPN.swap(a_vRPN);
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Add end marker to bytecode.
       
@@ -425,13 +1767,127 @@ namespace mu
   */
   void ParserByteCode::Finalize()
   {
-    SToken tok;
+    if (m_bEnableOptimizer)
+      Optimize();
+
+    Terminate();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Replace the bytecode by the bytecode of a derivative.
+      \param a_pVar The variable of the derivative
+      \param a_iOrder Order of the derivative
+      \param a_Rule Bytecode of the partial derivatives of callbacks. Each result
+                    of a rule is the partial derivative with respect to one 
+                    argument, written in terms of the placeholder variables.
+      \param a_pArg Array of placeholder variables standing for the arguments 
+                    of a callback in a_Rule
+      \param a_iNumArg Number of placeholder variables
+      \throw ParserError if the bytecode contains assignments
+
+      The bytecode must have been finalized. The derivative is built on the 
+      expression graph used by Optimize() so constants are folded and the 
+      derivative shares common subexpressions with the original expression. 
+      Callbacks without a rule are differentiated by central differences.
+  */
+  void ParserByteCode::Differentiate(value_type *a_pVar, 
+                                     int a_iOrder, 
+                                     const rulemap_type &a_Rule, 
+                                     const value_type *a_pArg, 
+                                     int a_iNumArg)
+  {
+    ExprGraph graph;
+    std::vector<int> vRoot;
+    if (!graph.Build(m_vRPN, vRoot))
+      throw ParserError(ecNOT_DIFFERENTIABLE);
+
+    graph.SetDiffVar(a_pVar, a_Rule, a_pArg, a_iNumArg);
+    for (int k=0; k<a_iOrder; ++k)
+    {
+      for (std::size_t i=0; i<vRoot.size(); ++i)
+        vRoot[i] = graph.Diff(vRoot[i]);
+    }
+
+    rpn_type vRPN;
+    int iTemps = 0;
+    if (!graph.Emit(vRoot, vRPN, iTemps))
+      throw ParserError(ecINTERNAL_ERROR);
+
+    m_iTokensSaved = 0;
+    SetCode(vRPN, iTemps);
+    Terminate();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Split the bytecode into a prologue and a per evaluation body.
+      \param a_vSweepVar The variables changing from one evaluation to the next, 
+                        all other variables are parameters.
+      \param a_Prologue [out] Bytecode computing the hoisted subexpressions, 
+                       one result per subexpression.
+      \param a_Body [out] Bytecode of the expression reading the hoisted values 
+                   from a_vSlot.
+      \param a_vSlot [out] Storage of the hoisted values, the results of 
+                    a_Prologue must be copied there before a_Body is run.
+      \return false if nothing can be hoisted, the output is not modified then.
+
+      The bytecode must have been finalized. Hoisted are the largest 
+      subexpressions that only read parameters and don't call functions with 
+      side effects. Expressions with assignments are never split.
+  */
+  bool ParserByteCode::Hoist(const std::vector<value_type*> &a_vSweepVar,
+                             ParserByteCode &a_Prologue,
+                             ParserByteCode &a_Body,
+                             std::vector<value_type> &a_vSlot) const
+  {
+    ExprGraph graph;
+    std::vector<int> vRoot, vHoist;
+    if (!graph.Build(m_vRPN, vRoot))
+      return false;
+
+    std::set<const value_type*> setSweepVar(a_vSweepVar.begin(), a_vSweepVar.end());
+    graph.FindInvariants(vRoot, setSweepVar, vHoist);
+    if (vHoist.empty())
+      return false;
+
+    rpn_type vPrologue, vBody;
+    int iPrologueTemps = 0, 
+        iBodyTemps = 0;
+    if (!graph.Emit(vHoist, vPrologue, iPrologueTemps))
+      return false;
+
+    // The hoisted nodes become variables of the body
+    std::vector<value_type> vSlot(vHoist.size(), 0);
+    for (std::size_t i=0; i<vHoist.size(); ++i)
+      graph.MakeVarLeaf(vHoist[i], &vSlot[i]);
+
+    if (!graph.Emit(vRoot, vBody, iBodyTemps))
+      return false;
+
+    // Swapping the vectors keeps the addresses in the body valid
+    a_vSlot.swap(vSlot);
+
+    a_Prologue.clear();
+    a_Prologue.SetCode(vPrologue, iPrologueTemps);
+    a_Prologue.Terminate();
+
+    a_Body.clear();
+    a_Body.SetCode(vBody, iBodyTemps);
+    a_Body.Terminate();
+    return true;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Add the end marker and determine the if-then-else and loop jump offsets. */
+  void ParserByteCode::Terminate()
+  {
+    SToken tok = SToken();
     tok.Cmd = cmEND;
     m_vRPN.push_back(tok);
     rpn_type(m_vRPN).swap(m_vRPN);     // shrink bytecode vector to fit
 
-    // Determine the if-then-else jump offsets
-    ParserStack<int> stIf, stElse;
+    // Determine the jump offsets, both ends of a loop get the distance 
+    // between them
+    ParserStack<int> stIf, stElse, stLoop;
     int idx;
     for (int i=0; i<(int)m_vRPN.size(); ++i)
     {
@@ -452,6 +1908,16 @@ namespace mu
             m_vRPN[idx].Oprt.offset = i - idx;
             break;
 
+      case cmLOOP:
+            stLoop.push(i);
+            break;
+
+      case cmENDLOOP:
+            idx = stLoop.pop();
+            m_vRPN[idx].Oprt.offset = i - idx;
+            m_vRPN[i].Oprt.offset = i - idx;
+            break;
+
       default:
             break;
       }
@@ -480,6 +1946,17 @@ namespace mu
     return m_vRPN.size();
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Returns the number of tokens removed by the optimizer. 
+  
+      The value may be negative if the optimizer replaced expensive tokens
+      by a longer sequence of cheaper ones.
+  */
+  int ParserByteCode::GetTokensSaved() const
+  {
+    return m_iTokensSaved;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Delete the bytecode. 
   
@@ -493,7 +1970,9 @@ namespace mu
   {
     m_vRPN.clear();
     m_iStackPos = 0;
+    m_stIfStackPos = std::stack<unsigned>();
     m_iMaxStackSize = 0;
+    m_iTokensSaved = 0;
   }
 
   //---------------------------------------------------------------------------
@@ -507,6 +1986,7 @@ namespace mu
     }
 
     mu::console() << _T("Number of RPN tokens:") << (int)m_vRPN.size() << _T("\n");
+    mu::console() << _T("Tokens saved by the optimizer:") << m_iTokensSaved << _T("\n");
     for (std::size_t i=0; i<m_vRPN.size() && m_vRPN[i].Cmd!=cmEND; ++i)
     {
       mu::console() << std::dec << i << _T(" : \t");
@@ -565,6 +2045,14 @@ namespace mu
       case cmDIV:   mu::console() << _T("DIV\n"); break;
       case cmPOW:   mu::console() << _T("POW\n"); break;
 
+      case cmSTORE: mu::console() << _T("STORE\t");
+                    mu::console() << _T("[IDX:") << std::dec << m_vRPN[i].Oprt.offset << _T("]\n");
+                    break;
+
+      case cmLOAD:  mu::console() << _T("LOAD\t");
+                    mu::console() << _T("[IDX:") << std::dec << m_vRPN[i].Oprt.offset << _T("]\n");
+                    break;
+
       case cmIF:    mu::console() << _T("IF\t");
                     mu::console() << _T("[OFFSET:") << std::dec << m_vRPN[i].Oprt.offset << _T("]\n");
                     break;
@@ -575,6 +2063,15 @@ namespace mu
 
       case cmENDIF: mu::console() << _T("ENDIF\n"); break;
 
+      case cmLOOP:  mu::console() << ((m_vRPN[i].Oprt.code==cmMUL) ? _T("PROD\t") : _T("SUM\t"));
+                    mu::console() << _T("[OFFSET:") << std::dec << m_vRPN[i].Oprt.offset << _T("]\n");
+                    break;
+
+      case cmENDLOOP: 
+                    mu::console() << _T("ENDLOOP\t");
+                    mu::console() << _T("[OFFSET:") << std::dec << m_vRPN[i].Oprt.offset << _T("]\n");
+                    break;
+
       case cmASSIGN: 
                     mu::console() << _T("ASSIGN\t");
                     mu::console() << _T("[ADDR: 0x") << m_vRPN[i].Oprt.ptr << _T("]\n"); 
@@ -0,0 +1,618 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+
+#include "muParserBase.h"
+#include "muParserTemplateMagic.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** \file
+    \brief Implementation of the differentiation of the bytecode.
+
+    The bytecode is run with dual numbers holding the value of a subexpression
+    together with its first and second derivative with respect to one variable.
+    Built in operators are differentiated exactly, function callbacks use the
+    rules defined with ParserBase::DefineDiff or central differences if there
+    is no rule.
+
+    ParserBase::SetDiffVar replaces the bytecode by the bytecode of a derivative 
+    built symbolically by ParserByteCode::Differentiate.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    //------------------------------------------------------------------------------
+    /** \brief Value of a subexpression with its first and second derivative. */
+    struct SJet
+    {
+      value_type v;
+      value_type d;
+      value_type dd;
+    };
+
+    //------------------------------------------------------------------------------
+    inline SJet MakeJet(value_type v, value_type d = 0, value_type dd = 0)
+    {
+      SJet jet = { v, d, dd };
+      return jet;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Apply the chain rule to a function of one jet.
+        \param u The argument
+        \param v f(u.v)
+        \param g f'(u.v)
+        \param h f''(u.v)
+    */
+    inline SJet Chain(const SJet &u, value_type v, value_type g, value_type h)
+    {
+      return MakeJet(v, g * u.d, g * u.dd + h * u.d * u.d);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Jet of u^n for a constant exponent n. */
+    SJet PowConst(const SJet &u, value_type n)
+    {
+      value_type v = MathImpl<value_type>::Pow(u.v, n);
+      if (n==0 || (u.d==0 && u.dd==0))
+        return MakeJet(v);
+
+      value_type g = (n==1) ? 1 : n * MathImpl<value_type>::Pow(u.v, n - 1),
+                 h = (n==1) ? 0 : n * (n - 1) * MathImpl<value_type>::Pow(u.v, n - 2);
+      return Chain(u, v, g, h);
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Call the function of a bytecode token.
+        \param a_Tok A cmFUNC, cmFUNC_STR or cmFUNC_BULK token
+        \param a_pArg The numerical arguments
+        \param a_szStr The string argument of string functions
+    */
+    value_type CallFun(const SToken &a_Tok, const value_type *a_pArg, const char_type *a_szStr)
+    {
+      generic_fun_type pFun = a_Tok.Fun.ptr;
+      const value_type *a = a_pArg;
+      switch(a_Tok.Cmd)
+      {
+      case cmFUNC_STR:
+            switch(a_Tok.Fun.argc)
+            {
+            case 0:  return (*(strfun_type1)pFun)(a_szStr);
+            case 1:  return (*(strfun_type2)pFun)(a_szStr, a[0]);
+            default: return (*(strfun_type3)pFun)(a_szStr, a[0], a[1]);
+            }
+
+      case cmFUNC_BULK:
+            switch(a_Tok.Fun.argc)
+            {
+            case 0:  return (*(bulkfun_type0 )pFun)(0, 0);
+            case 1:  return (*(bulkfun_type1 )pFun)(0, 0, a[0]);
+            case 2:  return (*(bulkfun_type2 )pFun)(0, 0, a[0], a[1]);
+            case 3:  return (*(bulkfun_type3 )pFun)(0, 0, a[0], a[1], a[2]);
+            case 4:  return (*(bulkfun_type4 )pFun)(0, 0, a[0], a[1], a[2], a[3]);
+            case 5:  return (*(bulkfun_type5 )pFun)(0, 0, a[0], a[1], a[2], a[3], a[4]);
+            case 6:  return (*(bulkfun_type6 )pFun)(0, 0, a[0], a[1], a[2], a[3], a[4], a[5]);
+            case 7:  return (*(bulkfun_type7 )pFun)(0, 0, a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            case 8:  return (*(bulkfun_type8 )pFun)(0, 0, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+            case 9:  return (*(bulkfun_type9 )pFun)(0, 0, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+            default: return (*(bulkfun_type10)pFun)(0, 0, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+            }
+
+      default:
+            switch(a_Tok.Fun.argc)
+            {
+            case 0:  return (*(fun_type0)pFun)();
+            case 1:  return (*(fun_type1)pFun)(a[0]);
+            case 2:  return (*(fun_type2)pFun)(a[0], a[1]);
+            case 3:  return (*(fun_type3)pFun)(a[0], a[1], a[2]);
+            case 4:  return (*(fun_type4)pFun)(a[0], a[1], a[2], a[3]);
+            case 5:  return (*(fun_type5)pFun)(a[0], a[1], a[2], a[3], a[4]);
+            case 6:  return (*(fun_type6)pFun)(a[0], a[1], a[2], a[3], a[4], a[5]);
+            case 7:  return (*(fun_type7)pFun)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            case 8:  return (*(fun_type8)pFun)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+            case 9:  return (*(fun_type9)pFun)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+            case 10: return (*(fun_type10)pFun)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+            default: return (*(multfun_type)pFun)(a, -a_Tok.Fun.argc);
+            }
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Compute the partial derivatives of a function by central differences.
+
+      Only the derivatives with respect to the arguments flagged in a_vActive 
+      are computed, the others are left untouched.
+    */
+    void NumDiff(const SToken &a_Tok, 
+                 const char_type *a_szStr, 
+                 std::vector<value_type> &a_vArg, 
+                 const std::vector<bool> &a_vActive,
+                 value_type a_fVal,
+                 value_type *a_pGrad, 
+                 value_type *a_pHess)
+    {
+      const value_type eps = std::numeric_limits<value_type>::epsilon();
+      const value_type fStep1 = std::pow(eps, (value_type)1/3),
+                       fStep2 = std::pow(eps, (value_type)1/4);
+      int n = (int)a_vArg.size();
+
+      for (int i=0; i<n; ++i)
+      {
+        if (!a_vActive[i])
+          continue;
+
+        value_type x = a_vArg[i],
+                   h = fStep1 * std::max((value_type)1, std::fabs(x));
+        a_vArg[i] = x + h;  value_type fp = CallFun(a_Tok, &a_vArg[0], a_szStr);
+        a_vArg[i] = x - h;  value_type fm = CallFun(a_Tok, &a_vArg[0], a_szStr);
+        a_pGrad[i] = (fp - fm) / (2 * h);
+
+        if (a_pHess)
+        {
+          h = fStep2 * std::max((value_type)1, std::fabs(x));
+          a_vArg[i] = x + h;  fp = CallFun(a_Tok, &a_vArg[0], a_szStr);
+          a_vArg[i] = x - h;  fm = CallFun(a_Tok, &a_vArg[0], a_szStr);
+          a_pHess[i*n + i] = (fp - 2 * a_fVal + fm) / (h * h);
+        }
+        a_vArg[i] = x;
+      }
+
+      if (!a_pHess)
+        return;
+
+      for (int i=0; i<n; ++i)
+      {
+        for (int j=i+1; j<n; ++j)
+        {
+          if (!a_vActive[i] || !a_vActive[j])
+            continue;
+
+          value_type xi = a_vArg[i], hi = fStep2 * std::max((value_type)1, std::fabs(xi)),
+                     xj = a_vArg[j], hj = fStep2 * std::max((value_type)1, std::fabs(xj)),
+                     f[4];
+          for (int k=0; k<4; ++k)
+          {
+            a_vArg[i] = (k & 1) ? xi - hi : xi + hi;
+            a_vArg[j] = (k & 2) ? xj - hj : xj + hj;
+            f[k] = CallFun(a_Tok, &a_vArg[0], a_szStr);
+          }
+          a_vArg[i] = xi;
+          a_vArg[j] = xj;
+          a_pHess[i*n + j] = a_pHess[j*n + i] = (f[0] - f[1] - f[2] + f[3]) / (4 * hi * hj);
+        }
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Parser compiling the derivative expressions defined with ParserBase::DefineDiff.
+
+      The parser is a copy of the parser being differentiated with the user 
+      variables and constants replaced by the placeholders x1 ... x10 
+      (and x for x1) standing for the arguments of a callback.
+    */
+    class DiffRuleParser : public ParserBase
+    {
+    public:
+
+      enum { s_iNumArg = 10 };
+
+      value_type m_vArg[s_iNumArg];
+
+      DiffRuleParser(const ParserBase &a_Parser)
+        :ParserBase(a_Parser)
+      {
+        static const char_type *c_szArg[s_iNumArg] = { _T("x1"), _T("x2"), _T("x3"), _T("x4"), _T("x5"), 
+                                                       _T("x6"), _T("x7"), _T("x8"), _T("x9"), _T("x10") };
+        SetDiffVar(NULL);
+        EnableOptimizer(false);
+        ClearConst();
+        ClearVar();
+        DefineVar(_T("x"), &m_vArg[0]);
+        for (int i=0; i<s_iNumArg; ++i)
+        {
+          m_vArg[i] = 0;
+          DefineVar(c_szArg[i], &m_vArg[i]);
+        }
+      }
+
+    protected:
+
+      virtual void InitCharSets() {}
+      virtual void InitFun() {}
+      virtual void InitConst() {}
+      virtual void InitOprt() {}
+    };
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Make the parser evaluate a derivative of the expression.
+      \param a_pVar Pointer to the variable of the derivative, NULL for evaluating 
+                    the expression itself.
+      \param a_iOrder Order of the derivative, 0 for evaluating the expression itself.
+
+    The derivative is computed symbolically when the bytecode is created. The
+    result is an ordinary bytecode, all the evaluation functions including 
+    EvalArray and the bulk mode compute the derivative without computing the
+    expression first. Built in operators are differentiated exactly, functions 
+    use the partial derivatives defined with DefineDiff and central differences 
+    if there is no rule. The setting stays in effect for new expressions.
+  */
+  void ParserBase::SetDiffVar(value_type *a_pVar, int a_iOrder)
+  {
+    m_pDiffVar = (a_iOrder>0) ? a_pVar : NULL;
+    m_iDiffOrder = a_iOrder;
+    ReInit();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Replace the bytecode by the bytecode of the derivative selected with SetDiffVar. */
+  void ParserBase::CreateDiffRPN() const
+  {
+    // Compile the rules of the callbacks used by the expression and by the rules
+    ParserByteCode::rulemap_type mapRule;
+    std::unique_ptr<DiffRuleParser> pRuleParser;
+    std::vector<const ParserByteCode*> vPending(1, &m_vRPN);
+    while (vPending.size())
+    {
+      const ParserByteCode *pCode = vPending.back();
+      vPending.pop_back();
+
+      const SToken *pTok = pCode->GetBase();
+      for (std::size_t i=0; i<pCode->GetSize(); ++i)
+      {
+        if (pTok[i].Cmd!=cmFUNC || mapRule.find(pTok[i].Fun.ptr)!=mapRule.end())
+          continue;
+
+        diffexprmap_type::const_iterator it = m_DiffExprDef.find(pTok[i].Fun.ptr);
+        if (it==m_DiffExprDef.end())
+          continue;
+
+        if (!pRuleParser.get())
+          pRuleParser.reset(new DiffRuleParser(*this));
+
+        // A rule that doesn't compile, i.e. because a function it uses was 
+        // removed, is replaced by central differences
+        ParserBase &rule = *pRuleParser;
+        try
+        {
+          rule.SetExpr(it->second);
+          rule.CreateRPN();
+        }
+        catch(ParserError&)
+        {
+          continue;
+        }
+
+        ParserByteCode &code = mapRule[pTok[i].Fun.ptr];
+        code = rule.m_vRPN;
+        vPending.push_back(&code);
+      }
+    }
+
+    if (pRuleParser.get())
+      m_vRPN.Differentiate(m_pDiffVar, m_iDiffOrder, mapRule, pRuleParser->m_vArg, DiffRuleParser::s_iNumArg);
+    else
+      m_vRPN.Differentiate(m_pDiffVar, m_iDiffOrder, mapRule, NULL, 0);
+
+    if (ParserBase::g_DbgDumpCmdCode)
+      m_vRPN.AsciiDump();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the expression and its derivative with respect to a variable.
+      \param a_pVar Pointer to the variable, its current value is used.
+      \param a_pDeriv [out] The first derivative of the expression.
+      \param a_pDeriv2 [out] The second derivative of the expression, pass NULL
+                       if it is not needed.
+      \return The value of the expression.
+
+    The bytecode is evaluated once with dual numbers (forward mode automatic 
+    differentiation). Built in operators are differentiated exactly, functions 
+    use the derivative rules defined with DefineDiff. Functions without a rule 
+    are differentiated with central differences. If the expression has several 
+    comma separated results the last one is returned.
+  */
+  value_type ParserBase::EvalDiff(value_type *a_pVar, value_type *a_pDeriv, value_type *a_pDeriv2) const
+  {
+    if (m_pParseFormula==&ParserBase::ParseString)
+      ParseString();
+
+    bool bSecond = a_pDeriv2!=NULL;
+    std::vector<SJet> Stack(m_vRPN.GetMaxStackSize());
+    std::vector<value_type> vArg, vGrad, vHess;
+    std::vector<bool> vActive;
+
+    // Jets of the variables: the one we differentiate against and the 
+    // ones written by assignments.
+    std::vector< std::pair<value_type*, SJet> > vVarJet(1, std::make_pair(a_pVar, MakeJet(*a_pVar, 1)));
+
+    int sidx(0);
+    for (const SToken *pTok = m_vRPN.GetBase(); pTok->Cmd!=cmEND ; ++pTok)
+    {
+      switch (pTok->Cmd)
+      {
+      // built in binary operators, comparisons have no derivative
+      case  cmLE:   --sidx; Stack[sidx] = MakeJet(Stack[sidx].v <= Stack[sidx+1].v); continue;
+      case  cmGE:   --sidx; Stack[sidx] = MakeJet(Stack[sidx].v >= Stack[sidx+1].v); continue;
+      case  cmNEQ:  --sidx; Stack[sidx] = MakeJet(Stack[sidx].v != Stack[sidx+1].v); continue;
+      case  cmEQ:   --sidx; Stack[sidx] = MakeJet(Stack[sidx].v == Stack[sidx+1].v); continue;
+      case  cmLT:   --sidx; Stack[sidx] = MakeJet(Stack[sidx].v <  Stack[sidx+1].v); continue;
+      case  cmGT:   --sidx; Stack[sidx] = MakeJet(Stack[sidx].v >  Stack[sidx+1].v); continue;
+      case  cmLAND: --sidx; Stack[sidx] = MakeJet(Stack[sidx].v && Stack[sidx+1].v); continue;
+      case  cmLOR:  --sidx; Stack[sidx] = MakeJet(Stack[sidx].v || Stack[sidx+1].v); continue;
+
+      case  cmADD:  
+            {
+              --sidx; 
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+              a.v += b.v; a.d += b.d; a.dd += b.dd;
+            }
+            continue;
+
+      case  cmSUB:  
+            {
+              --sidx; 
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+              a.v -= b.v; a.d -= b.d; a.dd -= b.dd;
+            }
+            continue;
+
+      case  cmMUL:
+            {
+              --sidx; 
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+              a = MakeJet(a.v * b.v, a.d * b.v + a.v * b.d, a.dd * b.v + 2 * a.d * b.d + a.v * b.dd);
+            }
+            continue;
+
+      case  cmDIV:
+            {
+              --sidx; 
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+
+  #if defined(MUP_MATH_EXCEPTIONS)
+              if (b.v==0)
+                Error(ecDIV_BY_ZERO);
+  #endif
+              value_type q = a.v / b.v,
+                         d = (a.d - q * b.d) / b.v;
+              a = MakeJet(q, d, (a.dd - 2 * d * b.d - q * b.dd) / b.v);
+            }
+            continue;
+
+      case  cmPOW: 
+            {
+              --sidx; 
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+              if (b.d==0 && b.dd==0)
+              {
+                a = PowConst(a, b.v);
+                continue;
+              }
+
+              // a^b = exp(b*ln(a))
+              value_type v   = MathImpl<value_type>::Pow(a.v, b.v),
+                         ln  = MathImpl<value_type>::Log(a.v),
+                         gb  = v * ln,
+                         d   = gb * b.d,
+                         dd  = gb * b.dd + v * ln * ln * b.d * b.d;
+              if (a.d!=0 || a.dd!=0)
+              {
+                value_type pm1 = MathImpl<value_type>::Pow(a.v, b.v - 1),
+                           ga  = b.v * pm1;
+                d  += ga * a.d;
+                dd += ga * a.dd + 
+                      b.v * (b.v - 1) * MathImpl<value_type>::Pow(a.v, b.v - 2) * a.d * a.d + 
+                      2 * pm1 * (1 + b.v * ln) * a.d * b.d;
+              }
+              a = MakeJet(v, d, dd);
+            }
+            continue;
+
+      case  cmASSIGN:
+            {
+              --sidx; 
+              Stack[sidx] = Stack[sidx+1];
+              *pTok->Oprt.ptr = Stack[sidx].v;
+
+              std::size_t i = 0;
+              while (i<vVarJet.size() && vVarJet[i].first!=pTok->Oprt.ptr)
+                ++i;
+
+              if (i==vVarJet.size())
+                vVarJet.push_back(std::make_pair(pTok->Oprt.ptr, Stack[sidx]));
+              else
+                vVarJet[i].second = Stack[sidx];
+            }
+            continue;
+
+      case  cmIF:
+            if (Stack[sidx--].v==0)
+              pTok += pTok->Oprt.offset;
+            continue;
+
+      case  cmELSE:
+            pTok += pTok->Oprt.offset;
+            continue;
+
+      case  cmENDIF:
+            continue;
+
+      // value and variable tokens
+      case  cmVAL:    
+            Stack[++sidx] = MakeJet(pTok->Val.data2);
+            continue;
+
+      case  cmVAR:
+      case  cmVARPOW2:
+      case  cmVARPOW3:
+      case  cmVARPOW4:
+      case  cmVARMUL:
+            {
+              SJet u = MakeJet(*pTok->Val.ptr);
+              for (std::size_t i=0; i<vVarJet.size(); ++i)
+              {
+                if (vVarJet[i].first==pTok->Val.ptr)
+                  u = vVarJet[i].second;
+              }
+
+              switch(pTok->Cmd)
+              {
+              case cmVARPOW2: u = PowConst(u, 2); break;
+              case cmVARPOW3: u = PowConst(u, 3); break;
+              case cmVARPOW4: u = PowConst(u, 4); break;
+              case cmVARMUL:  u = MakeJet(u.v * pTok->Val.data + pTok->Val.data2, u.d * pTok->Val.data, u.dd * pTok->Val.data); break;
+              default:        break;
+              }
+
+              Stack[++sidx] = u;
+            }
+            continue;
+
+      // temporaries holding common subexpressions
+      case  cmSTORE:
+            Stack[pTok->Oprt.offset] = Stack[sidx];
+            continue;
+
+      case  cmLOAD:
+            Stack[++sidx] = Stack[pTok->Oprt.offset];
+            continue;
+
+      // sums and products: the number of iterations is piecewise constant, 
+      // it is computed from the values only
+      case  cmLOOP:
+            {
+              value_type fCount = std::floor(Stack[sidx].v - Stack[sidx-1].v) + 1,
+                         fInit = (pTok->Oprt.code==cmMUL) ? 1 : 0;
+              if (fCount>0 && fCount<=MUP_LOOP_MAX)
+              {
+                Stack[sidx] = MakeJet(fCount);
+                Stack[++sidx] = MakeJet(fInit);
+                continue;
+              }
+
+              Stack[--sidx] = MakeJet((fCount<=0) ? fInit : std::numeric_limits<value_type>::quiet_NaN());
+              pTok += pTok->Oprt.offset;
+            }
+            continue;
+
+      case  cmENDLOOP:
+            {
+              --sidx;
+              SJet &a = Stack[sidx], &b = Stack[sidx+1];
+              if (pTok->Oprt.code==cmMUL)
+                a = MakeJet(a.v * b.v, a.d * b.v + a.v * b.d, a.dd * b.v + 2 * a.d * b.d + a.v * b.dd);
+              else
+              {
+                a.v += b.v; a.d += b.d; a.dd += b.dd;
+              }
+
+              if (--Stack[sidx-1].v>0)
+              {
+                Stack[sidx-2].v += 1;
+                pTok -= pTok->Oprt.offset;
+                continue;
+              }
+
+              sidx -= 2;
+              Stack[sidx] = Stack[sidx+2];
+            }
+            continue;
+
+      // functions: f(u1, ..., un)' = sum(df/dui * ui')
+      case  cmFUNC:
+      case  cmFUNC_STR:
+      case  cmFUNC_BULK:
+            {
+              int nArg = (pTok->Fun.argc>=0) ? pTok->Fun.argc : -pTok->Fun.argc;
+              const char_type *szStr = (pTok->Cmd==cmFUNC_STR) ? m_vStringBuf[pTok->Fun.idx].c_str() : NULL;
+              SJet *pArg = &Stack[sidx - nArg + 1];
+
+              vArg.resize(std::max(nArg, 1));
+              vActive.assign(nArg, false);
+              bool bActive = false;
+              for (int i=0; i<nArg; ++i)
+              {
+                vArg[i] = pArg[i].v;
+                vActive[i] = pArg[i].d!=0 || pArg[i].dd!=0;
+                bActive |= vActive[i];
+              }
+
+              SJet res = MakeJet(CallFun(*pTok, &vArg[0], szStr));
+              if (bActive)
+              {
+                vGrad.assign(nArg, 0);
+                if (bSecond)
+                  vHess.assign(nArg * nArg, 0);
+
+                diffmap_type::const_iterator item = m_DiffDef.find(pTok->Fun.ptr);
+                if (pTok->Cmd==cmFUNC && item!=m_DiffDef.end())
+                  item->second(&vArg[0], nArg, &vGrad[0], (bSecond) ? &vHess[0] : NULL);
+                else
+                  NumDiff(*pTok, szStr, vArg, vActive, res.v, &vGrad[0], (bSecond) ? &vHess[0] : NULL);
+
+                for (int i=0; i<nArg; ++i)
+                {
+                  if (!vActive[i])
+                    continue;
+
+                  res.d  += vGrad[i] * pArg[i].d;
+                  res.dd += vGrad[i] * pArg[i].dd;
+                  if (!bSecond)
+                    continue;
+
+                  for (int j=0; j<nArg; ++j)
+                  {
+                    if (vActive[j])
+                      res.dd += vHess[i*nArg + j] * pArg[i].d * pArg[j].d;
+                  }
+                }
+              }
+
+              sidx -= nArg - 1;
+              Stack[sidx] = res;
+            }
+            continue;
+
+      default:
+            Error(ecINTERNAL_ERROR, 3);
+            return 0;
+      } // switch CmdCode
+    } // for all bytecode tokens
+
+    const SJet &res = Stack[m_nFinalResultIdx];
+    *a_pDeriv = res.d;
+    if (a_pDeriv2)
+      *a_pDeriv2 = res.dd;
+
+    return res.v;
+  }
+} // namespace mu
@@ -83,6 +83,10 @@ namespace mu
     m_vErrMsg[ecMISSING_ELSE_CLAUSE]    = _T("If-then-else operator is missing an else clause");
     m_vErrMsg[ecMISPLACED_COLON]        = _T("Misplaced colon at position $POS$");
     m_vErrMsg[ecUNREASONABLE_NUMBER_OF_COMPUTATIONS] = _T("Number of computations to small for bulk mode. (Vectorisation overhead too costly)");
+    m_vErrMsg[ecNOT_DIFFERENTIABLE]     = _T("Expressions with assignments can't be differentiated.");
+    m_vErrMsg[ecTOO_FEW_RESULTS]        = _T("The expression has fewer results than requested.");
+    m_vErrMsg[ecINVALID_BYTECODE]       = _T("Invalid or incompatible bytecode.");
+    m_vErrMsg[ecBYTECODE_SYMBOL]        = _T("The bytecode uses the undefined symbol \"$TOK$\".");
     
     #if defined(_DEBUG)
       for (int i=0; i<ecCOUNT; ++i)
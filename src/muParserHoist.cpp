@@ -0,0 +1,146 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserBase.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+
+/** \file
+    \brief Implementation of the hoisting of parameter subexpressions out of a sweep.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    //------------------------------------------------------------------------------
+    /** \brief Variable access of the prologue, it reads the variables directly. */
+    struct SParamVar
+    {
+      value_type& operator()(const SToken*, value_type *a_pVar) const
+      {
+        return *a_pVar;
+      }
+    };
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Set the variables that change from one evaluation to the next.
+      \param a_pVar Pointers to the variables as passed to DefineVar.
+      \param a_iNumVar Number of variables, 0 disables the hoisting.
+
+    All other variables used by the expression (see GetUsedVar) are 
+    parameters. Subexpressions reading only parameters are split off into a 
+    prologue that is evaluated once per parameter change instead of once per 
+    evaluation, i.e. in "a*sin(b*x)+c*exp(-d)" with the sweep variable x only 
+    b*x, the sine and the final sum remain per sample work. Eval() and 
+    EvalArray() compare the parameters with their values of the last call and 
+    rerun the prologue if one of them changed.
+
+    EvalArray() ignores the hoisted code if it binds a parameter. The bulk 
+    mode, EvalInterval(), Compile() and SaveByteCode() always use the 
+    complete bytecode. The setting stays in effect for new expressions.
+  */
+  void ParserBase::SetSweepVars(value_type * const *a_pVar, int a_iNumVar)
+  {
+    m_vSweepVar.assign(a_pVar, a_pVar + a_iNumVar);
+    ReInit();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Split the bytecode into the prologue and the bytecode reading the 
+             hoisted values if sweep variables are set. 
+  */
+  void ParserBase::HoistInvariants() const
+  {
+    m_vHoisted.clear();
+    m_vParam.clear();
+    m_bHoistedValid = false;
+    if (m_vSweepVar.empty() || !m_vRPN.Hoist(m_vSweepVar, m_vPrologue, m_vHoistedRPN, m_vHoisted))
+      return;
+
+    // The parameters the hoisted values depend on
+    for (const SToken *pTok = m_vPrologue.GetBase(); pTok->Cmd!=cmEND; ++pTok)
+    {
+      switch(pTok->Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+            {
+              std::size_t i = 0;
+              while (i<m_vParam.size() && m_vParam[i].first!=pTok->Val.ptr)
+                ++i;
+
+              if (i==m_vParam.size())
+                m_vParam.push_back(std::make_pair(pTok->Val.ptr, (value_type)0));
+            }
+            break;
+
+      default:
+            break;
+      }
+    }
+
+    m_vPrologueStack.resize(m_vPrologue.GetMaxStackSize());
+    m_vStackBuffer.resize(std::max(m_vStackBuffer.size(), m_vHoistedRPN.GetMaxStackSize()));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Run the prologue if a parameter changed since the last call. */
+  void ParserBase::UpdateHoisted() const
+  {
+    bool bChanged = !m_bHoistedValid;
+    for (std::size_t i=0; i<m_vParam.size(); ++i)
+    {
+      // Compare the bits, a NaN parameter is not a change
+      value_type fVal = *m_vParam[i].first;
+      if (std::memcmp(&fVal, &m_vParam[i].second, sizeof(value_type))!=0)
+      {
+        m_vParam[i].second = fVal;
+        bChanged = true;
+      }
+    }
+
+    if (!bChanged)
+      return;
+
+    value_type *Stack = &m_vPrologueStack[0];
+    SParamVar var;
+    RunByteCode(m_vPrologue.GetBase(), Stack, var, NULL, 0, 0);
+    std::copy(Stack + 1, Stack + 1 + m_vHoisted.size(), m_vHoisted.begin());
+    m_bHoistedValid = true;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Update the hoisted values if necessary and evaluate the expression. */
+  value_type ParserBase::ParseHoisted() const
+  {
+    UpdateHoisted();
+    return (this->*m_pParseHoisted)();
+  }
+} // namespace mu
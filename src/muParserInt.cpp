@@ -201,9 +201,19 @@ int ParserInt::IsBinVal(const char_type *a_szExpr, int *a_iPos, value_type *a_fV
 //---------------------------------------------------------------------------
 /** \brief Constructor. 
 
-  Call ParserBase class constructor and trigger Function, Operator and Constant initialization.
+  The parser starts as a copy of the parser holding the built in functions and 
+  operators, it shares their definitions until it defines its own.
 */
 ParserInt::ParserInt()
+  :ParserBase(Builtin())
+{}
+
+//---------------------------------------------------------------------------
+/** \brief Constructor of the parser holding the built in definitions. 
+
+  Call ParserBase class constructor and trigger Function, Operator and Constant initialization.
+*/
+ParserInt::ParserInt(SBuiltinTag)
   :ParserBase()
 {
   AddValIdent(IsVal);    // lowest priority
@@ -215,6 +225,14 @@ ParserInt::ParserInt()
   InitOprt();
 }
 
+//---------------------------------------------------------------------------
+/** \brief Return the parser holding the built in definitions, it is created on first use. */
+const ParserInt& ParserInt::Builtin()
+{
+  static const ParserInt s_Builtin((SBuiltinTag()));
+  return s_Builtin;
+}
+
 //---------------------------------------------------------------------------
 void ParserInt::InitConst()
 {
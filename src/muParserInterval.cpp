@@ -0,0 +1,545 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserBase.h"
+#include "muParserTemplateMagic.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/** \file
+    \brief Implementation of the interval evaluation of the bytecode.
+
+    The bytecode is run with intervals [lo, hi] instead of values. The result 
+    encloses the value of the expression for every value of the variable within 
+    the input interval. Built in operators round their bounds outwards, function 
+    callbacks use the rules defined with ParserBase::DefineInterval. Functions 
+    without a rule can take any value.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    const value_type s_fInf = std::numeric_limits<value_type>::infinity();
+    const value_type s_fNaN = std::numeric_limits<value_type>::quiet_NaN();
+
+    //------------------------------------------------------------------------------
+    /** \brief Interval holding the range of a subexpression. 
+    
+      Empty intervals (the subexpression is undefined everywhere) have NaN bounds. 
+    */
+    struct SInterval
+    {
+      value_type lo;
+      value_type hi;
+    };
+
+    //------------------------------------------------------------------------------
+    inline SInterval MakeInterval(value_type lo, value_type hi)
+    {
+      SInterval res = { lo, hi };
+      return res;
+    }
+
+    inline SInterval MakeInterval(value_type v)
+    {
+      return MakeInterval(v, v);
+    }
+
+    /** \brief Result of a comparison or logical operator. */
+    inline SInterval MakeTruth(bool bMaybeFalse, bool bMaybeTrue)
+    {
+      return MakeInterval((value_type)(bMaybeFalse ? 0 : 1), (value_type)(bMaybeTrue ? 1 : 0));
+    }
+
+    inline bool IsEmpty(const SInterval &a)
+    {
+      return a.lo!=a.lo || a.hi!=a.hi;
+    }
+
+    inline SInterval Hull(const SInterval &a, const SInterval &b)
+    {
+      if (IsEmpty(a))
+        return b;
+      if (IsEmpty(b))
+        return a;
+      return MakeInterval(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+    }
+
+    // Like in the bytecode NaN counts as true, it is never false.
+    inline bool MaybeFalse(const SInterval &a) { return a.lo<=0 && a.hi>=0; }
+    inline bool MaybeTrue(const SInterval &a)  { return !(a.lo==0 && a.hi==0); }
+
+    //------------------------------------------------------------------------------
+    // Outward rounding. The rounding error of a result is computed exactly and 
+    // the result is moved by one ulp only if it was rounded in the wrong direction.
+    // Results close to the underflow range are always moved.
+    inline bool IsTiny(value_type v)
+    {
+      return std::fabs(v) < std::ldexp(std::numeric_limits<value_type>::min(), 2*std::numeric_limits<value_type>::digits);
+    }
+
+    inline value_type RoundDown(value_type v, value_type err) { return (err<0) ? std::nextafter(v, -s_fInf) : v; }
+    inline value_type RoundUp(value_type v, value_type err)   { return (err>0) ? std::nextafter(v, s_fInf) : v; }
+
+    // error of a+b by Knuth's TwoSum
+    inline value_type AddErr(value_type a, value_type b, value_type s)
+    {
+      if (!(s>-s_fInf && s<s_fInf))
+        return 0;
+
+      value_type bb = s - a;
+      return (a - (s - bb)) + (b - bb);
+    }
+
+    inline value_type AddDown(value_type a, value_type b) { value_type s = a + b; return RoundDown(s, AddErr(a, b, s)); }
+    inline value_type AddUp(value_type a, value_type b)   { value_type s = a + b; return RoundUp(s, AddErr(a, b, s)); }
+
+    // Products of a bound with zero are zero even if the other bound is infinite.
+    inline value_type MulErr(value_type a, value_type b, value_type p)
+    {
+      return (p>-s_fInf && p<s_fInf) ? std::fma(a, b, -p) : 0;
+    }
+
+    inline value_type MulDown(value_type a, value_type b) 
+    { 
+      if (a==0 || b==0)
+        return 0;
+
+      value_type p = a * b; 
+      return IsTiny(p) ? std::nextafter(p, -s_fInf) : RoundDown(p, MulErr(a, b, p)); 
+    }
+
+    inline value_type MulUp(value_type a, value_type b)   
+    { 
+      if (a==0 || b==0)
+        return 0;
+
+      value_type p = a * b; 
+      return IsTiny(p) ? std::nextafter(p, s_fInf) : RoundUp(p, MulErr(a, b, p)); 
+    }
+
+    // The remainder a - q*b has the sign of the rounding error of q = a/b.
+    inline value_type DivErr(value_type a, value_type b, value_type q)
+    {
+      if (!(q>-s_fInf && q<s_fInf) || !(b>-s_fInf && b<s_fInf))
+        return 0;
+
+      value_type r = std::fma(-q, b, a);
+      return (b>0) ? r : -r;
+    }
+
+    inline value_type DivDown(value_type a, value_type b) 
+    { 
+      if (a==0)
+        return 0;
+
+      value_type q = a / b; 
+      return (IsTiny(q) || IsTiny(a)) ? std::nextafter(q, -s_fInf) : RoundDown(q, DivErr(a, b, q)); 
+    }
+
+    inline value_type DivUp(value_type a, value_type b)   
+    { 
+      if (a==0)
+        return 0;
+
+      value_type q = a / b; 
+      return (IsTiny(q) || IsTiny(a)) ? std::nextafter(q, s_fInf) : RoundUp(q, DivErr(a, b, q)); 
+    }
+
+    //------------------------------------------------------------------------------
+    SInterval Mul(const SInterval &a, const SInterval &b)
+    {
+      value_type lo = std::min(std::min(MulDown(a.lo, b.lo), MulDown(a.lo, b.hi)), 
+                               std::min(MulDown(a.hi, b.lo), MulDown(a.hi, b.hi))),
+                 hi = std::max(std::max(MulUp(a.lo, b.lo), MulUp(a.lo, b.hi)), 
+                               std::max(MulUp(a.hi, b.lo), MulUp(a.hi, b.hi)));
+      return MakeInterval(lo, hi);
+    }
+
+    SInterval Div(const SInterval &a, const SInterval &b)
+    {
+      if (b.lo>0 || b.hi<0)
+      {
+        value_type lo = std::min(std::min(DivDown(a.lo, b.lo), DivDown(a.lo, b.hi)), 
+                                 std::min(DivDown(a.hi, b.lo), DivDown(a.hi, b.hi))),
+                   hi = std::max(std::max(DivUp(a.lo, b.lo), DivUp(a.lo, b.hi)), 
+                                 std::max(DivUp(a.hi, b.lo), DivUp(a.hi, b.hi)));
+        return MakeInterval(lo, hi);
+      }
+
+      // The divisor touches zero, the result is unbounded on at least one side.
+      if (b.lo==0 && b.hi>0)
+      {
+        if (a.lo>0) return MakeInterval(DivDown(a.lo, b.hi), s_fInf);
+        if (a.hi<0) return MakeInterval(-s_fInf, DivUp(a.hi, b.hi));
+      }
+      else if (b.hi==0 && b.lo<0)
+      {
+        if (a.lo>0) return MakeInterval(-s_fInf, DivUp(a.lo, b.lo));
+        if (a.hi<0) return MakeInterval(DivDown(a.hi, b.lo), s_fInf);
+      }
+
+      return MakeInterval(-s_fInf, s_fInf);
+    }
+
+    // std::pow is not correctly rounded, its results are widened by a few ulps.
+    inline value_type PowErr(value_type v)
+    {
+      return (v>-s_fInf && v<s_fInf) ? std::fabs(v) * 4 * std::numeric_limits<value_type>::epsilon() 
+                                       + std::numeric_limits<value_type>::denorm_min() : 0;
+    }
+
+    inline value_type PowDown(value_type a, value_type b) { value_type v = MathImpl<value_type>::Pow(a, b); return v - PowErr(v); }
+    inline value_type PowUp(value_type a, value_type b)   { value_type v = MathImpl<value_type>::Pow(a, b); return v + PowErr(v); }
+
+    /** \brief Integer power of an interval, even powers are not negative. */
+    SInterval PowInt(const SInterval &a, value_type n)
+    {
+      if (n==0)
+        return MakeInterval(1);
+
+      if (n<0)
+        return Div(MakeInterval(1), PowInt(a, -n));
+
+      // squares are rounded exactly
+      if (n==2)
+      {
+        value_type lo = (a.lo>=0) ? a.lo : (a.hi<=0) ? -a.hi : 0,
+                   hi = std::max(-a.lo, a.hi);
+        return MakeInterval(MulDown(lo, lo), MulUp(hi, hi));
+      }
+
+      bool bEven = std::fmod(n, (value_type)2)==0;
+      if (!bEven || a.lo>=0)
+        return MakeInterval(PowDown(a.lo, n), PowUp(a.hi, n));
+      else if (a.hi<=0)
+        return MakeInterval(PowDown(a.hi, n), PowUp(a.lo, n));
+      else
+        return MakeInterval(0, std::max(PowUp(a.lo, n), PowUp(a.hi, n)));
+    }
+
+    SInterval Pow(const SInterval &a, const SInterval &b)
+    {
+      if (b.lo==b.hi && b.lo==std::floor(b.lo))
+        return PowInt(a, b.lo);
+
+      // Negative bases are only valid with integer exponents.
+      if (a.lo<0 && b.lo!=b.hi)
+        return MakeInterval(-s_fInf, s_fInf);
+
+      value_type lo = std::max(a.lo, (value_type)0);
+      if (lo>a.hi)
+        return MakeInterval(s_fNaN, s_fNaN);
+
+      // a^b is monotonic in both arguments for a>=0
+      value_type c[4] = { PowDown(lo, b.lo), PowDown(lo, b.hi), PowDown(a.hi, b.lo), PowDown(a.hi, b.hi) },
+                 d[4] = { PowUp(lo, b.lo),   PowUp(lo, b.hi),   PowUp(a.hi, b.lo),   PowUp(a.hi, b.hi) };
+      return MakeInterval(std::max(*std::min_element(c, c+4), (value_type)0), *std::max_element(d, d+4));
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief State of an if-then-else clause. */
+    enum EBranch
+    {
+      brTHEN,       ///< The condition is true, only the if branch is evaluated
+      brELSE,       ///< The condition is false, only the else branch is evaluated
+      brBOTH,       ///< The condition may be true or false, the results are merged
+    };
+
+    /** \brief Open if-then-else clause. */
+    struct SBranch
+    {
+      EBranch eState;
+      SInterval vThen;  ///< Result of the if branch if both are evaluated
+    };
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the range of the expression over an interval of a variable.
+      \param a_pVar Pointer to the variable.
+      \param a_fLo Lower bound of the variable.
+      \param a_fHi Upper bound of the variable.
+      \param a_pLo [out] Lower bound of the expression.
+      \param a_pHi [out] Upper bound of the expression.
+
+    The bytecode is evaluated once with intervals. The bounds enclose the 
+    expression for any value of the variable within [a_fLo, a_fHi], they are 
+    usually not tight. Points where the expression is undefined are ignored, if 
+    it is undefined everywhere the bounds are NaN. Conditions that can be both 
+    true and false evaluate both branches and merge their results. Assignments 
+    do not modify the variables. If the expression has several comma separated 
+    results the last one is returned.
+  */
+  void ParserBase::EvalInterval(value_type *a_pVar, 
+                                value_type a_fLo, 
+                                value_type a_fHi, 
+                                value_type *a_pLo, 
+                                value_type *a_pHi) const
+  {
+    if (m_pParseFormula==&ParserBase::ParseString)
+      ParseString();
+
+    std::vector<SInterval> Stack(m_vRPN.GetMaxStackSize());
+    std::vector<SBranch> vBranch;
+    std::vector<value_type> vLo, vHi;
+
+    // Ranges of the variables: the input interval and the ones written by 
+    // assignments.
+    std::vector< std::pair<value_type*, SInterval> > vVarRange(1, std::make_pair(a_pVar, MakeInterval(a_fLo, a_fHi)));
+
+    int sidx(0);
+    for (const SToken *pTok = m_vRPN.GetBase(); pTok->Cmd!=cmEND ; ++pTok)
+    {
+      if (pTok->Cmd<=cmLOR)
+      {
+        --sidx;
+        SInterval &a = Stack[sidx];
+        const SInterval &b = Stack[sidx+1];
+        bool bEmpty = IsEmpty(a) || IsEmpty(b);
+
+        switch (pTok->Cmd)
+        {
+        // comparisons with NaN are false
+        case  cmLE:   a = (bEmpty) ? MakeInterval(0) : MakeTruth(a.hi>b.lo, a.lo<=b.hi); continue;
+        case  cmGE:   a = (bEmpty) ? MakeInterval(0) : MakeTruth(a.lo<b.hi, a.hi>=b.lo); continue;
+        case  cmLT:   a = (bEmpty) ? MakeInterval(0) : MakeTruth(a.hi>=b.lo, a.lo<b.hi); continue;
+        case  cmGT:   a = (bEmpty) ? MakeInterval(0) : MakeTruth(a.lo<=b.hi, a.hi>b.lo); continue;
+        case  cmEQ:   a = (bEmpty) ? MakeInterval(0) : MakeTruth(a.lo!=a.hi || b.lo!=b.hi || a.lo!=b.lo, a.lo<=b.hi && b.lo<=a.hi); continue;
+        case  cmNEQ:  a = (bEmpty) ? MakeInterval(1) : MakeTruth(a.lo<=b.hi && b.lo<=a.hi, a.lo!=a.hi || b.lo!=b.hi || a.lo!=b.lo); continue;
+        case  cmLAND: a = MakeTruth(MaybeFalse(a) || MaybeFalse(b), MaybeTrue(a) && MaybeTrue(b)); continue;
+        case  cmLOR:  a = MakeTruth(MaybeFalse(a) && MaybeFalse(b), MaybeTrue(a) || MaybeTrue(b)); continue;
+        default:      break;
+        }
+
+        if (bEmpty)
+        {
+          a = MakeInterval(s_fNaN, s_fNaN);
+          continue;
+        }
+
+        switch (pTok->Cmd)
+        {
+        case  cmADD:  a = MakeInterval(AddDown(a.lo, b.lo), AddUp(a.hi, b.hi)); continue;
+        case  cmSUB:  a = MakeInterval(AddDown(a.lo, -b.hi), AddUp(a.hi, -b.lo)); continue;
+        case  cmMUL:  a = Mul(a, b); continue;
+        case  cmDIV:  a = Div(a, b); continue;
+        case  cmPOW:  a = Pow(a, b); continue;
+        default:      
+              Error(ecINTERNAL_ERROR, 3);
+              return;
+        }
+      }
+
+      switch (pTok->Cmd)
+      {
+      case  cmASSIGN:
+            {
+              --sidx; 
+              Stack[sidx] = Stack[sidx+1];
+
+              std::size_t i = 0;
+              while (i<vVarRange.size() && vVarRange[i].first!=pTok->Oprt.ptr)
+                ++i;
+
+              if (i==vVarRange.size())
+                vVarRange.push_back(std::make_pair(pTok->Oprt.ptr, MakeInterval(*pTok->Oprt.ptr)));
+
+              // A branch that may not be taken keeps the previous range.
+              bool bMaybe = false;
+              for (std::size_t j=0; j<vBranch.size(); ++j)
+                bMaybe |= vBranch[j].eState==brBOTH;
+
+              vVarRange[i].second = (bMaybe) ? Hull(vVarRange[i].second, Stack[sidx]) : Stack[sidx];
+            }
+            continue;
+
+      case  cmIF:
+            {
+              const SInterval &c = Stack[sidx--];
+              SBranch br = { MaybeFalse(c) ? (MaybeTrue(c) ? brBOTH : brELSE) : brTHEN, MakeInterval(s_fNaN, s_fNaN) };
+              vBranch.push_back(br);
+              if (br.eState==brELSE)
+                pTok += pTok->Oprt.offset;
+            }
+            continue;
+
+      case  cmELSE:
+            // The if branch is done. Merged results are completed at cmENDIF, 
+            // which is skipped when jumping.
+            if (vBranch.back().eState==brBOTH)
+            {
+              vBranch.back().vThen = Stack[sidx--];
+              continue;
+            }
+
+            vBranch.pop_back();
+            pTok += pTok->Oprt.offset;
+            continue;
+
+      case  cmENDIF:
+            if (vBranch.back().eState==brBOTH)
+              Stack[sidx] = Hull(vBranch.back().vThen, Stack[sidx]);
+            vBranch.pop_back();
+            continue;
+
+      // value and variable tokens
+      case  cmVAL:    
+            Stack[++sidx] = MakeInterval(pTok->Val.data2);
+            continue;
+
+      case  cmVAR:
+      case  cmVARPOW2:
+      case  cmVARPOW3:
+      case  cmVARPOW4:
+      case  cmVARMUL:
+            {
+              SInterval u = MakeInterval(*pTok->Val.ptr);
+              for (std::size_t i=0; i<vVarRange.size(); ++i)
+              {
+                if (vVarRange[i].first==pTok->Val.ptr)
+                  u = vVarRange[i].second;
+              }
+
+              switch(pTok->Cmd)
+              {
+              case cmVARPOW2: u = PowInt(u, 2); break;
+              case cmVARPOW3: u = PowInt(u, 3); break;
+              case cmVARPOW4: u = PowInt(u, 4); break;
+              case cmVARMUL:  
+                   u = Mul(u, MakeInterval(pTok->Val.data)); 
+                   u = MakeInterval(AddDown(u.lo, pTok->Val.data2), AddUp(u.hi, pTok->Val.data2)); 
+                   break;
+              default:        break;
+              }
+
+              Stack[++sidx] = u;
+            }
+            continue;
+
+      // temporaries holding common subexpressions
+      case  cmSTORE:
+            Stack[pTok->Oprt.offset] = Stack[sidx];
+            continue;
+
+      case  cmLOAD:
+            Stack[++sidx] = Stack[pTok->Oprt.offset];
+            continue;
+
+      // sums and products: bounds that aren't points leave the number of 
+      // iterations open, the result is unbounded then
+      case  cmLOOP:
+            {
+              SInterval &k = Stack[sidx-1], 
+                        &b = Stack[sidx];
+              value_type fCount = std::floor(b.lo - k.lo) + 1,
+                         fInit = (pTok->Oprt.code==cmMUL) ? 1 : 0;
+              bool bPoint = k.lo==k.hi && b.lo==b.hi;
+              if (bPoint && fCount>0 && fCount<=MUP_LOOP_MAX)
+              {
+                b = MakeInterval(fCount);
+                Stack[++sidx] = MakeInterval(fInit);
+                continue;
+              }
+
+              SInterval res = MakeInterval(s_fNaN, s_fNaN);
+              if (!bPoint && !IsEmpty(k) && !IsEmpty(b))
+                res = MakeInterval(-s_fInf, s_fInf);
+              else if (bPoint && fCount<=0)
+                res = MakeInterval(fInit);
+
+              Stack[--sidx] = res;
+              pTok += pTok->Oprt.offset;
+            }
+            continue;
+
+      case  cmENDLOOP:
+            {
+              --sidx;
+              SInterval &a = Stack[sidx];
+              const SInterval &v = Stack[sidx+1];
+              if (IsEmpty(a) || IsEmpty(v))
+                a = MakeInterval(s_fNaN, s_fNaN);
+              else if (pTok->Oprt.code==cmMUL)
+                a = Mul(a, v);
+              else
+                a = MakeInterval(AddDown(a.lo, v.lo), AddUp(a.hi, v.hi));
+
+              SInterval &iCount = Stack[sidx-1];
+              if (iCount.lo>1)
+              {
+                iCount = MakeInterval(iCount.lo - 1);
+                Stack[sidx-2] = MakeInterval(Stack[sidx-2].lo + 1);
+                pTok -= pTok->Oprt.offset;
+                continue;
+              }
+
+              sidx -= 2;
+              Stack[sidx] = Stack[sidx+2];
+            }
+            continue;
+
+      case  cmFUNC:
+      case  cmFUNC_STR:
+      case  cmFUNC_BULK:
+            {
+              int nArg = (pTok->Fun.argc>=0) ? pTok->Fun.argc : -pTok->Fun.argc;
+              sidx -= nArg - 1;
+
+              bool bEmpty = false;
+              vLo.resize(std::max(nArg, 1));
+              vHi.resize(std::max(nArg, 1));
+              for (int i=0; i<nArg; ++i)
+              {
+                vLo[i] = Stack[sidx + i].lo;
+                vHi[i] = Stack[sidx + i].hi;
+                bEmpty |= IsEmpty(Stack[sidx + i]);
+              }
+
+              intervalmap_type::const_iterator item = m_IntervalDef.find(pTok->Fun.ptr);
+              SInterval &res = Stack[sidx];
+              if (bEmpty)
+                res = MakeInterval(s_fNaN, s_fNaN);
+              else if (pTok->Cmd==cmFUNC && item!=m_IntervalDef.end())
+                item->second(&vLo[0], &vHi[0], nArg, &res.lo, &res.hi);
+              else
+                res = MakeInterval(-s_fInf, s_fInf);
+            }
+            continue;
+
+      default:
+            Error(ecINTERNAL_ERROR, 3);
+            return;
+      } // switch CmdCode
+    } // for all bytecode tokens
+
+    const SInterval &res = Stack[m_nFinalResultIdx];
+    *a_pLo = res.lo;
+    *a_pHi = res.hi;
+  }
+} // namespace mu
@@ -0,0 +1,553 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+
+#include "muParserJit.h"
+#include "muParserTemplateMagic.h"
+#include "muParserStack.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <cstring>
+#include <type_traits>
+
+#if defined(MUP_JIT_X64)
+  #if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+  #else
+    #include <sys/mman.h>
+  #endif
+#endif
+
+/** \file
+    \brief Implementation of the just in time compiler for the parser bytecode.
+*/
+
+
+namespace mu
+{
+  namespace
+  {
+    // opcodes of the SSE2 instructions used (all following a 0x0F byte)
+    const unsigned char opMOVSD_LOAD  = 0x10;
+    const unsigned char opMOVSD_STORE = 0x11;
+    const unsigned char opMOVAPD      = 0x28;
+    const unsigned char opUCOMISD     = 0x2E;
+    const unsigned char opANDPD       = 0x54;
+    const unsigned char opORPD        = 0x56;
+    const unsigned char opXORPD       = 0x57;
+    const unsigned char opADDSD       = 0x58;
+    const unsigned char opMULSD       = 0x59;
+    const unsigned char opSUBSD       = 0x5C;
+    const unsigned char opDIVSD       = 0x5E;
+    const unsigned char opCMPSD       = 0xC2;
+
+    // predicates of cmpsd
+    const unsigned char cmpEQ  = 0;
+    const unsigned char cmpLT  = 1;
+    const unsigned char cmpLE  = 2;
+    const unsigned char cmpNEQ = 4;
+
+    // The register used as temporary for constants, xmm6 and up must be 
+    // preserved in the Win64 calling convention.
+    const int regTMP = 5;
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  ParserJit::ParserJit()
+    :m_vCode()
+    ,m_pMem(0)
+    ,m_iMemSize(0)
+    ,m_pFun(0)
+  {}
+
+  //---------------------------------------------------------------------------
+  ParserJit::~ParserJit()
+  {
+    Clear();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Release the compiled code. */
+  void ParserJit::Clear()
+  {
+#if defined(MUP_JIT_X64)
+    if (m_pMem)
+    {
+  #if defined(_WIN32)
+      VirtualFree(m_pMem, 0, MEM_RELEASE);
+  #else
+      munmap(m_pMem, m_iMemSize);
+  #endif
+    }
+#endif
+
+    m_vCode.clear();
+    m_pMem = 0;
+    m_iMemSize = 0;
+    m_pFun = 0;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns true if Compile() succeeded and the code can be run. */
+  bool ParserJit::IsCompiled() const
+  {
+    return m_pFun!=0;
+  }
+
+  //---------------------------------------------------------------------------
+  void ParserJit::Emit(const unsigned char *a_pBytes, std::size_t a_iSize)
+  {
+    m_vCode.insert(m_vCode.end(), a_pBytes, a_pBytes + a_iSize);
+  }
+
+  //---------------------------------------------------------------------------
+  void ParserJit::Emit8(unsigned char a_iByte)
+  {
+    m_vCode.push_back(a_iByte);
+  }
+
+  //---------------------------------------------------------------------------
+  void ParserJit::Emit32(int a_iVal)
+  {
+    unsigned char buf[4];
+    std::memcpy(buf, &a_iVal, 4);
+    Emit(buf, 4);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Emit the 8 bytes a_pVal points to. */
+  void ParserJit::Emit64(const void *a_pVal)
+  {
+    Emit(static_cast<const unsigned char*>(a_pVal), 8);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Emit "mov rax, imm64" with the 8 bytes a_pVal points to. */
+  void ParserJit::EmitMovRax(const void *a_pVal)
+  {
+    Emit8(0x48);
+    Emit8(0xB8);
+    Emit64(a_pVal);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Emit a SSE instruction with two xmm register operands. */
+  void ParserJit::EmitSse(unsigned char a_iPrefix, unsigned char a_iOp, int a_iDst, int a_iSrc)
+  {
+    Emit8(a_iPrefix);
+    Emit8(0x0F);
+    Emit8(a_iOp);
+    Emit8((unsigned char)(0xC0 | (a_iDst << 3) | a_iSrc));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Emit a scalar double instruction operating on a stack slot. 
+  
+    The stack base address is held in rbx, the operand is [rbx + 8*a_iSlot].
+  */
+  void ParserJit::EmitSlotOp(unsigned char a_iOp, int a_iReg, int a_iSlot)
+  {
+    Emit8(0xF2);
+    Emit8(0x0F);
+    Emit8(a_iOp);
+    Emit8((unsigned char)(0x83 | (a_iReg << 3)));
+    Emit32(a_iSlot * (int)sizeof(value_type));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Load a constant into a xmm register. */
+  void ParserJit::EmitLoadVal(int a_iReg, value_type a_fVal)
+  {
+    EmitMovRax(&a_fVal);
+
+    // movq xmm, rax
+    Emit8(0x66);
+    Emit8(0x48);
+    Emit8(0x0F);
+    Emit8(0x6E);
+    Emit8((unsigned char)(0xC0 | (a_iReg << 3)));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Load the value of a variable into a xmm register. */
+  void ParserJit::EmitLoadVar(int a_iReg, const value_type *a_pVar)
+  {
+    EmitMovRax(&a_pVar);
+
+    // movsd xmm, [rax]
+    Emit8(0xF2);
+    Emit8(0x0F);
+    Emit8(opMOVSD_LOAD);
+    Emit8((unsigned char)(a_iReg << 3));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Turn the all bits set mask of a comparison into 1.0. */
+  void ParserJit::EmitAndOne(int a_iReg)
+  {
+    EmitLoadVal(regTMP, 1);
+    EmitSse(0x66, opANDPD, a_iReg, regTMP);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Emit a call of a function, the arguments must already be set up. 
+      \param a_pFun Points to the function pointer.
+  */
+  void ParserJit::EmitCall(const void *a_pFun)
+  {
+    EmitMovRax(a_pFun);
+
+    // call rax
+    Emit8(0xFF);
+    Emit8(0xD0);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Copy the code into executable memory. */
+  bool ParserJit::CreateFunction()
+  {
+#if defined(MUP_JIT_X64)
+    m_iMemSize = m_vCode.size();
+
+  #if defined(_WIN32)
+    m_pMem = VirtualAlloc(0, m_iMemSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (m_pMem==0)
+      return false;
+
+    DWORD dwOld;
+    std::memcpy(m_pMem, &m_vCode[0], m_iMemSize);
+    if (!VirtualProtect(m_pMem, m_iMemSize, PAGE_EXECUTE_READ, &dwOld))
+      return false;
+  #else
+    m_pMem = mmap(0, m_iMemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m_pMem==MAP_FAILED)
+    {
+      m_pMem = 0;
+      return false;
+    }
+
+    std::memcpy(m_pMem, &m_vCode[0], m_iMemSize);
+    if (mprotect(m_pMem, m_iMemSize, PROT_READ | PROT_EXEC)!=0)
+      return false;
+  #endif
+
+    std::memcpy(&m_pFun, &m_pMem, sizeof(m_pFun));
+    std::vector<unsigned char>().swap(m_vCode);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Translate bytecode into machine code. 
+      \param a_ByteCode The finalized bytecode.
+      \return true if the bytecode could be compiled, false if the interpreter
+              has to be used.
+  */
+  bool ParserJit::Compile(const ParserByteCode &a_ByteCode)
+  {
+    Clear();
+
+#if !defined(MUP_JIT_X64)
+    (void)a_ByteCode;
+    return false;
+#else
+    if (!std::is_same<value_type, double>::value)
+      return false;
+
+  #if defined(_WIN32)
+    const unsigned char regARG1 = 0x8B;   // modrm for "lea rcx, [rbx+disp32]"
+    const unsigned char movARG2 = 0xBA;   // mov edx, imm32
+  #else
+    const unsigned char regARG1 = 0xBB;   // modrm for "lea rdi, [rbx+disp32]"
+    const unsigned char movARG2 = 0xBE;   // mov esi, imm32
+  #endif
+
+    const SToken *pRPN = a_ByteCode.GetBase();
+    std::size_t nTok = a_ByteCode.GetSize();
+
+    std::vector<std::size_t> vTokPos(nTok + 1, 0);  // code position of each token
+    std::vector<std::size_t> vJumpPos, vJumpTarget; // jumps to patch 
+    ParserStack<int> stIf;                          // stack positions at if-then-else tokens
+
+    // Prologue: save rbx, align the stack with room for the Win64 shadow space
+    // and keep the stack base passed as argument in rbx.
+    static const unsigned char szPrologue[] = 
+    {
+      0x53,                   // push rbx
+      0x48, 0x83, 0xEC, 0x20, // sub rsp, 32
+  #if defined(_WIN32)
+      0x48, 0x89, 0xCB        // mov rbx, rcx
+  #else
+      0x48, 0x89, 0xFB        // mov rbx, rdi
+  #endif
+    };
+    Emit(szPrologue, sizeof(szPrologue));
+
+    int sidx(0);
+    std::size_t i(0);
+    for (; i<nTok && pRPN[i].Cmd!=cmEND; ++i)
+    {
+      const SToken &tok = pRPN[i];
+      vTokPos[i] = m_vCode.size();
+
+      switch (tok.Cmd)
+      {
+      // built in binary operators
+      case  cmLE:
+      case  cmGE:
+      case  cmNEQ:
+      case  cmEQ:
+      case  cmLT:
+      case  cmGT:
+            {
+              --sidx; 
+              EmitSlotOp(opMOVSD_LOAD, 0, sidx);
+              EmitSlotOp(opMOVSD_LOAD, 1, sidx + 1);
+
+              // a>b and a>=b are computed as b<a and b<=a
+              int iDst = (tok.Cmd==cmGE || tok.Cmd==cmGT) ? 1 : 0;
+              unsigned char iPred = cmpEQ;
+              switch(tok.Cmd)
+              {
+              case cmLE:  iPred = cmpLE;  break;
+              case cmGE:  iPred = cmpLE;  break;
+              case cmNEQ: iPred = cmpNEQ; break;
+              case cmLT:  iPred = cmpLT;  break;
+              case cmGT:  iPred = cmpLT;  break;
+              default:    iPred = cmpEQ;  break;
+              }
+
+              EmitSse(0xF2, opCMPSD, iDst, 1 - iDst);
+              Emit8(iPred);
+              EmitAndOne(iDst);
+              EmitSlotOp(opMOVSD_STORE, iDst, sidx);
+            }
+            continue;
+
+      case  cmADD:
+      case  cmSUB:
+      case  cmMUL:
+      case  cmDIV:
+            {
+  #if defined(MUP_MATH_EXCEPTIONS)
+              if (tok.Cmd==cmDIV)
+                return false;
+  #endif
+              unsigned char iOp = (tok.Cmd==cmADD) ? opADDSD :
+                                  (tok.Cmd==cmSUB) ? opSUBSD :
+                                  (tok.Cmd==cmMUL) ? opMULSD : opDIVSD;
+              --sidx;
+              EmitSlotOp(opMOVSD_LOAD, 0, sidx);
+              EmitSlotOp(iOp, 0, sidx + 1);
+              EmitSlotOp(opMOVSD_STORE, 0, sidx);
+            }
+            continue;
+
+      case  cmPOW:
+            {
+              fun_type2 pPow = &MathImpl<value_type>::Pow;
+              --sidx;
+              EmitSlotOp(opMOVSD_LOAD, 0, sidx);
+              EmitSlotOp(opMOVSD_LOAD, 1, sidx + 1);
+              EmitCall(&pPow);
+              EmitSlotOp(opMOVSD_STORE, 0, sidx);
+            }
+            continue;
+
+      case  cmLAND:
+      case  cmLOR:
+            // Any value different from zero (including NaN) is true
+            --sidx;
+            EmitSlotOp(opMOVSD_LOAD, 0, sidx);
+            EmitSlotOp(opMOVSD_LOAD, 1, sidx + 1);
+            EmitSse(0x66, opXORPD, 2, 2);
+            EmitSse(0xF2, opCMPSD, 0, 2);
+            Emit8(cmpNEQ);
+            EmitSse(0xF2, opCMPSD, 1, 2);
+            Emit8(cmpNEQ);
+            EmitSse(0x66, (tok.Cmd==cmLAND) ? opANDPD : opORPD, 0, 1);
+            EmitAndOne(0);
+            EmitSlotOp(opMOVSD_STORE, 0, sidx);
+            continue;
+
+      case  cmASSIGN:
+            --sidx; 
+            EmitSlotOp(opMOVSD_LOAD, 0, sidx + 1);
+            EmitSlotOp(opMOVSD_STORE, 0, sidx);
+            EmitMovRax(&tok.Oprt.ptr);
+            Emit8(0xF2);                 // movsd [rax], xmm0
+            Emit8(0x0F);
+            Emit8(opMOVSD_STORE);
+            Emit8(0x00);
+            continue;
+
+      case  cmIF:
+            {
+              EmitSlotOp(opMOVSD_LOAD, 0, sidx--);
+              EmitSse(0x66, opXORPD, 1, 1);
+              EmitSse(0x66, opUCOMISD, 0, 1);
+
+              // NaN is not equal to zero: skip the jump if the comparison is unordered
+              static const unsigned char szJmp[] = { 0x7A, 0x06, 0x0F, 0x84 }; // jp +6; je rel32
+              Emit(szJmp, sizeof(szJmp));
+              vJumpPos.push_back(m_vCode.size());
+              vJumpTarget.push_back(i + tok.Oprt.offset + 1);
+              Emit32(0);
+              stIf.push(sidx);
+            }
+            continue;
+
+      case  cmELSE:
+            {
+              Emit8(0xE9);  // jmp rel32
+              vJumpPos.push_back(m_vCode.size());
+              vJumpTarget.push_back(i + tok.Oprt.offset + 1);
+              Emit32(0);
+
+              // the else branch starts with the stack as it was after the condition
+              int iIfPos = stIf.pop();
+              stIf.push(sidx);
+              sidx = iIfPos;
+            }
+            continue;
+
+      case  cmENDIF:
+            if (stIf.pop()!=sidx)
+              return false;
+            continue;
+
+      // value and variable tokens
+      case  cmVAR:
+            EmitLoadVar(0, tok.Val.ptr);
+            EmitSlotOp(opMOVSD_STORE, 0, ++sidx);
+            continue;
+
+      case  cmVAL:
+            EmitLoadVal(0, tok.Val.data2);
+            EmitSlotOp(opMOVSD_STORE, 0, ++sidx);
+            continue;
+
+      case  cmVARPOW2:
+      case  cmVARPOW3:
+      case  cmVARPOW4:
+            {
+              int n = (tok.Cmd==cmVARPOW2) ? 1 : (tok.Cmd==cmVARPOW3) ? 2 : 3;
+              EmitLoadVar(0, tok.Val.ptr);
+              EmitSse(0x66, opMOVAPD, 1, 0);
+              for (int k=0; k<n; ++k)
+                EmitSse(0xF2, opMULSD, 0, 1);
+              EmitSlotOp(opMOVSD_STORE, 0, ++sidx);
+            }
+            continue;
+
+      case  cmVARMUL:
+            EmitLoadVar(0, tok.Val.ptr);
+            EmitLoadVal(1, tok.Val.data);
+            EmitSse(0xF2, opMULSD, 0, 1);
+            EmitLoadVal(1, tok.Val.data2);
+            EmitSse(0xF2, opADDSD, 0, 1);
+            EmitSlotOp(opMOVSD_STORE, 0, ++sidx);
+            continue;
+
+      case  cmSTORE:
+            EmitSlotOp(opMOVSD_LOAD, 0, sidx);
+            EmitSlotOp(opMOVSD_STORE, 0, tok.Oprt.offset);
+            continue;
+
+      case  cmLOAD:
+            EmitSlotOp(opMOVSD_LOAD, 0, tok.Oprt.offset);
+            EmitSlotOp(opMOVSD_STORE, 0, ++sidx);
+            continue;
+
+      // Numeric functions with up to four arguments are passed in xmm0..xmm3,
+      // this works for both the Win64 and the System V calling convention. 
+      // Functions with a variable number of arguments take a pointer to the 
+      // stack and the number of arguments.
+      case  cmFUNC:
+            {
+              int iArgCount = tok.Fun.argc;
+              if (iArgCount>4)
+                return false;
+
+              if (iArgCount>=0)
+              {
+                sidx -= iArgCount - 1;
+                for (int k=0; k<iArgCount; ++k)
+                  EmitSlotOp(opMOVSD_LOAD, k, sidx + k);
+              }
+              else
+              {
+                sidx -= -iArgCount - 1;
+                Emit8(0x48);        // lea arg1, [rbx + disp32]
+                Emit8(0x8D);
+                Emit8(regARG1);
+                Emit32(sidx * (int)sizeof(value_type));
+                Emit8(movARG2);     // mov arg2, imm32
+                Emit32(-iArgCount);
+              }
+
+              EmitCall(&tok.Fun.ptr);
+              EmitSlotOp(opMOVSD_STORE, 0, sidx);
+            }
+            continue;
+
+      // String functions, bulk functions and anything unknown are left to the interpreter
+      default:
+            return false;
+      } // switch CmdCode
+    } // for all bytecode tokens
+
+    vTokPos[i] = m_vCode.size();
+
+    // Epilogue
+    static const unsigned char szEpilogue[] = 
+    {
+      0x48, 0x83, 0xC4, 0x20, // add rsp, 32
+      0x5B,                   // pop rbx
+      0xC3                    // ret
+    };
+    Emit(szEpilogue, sizeof(szEpilogue));
+
+    // Resolve the jumps of the if-then-else clauses
+    for (std::size_t k=0; k<vJumpPos.size(); ++k)
+    {
+      if (vJumpTarget[k]>i)
+        return false;
+
+      int iRel = (int)vTokPos[vJumpTarget[k]] - (int)(vJumpPos[k] + 4);
+      std::memcpy(&m_vCode[vJumpPos[k]], &iRel, 4);
+    }
+
+    if (!CreateFunction())
+    {
+      Clear();
+      return false;
+    }
+
+    return true;
+#endif
+  }
+} // namespace mu
@@ -0,0 +1,172 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserBase.h"
+#include "muParserThreadPool.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+
+/** \file
+    \brief Implementation of the profiling counters of the evaluator.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    //------------------------------------------------------------------------------
+    /** \brief Orders callbacks by decreasing time. */
+    bool SlowerThan(const ParserProfile::SFunStat &a, const ParserProfile::SFunStat &b)
+    {
+      return a.fTime > b.fTime;
+    }
+
+    //------------------------------------------------------------------------------
+    /** \brief Add the names of the callbacks of a table that are not known yet. */
+    void AddNames(const funmap_type &a_FunDef, 
+                  const string_type &a_sPrefix, 
+                  std::map<generic_fun_type, string_type> &a_mapName)
+    {
+      for (funmap_type::const_iterator it=a_FunDef.begin(); it!=a_FunDef.end(); ++it)
+        a_mapName.insert(std::make_pair((generic_fun_type)it->second.GetAddr(), a_sPrefix + it->first));
+    }
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns a short name of a command code for display. */
+  const char_type* ParserProfile::GetCmdName(ECmdCode a_iCmd)
+  {
+    static const char_type *s_szName[] = 
+    {
+      _T("<="), _T(">="), _T("!="), _T("=="), _T("<"), _T(">"), _T("+"), _T("-"), _T("*"), _T("/"), 
+      _T("^"), _T("&&"), _T("||"), _T("="), _T("("), _T(")"), _T("if"), _T("else"), _T("endif"), 
+      _T(","), _T("var"), _T("val"), _T("var^2"), _T("var^3"), _T("var^4"), _T("a*var+b"), _T("^2"), 
+      _T("store"), _T("load"), _T("loop"), _T("endloop"), _T("func"), _T("strfunc"), _T("bulkfunc"), _T("string"), 
+      _T("binop"), _T("postfix"), _T("infix"), _T("end")
+    };
+    static_assert(sizeof(s_szName) / sizeof(s_szName[0])==cmUNKNOWN, "missing command names");
+
+    return (a_iCmd>=0 && a_iCmd<cmUNKNOWN) ? s_szName[a_iCmd] : _T("?");
+  }
+
+  //---------------------------------------------------------------------------
+  ParserProfileCounters::ParserProfileCounters()
+  {
+    Reset();
+  }
+
+  //---------------------------------------------------------------------------
+  void ParserProfileCounters::Reset()
+  {
+    nParse = 0;
+    fParseTime = 0;
+    nEval = 0;
+    fEvalTime = 0;
+    std::memset(aCmdCount, 0, sizeof(aCmdCount));
+    mapFun.clear();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns the profiling counters of this parser.
+
+    The counters sum up all evaluations since the parser was created or 
+    ResetProfile was called, whatever the expression. They are only maintained 
+    if the parser is built with MUP_PROFILING defined. Such builds always use 
+    the bytecode interpreter and the array evaluation, the JIT and the register
+    code have no counters. Timing the callbacks makes them slower than usual.
+
+    Tokens run by the array evaluation are counted once per value.
+  */
+  ParserProfile ParserBase::GetProfile() const
+  {
+    ParserProfile prof;
+#if defined(MUP_PROFILING)
+    prof.bEnabled = true;
+#else
+    prof.bEnabled = false;
+#endif
+
+    ParserProfileCounters sum;
+    for (std::size_t i=0; i<m_vProfile.size(); ++i)
+    {
+      const ParserProfileCounters &cnt = m_vProfile[i];
+      sum.nParse += cnt.nParse;
+      sum.fParseTime += cnt.fParseTime;
+      sum.nEval += cnt.nEval;
+      sum.fEvalTime += cnt.fEvalTime;
+      for (int k=0; k<cmUNKNOWN; ++k)
+        sum.aCmdCount[k] += cnt.aCmdCount[k];
+
+      for (ParserProfileCounters::funstat_type::const_iterator it=cnt.mapFun.begin(); it!=cnt.mapFun.end(); ++it)
+      {
+        std::pair<unsigned long long, double> &stat = sum.mapFun[it->first];
+        stat.first += it->second.first;
+        stat.second += it->second.second;
+      }
+    }
+
+    prof.nParse = sum.nParse;
+    prof.fParseTime = sum.fParseTime;
+    prof.nEval = sum.nEval;
+    prof.fEvalTime = sum.fEvalTime;
+    std::copy(sum.aCmdCount, sum.aCmdCount + cmUNKNOWN, prof.aCmdCount);
+
+    std::map<generic_fun_type, string_type> mapName;
+    AddNames(m_FunDef.Get(), string_type(), mapName);
+    AddNames(m_OprtDef.Get(), _T("binary "), mapName);
+    AddNames(m_InfixOprtDef.Get(), _T("prefix "), mapName);
+    AddNames(m_PostOprtDef.Get(), _T("postfix "), mapName);
+    for (ParserProfileCounters::funstat_type::const_iterator it=sum.mapFun.begin(); it!=sum.mapFun.end(); ++it)
+    {
+      std::map<generic_fun_type, string_type>::const_iterator itName = mapName.find(it->first);
+      ParserProfile::SFunStat stat = { (itName!=mapName.end()) ? itName->second : _T("?"), 
+                                       it->second.first, 
+                                       it->second.second };
+      prof.vFun.push_back(stat);
+    }
+    std::sort(prof.vFun.begin(), prof.vFun.end(), SlowerThan);
+
+    return prof;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Set all profiling counters to zero. */
+  void ParserBase::ResetProfile()
+  {
+    for (std::size_t i=0; i<m_vProfile.size(); ++i)
+      m_vProfile[i].Reset();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns the profiling counters of a thread of the pool or NULL.
+  
+    The counters exist once the bytecode has been compiled in a build with
+    MUP_PROFILING defined.
+  */
+  ParserProfileCounters* ParserBase::GetProfileCounters(int a_iThread) const
+  {
+    return (a_iThread < (int)m_vProfile.size()) ? &m_vProfile[a_iThread] : NULL;
+  }
+} // namespace mu
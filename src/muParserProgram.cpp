@@ -0,0 +1,161 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserProgram.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+
+/** \file
+    \brief Implementation of the compiled program.
+*/
+
+namespace mu
+{
+  //---------------------------------------------------------------------------
+  /** \brief Create an empty program. */
+  ParserProgram::ParserProgram()
+    :m_pProgram()
+  {}
+
+  //---------------------------------------------------------------------------
+  /** \brief Create a program from finalized bytecode.
+      \param a_ByteCode The bytecode, it is copied.
+      \param a_vStrBuf The string arguments of the bytecode.
+      \param a_iNumResults The number of comma separated results.
+  */
+  ParserProgram::ParserProgram(const ParserByteCode &a_ByteCode, const stringbuf_type &a_vStrBuf, int a_iNumResults)
+    :m_pProgram()
+  {
+    std::shared_ptr<SProgram> pProgram(new SProgram);
+    pProgram->vRPN.assign(a_ByteCode.GetBase(), a_ByteCode.GetBase() + a_ByteCode.GetSize());
+    pProgram->vSlot.assign(pProgram->vRPN.size(), -1);
+    pProgram->vStrBuf = a_vStrBuf;
+    pProgram->iStackSize = a_ByteCode.GetMaxStackSize();
+    pProgram->iNumResults = a_iNumResults;
+
+    // Number the variables in the order of their first use
+    for (std::size_t i=0; i<pProgram->vRPN.size(); ++i)
+    {
+      const SToken &tok = pProgram->vRPN[i];
+      value_type *pVar = NULL;
+      switch (tok.Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:  pVar = tok.Val.ptr;  break;
+      case cmASSIGN:  pVar = tok.Oprt.ptr; break;
+      default:        continue;
+      }
+
+      std::vector<value_type*> &vVar = pProgram->vVar;
+      pProgram->vSlot[i] = (int)(std::find(vVar.begin(), vVar.end(), pVar) - vVar.begin());
+      if (pProgram->vSlot[i]==(int)vVar.size())
+        vVar.push_back(pVar);
+    }
+
+    m_pProgram = pProgram;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the program.
+      \param a_pVar The variable values in slot order, assignments write to it.
+      \param a_pStack The evaluation stack, it must hold GetStackSize() values.
+      \return The last result. All results are at a_pStack[1..GetNumResults()].
+
+    Concurrent evaluations are safe as long as they use different variable 
+    arrays and stacks and the callbacks of the expression are thread safe.
+  */
+  value_type ParserProgram::Eval(value_type *a_pVar, value_type *a_pStack) const
+  {
+    if (!m_pProgram)
+      throw ParserError(ecUNEXPECTED_EOF, 0, string_type());
+
+    const SProgram &prog = *m_pProgram;
+    SSlotVar var = { &prog.vRPN[0], &prog.vSlot[0], a_pVar };
+    return RunByteCode(&prog.vRPN[0], a_pStack, var, prog.vStrBuf.empty() ? NULL : &prog.vStrBuf[0], 0, 0);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Copy the current values of the variables bound to the parser.
+      \param a_pVar [out] The variable values in slot order.
+  */
+  void ParserProgram::LoadVar(value_type *a_pVar) const
+  {
+    for (int i=0; i<GetNumVar(); ++i)
+      a_pVar[i] = *m_pProgram->vVar[i];
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the number of variable slots. */
+  int ParserProgram::GetNumVar() const
+  {
+    return (m_pProgram) ? (int)m_pProgram->vVar.size() : 0;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the slot of a variable bound to the parser.
+      \param a_pVar The pointer the variable was defined with.
+      \return The slot or -1 if the expression does not use the variable.
+  */
+  int ParserProgram::GetVarSlot(const value_type *a_pVar) const
+  {
+    for (int i=0; i<GetNumVar(); ++i)
+    {
+      if (m_pProgram->vVar[i]==a_pVar)
+        return i;
+    }
+
+    return -1;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the pointer the variable of a slot was bound to. */
+  value_type* ParserProgram::GetVarPtr(int a_iSlot) const
+  {
+    return m_pProgram->vVar[a_iSlot];
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the number of stack values needed by Eval. */
+  std::size_t ParserProgram::GetStackSize() const
+  {
+    return (m_pProgram) ? m_pProgram->iStackSize : 0;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the number of comma separated results. */
+  int ParserProgram::GetNumResults() const
+  {
+    return (m_pProgram) ? m_pProgram->iNumResults : 0;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Check if the program was created from a parser. */
+  bool ParserProgram::IsEmpty() const
+  {
+    return !m_pProgram;
+  }
+} // namespace mu
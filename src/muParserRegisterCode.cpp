@@ -0,0 +1,647 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+
+#include "muParserRegisterCode.h"
+#include "muParserTemplateMagic.h"
+#include "muParserStack.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+/** \file
+    \brief Implementation of the register based form of the parser bytecode.
+*/
+
+
+namespace mu
+{
+  namespace
+  {
+    /** \brief Largest index that can be stored in an instruction operand. */
+    const std::size_t s_iMaxIndex = 0xFFFF;
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  ParserRegisterCode::ParserRegisterCode()
+    :m_vCode()
+    ,m_vConst()
+    ,m_ConstSlot()
+    ,m_vVar()
+    ,m_vVarSlot()
+    ,m_vFun()
+    ,m_iMaxStackSize(0)
+    ,m_iLabel(0)
+    ,m_bLiveVar(false)
+  {}
+
+  //---------------------------------------------------------------------------
+  /** \brief Delete the register code. */
+  void ParserRegisterCode::clear()
+  {
+    m_vCode.clear();
+    m_vConst.clear();
+    m_ConstSlot.clear();
+    m_vVar.clear();
+    m_vVarSlot.clear();
+    m_vFun.clear();
+    m_iMaxStackSize = 0;
+    m_iLabel = 0;
+    m_bLiveVar = false;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns true if Compile() succeeded. */
+  bool ParserRegisterCode::IsCompiled() const
+  {
+    return m_vCode.size()!=0;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Returns the number of values in the frame needed by Run(). */
+  std::size_t ParserRegisterCode::GetFrameSize() const
+  {
+    return m_iMaxStackSize + m_vConst.size();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Store the constant pool into a frame. 
+      \param a_pFrame A frame of GetFrameSize() values.
+      
+    This has to be done once before the frame is passed to Run().
+  */
+  void ParserRegisterCode::InitFrame(value_type *a_pFrame) const
+  {
+    for (std::size_t i=0; i<m_iMaxStackSize; ++i)
+      a_pFrame[i] = 0;
+
+    for (std::size_t i=0; i<m_vConst.size(); ++i)
+      a_pFrame[m_iMaxStackSize + i] = m_vConst[i];
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the frame index of a constant, add it to the pool if needed. */
+  unsigned ParserRegisterCode::ConstSlot(value_type a_fVal)
+  {
+    // Constants are looked up by their representation, 0 and -0 must not be merged.
+    // Variable slots are not in the map, they must never be shared.
+    std::uint64_t iBits = 0;
+    std::memcpy(&iBits, &a_fVal, sizeof(value_type));
+
+    std::unordered_map<std::uint64_t, unsigned>::const_iterator it = m_ConstSlot.find(iBits);
+    if (it!=m_ConstSlot.end())
+      return it->second;
+
+    m_vConst.push_back(a_fVal);
+    unsigned iSlot = (unsigned)(m_iMaxStackSize + m_vConst.size() - 1);
+    m_ConstSlot[iBits] = iSlot;
+    return iSlot;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the index of a variable in the variable table. */
+  unsigned ParserRegisterCode::VarIndex(value_type *a_pVar)
+  {
+    for (std::size_t i=0; i<m_vVar.size(); ++i)
+    {
+      if (m_vVar[i]==a_pVar)
+        return (unsigned)i;
+    }
+
+    m_vVar.push_back(a_pVar);
+    return (unsigned)(m_vVar.size() - 1);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the frame index holding the value of a variable. */
+  unsigned ParserRegisterCode::VarSlot(value_type *a_pVar)
+  {
+    unsigned iIdx = VarIndex(a_pVar);
+    if (iIdx==m_vVarSlot.size())
+    {
+      m_vConst.push_back(0);
+      m_vVarSlot.push_back((unsigned)(m_iMaxStackSize + m_vConst.size() - 1));
+    }
+
+    return m_vVarSlot[iIdx];
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the index of a function in the function table. */
+  unsigned ParserRegisterCode::FunIndex(generic_fun_type a_pFun)
+  {
+    for (std::size_t i=0; i<m_vFun.size(); ++i)
+    {
+      if (m_vFun[i]==a_pFun)
+        return (unsigned)i;
+    }
+
+    m_vFun.push_back(a_pFun);
+    return (unsigned)(m_vFun.size() - 1);
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Append an instruction.
+      \return The index of the instruction.
+  */
+  int ParserRegisterCode::AddInstr(unsigned a_iOp, 
+                                   unsigned a_iDst, 
+                                   unsigned a_iA, 
+                                   unsigned a_iB, 
+                                   unsigned a_iC, 
+                                   unsigned a_iAux)
+  {
+    SRegInstr instr;
+    instr.Op  = (unsigned short)a_iOp;
+    instr.Dst = (unsigned short)a_iDst;
+    instr.A   = (unsigned short)a_iA;
+    instr.B   = (unsigned short)a_iB;
+    instr.C   = (unsigned short)a_iC;
+    instr.Aux = (unsigned short)a_iAux;
+    m_vCode.push_back(instr);
+    return (int)m_vCode.size() - 1;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Make sure a value of the simulated stack is stored in the 
+             temporary matching its stack position. 
+      \param a_vStack The simulated stack.
+      \param a_iPos Index into a_vStack, the stack position is a_iPos+1.
+  */
+  void ParserRegisterCode::Materialize(std::vector<SOperand> &a_vStack, std::size_t a_iPos)
+  {
+    SOperand &opd = a_vStack[a_iPos];
+    unsigned iTemp = (unsigned)(a_iPos + 1);
+    if (opd.Slot==iTemp)
+      return;
+
+    opd.Instr = AddInstr(rcMOV, iTemp, opd.Slot);
+    opd.Slot = iTemp;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Translate the bytecode into register code. 
+      \param a_ByteCode The finalized bytecode.
+      \return false if the bytecode can't be translated.
+
+    The stack of the bytecode is simulated at compile time. Its entries refer 
+    to the frame index holding the value, values computed by an instruction are
+    stored in the temporary of the stack position. Constants and variables 
+    don't need any instruction, unless assignments are used: the values of the
+    variables are then read when they are used.
+  */
+  bool ParserRegisterCode::Compile(const ParserByteCode &a_ByteCode)
+  {
+    clear();
+
+    const SToken *pRPN = a_ByteCode.GetBase();
+    std::size_t nTok = a_ByteCode.GetSize();
+    if (nTok==0)
+      return false;
+
+    for (std::size_t i=0; i<nTok; ++i)
+    {
+      switch(pRPN[i].Cmd)
+      {
+      case cmFUNC_STR:
+      case cmFUNC_BULK: 
+            return false;
+
+  #if defined(MUP_MATH_EXCEPTIONS)
+      case cmDIV:
+            return false;
+  #endif
+
+      case cmASSIGN:
+            m_bLiveVar = true;
+            break;
+
+      default:
+            break;
+      }
+    }
+
+    m_iMaxStackSize = a_ByteCode.GetMaxStackSize();
+
+    std::vector<SOperand> vStack;
+    ParserStack<int> stIf, stElse;
+    SOperand opd;
+
+    for (const SToken *pTok = pRPN; pTok->Cmd!=cmEND; ++pTok)
+    {
+      switch (pTok->Cmd)
+      {
+      // built in binary operators
+      case  cmLE:
+      case  cmGE:
+      case  cmNEQ:
+      case  cmEQ:
+      case  cmLT:
+      case  cmGT:
+      case  cmADD:
+      case  cmSUB:
+      case  cmMUL:
+      case  cmDIV:
+      case  cmPOW:
+      case  cmLAND:
+      case  cmLOR:
+            {
+              SOperand b = vStack.back(); vStack.pop_back();
+              SOperand a = vStack.back(); vStack.pop_back();
+              unsigned iDst = (unsigned)(vStack.size() + 1);
+              int iLast = (int)m_vCode.size() - 1;
+
+              // Fuse an addition or subtraction with the multiplication computing one 
+              // of its operands. The multiplication must be the last instruction and
+              // must not be a jump target.
+              if ( (pTok->Cmd==cmADD || pTok->Cmd==cmSUB) && 
+                   iLast>=(int)m_iLabel && 
+                   m_vCode[iLast].Op==rcMUL && 
+                   (b.Instr==iLast || a.Instr==iLast) )
+              {
+                SRegInstr &mul = m_vCode[iLast];
+                mul.Dst = (unsigned short)iDst;
+                if (b.Instr==iLast)
+                {
+                  mul.Op = (unsigned short)((pTok->Cmd==cmADD) ? rcMULADD : rcNMULADD);
+                  mul.C  = (unsigned short)a.Slot;
+                }
+                else
+                {
+                  mul.Op = (unsigned short)((pTok->Cmd==cmADD) ? rcMULADD : rcMULSUB);
+                  mul.C  = (unsigned short)b.Slot;
+                }
+
+                opd.Slot = iDst;
+                opd.Instr = iLast;
+                vStack.push_back(opd);
+                continue;
+              }
+
+              // The order of the built in operator codes is the same in both enums
+              unsigned iOp = rcLE + (pTok->Cmd - cmLE);
+              opd.Slot = iDst;
+              opd.Instr = AddInstr(iOp, iDst, a.Slot, b.Slot);
+              vStack.push_back(opd);
+            }
+            continue;
+
+      case  cmASSIGN:
+            {
+              SOperand val = vStack.back(); vStack.pop_back();
+              vStack.pop_back();  // the variable assigned to
+              unsigned iDst = (unsigned)(vStack.size() + 1);
+              opd.Slot = iDst;
+              opd.Instr = AddInstr(rcASSIGN, iDst, val.Slot, 0, 0, VarIndex(pTok->Oprt.ptr));
+              vStack.push_back(opd);
+            }
+            continue;
+
+      case  cmIF:
+            opd = vStack.back(); 
+            vStack.pop_back();
+            stIf.push(AddInstr(rcJZ, 0, opd.Slot));
+            continue;
+
+      case  cmELSE:
+            // The result of the if branch goes to the temporary of its stack position,
+            // the else branch starts from the stack as it was after the condition.
+            Materialize(vStack, vStack.size() - 1);
+            vStack.pop_back();
+            stElse.push(AddInstr(rcJMP, 0));
+            m_vCode[stIf.pop()].Aux = (unsigned short)m_vCode.size();
+            m_iLabel = m_vCode.size();
+            continue;
+
+      case  cmENDIF:
+            Materialize(vStack, vStack.size() - 1);
+            vStack.back().Instr = -1;
+            m_vCode[stElse.pop()].Aux = (unsigned short)m_vCode.size();
+            m_iLabel = m_vCode.size();
+            continue;
+
+      // Temporaries holding common subexpressions are frame slots above the stack 
+      // temporaries. If the value was just computed the instruction writes it 
+      // to the temporary directly.
+      case  cmSTORE:
+            {
+              SOperand &top = vStack.back();
+              int iLast = (int)m_vCode.size() - 1;
+              unsigned iTemp = (unsigned)pTok->Oprt.offset;
+              if (top.Instr>=0 && top.Instr==iLast && iLast>=(int)m_iLabel && m_vCode[iLast].Dst==top.Slot)
+              {
+                m_vCode[iLast].Dst = (unsigned short)iTemp;
+                top.Slot = iTemp;
+              }
+              else
+              {
+                AddInstr(rcMOV, iTemp, top.Slot);
+              }
+
+              // the instruction must not be fused any more
+              top.Instr = -1;
+            }
+            continue;
+
+      case  cmLOAD:
+            opd.Slot = (unsigned)pTok->Oprt.offset;
+            opd.Instr = -1;
+            vStack.push_back(opd);
+            continue;
+
+      // value and variable tokens
+      case  cmVAL:
+            opd.Slot = ConstSlot(pTok->Val.data2);
+            opd.Instr = -1;
+            vStack.push_back(opd);
+            continue;
+
+      case  cmVAR:
+      case  cmVARPOW2:
+      case  cmVARPOW3:
+      case  cmVARPOW4:
+      case  cmVARMUL:
+            {
+              unsigned iDst = (unsigned)(vStack.size() + 1);
+              if (m_bLiveVar)
+              {
+                opd.Slot = iDst;
+                opd.Instr = AddInstr(rcLOADVAR, iDst, 0, 0, 0, VarIndex(pTok->Val.ptr));
+              }
+              else
+              {
+                opd.Slot = VarSlot(pTok->Val.ptr);
+                opd.Instr = -1;
+              }
+
+              switch(pTok->Cmd)
+              {
+              case cmVARPOW2: opd.Instr = AddInstr(rcPOW2, iDst, opd.Slot); break;
+              case cmVARPOW3: opd.Instr = AddInstr(rcPOW3, iDst, opd.Slot); break;
+              case cmVARPOW4: opd.Instr = AddInstr(rcPOW4, iDst, opd.Slot); break;
+              case cmVARMUL:  opd.Instr = AddInstr(rcMULADD, iDst, opd.Slot, ConstSlot(pTok->Val.data), ConstSlot(pTok->Val.data2)); break;
+              default:        break;
+              }
+
+              if (pTok->Cmd!=cmVAR)
+                opd.Slot = iDst;
+
+              vStack.push_back(opd);
+            }
+            continue;
+
+      case  cmFUNC:
+            {
+              int iArgCount = pTok->Fun.argc;
+              unsigned iFun = FunIndex(pTok->Fun.ptr);
+              std::size_t nArg = (iArgCount>=0) ? iArgCount : -iArgCount;
+              if (nArg>10 && iArgCount>0)
+                return false;
+
+              // Functions with more than three arguments get them in consecutive temporaries
+              if (nArg>3 || iArgCount<0)
+              {
+                for (std::size_t k=vStack.size()-nArg; k<vStack.size(); ++k)
+                  Materialize(vStack, k);
+              }
+
+              unsigned iArg[3] = { 0, 0, 0 };
+              for (std::size_t k=0; k<nArg; ++k)
+              {
+                if (k<3)
+                  iArg[k] = vStack[vStack.size() - nArg + k].Slot;
+              }
+
+              vStack.resize(vStack.size() - nArg);
+              unsigned iDst = (unsigned)(vStack.size() + 1);
+              
+              if (iArgCount<0)
+                opd.Instr = AddInstr(rcFUNCMULT, iDst, iDst, 0, (unsigned)nArg, iFun);
+              else if (nArg>3)
+                opd.Instr = AddInstr(rcFUNCN, iDst, iDst, 0, (unsigned)nArg, iFun);
+              else
+                opd.Instr = AddInstr(rcFUNC0 + (unsigned)nArg, iDst, iArg[0], iArg[1], iArg[2], iFun);
+
+              opd.Slot = iDst;
+              vStack.push_back(opd);
+            }
+            continue;
+
+      default:
+            return false;
+      } // switch CmdCode
+    } // for all bytecode tokens
+
+    if (vStack.size()==0)
+      return false;
+
+    // All results of comma separated expressions go to the temporaries
+    for (std::size_t k=0; k<vStack.size(); ++k)
+      Materialize(vStack, k);
+
+    AddInstr(rcEND, 0, (unsigned)vStack.size());
+
+    // The prologue reads the variables into their slots
+    if (!m_bLiveVar && m_vVar.size())
+    {
+      std::vector<SRegInstr> vPrologue;
+      for (std::size_t i=0; i<m_vVar.size(); ++i)
+      {
+        SRegInstr instr = { (unsigned short)rcLOADVAR, (unsigned short)m_vVarSlot[i], 0, 0, 0, (unsigned short)i };
+        vPrologue.push_back(instr);
+      }
+
+      for (std::size_t i=0; i<m_vCode.size(); ++i)
+      {
+        if (m_vCode[i].Op==rcJZ || m_vCode[i].Op==rcJMP)
+          m_vCode[i].Aux = (unsigned short)(m_vCode[i].Aux + vPrologue.size());
+      }
+
+      m_vCode.insert(m_vCode.begin(), vPrologue.begin(), vPrologue.end());
+    }
+
+    // Indices beyond the range of the instruction operands would be truncated
+    if ( GetFrameSize()>s_iMaxIndex || m_vCode.size()>s_iMaxIndex || 
+         m_vVar.size()>s_iMaxIndex || m_vFun.size()>s_iMaxIndex )
+    {
+      clear();
+      return false;
+    }
+
+    std::vector<SRegInstr>(m_vCode).swap(m_vCode);
+    return true;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Evaluate the register code.
+      \param a_pFrame A frame initialized with InitFrame().
+      \return The final result, the results of all comma separated 
+              expressions are in a_pFrame[1] to a_pFrame[n].
+  */
+  value_type ParserRegisterCode::Run(value_type *a_pFrame) const
+  {
+    value_type *f = a_pFrame;
+    value_type * const *pVar = m_vVar.size() ? &m_vVar[0] : 0;
+    const generic_fun_type *pFun = m_vFun.size() ? &m_vFun[0] : 0;
+    const SRegInstr *pBase = &m_vCode[0];
+    const SRegInstr *pc = pBase;
+
+#if defined(__GNUC__)
+    // Labels as values allow a jump table without bounds checks. 
+    // The order must match ERegCode.
+    static const void * const s_pLabel[] = 
+    {
+      &&lbLOADVAR, &&lbMOV, 
+      &&lbLE, &&lbGE, &&lbNEQ, &&lbEQ, &&lbLT, &&lbGT, 
+      &&lbADD, &&lbSUB, &&lbMUL, &&lbDIV, &&lbPOW, &&lbLAND, &&lbLOR,
+      &&lbMULADD, &&lbMULSUB, &&lbNMULADD, &&lbPOW2, &&lbPOW3, &&lbPOW4,
+      &&lbFUNC0, &&lbFUNC1, &&lbFUNC2, &&lbFUNC3, &&lbFUNCN, &&lbFUNCMULT,
+      &&lbASSIGN, &&lbJZ, &&lbJMP, &&lbEND
+    };
+
+    #define MUP_REG_CASE(OP)   lb##OP:
+    #define MUP_REG_DISPATCH   goto *s_pLabel[pc->Op]
+    
+    MUP_REG_DISPATCH;
+    {
+#else
+    #define MUP_REG_CASE(OP)   case rc##OP:
+    #define MUP_REG_DISPATCH   continue
+
+    for (;;)
+    {
+      switch(pc->Op)
+      {
+#endif
+    #define MUP_REG_NEXT       ++pc; MUP_REG_DISPATCH
+
+      MUP_REG_CASE(LOADVAR)  f[pc->Dst] = *pVar[pc->Aux];         MUP_REG_NEXT;
+      MUP_REG_CASE(MOV)      f[pc->Dst] = f[pc->A];               MUP_REG_NEXT;
+      MUP_REG_CASE(LE)       f[pc->Dst] = f[pc->A] <= f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(GE)       f[pc->Dst] = f[pc->A] >= f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(NEQ)      f[pc->Dst] = f[pc->A] != f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(EQ)       f[pc->Dst] = f[pc->A] == f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(LT)       f[pc->Dst] = f[pc->A] < f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(GT)       f[pc->Dst] = f[pc->A] > f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(ADD)      f[pc->Dst] = f[pc->A] + f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(SUB)      f[pc->Dst] = f[pc->A] - f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(MUL)      f[pc->Dst] = f[pc->A] * f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(DIV)      f[pc->Dst] = f[pc->A] / f[pc->B];    MUP_REG_NEXT;
+      MUP_REG_CASE(POW)      f[pc->Dst] = MathImpl<value_type>::Pow(f[pc->A], f[pc->B]); MUP_REG_NEXT;
+      MUP_REG_CASE(LAND)     f[pc->Dst] = f[pc->A] && f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(LOR)      f[pc->Dst] = f[pc->A] || f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(MULADD)   f[pc->Dst] = f[pc->A] * f[pc->B] + f[pc->C];   MUP_REG_NEXT;
+      MUP_REG_CASE(MULSUB)   f[pc->Dst] = f[pc->A] * f[pc->B] - f[pc->C];   MUP_REG_NEXT;
+      MUP_REG_CASE(NMULADD)  f[pc->Dst] = f[pc->C] - f[pc->A] * f[pc->B];   MUP_REG_NEXT;
+      MUP_REG_CASE(POW2)     { value_type v = f[pc->A]; f[pc->Dst] = v*v;       } MUP_REG_NEXT;
+      MUP_REG_CASE(POW3)     { value_type v = f[pc->A]; f[pc->Dst] = v*v*v;     } MUP_REG_NEXT;
+      MUP_REG_CASE(POW4)     { value_type v = f[pc->A]; f[pc->Dst] = v*v*v*v;   } MUP_REG_NEXT;
+      MUP_REG_CASE(FUNC0)    f[pc->Dst] = (*(fun_type0)pFun[pc->Aux])();  MUP_REG_NEXT;
+      MUP_REG_CASE(FUNC1)    f[pc->Dst] = (*(fun_type1)pFun[pc->Aux])(f[pc->A]);  MUP_REG_NEXT;
+      MUP_REG_CASE(FUNC2)    f[pc->Dst] = (*(fun_type2)pFun[pc->Aux])(f[pc->A], f[pc->B]);  MUP_REG_NEXT;
+      MUP_REG_CASE(FUNC3)    f[pc->Dst] = (*(fun_type3)pFun[pc->Aux])(f[pc->A], f[pc->B], f[pc->C]);  MUP_REG_NEXT;
+      MUP_REG_CASE(FUNCN)    
+            {
+              const value_type *a = &f[pc->A];
+              generic_fun_type pF = pFun[pc->Aux];
+              switch(pc->C)
+              {
+              case 4:  f[pc->Dst] = (*(fun_type4)pF)(a[0], a[1], a[2], a[3]); break;
+              case 5:  f[pc->Dst] = (*(fun_type5)pF)(a[0], a[1], a[2], a[3], a[4]); break;
+              case 6:  f[pc->Dst] = (*(fun_type6)pF)(a[0], a[1], a[2], a[3], a[4], a[5]); break;
+              case 7:  f[pc->Dst] = (*(fun_type7)pF)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+              case 8:  f[pc->Dst] = (*(fun_type8)pF)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]); break;
+              case 9:  f[pc->Dst] = (*(fun_type9)pF)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]); break;
+              default: f[pc->Dst] = (*(fun_type10)pF)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]); break;
+              }
+            }
+            MUP_REG_NEXT;
+
+      MUP_REG_CASE(FUNCMULT) f[pc->Dst] = (*(multfun_type)pFun[pc->Aux])(&f[pc->A], pc->C);  MUP_REG_NEXT;
+      MUP_REG_CASE(ASSIGN)   f[pc->Dst] = *pVar[pc->Aux] = f[pc->A];  MUP_REG_NEXT;
+      
+      MUP_REG_CASE(JZ)       
+            if (f[pc->A]==0)
+            {
+              pc = pBase + pc->Aux;
+              MUP_REG_DISPATCH;
+            }
+            MUP_REG_NEXT;
+
+      MUP_REG_CASE(JMP)      
+            pc = pBase + pc->Aux;
+            MUP_REG_DISPATCH;
+
+      MUP_REG_CASE(END)      
+            return f[pc->A];
+
+#if !defined(__GNUC__)
+      } // switch
+#endif
+    }
+
+    #undef MUP_REG_CASE
+    #undef MUP_REG_DISPATCH
+    #undef MUP_REG_NEXT
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Dump the register code to the console (for debugging). */
+  void ParserRegisterCode::AsciiDump() const
+  {
+    static const char_type *c_szOp[] = 
+    {
+      _T("LOADVAR"), _T("MOV"), 
+      _T("LE"), _T("GE"), _T("NEQ"), _T("EQ"), _T("LT"), _T("GT"), 
+      _T("ADD"), _T("SUB"), _T("MUL"), _T("DIV"), _T("POW"), _T("&&"), _T("||"),
+      _T("MULADD"), _T("MULSUB"), _T("NMULADD"), _T("POW2"), _T("POW3"), _T("POW4"),
+      _T("FUNC0"), _T("FUNC1"), _T("FUNC2"), _T("FUNC3"), _T("FUNCN"), _T("FUNCMULT"),
+      _T("ASSIGN"), _T("JZ"), _T("JMP"), _T("END")
+    };
+
+    if (!m_vCode.size()) 
+    {
+      mu::console() << _T("No register code available\n");
+      return;
+    }
+
+    mu::console() << _T("Number of instructions:") << (int)m_vCode.size() 
+                  << _T(" (") << (int)(m_vCode.size() * sizeof(SRegInstr)) << _T(" bytes)\n");
+    mu::console() << _T("Temporaries: 1..") << (int)m_iMaxStackSize - 1 << _T("\n");
+    for (std::size_t i=0; i<m_vConst.size(); ++i)
+      mu::console() << _T("Slot ") << (int)(m_iMaxStackSize + i) << _T(" : \t[") << m_vConst[i] << _T("]\n");
+
+    for (std::size_t i=0; i<m_vCode.size(); ++i)
+    {
+      const SRegInstr &instr = m_vCode[i];
+      mu::console() << std::dec << i << _T(" : \t") << c_szOp[instr.Op] 
+                    << _T("\t") << instr.Dst 
+                    << _T(", ") << instr.A 
+                    << _T(", ") << instr.B 
+                    << _T(", ") << instr.C 
+                    << _T(" [AUX: ") << instr.Aux << _T("]\n");
+    }
+  }
+} // namespace mu
@@ -0,0 +1,717 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserBase.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+/** \file
+    \brief Implementation of the binary serialization of the bytecode.
+
+    Compiled bytecode is written to a blob in which the variables and callbacks 
+    are referred to by name. Loading a blob resolves the names against the 
+    definitions of the loading parser, the expression is not parsed again.
+
+    Layout of a blob, all numbers are in the byte order of the machine that
+    wrote it:
+    <ul>
+      <li>uint32 magic number "muBC", uint32 format version</li>
+      <li>uint32 size of value_type, uint32 size of char_type</li>
+      <li>the expression, int32 number of results, the string constants</li>
+      <li>uint32 maximum stack size, the symbols and the tokens</li>
+    </ul>
+    Strings are stored as an uint32 length followed by the characters. A symbol
+    is its name, its uint8 kind (cmVAR or the command code of the callback) and
+    the int32 number of arguments of a callback. A token is its uint8 command 
+    code followed by the operands the command uses, pointers are replaced by an
+    int32 index into the symbols or -1.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    const std::uint32_t s_iMagic   = 0x4342756d;  // "muBC" in little endian byte order
+    const std::uint32_t s_iVersion = 3;
+
+    //------------------------------------------------------------------------------
+    /** \brief Appends plain values and strings to a blob. */
+    class BlobWriter
+    {
+    public:
+      explicit BlobWriter(std::vector<char> &a_vBlob)
+        :m_vBlob(a_vBlob)
+      {}
+
+      template<typename T>
+      void Put(const T &a_Val)
+      {
+        const char *pVal = reinterpret_cast<const char*>(&a_Val);
+        m_vBlob.insert(m_vBlob.end(), pVal, pVal + sizeof(T));
+      }
+
+      void PutString(const string_type &a_sVal)
+      {
+        Put((std::uint32_t)a_sVal.length());
+        const char *pVal = reinterpret_cast<const char*>(a_sVal.data());
+        m_vBlob.insert(m_vBlob.end(), pVal, pVal + a_sVal.length() * sizeof(char_type));
+      }
+
+    private:
+      std::vector<char> &m_vBlob;
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief Reads plain values and strings from a blob. 
+    
+      The blob does not need to be aligned, values are copied out of it.
+      \throw ParserError with ecINVALID_BYTECODE when reading past the end.
+    */
+    class BlobReader
+    {
+    public:
+      BlobReader(const char *a_pBlob, std::size_t a_iSize)
+        :m_pBegin(a_pBlob)
+        ,m_pPos(a_pBlob)
+        ,m_pEnd(a_pBlob + a_iSize)
+      {}
+
+      template<typename T>
+      T Get()
+      {
+        T val;
+        std::memcpy(&val, Take(sizeof(T)), sizeof(T));
+        return val;
+      }
+
+      string_type GetString()
+      {
+        std::size_t iLen = Get<std::uint32_t>();
+        if (iLen > (std::size_t)(m_pEnd - m_pPos) / sizeof(char_type))
+          throw ParserError(ecINVALID_BYTECODE);
+
+        string_type sVal(iLen, 0);
+        if (iLen)
+          std::memcpy(&sVal[0], Take(iLen * sizeof(char_type)), iLen * sizeof(char_type));
+        return sVal;
+      }
+
+      std::size_t GetCount() const
+      {
+        return m_pPos - m_pBegin;
+      }
+
+    private:
+      const char *Take(std::size_t a_iSize)
+      {
+        if (a_iSize > (std::size_t)(m_pEnd - m_pPos))
+          throw ParserError(ecINVALID_BYTECODE);
+
+        const char *pVal = m_pPos;
+        m_pPos += a_iSize;
+        return pVal;
+      }
+
+      const char *m_pBegin;
+      const char *m_pPos;
+      const char *m_pEnd;
+    };
+
+    //------------------------------------------------------------------------------
+    /** \brief Prefixes distinguishing callbacks of different kinds with the same name. */
+    const char_type s_cFunPrefix[] = { 'f', 'b', 'i', 'p' };
+
+    //------------------------------------------------------------------------------
+    /** \brief Add the callbacks of a function or operator table to the symbol maps. */
+    void AddCallbackNames(const funmap_type &a_FunDef, 
+                          char_type a_cPrefix,
+                          ParserByteCode::funname_type *a_pName,
+                          ParserByteCode::funaddr_type *a_pAddr)
+    {
+      for (funmap_type::const_iterator it=a_FunDef.begin(); it!=a_FunDef.end(); ++it)
+      {
+        ParserByteCode::SFunSymbol sym;
+        sym.Name = a_cPrefix + it->first;
+        sym.Ptr  = (generic_fun_type)it->second.GetAddr();
+        sym.Argc = it->second.GetArgc();
+
+        // Operators are called like functions
+        switch(it->second.GetCode())
+        {
+        case cmFUNC_STR:  sym.Cmd = cmFUNC_STR;  break;
+        case cmFUNC_BULK: sym.Cmd = cmFUNC_BULK; break;
+        default:          sym.Cmd = cmFUNC;      break;
+        }
+
+        if (a_pName)
+          a_pName->insert(std::make_pair(sym.Ptr, sym));
+        if (a_pAddr)
+          (*a_pAddr)[sym.Name] = sym;
+      }
+    }
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Append the bytecode to a blob.
+      \param [out] a_vBlob The blob, the bytecode is appended to its content.
+      \param a_VarName Names of the variables the bytecode may reference.
+      \param a_FunName Names of the callbacks the bytecode may reference.
+      \throw ParserError with ecINVALID_BYTECODE if a pointer has no name.
+  */
+  void ParserByteCode::Serialize(std::vector<char> &a_vBlob, 
+                                 const varname_type &a_VarName, 
+                                 const funname_type &a_FunName) const
+  {
+    // Symbol table: the variables and callbacks in order of their first use
+    std::vector<SFunSymbol> vSymbol;
+    std::vector<int> vSymIdx(m_vRPN.size(), -1);
+    std::map<string_type, int> mapSymbol;
+    for (std::size_t i=0; i<m_vRPN.size(); ++i)
+    {
+      const SToken &tok = m_vRPN[i];
+      SFunSymbol sym = { string_type(), NULL, 0, cmVAR };
+      const string_type *pName = NULL;
+      switch(tok.Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+      case cmVAL:
+            if (tok.Val.ptr)
+            {
+              varname_type::const_iterator it = a_VarName.find(tok.Val.ptr);
+              if (it==a_VarName.end())
+                throw ParserError(ecINVALID_BYTECODE);
+              pName = &it->second;
+            }
+            break;
+
+      case cmASSIGN:
+            {
+              varname_type::const_iterator it = a_VarName.find(tok.Oprt.ptr);
+              if (it==a_VarName.end())
+                throw ParserError(ecINVALID_BYTECODE);
+              pName = &it->second;
+            }
+            break;
+
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            {
+              funname_type::const_iterator it = a_FunName.find(tok.Fun.ptr);
+              if (it==a_FunName.end())
+                throw ParserError(ecINVALID_BYTECODE);
+              sym = it->second;
+              pName = &it->second.Name;
+            }
+            break;
+
+      default:
+            break;
+      }
+
+      if (pName)
+      {
+        std::map<string_type, int>::const_iterator it = mapSymbol.find(*pName);
+        if (it==mapSymbol.end())
+        {
+          it = mapSymbol.insert(std::make_pair(*pName, (int)vSymbol.size())).first;
+          sym.Name = *pName;
+          vSymbol.push_back(sym);
+        }
+        vSymIdx[i] = it->second;
+      }
+    }
+
+    BlobWriter out(a_vBlob);
+    out.Put((std::uint32_t)m_iMaxStackSize);
+    out.Put((std::uint32_t)vSymbol.size());
+    for (std::size_t i=0; i<vSymbol.size(); ++i)
+    {
+      out.PutString(vSymbol[i].Name);
+      out.Put((std::uint8_t)vSymbol[i].Cmd);
+      out.Put((std::int32_t)vSymbol[i].Argc);
+    }
+
+    out.Put((std::uint32_t)m_vRPN.size());
+    for (std::size_t i=0; i<m_vRPN.size(); ++i)
+    {
+      const SToken &tok = m_vRPN[i];
+      out.Put((std::uint8_t)tok.Cmd);
+      switch(tok.Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+      case cmVAL:
+            out.Put((std::int32_t)vSymIdx[i]);
+            out.Put(tok.Val.data);
+            out.Put(tok.Val.data2);
+            break;
+
+      // Only the fields a command uses are written, the blob of an 
+      // expression is always the same
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            out.Put((std::int32_t)vSymIdx[i]);
+            out.Put((std::int32_t)tok.Fun.argc);
+            if (tok.Cmd==cmFUNC)
+              out.Put((std::uint8_t)tok.Fun.opt);
+            else if (tok.Cmd==cmFUNC_STR)
+              out.Put((std::int32_t)tok.Fun.idx);
+            break;
+
+      case cmASSIGN:
+            out.Put((std::int32_t)vSymIdx[i]);
+            break;
+
+      case cmIF:
+      case cmELSE:
+      case cmSTORE:
+      case cmLOAD:
+            out.Put((std::int32_t)tok.Oprt.offset);
+            break;
+
+      case cmLOOP:
+      case cmENDLOOP:
+            out.Put((std::int32_t)tok.Oprt.offset);
+            out.Put((std::uint8_t)tok.Oprt.code);
+            break;
+
+      default:
+            break;
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Replace the bytecode by bytecode read from a blob.
+      \param a_pBlob Start of the bytecode written by Serialize.
+      \param a_iSize Number of bytes available at a_pBlob.
+      \param a_VarDef The variables by name.
+      \param a_FunDef The callbacks by name.
+      \return Number of bytes read.
+      \throw ParserError with ecBYTECODE_SYMBOL if a symbol is not defined and 
+             ecINVALID_BYTECODE if the blob is malformed. The bytecode is left
+             unchanged in this case.
+  */
+  std::size_t ParserByteCode::Deserialize(const char *a_pBlob, 
+                                          std::size_t a_iSize,
+                                          const varmap_type &a_VarDef,
+                                          const funaddr_type &a_FunDef)
+  {
+    BlobReader in(a_pBlob, a_iSize);
+    std::size_t iMaxStackSize = in.Get<std::uint32_t>();
+
+    // Resolve the symbols, callbacks have to take the arguments they were 
+    // compiled for
+    std::size_t nSymbol = in.Get<std::uint32_t>();
+    std::vector<value_type*> vVar;
+    std::vector<SFunSymbol> vSym;
+    for (std::size_t i=0; i<nSymbol; ++i)
+    {
+      SFunSymbol sym;
+      sym.Name = in.GetString();
+      std::uint8_t iCmd = in.Get<std::uint8_t>();
+      sym.Argc = in.Get<std::int32_t>();
+      sym.Ptr  = NULL;
+      if (iCmd!=cmVAR && iCmd!=cmFUNC && iCmd!=cmFUNC_STR && iCmd!=cmFUNC_BULK)
+        throw ParserError(ecINVALID_BYTECODE);
+      sym.Cmd = (ECmdCode)iCmd;
+
+      value_type *pVar = NULL;
+      switch(sym.Cmd)
+      {
+      case cmVAR:
+            {
+              varmap_type::const_iterator it = a_VarDef.find(sym.Name);
+              if (it==a_VarDef.end())
+                throw ParserError(ecBYTECODE_SYMBOL, sym.Name);
+              pVar = it->second;
+            }
+            break;
+
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            {
+              funaddr_type::const_iterator it = a_FunDef.find(sym.Name);
+              if (it==a_FunDef.end() || it->second.Cmd!=sym.Cmd || it->second.Argc!=sym.Argc)
+                throw ParserError(ecBYTECODE_SYMBOL, sym.Name.substr(1));
+              sym.Ptr = it->second.Ptr;
+            }
+            break;
+
+      default:
+            throw ParserError(ecINVALID_BYTECODE);
+      }
+
+      vVar.push_back(pVar);
+      vSym.push_back(sym);
+    }
+
+    // Each stack position and each temporary is written by a token
+    std::size_t nTok = in.Get<std::uint32_t>();
+    if (nTok==0 || nTok > a_iSize || iMaxStackSize > nTok)
+      throw ParserError(ecINVALID_BYTECODE);
+
+    rpn_type vRPN(nTok);
+    for (std::size_t i=0; i<nTok; ++i)
+    {
+      SToken &tok = vRPN[i];
+      std::memset(&tok, 0, sizeof(tok));
+      std::uint8_t iCmd = in.Get<std::uint8_t>();
+      if (iCmd>=cmUNKNOWN)
+        throw ParserError(ecINVALID_BYTECODE);
+      tok.Cmd = (ECmdCode)iCmd;
+
+      int iSym = -1;
+      switch(tok.Cmd)
+      {
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+      case cmVAL:
+            iSym = in.Get<std::int32_t>();
+            tok.Val.data  = in.Get<value_type>();
+            tok.Val.data2 = in.Get<value_type>();
+            break;
+
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            iSym = in.Get<std::int32_t>();
+            tok.Fun.argc = in.Get<std::int32_t>();
+            if (tok.Cmd==cmFUNC)
+              tok.Fun.opt = in.Get<std::uint8_t>()!=0;
+            else if (tok.Cmd==cmFUNC_STR)
+              tok.Fun.idx = in.Get<std::int32_t>();
+            break;
+
+      case cmASSIGN:
+            iSym = in.Get<std::int32_t>();
+            break;
+
+      case cmIF:
+      case cmELSE:
+      case cmSTORE:
+      case cmLOAD:
+            tok.Oprt.offset = in.Get<std::int32_t>();
+            break;
+
+      case cmLOOP:
+      case cmENDLOOP:
+            {
+              tok.Oprt.offset = in.Get<std::int32_t>();
+              std::uint8_t iCode = in.Get<std::uint8_t>();
+              if (iCode!=cmADD && iCode!=cmMUL)
+                throw ParserError(ecINVALID_BYTECODE);
+              tok.Oprt.code = (ECmdCode)iCode;
+            }
+            break;
+
+      default:
+            break;
+      }
+
+      if (iSym<-1 || iSym>=(int)nSymbol)
+        throw ParserError(ecINVALID_BYTECODE);
+
+      switch(tok.Cmd)
+      {
+      case cmVAL:
+            if (iSym!=-1)
+              throw ParserError(ecINVALID_BYTECODE);
+            break;
+
+      case cmVAR:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+      case cmASSIGN:
+            if (iSym==-1 || !vVar[iSym])
+              throw ParserError(ecINVALID_BYTECODE);
+
+            if (tok.Cmd==cmASSIGN)
+              tok.Oprt.ptr = vVar[iSym];
+            else
+              tok.Val.ptr = vVar[iSym];
+            break;
+
+      case cmFUNC:
+      case cmFUNC_STR:
+      case cmFUNC_BULK:
+            if (iSym==-1 || vSym[iSym].Cmd!=tok.Cmd)
+              throw ParserError(ecINVALID_BYTECODE);
+
+            // Functions with any number of arguments store their count negated
+            if ( (vSym[iSym].Argc==-1) ? tok.Fun.argc>=0 : tok.Fun.argc!=vSym[iSym].Argc )
+              throw ParserError(ecINVALID_BYTECODE);
+            tok.Fun.ptr = vSym[iSym].Ptr;
+            break;
+
+      // Temporaries have to be within the stack, jumps are checked below
+      case cmSTORE:
+      case cmLOAD:
+            if (tok.Oprt.offset<1 || tok.Oprt.offset>(int)iMaxStackSize)
+              throw ParserError(ecINVALID_BYTECODE);
+            break;
+
+      default:
+            break;
+      }
+    }
+
+    if (vRPN.back().Cmd!=cmEND)
+      throw ParserError(ecINVALID_BYTECODE);
+
+    // The operands of every token have to be on the stack and the stack may 
+    // not grow beyond the size it was saved with. The jumps have to go where
+    // Terminate() would have sent them: if-then-else and loops are nested, an
+    // IF jumps to its ELSE, an ELSE to its ENDIF and both ends of a loop to 
+    // each other. Every branch and every iteration of a loop body leaves one 
+    // value on the stack.
+    ParserStack<int> stOpen,   // Index of the IF, ELSE or LOOP of the innermost open block
+                     stDepth;  // Stack position at the start of its branch or body
+    int iStackPos = 0;
+    for (int i=0; i<(int)nTok; ++i)
+    {
+      const SToken &tok = vRPN[i];
+      int nPop = 0, 
+          nPush = 1;
+      switch(tok.Cmd)
+      {
+      case cmIF:
+      case cmLOOP:
+            if (iStackPos<((tok.Cmd==cmIF) ? 1 : 2))
+              throw ParserError(ecINVALID_BYTECODE);
+
+            // Only one branch is run, both start with the condition removed
+            iStackPos += (tok.Cmd==cmIF) ? -1 : 1;
+            stOpen.push(i);
+            stDepth.push(iStackPos);
+            nPush = 0;
+            break;
+
+      case cmELSE:
+      case cmENDIF:
+      case cmENDLOOP:
+            {
+              ECmdCode iOpen = (tok.Cmd==cmELSE) ? cmIF : (tok.Cmd==cmENDIF) ? cmELSE : cmLOOP;
+              if ( stOpen.empty() || 
+                   vRPN[stOpen.top()].Cmd!=iOpen || 
+                   vRPN[stOpen.top()].Oprt.offset!=i - stOpen.top() || 
+                   (tok.Cmd==cmENDLOOP && tok.Oprt.offset!=i - stOpen.top()) ||
+                   iStackPos!=stDepth.top()+1 )
+                throw ParserError(ecINVALID_BYTECODE);
+
+              stOpen.pop();
+              if (tok.Cmd==cmELSE)
+              {
+                stOpen.push(i);
+                iStackPos = stDepth.top();
+              }
+              else
+              {
+                stDepth.pop();
+                if (tok.Cmd==cmENDLOOP)
+                  iStackPos -= 3;
+              }
+            }
+            nPush = 0;
+            break;
+
+      case cmVAR:
+      case cmVAL:
+      case cmVARPOW2:
+      case cmVARPOW3:
+      case cmVARPOW4:
+      case cmVARMUL:
+      case cmLOAD:      break;
+      case cmPOW2:
+      case cmSTORE:     nPop = 1;  break;
+      case cmFUNC:      nPop = (tok.Fun.argc>=0) ? tok.Fun.argc : -tok.Fun.argc;  break;
+      case cmFUNC_STR:
+      case cmFUNC_BULK: nPop = tok.Fun.argc;  break;
+      case cmEND:
+            if (i!=(int)nTok-1)
+              throw ParserError(ecINVALID_BYTECODE);
+            nPush = 0;
+            break;
+      default:
+            if (tok.Cmd>cmASSIGN)
+              throw ParserError(ecINVALID_BYTECODE);
+            nPop = 2;
+            break;
+      }
+
+      if (iStackPos<nPop)
+        throw ParserError(ecINVALID_BYTECODE);
+
+      iStackPos += nPush - nPop;
+      if (iStackPos>(int)iMaxStackSize)
+        throw ParserError(ecINVALID_BYTECODE);
+    }
+
+    if (!stOpen.empty() || iStackPos<1)
+      throw ParserError(ecINVALID_BYTECODE);
+
+    m_vRPN.swap(vRPN);
+    m_iMaxStackSize = iMaxStackSize;
+    m_iStackPos = 0;
+    m_iTokensSaved = 0;
+    return in.GetCount();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Append the compiled expression to a blob.
+      \param [out] a_vBlob The blob, the expression is appended to its content so
+                   that several expressions can be stored in one blob.
+      \throw ParserException if the expression is invalid.
+      \sa LoadByteCode
+
+    The blob holds the expression, the bytecode and the string constants. The
+    variables and callbacks are stored by name and resolved when the blob is 
+    loaded. If SetDiffVar is active the bytecode of the derivative is stored.
+  */
+  void ParserBase::SaveByteCode(std::vector<char> &a_vBlob) const
+  {
+    if (m_pParseFormula==&ParserBase::ParseString)
+    {
+      try
+      {
+        CompileString();
+      }
+      catch(ParserError &exc)
+      {
+        exc.SetFormula(m_pTokenReader->GetExpr());
+        throw;
+      }
+    }
+
+    ParserByteCode::varname_type mapVarName;
+    const varmap_type &vars = m_VarDef.Get();
+    for (varmap_type::const_iterator it=vars.begin(); it!=vars.end(); ++it)
+      mapVarName.insert(std::make_pair(it->second, it->first));
+
+    ParserByteCode::funname_type mapFunName;
+    AddCallbackNames(m_FunDef.Get(), s_cFunPrefix[0], &mapFunName, NULL);
+    AddCallbackNames(m_OprtDef.Get(), s_cFunPrefix[1], &mapFunName, NULL);
+    AddCallbackNames(m_InfixOprtDef.Get(), s_cFunPrefix[2], &mapFunName, NULL);
+    AddCallbackNames(m_PostOprtDef.Get(), s_cFunPrefix[3], &mapFunName, NULL);
+
+    // SetExpr pads the expression with a space
+    string_type sExpr = m_pTokenReader->GetExpr();
+    if (sExpr.length() && sExpr[sExpr.length()-1]==' ')
+      sExpr.erase(sExpr.length()-1);
+
+    std::vector<char> vBlob;
+    BlobWriter out(vBlob);
+    out.Put(s_iMagic);
+    out.Put(s_iVersion);
+    out.Put((std::uint32_t)sizeof(value_type));
+    out.Put((std::uint32_t)sizeof(char_type));
+    out.PutString(sExpr);
+    out.Put((std::int32_t)m_nFinalResultIdx);
+    out.Put((std::uint32_t)m_vStringBuf.size());
+    for (std::size_t i=0; i<m_vStringBuf.size(); ++i)
+      out.PutString(m_vStringBuf[i]);
+
+    m_vRPN.Serialize(vBlob, mapVarName, mapFunName);
+    a_vBlob.insert(a_vBlob.end(), vBlob.begin(), vBlob.end());
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Set the expression from a blob written by SaveByteCode without parsing it.
+      \param a_pBlob Start of the saved expression, for instance in a memory mapped file.
+      \param a_iSize Number of bytes available at a_pBlob.
+      \return Number of bytes read, the next expression of the blob starts there.
+      \throw ParserException with ecINVALID_BYTECODE if the blob was not written
+             by SaveByteCode of this version of the parser or is damaged and with
+             ecBYTECODE_SYMBOL if it uses a variable, function or operator this
+             parser does not define. The parser is left unchanged in this case.
+
+    The names of the variables and callbacks are resolved against the definitions 
+    of this parser, which need to match those of the parser that saved the blob.
+    The blob is not required to be aligned. Once loaded the expression behaves 
+    as if it had been set by SetExpr and evaluated: it is parsed again only if 
+    the definitions of the parser change.
+  */
+  std::size_t ParserBase::LoadByteCode(const void *a_pBlob, std::size_t a_iSize)
+  {
+    BlobReader in(static_cast<const char*>(a_pBlob), a_iSize);
+    if (in.Get<std::uint32_t>()!=s_iMagic || 
+        in.Get<std::uint32_t>()!=s_iVersion ||
+        in.Get<std::uint32_t>()!=sizeof(value_type) ||
+        in.Get<std::uint32_t>()!=sizeof(char_type))
+      throw ParserError(ecINVALID_BYTECODE);
+
+    string_type sExpr = in.GetString();
+    int nFinalResultIdx = in.Get<std::int32_t>();
+    std::size_t nString = in.Get<std::uint32_t>();
+    stringbuf_type vStringBuf;
+    for (std::size_t i=0; i<nString; ++i)
+      vStringBuf.push_back(in.GetString());
+
+    ParserByteCode::funaddr_type mapFunAddr;
+    AddCallbackNames(m_FunDef.Get(), s_cFunPrefix[0], NULL, &mapFunAddr);
+    AddCallbackNames(m_OprtDef.Get(), s_cFunPrefix[1], NULL, &mapFunAddr);
+    AddCallbackNames(m_InfixOprtDef.Get(), s_cFunPrefix[2], NULL, &mapFunAddr);
+    AddCallbackNames(m_PostOprtDef.Get(), s_cFunPrefix[3], NULL, &mapFunAddr);
+
+    std::size_t iPos = in.GetCount();
+    ParserByteCode vRPN;
+    iPos += vRPN.Deserialize(static_cast<const char*>(a_pBlob) + iPos, a_iSize - iPos, m_VarDef.Get(), mapFunAddr);
+
+    // The results and string constants have to be within the bytecode buffers
+    if (nFinalResultIdx<1 || nFinalResultIdx>=(int)vRPN.GetMaxStackSize())
+      throw ParserError(ecINVALID_BYTECODE);
+
+    for (const SToken *pTok = vRPN.GetBase(); pTok->Cmd!=cmEND; ++pTok)
+    {
+      if (pTok->Cmd==cmFUNC_STR && (pTok->Fun.idx<0 || pTok->Fun.idx>=(int)nString))
+        throw ParserError(ecINVALID_BYTECODE);
+    }
+
+    SetExpr(sExpr);
+    m_vRPN = vRPN;
+    m_vStringBuf.swap(vStringBuf);
+    m_nFinalResultIdx = nFinalResultIdx;
+    m_vStackBuffer.resize(m_vRPN.GetMaxStackSize());
+    CompileByteCode();
+    return iPos;
+  }
+} // namespace mu
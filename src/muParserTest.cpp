@@ -25,7 +25,10 @@
 
 #include "muParserTest.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
 #include <iostream>
 #include <limits>
@@ -44,6 +47,7 @@ namespace mu
   namespace Test
   {
     int ParserTester::c_iCount = 0;
+    int ParserTester::c_iCalls = 0;
 
     //---------------------------------------------------------------------------------------------
     ParserTester::ParserTester()
@@ -62,6 +66,19 @@ namespace mu
       AddTest(&ParserTester::TestException);
       AddTest(&ParserTester::TestStrArg);
       AddTest(&ParserTester::TestBulkMode);
+      AddTest(&ParserTester::TestDiff);
+      AddTest(&ParserTester::TestInterval);
+      AddTest(&ParserTester::TestProgram);
+      AddTest(&ParserTester::TestParallel);
+      AddTest(&ParserTester::TestSharedDef);
+      AddTest(&ParserTester::TestLongExpr);
+      AddTest(&ParserTester::TestFusedExpr);
+      AddTest(&ParserTester::TestFloatEval);
+      AddTest(&ParserTester::TestVecMath);
+      AddTest(&ParserTester::TestByteCodeIO);
+      AddTest(&ParserTester::TestProfile);
+      AddTest(&ParserTester::TestHoist);
+      AddTest(&ParserTester::TestLoop);
 
       ParserTester::c_iCount = 0;
     }
@@ -191,6 +208,958 @@ namespace mu
         return iStat;
     }
 
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestDiff()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing automatic differentiation...");
+
+        // built in operators and functions
+        iStat += EqnTestDiff(_T("a^3-2*a"), 2, 4, 10, 12);
+        iStat += EqnTestDiff(_T("sin(a)*a"), 1, sin(1.0), cos(1.0)+sin(1.0), 2*cos(1.0)-sin(1.0));
+        iStat += EqnTestDiff(_T("exp(2*a)/a"), 1, exp(2.0), exp(2.0), 2*exp(2.0));
+        iStat += EqnTestDiff(_T("sqrt(a)+ln(a)"), 4, 2+log(4.0), 0.5, -1.0/32-1.0/16);
+        iStat += EqnTestDiff(_T("a^a"), 1, 1, 1, 2);
+        iStat += EqnTestDiff(_T("atan2(a, 1)+min(a, 2*a, 3)"), 1, atan(1.0)+1, 1.5, -0.5);
+        iStat += EqnTestDiff(_T("a<1 ? -a^2 : a^2"), 2, 4, 4, 2);
+        iStat += EqnTestDiff(_T("b=a*3, b^2"), 1, 9, 18, 18, false);
+        iStat += EqnTestDiff(_T("a, 2^a*cos(a)"), 0, 1, log(2.0), log(2.0)*log(2.0)-1);
+        iStat += EqnTestDiff(_T("tanh(a)+asinh(a)+log10(a)"), 1, tanh(1.0)+asinh(1.0), 1-tanh(1.0)*tanh(1.0)+sqrt(0.5)+1/log(10.0), 
+                             -2*tanh(1.0)*(1-tanh(1.0)*tanh(1.0))-0.5*sqrt(0.5)-1/log(10.0));
+        iStat += EqnTestDiff(_T("b*a^2+(a>b ? sin(a) : 0)"), 0.5, sin(0.5), cos(0.5), -sin(0.5));
+        
+        // callbacks without derivative rule are differentiated numerically
+        iStat += EqnTestDiff(_T("f1of2(a^2, 1)"), 3, 9, 6, 2);
+        iStat += EqnTestDiff(_T("a'"), 3, 9, 6, 2);
+
+        // the bytecode of expressions with assignments can't be differentiated
+        {
+          value_type a = 1;
+          ParserTester::c_iCount++;
+          try
+          {
+            Parser p;
+            p.DefineVar(_T("a"), &a);
+            p.SetExpr(_T("a=2*a"));
+            p.SetDiffVar(&a);
+            p.Eval();
+            mu::console() << _T("\n  fail: a=2*a (no exception)");
+            iStat += 1;
+          }
+          catch(Parser::exception_type &e)
+          {
+            iStat += (e.GetCode()!=ecNOT_DIFFERENTIABLE) ? 1 : 0;
+          }
+        }
+
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestInterval()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing interval evaluation...");
+
+        const double fInf = std::numeric_limits<double>::infinity();
+        iStat += EqnTestInterval(_T("a^2"), -1, 2, 0, 4);
+        iStat += EqnTestInterval(_T("a^3-a"), 2, 3, 8-3, 27-2);
+        iStat += EqnTestInterval(_T("sin(a)"), 0, 4, sin(4.0), 1);
+        iStat += EqnTestInterval(_T("cos(a)"), -1, 7, -1, 1);
+        iStat += EqnTestInterval(_T("exp(a)+ln(a)"), 1, 2, exp(1.0), exp(2.0)+log(2.0));
+        iStat += EqnTestInterval(_T("sqrt(a)"), -4, 4, 0, 2);
+        iStat += EqnTestInterval(_T("1/a"), 0, 2, 0.5, fInf);
+        iStat += EqnTestInterval(_T("1/a"), -1, 2, -fInf, fInf);
+        iStat += EqnTestInterval(_T("abs(a)+min(a, 1)"), -2, 3, -2+0, 3+1);
+        iStat += EqnTestInterval(_T("tan(a)"), 1, 2, -fInf, fInf);
+        iStat += EqnTestInterval(_T("f1of1(a)"), 1, 2, -fInf, fInf);
+
+        // conditions and comparisons
+        iStat += EqnTestInterval(_T("a>0"), 1, 2, 1, 1);
+        iStat += EqnTestInterval(_T("a>0"), -1, 2, 0, 1);
+        iStat += EqnTestInterval(_T("a<0 ? -a : 2*a"), 1, 2, 2, 4);
+        iStat += EqnTestInterval(_T("a<0 ? -a : 2*a"), -3, -1, 1, 3);
+        iStat += EqnTestInterval(_T("a<0 ? -a : 2*a"), -3, 1, -6, 3);
+        iStat += EqnTestInterval(_T("b=a*2, b+1"), 1, 2, 3, 5);
+
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestProgram()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing compiled programs...");
+
+        try
+        {
+            value_type a = 1, b = 2, c = 3;
+            Parser p;
+            p.DefineVar(_T("a"), &a);
+            p.DefineVar(_T("b"), &b);
+            p.DefineVar(_T("c"), &c);
+            p.DefineFun(_T("strfun2"), StrFun2);
+            p.SetExpr(_T("c=b*2, strfun2(\"100\", a) + c"));
+            ParserProgram prog = p.Compile();
+
+            iStat += (prog.GetNumVar()==3 && prog.GetNumResults()==2) ? 0 : 1;
+            iStat += (prog.GetVarPtr(prog.GetVarSlot(&b))==&b) ? 0 : 1;
+
+            // the program is independent of the parser and its bound variables
+            p.SetExpr(_T("0"));
+            std::vector<value_type> vStack(prog.GetStackSize()), vVar(prog.GetNumVar());
+            prog.LoadVar(&vVar[0]);
+            vVar[prog.GetVarSlot(&b)] = 5;
+            value_type fRes = prog.Eval(&vVar[0], &vStack[0]);
+            iStat += (fRes==111 && vStack[1]==10 && vStack[2]==111 && vVar[prog.GetVarSlot(&c)]==10 && c==3) ? 0 : 1;
+            iStat += (p.Eval()==0) ? 0 : 1;
+
+            // copies share the program
+            ParserProgram prog2(prog);
+            vVar[prog.GetVarSlot(&b)] = 1;
+            iStat += (prog2.Eval(&vVar[0], &vStack[0])==103) ? 0 : 1;
+            ParserTester::c_iCount += 5;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestParallel()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing parallel evaluation...");
+
+        try
+        {
+            // large enough to be split between the threads of the pool
+            const int nSize = 200000;
+            std::vector<value_type> vA(nSize), vB(nSize, 2), vRes(nSize), vArrayRes(nSize), vExpect(nSize);
+            for (int i=0; i<nSize; ++i)
+            {
+                vA[i] = i * 0.5;
+                vExpect[i] = sin(vA[i]) * 2 + ((vA[i]>50000) ? vA[i] * vA[i] : -vA[i]);
+            }
+
+            Parser p;
+            p.DefineVar(_T("a"), &vA[0]);
+            p.DefineVar(_T("b"), &vB[0]);
+            p.SetExpr(_T("sin(a)*b + (a>50000 ? a^2 : -a)"));
+            p.Eval(&vRes[0], nSize);
+
+            value_type a = 0;
+            p.DefineVar(_T("a"), &a);
+            p.EvalArray(&a, &vA[0], &vArrayRes[0], nSize);
+
+            int nBad(0);
+            for (int i=0; i<nSize; ++i)
+            {
+                nBad += (fabs(vRes[i] - vExpect[i]) <= fabs(vExpect[i]) * 1e-14) ? 0 : 1;
+                nBad += (fabs(vArrayRes[i] - vExpect[i]) <= fabs(vExpect[i]) * 1e-14) ? 0 : 1;
+            }
+
+            iStat += (nBad==0) ? 0 : 1;
+            ParserTester::c_iCount += 2;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestSharedDef()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing shared definitions...");
+
+        try
+        {
+            // parsers share the built in definitions until they define their own
+            Parser p1, p2;
+            p1.DefineFun(_T("myfun"), f1of1);
+            p1.DefineConst(_T("myconst"), 2);
+            p1.DefineOprt(_T("$"), add);
+            Parser p3(p1);
+            p3.ClearConst();
+
+            p1.SetExpr(_T("myfun(3) $ myconst + sin(0)"));
+            iStat += (p1.Eval()==5) ? 0 : 1;
+            iStat += (p2.GetFunDef().find(_T("myfun"))==p2.GetFunDef().end()) ? 0 : 1;
+            iStat += (p2.GetConst().find(_T("myconst"))==p2.GetConst().end() && p2.GetConst().size()==2) ? 0 : 1;
+            iStat += (p3.GetFunDef().find(_T("myfun"))!=p3.GetFunDef().end() && p3.GetConst().empty()) ? 0 : 1;
+            iStat += (p1.GetConst().size()==3) ? 0 : 1;
+
+            p2.SetExpr(_T("1 $ 2"));
+            p2.Eval();
+            iStat += 1; // "$" is not defined in p2
+        }
+        catch(ParserError &e)
+        {
+            iStat += (e.GetCode()==ecUNASSIGNABLE_TOKEN) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 6;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestLongExpr()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing long expressions...");
+
+        try
+        {
+            // a 1000 term polynomial mixing every kind of token
+            value_type x = 0.75, fExpect = 0;
+            stringstream_type ss;
+            ss.imbue(std::locale::classic());
+            for (int i=0; i<1000; ++i)
+            {
+                ss << ((i>0) ? _T(" + ") : _T("")) << (i % 10) << _T(".5*");
+                switch(i % 4)
+                {
+                case 0:  ss << _T("x^") << (i % 5);     fExpect += (i % 10 + 0.5) * std::pow(x, i % 5); break;
+                case 1:  ss << _T("sin(x)");            fExpect += (i % 10 + 0.5) * std::sin(x);         break;
+                case 2:  ss << _T("_pi");               fExpect += (i % 10 + 0.5) * PARSER_CONST_PI;     break;
+                default: ss << _T("(x>0.5 ? 2e-1 : 1)"); fExpect += (i % 10 + 0.5) * 0.2;                break;
+                }
+            }
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.SetExpr(ss.str());
+            value_type fRes = p.Eval();
+            iStat += (fabs(fRes - fExpect) <= fabs(fExpect) * 1e-12) ? 0 : 1;
+            ParserTester::c_iCount++;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        try
+        {
+            // a sum nesting 100000 operators deep, the optimizer, hoisting and
+            // the derivative must not recurse once per level
+            const int iTerms = 100000;
+            value_type x = 0.5, c = 2, fRes[2] = { 0, 0 };
+            value_type vX[2] = { 0.25, 0.5 };
+            string_type sExpr;
+            for (int i=0; i<iTerms; ++i)
+              sExpr += (i>0) ? _T("+sin(x)*c") : _T("sin(x)*c");
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.DefineVar(_T("c"), &c);
+            p.SetExpr(sExpr);
+            iStat += (fabs(p.Eval() - iTerms*2*std::sin(x)) <= 1e-6) ? 0 : 1;
+
+            p.EvalArray(&x, vX, fRes, 2);
+            iStat += (fabs(fRes[0] - iTerms*2*std::sin(vX[0])) <= 1e-6) ? 0 : 1;
+
+            p.SetDiffVar(&x);
+            iStat += (fabs(p.Eval() - iTerms*2*std::cos(x)) <= 1e-6) ? 0 : 1;
+            ParserTester::c_iCount += 3;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        try
+        {
+            // more constants than the register code can address, it must fall
+            // back to the interpreter
+            const int iTerms = 70000;
+            value_type x = 0.5;
+            stringstream_type ss;
+            ss.imbue(std::locale::classic());
+            for (int i=0; i<iTerms; ++i)
+              ss << ((i>0) ? _T("+") : _T("")) << _T("sin(x)*") << i << _T(".5");
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.EnableJit(false);
+            p.EnableRegisterCode(true);
+            p.SetExpr(ss.str());
+            value_type fExpect = std::sin(x) * iTerms * (value_type)iTerms / 2;
+            iStat += (fabs(p.Eval() - fExpect) <= fExpect * 1e-12) ? 0 : 1;
+            ParserTester::c_iCount++;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestFusedExpr()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing fused expressions...");
+
+        // the results of a fused program must match the separately evaluated expressions
+        const int nExpr = 3, nVal = 150;
+        const char_type *szExpr[nExpr] = { _T("sin(x)*2"), _T("sin(x)+x"), _T("x>0.5 ? x : -x") };
+        for (int iJit=0; iJit<2; ++iJit)
+        {
+            try
+            {
+                value_type x = 0;
+                std::vector<value_type> vX(nVal), vRes[nExpr], vExpect[nExpr];
+                for (int i=0; i<nVal; ++i)
+                    vX[i] = i / (value_type)nVal;
+
+                Parser p;
+                p.DefineVar(_T("x"), &x);
+                p.EnableJit(iJit!=0);
+                p.SetFusedExpr(std::vector<string_type>(szExpr, szExpr + nExpr));
+
+                value_type *pRes[nExpr];
+                for (int k=0; k<nExpr; ++k)
+                {
+                    Parser q;
+                    q.DefineVar(_T("x"), &x);
+                    q.SetExpr(szExpr[k]);
+                    vExpect[k].resize(nVal);
+                    q.EvalArray(&x, &vX[0], &vExpect[k][0], nVal);
+
+                    vRes[k].resize(nVal);
+                    pRes[k] = &vRes[k][0];
+                }
+
+                value_type *pX = &x;
+                const value_type *pValues = &vX[0];
+                p.EvalArray(&pX, &pValues, 1, pRes, nExpr, nVal);
+                for (int k=0; k<nExpr; ++k)
+                    iStat += (vRes[k]==vExpect[k]) ? 0 : 1;
+
+                int nRes = 0;
+                x = vX[37];
+                value_type *v = p.Eval(nRes);
+                iStat += (nRes==nExpr && v[0]==vExpect[0][37] && v[1]==vExpect[1][37] && v[2]==vExpect[2][37]) ? 0 : 1;
+            }
+            catch(...)
+            {
+                iStat += 1;
+            }
+        }
+
+        // an expression with results of its own can't be part of a fused program
+        try
+        {
+            Parser p;
+            p.SetFusedExpr(std::vector<string_type>(1, _T("1,2")));
+            p.Eval();
+            iStat += 1;
+        }
+        catch(ParserError &e)
+        {
+            iStat += (e.GetCode()==ecUNEXPECTED_ARG) ? 0 : 1;
+        }
+
+        // more results than the expression has
+        try
+        {
+            value_type x = 0, fVal = 1, fRes[2];
+            value_type *pX = &x, *pRes[2] = { &fRes[0], &fRes[1] };
+            const value_type *pValues = &fVal;
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.SetExpr(_T("x+1"));
+            p.EvalArray(&pX, &pValues, 1, pRes, 2, 1);
+            iStat += 1;
+        }
+        catch(ParserError &e)
+        {
+            iStat += (e.GetCode()==ecTOO_FEW_RESULTS) ? 0 : 1;
+        }
+
+        ParserTester::c_iCount += 10;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestFloatEval()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing single precision evaluation...");
+
+        try
+        {
+            const int nVal = 150;
+            value_type x = 0;
+            std::vector<value_type> vX(nVal), vRes(nVal);
+            std::vector<float> vXf(nVal), vResf(nVal);
+            for (int i=0; i<nVal; ++i)
+            {
+                vX[i] = i / (value_type)nVal;
+                vXf[i] = (float)vX[i];
+            }
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.SetExpr(_T("sin(x)*2 + x^2 - (x>0.5 ? x : 1) + 3*x+1"));
+            p.EvalArray(&x, &vX[0], &vRes[0], nVal);
+            p.EvalArray(&x, &vXf[0], &vResf[0], nVal);
+
+            value_type fMaxErr = 0;
+            for (int i=0; i<nVal; ++i)
+                fMaxErr = std::max(fMaxErr, std::fabs(vRes[i] - vResf[i]));
+            iStat += (fMaxErr < 1e-5) ? 0 : 1;
+            iStat += (p.EvalFloatError(&x, &vX[0], nVal) < 1e-5) ? 0 : 1;
+
+            // float can't resolve small steps far away from zero
+            for (int i=0; i<nVal; ++i)
+                vX[i] = 1e6 + i * 1e-3;
+            p.SetExpr(_T("x-1e6"));
+            iStat += (p.EvalFloatError(&x, &vX[0], nVal) > 1e-2) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 3;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestVecMath()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing vectorized math functions...");
+
+        try
+        {
+            const int nVal = 300;
+            value_type x = 0;
+            std::vector<value_type> vX(nVal), vRes(nVal), vResFast(nVal);
+            for (int i=0; i<nVal; ++i)
+                vX[i] = -10 + 20 * i / (value_type)nVal;
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.SetExpr(_T("sin(x)+cos(2*x)+exp(x)+ln(x+2)+log2(abs(x))+log10(x+5)+tanh(x)+sqrt(x+1)"));
+            p.EvalArray(&x, &vX[0], &vRes[0], nVal);
+            p.EnableFastMath(true);
+            p.EvalArray(&x, &vX[0], &vResFast[0], nVal);
+
+            // Arguments outside of the domains have to give the same NaN or infinity as Eval
+            int nErr = 0, nErrFast = 0;
+            for (int i=0; i<nVal; ++i)
+            {
+                x = vX[i];
+                value_type fVal = p.Eval(),
+                           fTol = std::max((value_type)1, std::fabs(fVal));
+                bool bNaN = (fVal!=fVal);
+                if (!(vRes[i]==fVal || (bNaN && vRes[i]!=vRes[i]) || std::fabs(vRes[i] - fVal) <= 1e-14 * fTol))
+                    ++nErr;
+                if (!(vResFast[i]==fVal || (bNaN && vResFast[i]!=vResFast[i]) || std::fabs(vResFast[i] - fVal) <= 1e-5 * fTol))
+                    ++nErrFast;
+            }
+            iStat += (nErr==0) ? 0 : 1;
+            iStat += (nErrFast==0) ? 0 : 1;
+
+            // close to the zeros of the sine the result must keep its relative accuracy
+            const long double fPi2 = 1.5707963267948966192313216916397514L;
+            vX.clear();
+            for (int k=1; k<=200; ++k)
+            {
+                vX.push_back((value_type)(k * fPi2));
+                vX.push_back((value_type)(k * 3181 * fPi2));
+            }
+            vRes.resize(vX.size());
+
+            p.SetExpr(_T("sin(x)"));
+            p.EnableFastMath(false);
+            p.EvalArray(&x, &vX[0], &vRes[0], (int)vX.size());
+            nErr = 0;
+            for (std::size_t i=0; i<vX.size(); ++i)
+            {
+                value_type fVal = std::sin(vX[i]);
+                if (std::fabs(vRes[i] - fVal) > 4 * std::numeric_limits<value_type>::epsilon() * std::fabs(fVal))
+                    ++nErr;
+            }
+            iStat += (nErr==0) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 3;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestByteCodeIO()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing bytecode serialization...");
+
+        const int nExpr = 3;
+        const char_type *szExpr[nExpr] = { _T("a>0 ? sin(a)*b : b^2, -a+b*2, sin(a)*b"), 
+                                           _T("min(a,b,3) + strfun1(\"100\") + _pi"),
+                                           _T("b = a*2") };
+        std::vector<char> vBlob;
+        try
+        {
+            value_type a = 0.5, b = 2, a2 = 0, b2 = 0;
+            Parser p1, p2;
+            p1.DefineVar(_T("a"), &a);
+            p1.DefineVar(_T("b"), &b);
+            p1.DefineFun(_T("strfun1"), StrFun1);
+            p2.DefineVar(_T("a"), &a2);
+            p2.DefineVar(_T("b"), &b2);
+            p2.DefineFun(_T("strfun1"), StrFun1);
+            p2.EnableRegisterCode(true);
+
+            // several expressions are stored one after the other in the same blob
+            for (int k=0; k<nExpr; ++k)
+            {
+                p1.SetExpr(szExpr[k]);
+                p1.SaveByteCode(vBlob);
+            }
+
+            std::size_t iPos = 0;
+            for (int k=0; k<nExpr; ++k)
+            {
+                p1.SetExpr(szExpr[k]);
+                iPos += p2.LoadByteCode(&vBlob[iPos], vBlob.size() - iPos);
+                iStat += (p2.GetExpr()==p1.GetExpr()) ? 0 : 1;
+
+                for (int i=0; i<4; ++i)
+                {
+                    a = a2 = -1.5 + i;
+                    b = b2 = 2 - i * 0.5;
+                    int n1 = 0, n2 = 0;
+                    value_type *v1 = p1.Eval(n1), 
+                               *v2 = p2.Eval(n2);
+                    iStat += (n1==n2 && std::equal(v1, v1 + n1, v2) && b==b2) ? 0 : 1;
+                }
+            }
+            iStat += (iPos==vBlob.size()) ? 0 : 1;
+
+            // the same expression always gives the same blob
+            std::vector<char> vBlob1, vBlob2;
+            for (int k=0; k<nExpr; ++k)
+            {
+                p1.SetExpr(szExpr[k]);
+                p1.SaveByteCode(vBlob1);
+                p1.SetExpr(szExpr[k]);
+                p1.SaveByteCode(vBlob2);
+            }
+            iStat += (vBlob1==vBlob2) ? 0 : 1;
+
+            // redefining a variable falls back to parsing the expression
+            value_type c = 3;
+            p2.DefineVar(_T("c"), &c);
+            a2 = 1;
+            iStat += (p2.Eval()==2) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        // symbols are resolved by name
+        try
+        {
+            value_type a = 0;
+            Parser p;
+            p.DefineVar(_T("a"), &a);
+            p.LoadByteCode(&vBlob[0], vBlob.size());
+            iStat += 1;
+        }
+        catch(ParserError &e)
+        {
+            iStat += (e.GetCode()==ecBYTECODE_SYMBOL && e.GetToken()==_T("b")) ? 0 : 1;
+        }
+
+        // truncated blob
+        try
+        {
+            Parser p;
+            p.LoadByteCode(&vBlob[0], 20);
+            iStat += 1;
+        }
+        catch(ParserError &e)
+        {
+            iStat += (e.GetCode()==ecINVALID_BYTECODE) ? 0 : 1;
+        }
+
+        // callbacks have to take the same arguments
+        for (int k=0; k<2; ++k)
+        {
+            try
+            {
+                value_type a = 1;
+                std::vector<char> vFunBlob;
+                Parser p1, p2;
+                p1.DefineVar(_T("a"), &a);
+                p1.DefineFun(_T("f"), f1of1);
+                p1.SetExpr(_T("f(a)"));
+                p1.SaveByteCode(vFunBlob);
+
+                p2.DefineVar(_T("a"), &a);
+                if (k==0)
+                  p2.DefineFun(_T("f"), f1of2);
+                else
+                  p2.DefineFun(_T("f"), Sum);
+                p2.LoadByteCode(&vFunBlob[0], vFunBlob.size());
+                iStat += 1;
+            }
+            catch(ParserError &e)
+            {
+                iStat += (e.GetCode()==ecBYTECODE_SYMBOL && e.GetToken()==_T("f")) ? 0 : 1;
+            }
+        }
+
+        // stack too small for the bytecode or larger than it could be
+        const std::uint32_t aStackSize[2] = { 1, 0x7fffffff };
+        for (int k=0; k<2; ++k)
+        {
+            try
+            {
+                value_type a = 1, b = 2;
+                std::vector<char> vStackBlob;
+                Parser p;
+                p.DefineVar(_T("a"), &a);
+                p.DefineVar(_T("b"), &b);
+                p.SetExpr(_T("a+b"));
+                p.SaveByteCode(vStackBlob);
+
+                // header, expression, number of results and of string constants
+                std::memcpy(&vStackBlob[28 + 3 * sizeof(char_type)], &aStackSize[k], sizeof(aStackSize[k]));
+                p.LoadByteCode(&vStackBlob[0], vStackBlob.size());
+                iStat += 1;
+            }
+            catch(ParserError &e)
+            {
+                iStat += (e.GetCode()==ecINVALID_BYTECODE) ? 0 : 1;
+            }
+        }
+
+        // an ELSE has to jump to its own ENDIF
+        try
+        {
+            value_type x = 0.5, y = 1;
+            std::vector<char> vJumpBlob;
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.DefineVar(_T("y"), &y);
+            p.SetExpr(_T("x<1 ? y*2 : x>2 ? 3 : ln(x)"));
+            p.SaveByteCode(vJumpBlob);
+
+            // Other bytes with the value of cmELSE aren't followed by a jump offset
+            int nElse = 0;
+            for (std::size_t i=0; i+1+sizeof(std::int32_t)<=vJumpBlob.size(); ++i)
+            {
+                std::int32_t iOffset;
+                std::memcpy(&iOffset, &vJumpBlob[i+1], sizeof(iOffset));
+                if (vJumpBlob[i]!=cmELSE || iOffset<3 || iOffset>20)
+                    continue;
+
+                ++nElse;
+                std::vector<char> vBadBlob(vJumpBlob);
+                iOffset = 2;
+                std::memcpy(&vBadBlob[i+1], &iOffset, sizeof(iOffset));
+                try
+                {
+                    p.LoadByteCode(&vBadBlob[0], vBadBlob.size());
+                    iStat += 1;
+                }
+                catch(ParserError &e)
+                {
+                    iStat += (e.GetCode()==ecINVALID_BYTECODE) ? 0 : 1;
+                }
+            }
+            iStat += (nElse==2) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 6;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestProfile()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing profiling counters...");
+
+        try
+        {
+            const int nVal = 100;
+            value_type x = 1;
+            std::vector<value_type> vX(nVal, 0.5), vRes(nVal);
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.EnableJit(true);
+            p.SetExpr(_T("sin(x)+x*2"));
+            for (int i=0; i<10; ++i)
+                p.Eval();
+            p.EvalArray(&x, &vX[0], &vRes[0], nVal);
+
+            ParserProfile prof = p.GetProfile();
+#if defined(MUP_PROFILING)
+            // every value counts, no matter how it is evaluated
+            iStat += (prof.bEnabled && prof.nParse==1 && prof.nEval==10 + nVal) ? 0 : 1;
+            iStat += (prof.aCmdCount[cmFUNC]==10 + nVal && prof.vFun.size()==1 && 
+                      prof.vFun[0].Name==_T("sin") && prof.vFun[0].nCalls==10 + nVal) ? 0 : 1;
+#else
+            iStat += (!prof.bEnabled && prof.nEval==0 && prof.vFun.empty()) ? 0 : 1;
+            iStat += (prof.aCmdCount[cmFUNC]==0) ? 0 : 1;
+#endif
+
+            p.ResetProfile();
+            prof = p.GetProfile();
+            iStat += (prof.nEval==0 && prof.nParse==0) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 3;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestHoist()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing hoisting of parameter subexpressions...");
+
+        try
+        {
+            const int nVal = 100;
+            value_type x = 0.5, a = 2, b = 3, c = 4, d = 0.25;
+            std::vector<value_type> vX(nVal), vRes(nVal), vRef(nVal);
+            for (int i=0; i<nVal; ++i)
+                vX[i] = -2 + i * 0.04;
+
+            Parser p, ref;
+            p.DefineVar(_T("x"), &x);
+            p.DefineVar(_T("a"), &a);
+            p.DefineVar(_T("b"), &b);
+            p.DefineVar(_T("c"), &c);
+            p.DefineVar(_T("d"), &d);
+            p.DefineFun(_T("counted"), Counted);
+            ref = p;
+            value_type *pSweepVar = &x;
+            p.SetSweepVars(&pSweepVar, 1);
+            p.SetExpr(_T("a*sin(b*x)+counted(c)*exp(-d), x>0 ? counted(c)*exp(-d) : b*b"));
+            ref.SetExpr(p.GetExpr());
+
+            // The prologue only runs if a parameter changes
+            int nErr = 0, nCalls = 0;
+            for (int i=0; i<nVal; ++i)
+            {
+                x = vX[i];
+                if (i==nVal/2)
+                    c = 5;
+
+                int nRes = 0, nRefRes = 0;
+                c_iCalls = 0;
+                value_type *pRes = p.Eval(nRes);
+                nCalls += c_iCalls;
+
+                value_type *pRef = ref.Eval(nRefRes);
+                nErr += (nRes==2 && pRes[0]==pRef[0] && pRes[1]==pRef[1]) ? 0 : 1;
+            }
+            iStat += (nErr==0 && nCalls==2) ? 0 : 1;
+
+            // Array evaluation with the sweep variable and with a bound parameter
+            d = 1;
+            p.EvalArray(&x, &vX[0], &vRes[0], nVal);
+            ref.EvalArray(&x, &vX[0], &vRef[0], nVal);
+            nErr = 0;
+            for (int i=0; i<nVal; ++i)
+                nErr += (std::fabs(vRes[i] - vRef[i]) <= 1e-14 * (1 + std::fabs(vRef[i]))) ? 0 : 1;
+
+            p.EvalArray(&a, &vX[0], &vRes[0], nVal);
+            ref.EvalArray(&a, &vX[0], &vRef[0], nVal);
+            for (int i=0; i<nVal; ++i)
+                nErr += (std::fabs(vRes[i] - vRef[i]) <= 1e-14 * (1 + std::fabs(vRef[i]))) ? 0 : 1;
+            iStat += (nErr==0) ? 0 : 1;
+
+            // Expressions without parameter subexpressions and with assignments
+            p.SetExpr(_T("x*x+1"));
+            iStat += (p.Eval()==x*x+1) ? 0 : 1;
+            p.SetExpr(_T("a=b*c, a+x"));
+            iStat += (p.Eval()==b*c+x) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 4;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    int ParserTester::TestLoop()
+    {
+        int iStat = 0;
+        mu::console() << _T("testing sums and products...");
+
+        iStat += EqnTest(_T("sum(k,1,10,k)"), 55, true);
+        iStat += EqnTest(_T("prod(k, 1, 5, k)"), 120, true);
+        iStat += EqnTest(_T("sum(k,a,c,k^2)"), 14, true);
+        iStat += EqnTest(_T("sum(k,1,b,sum(j,1,k,j*k))"), 7, true);
+        iStat += EqnTest(_T("sum(k,1,3,sum(k,1,2,k))"), 9, true);        // the inner loop variable hides the outer one
+        iStat += EqnTest(_T("a+2*sum(k,1,3,k>2 ? k : 0)"), 7, true);
+        iStat += EqnTest(_T("sum(k,1,0,k)+prod(k,1,0,k)"), 1, true);   // no iterations
+        iStat += EqnTest(_T("sum(1,2,3)"), 6, true);                    // not a loop
+        iStat += EqnTest(_T("1+2+sum(k,1,3,k)"), 9, true);              // folded constants below the loop
+        iStat += EqnTest(_T("1+2+3+4+sum(n,1,3,n)"), 16, true);
+        iStat += EqnTest(_T("2*3+sum(n,0,10,n)"), 61, true);
+        iStat += EqnTest(_T("b*2+sum(n,0,10,n)"), 59, true);
+        iStat += EqnTest(_T("sum(k,0,2*5,k)"), 55, true);               // folded bound
+        iStat += EqnTest(_T("sum(n,0,c*2+4,n)"), 55, true);
+        iStat += EqnTest(_T("(a<b ? 3 : 4)+sum(n,1,3,n)"), 9, true);     // loops after and within if-then-else
+        iStat += EqnTest(_T("a<1 ? 0 : sum(n,1,3,n)+1"), 7, true);
+        iStat += EqnTest(_T("(a>0 ? 1 : 2)+(a<0 ? 3 : sum(j,1,2,j))"), 4, true);
+        iStat += EqnTest(_T("a<1 ? 0 : (b>1 ? sum(n,1,3,n*sum(m,1,n,m)) : 5)"), 25, true);
+        iStat += EqnTestDiff(_T("sum(k,1,3,a^k)"), 2, 14, 17, 14, false);
+        iStat += EqnTestDiff(_T("prod(k,1,2,a+k)"), 1, 6, 5, 2, false);
+        iStat += EqnTestInterval(_T("sum(k,1,3,k*a)"), 0, 1, 0, 6);
+        iStat += ThrowTest(_T("sum(k,1,3)"), ecTOO_FEW_PARAMS);
+        iStat += ThrowTest(_T("sum(k,1,3,4,5)"), ecTOO_MANY_PARAMS);
+        iStat += ThrowTest(_T("sum(k,k,3,k)"), ecUNASSIGNABLE_TOKEN);
+        iStat += ThrowTest(_T("sum(k,1,3,k=2)"), ecUNEXPECTED_OPERATOR);
+
+        try
+        {
+            // The number of iterations differs from one value to the next
+            const int nVal = 100;
+            value_type x = 0;
+            std::vector<value_type> vX(nVal), vRes(nVal);
+            for (int i=0; i<nVal; ++i)
+                vX[i] = i * 0.25 - 5;
+
+            Parser p;
+            p.DefineVar(_T("x"), &x);
+            p.SetExpr(_T("sum(n,0,x,(-1)^n/(2*n+1)) + prod(n,1,x/2,x/n)"));
+            p.EvalArray(&x, &vX[0], &vRes[0], nVal);
+
+            int nErr = 0;
+            for (int i=0; i<nVal; ++i)
+            {
+                x = vX[i];
+                nErr += (std::fabs(vRes[i] - p.Eval()) <= 1e-14 * (1 + std::fabs(vRes[i]))) ? 0 : 1;
+            }
+            iStat += (nErr==0) ? 0 : 1;
+
+            // Too many iterations
+            p.SetExpr(_T("sum(n,1,1e12,n)"));
+            iStat += (p.Eval()!=p.Eval()) ? 0 : 1;
+
+            // Loops survive saving and loading the bytecode
+            std::vector<char> vBlob;
+            Parser p2;
+            p2.DefineVar(_T("x"), &x);
+            p.SetExpr(_T("prod(n,1,3,sum(j,n,x,j))"));
+            p.SaveByteCode(vBlob);
+            p2.LoadByteCode(&vBlob[0], vBlob.size());
+            x = 4;
+            iStat += (p2.Eval()==p.Eval() && p.Eval()==10*9*7) ? 0 : 1;
+        }
+        catch(...)
+        {
+            iStat += 1;
+        }
+
+        ParserTester::c_iCount += 3;
+        if (iStat == 0)
+            mu::console() << _T("passed") << endl;
+        else
+            mu::console() << _T("\n  failed with ") << iStat << _T(" errors") << endl;
+
+        return iStat;
+    }
+
     //---------------------------------------------------------------------------------------------
     int ParserTester::TestBinOprt()
     {
@@ -883,6 +1852,12 @@ namespace mu
 
       // long formula (Reference: Matlab)
       iStat += EqnTest( _T("1+2-3*4/5^6*(2*(1-5+(3*7^9)*(4+6*7-3)))+12"), -7995810.09926, true);
+
+      // common subexpressions and algebraic simplifications
+      iStat += EqnTest( _T("sin(a)^2+cos(a)*sin(a)+sin(a)"), sin(1.0)*sin(1.0)+cos(1.0)*sin(1.0)+sin(1.0), true);
+      iStat += EqnTest( _T("(a+b)^5-(a+b)^-2+a^7"), pow(3.0, 5)-pow(3.0, -2)+1, true);
+      iStat += EqnTest( _T("b/4+(a+b)/3+(a+b)*1-0"), 4.5, true);
+      iStat += EqnTest( _T("sqrt(4)*a+sin(a), sin(a)*2"), 2*sin(1.0), true);
 	  
       if (iStat==0) 
         mu::console() << _T("passed") << endl;  
@@ -972,6 +1947,8 @@ namespace mu
       iStat += EqnTest(_T("1>0 ? 1>2 ? 128 : 255 :  1>0 ? 32 :1>2 ? 64 : 16"), 255, true);
       iStat += EqnTest(_T("1>0 ? 1>2 ? 128 : 255 : (1>0 ? 32 :1>2 ? 64 : 16)"), 255, true);
       iStat += EqnTest(_T("1 ? 0 ? 128 : 255 : 1 ? 32 : 64"), 255, true);
+      iStat += EqnTest(_T("0 ? sin(a) : cos(a)*cos(a)"), cos(1.0)*cos(1.0), true);
+      iStat += EqnTest(_T("(a<b ? sin(a)*sin(a) : sin(a)) + sin(a)*sin(a)"), 2*sin(1.0)*sin(1.0), true);
 
       // assignment operators
       iStat += EqnTest(_T("a= 0 ? 128 : 255, a"), 255, true);
@@ -1254,7 +2231,7 @@ namespace mu
     {
       ParserTester::c_iCount++;
       int iRet(0);
-      value_type fVal[5] = {-999, -998, -997, -996, -995}; // initially should be different
+      value_type fVal[8] = {-999, -998, -997, -996, -995, -994, -993, -992}; // initially should be different
 
       try
       {
@@ -1369,6 +2346,28 @@ namespace mu
           int nNum;
           value_type *v = p4.Eval(nNum);
           fVal[4] = v[nNum-1];
+
+          // Test array evaluation, the size covers a full block and a partial one.
+          // All variables keep their value so every result must be the same.
+          value_type vArrayIn[70], vArrayOut[70];
+          std::fill(vArrayIn, vArrayIn + 70, vVarVal[0]);
+          p4.EvalArray(&vVarVal[0], vArrayIn, vArrayOut, 70);
+          fVal[5] = vArrayOut[0];
+          for (int i=1; i<70; ++i)
+          {
+            if (vArrayOut[i]!=fVal[5])
+              throw Parser::exception_type( _T("Array evaluation result mismatch.") );
+          }
+
+          // Test the machine code compiled from the bytecode
+          mu::Parser p6 = p4;
+          p6.EnableJit(true);
+          fVal[6] = p6.Eval();
+
+          // Test the register code
+          mu::Parser p7 = p4;
+          p7.EnableRegisterCode(true);
+          fVal[7] = p7.Eval();
         }
         catch(std::exception &e)
         {
@@ -1408,7 +2407,10 @@ namespace mu
                                                 << fVal[1] << _T(",")
                                                 << fVal[2] << _T(",")
                                                 << fVal[3] << _T(",")
-                                                << fVal[4] << _T(").");
+                                                << fVal[4] << _T(",")
+                                                << fVal[5] << _T(",")
+                                                << fVal[6] << _T(",")
+                                                << fVal[7] << _T(").");
         }
       }
       catch(Parser::exception_type &e)
@@ -1499,6 +2501,7 @@ namespace mu
         value_type vVariableB[] = { 2, 2, 2, 2 };   // variable values
         value_type vVariableC[] = { 3, 3, 3, 3 };   // variable values
         value_type vResults[] = { 0, 0, 0, 0 };   // variable values
+        value_type vArrayResults[] = { 0, 0, 0, 0 };
         int iRet(0);
 
         try
@@ -1511,12 +2514,21 @@ namespace mu
             p.DefineVar(_T("c"), vVariableC);
 
             p.SetExpr(a_str);
+
+            // Array evaluation must yield the same results as the bulk mode,
+            // it has to run first since assignments in bulk mode modify the variables.
+            value_type vValA[] = { 1, 2, 3, 4 }, vValB[] = { 2, 2, 2, 2 }, vValC[] = { 3, 3, 3, 3 };
+            value_type *vArrayVar[] = { vVariableA, vVariableB, vVariableC };
+            const value_type *vArrayVal[] = { vValA, vValB, vValC };
+            p.EvalArray(vArrayVar, vArrayVal, 3, vArrayResults, nBulkSize);
+
             p.Eval(vResults, nBulkSize);
 
             bool bCloseEnough(true);
             for (int i = 0; i < nBulkSize; ++i)
             {
                 bCloseEnough &= (fabs(a_fRes[i] - vResults[i]) <= fabs(a_fRes[i] * 0.00001));
+                bCloseEnough &= (fabs(a_fRes[i] - vArrayResults[i]) <= fabs(a_fRes[i] * 0.00001));
             }
 
             iRet = ((bCloseEnough && a_fPass) || (!bCloseEnough && !a_fPass)) ? 0 : 1;
@@ -1544,6 +2556,121 @@ namespace mu
         return iRet;
     }
 
+    //---------------------------------------------------------------------------
+    /** \brief Evaluate an expression and its derivatives with respect to the variable a. 
+    
+      If a_bSymbolic is set the derivatives are also computed by the bytecode 
+      created with ParserBase::SetDiffVar.
+    */
+    int ParserTester::EqnTestDiff(const string_type &a_str, double a_fVar, double a_fRes, double a_fDeriv, double a_fDeriv2, bool a_bSymbolic)
+    {
+        ParserTester::c_iCount++;
+
+        value_type a = a_fVar, b = 0, fRes = 0, fDeriv = 0, fDeriv2 = 0;
+        int iRet(0);
+
+        try
+        {
+            Parser p;
+            p.DefineVar(_T("a"), &a);
+            p.DefineVar(_T("b"), &b);
+            p.DefineFun(_T("f1of2"), f1of2);
+            p.DefinePostfixOprt(_T("'"), sqr);
+            p.SetExpr(a_str);
+            fRes = p.EvalDiff(&a, &fDeriv, &fDeriv2);
+
+            // numerical derivatives are less accurate
+            bool bCloseEnough = fabs(fRes - a_fRes) <= fabs(a_fRes * 0.00001) &&
+                                fabs(fDeriv - a_fDeriv) <= 0.00001 * (1 + fabs(a_fDeriv)) &&
+                                fabs(fDeriv2 - a_fDeriv2) <= 0.0001 * (1 + fabs(a_fDeriv2));
+            if (!bCloseEnough)
+            {
+                mu::console() << _T("\n  fail: ") << a_str.c_str()
+                    << _T(" (incorrect result; expected: ") << a_fRes << _T(",") << a_fDeriv << _T(",") << a_fDeriv2
+                    << _T(" ;calculated: ") << fRes << _T(",") << fDeriv << _T(",") << fDeriv2 << _T(")");
+                iRet = 1;
+            }
+
+            if (a_bSymbolic && !iRet)
+            {
+                // The same derivatives computed by the bytecode of the derivative
+                Parser p1(p), p2(p);
+                p1.SetDiffVar(&a);
+                p2.SetDiffVar(&a, 2);
+                fDeriv = p1.Eval();
+                fDeriv2 = p2.Eval();
+
+                bCloseEnough = fabs(fDeriv - a_fDeriv) <= 0.00001 * (1 + fabs(a_fDeriv)) &&
+                               fabs(fDeriv2 - a_fDeriv2) <= 0.0001 * (1 + fabs(a_fDeriv2));
+                if (!bCloseEnough)
+                {
+                    mu::console() << _T("\n  fail: ") << a_str.c_str()
+                        << _T(" (incorrect derivative bytecode; expected: ") << a_fDeriv << _T(",") << a_fDeriv2
+                        << _T(" ;calculated: ") << fDeriv << _T(",") << fDeriv2 << _T(")");
+                    iRet = 1;
+                }
+            }
+        }
+        catch (Parser::exception_type &e)
+        {
+            mu::console() << _T("\n  fail: ") << e.GetExpr() << _T(" : ") << e.GetMsg();
+            iRet = 1;
+        }
+        catch (...)
+        {
+            mu::console() << _T("\n  fail: ") << a_str.c_str() << _T(" (unexpected exception)");
+            iRet = 1;  // exceptions other than ParserException are not allowed
+        }
+
+        return iRet;
+    }
+
+    //---------------------------------------------------------------------------
+    /** \brief Evaluate the range of an expression over an interval of a.
+
+      The computed bounds must enclose the expected ones and be close to them.
+    */
+    int ParserTester::EqnTestInterval(const string_type &a_str, double a_fLo, double a_fHi, double a_fResLo, double a_fResHi)
+    {
+        ParserTester::c_iCount++;
+
+        value_type a = 0, b = 0, fLo = 0, fHi = 0;
+        int iRet(0);
+
+        try
+        {
+            Parser p;
+            p.DefineVar(_T("a"), &a);
+            p.DefineVar(_T("b"), &b);
+            p.DefineFun(_T("f1of1"), f1of1);
+            p.SetExpr(a_str);
+            p.EvalInterval(&a, a_fLo, a_fHi, &fLo, &fHi);
+
+            bool bEncloses = fLo<=a_fResLo && fHi>=a_fResHi &&
+                             (fLo==a_fResLo || fLo>=a_fResLo - 0.00001 * (1 + fabs(a_fResLo))) &&
+                             (fHi==a_fResHi || fHi<=a_fResHi + 0.00001 * (1 + fabs(a_fResHi)));
+            if (!bEncloses)
+            {
+                mu::console() << _T("\n  fail: ") << a_str.c_str()
+                    << _T(" (incorrect range; expected: [") << a_fResLo << _T(",") << a_fResHi
+                    << _T("] ;calculated: [") << fLo << _T(",") << fHi << _T("])");
+                iRet = 1;
+            }
+        }
+        catch (Parser::exception_type &e)
+        {
+            mu::console() << _T("\n  fail: ") << e.GetExpr() << _T(" : ") << e.GetMsg();
+            iRet = 1;
+        }
+        catch (...)
+        {
+            mu::console() << _T("\n  fail: ") << a_str.c_str() << _T(" (unexpected exception)");
+            iRet = 1;  // exceptions other than ParserException are not allowed
+        }
+
+        return iRet;
+    }
+
     //---------------------------------------------------------------------------
     /** \brief Internal error in test class Test is going to be aborted. */
     void ParserTester::Abort() const
@@ -0,0 +1,337 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+#include "muParserThreadPool.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
+/** \file
+    \brief Implementation of the thread pool used for evaluating many values at once.
+*/
+
+namespace mu
+{
+  namespace
+  {
+    /** \brief Time spent by the calling thread measuring the cost of a job [s]. */
+    const double s_fProbeTime = 10e-6;
+
+    /** \brief Jobs shorter than this are not worth waking the workers [s]. */
+    const double s_fMinJobTime = 50e-6;
+
+    /** \brief Targeted duration of a chunk [s]. */
+    const double s_fChunkTime = 20e-6;
+
+    /** \brief Set while a thread runs a chunk, nested jobs run serially. */
+    thread_local bool s_bInJob = false;
+
+    //------------------------------------------------------------------------------
+    /** \brief Run a chunk of a job on the current thread. */
+    void RunChunk(ParserThreadPool::range_fun_type a_pFun, void *a_pCtx, int a_iBegin, int a_iEnd, int a_iThread)
+    {
+      struct SInJob
+      {
+        SInJob()  { s_bInJob = true;  }
+       ~SInJob()  { s_bInJob = false; }
+      } guard;
+
+      a_pFun(a_pCtx, a_iBegin, a_iEnd, a_iThread);
+    }
+  } // anonymous namespace
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the pool shared by all parsers. */
+  ParserThreadPool& ParserThreadPool::Instance()
+  {
+    static ParserThreadPool s_Pool;
+    return s_Pool;
+  }
+
+  //---------------------------------------------------------------------------
+  ParserThreadPool::ParserThreadPool()
+    :m_iNumThreads(std::max((int)std::thread::hardware_concurrency(), 1))
+    ,m_vWorker()
+    ,m_pQueue(new SQueue[std::max((int)std::thread::hardware_concurrency(), 1)])
+    ,m_RunLock()
+    ,m_Lock()
+    ,m_cvStart()
+    ,m_cvDone()
+    ,m_iJob(0)
+    ,m_iBusy(0)
+    ,m_bStop(false)
+    ,m_pFun(NULL)
+    ,m_pCtx(NULL)
+    ,m_iGrain(1)
+    ,m_iAlign(1)
+    ,m_pError()
+  {
+    for (int i=0; i<m_iNumThreads; ++i)
+      m_pQueue[i].iBegin = m_pQueue[i].iEnd = 0;
+  }
+
+  //---------------------------------------------------------------------------
+  ParserThreadPool::~ParserThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      m_bStop = true;
+    }
+
+    m_cvStart.notify_all();
+    for (std::size_t i=0; i<m_vWorker.size(); ++i)
+      m_vWorker[i].join();
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Return the number of threads running a job, including the caller. 
+  
+    The number may drop once when the first parallel job starts the workers, 
+    buffers sized with a former value remain large enough.
+  */
+  int ParserThreadPool::GetNumThreads() const
+  {
+    return m_iNumThreads;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Start the worker threads if this wasn't done yet. 
+  
+    If the system refuses to create threads the pool works with the ones it got.
+  */
+  void ParserThreadPool::Start()
+  {
+    int nThreads = m_iNumThreads;
+    if ((int)m_vWorker.size()==nThreads-1)
+      return;
+
+    try
+    {
+      for (int i=1; i<nThreads; ++i)
+        m_vWorker.push_back(std::thread(&ParserThreadPool::WorkerMain, this, i));
+    }
+    catch(std::system_error &)
+    {
+      m_iNumThreads = (int)m_vWorker.size() + 1;
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Main loop of the worker threads. */
+  void ParserThreadPool::WorkerMain(int a_iThread)
+  {
+    unsigned iJob = 0;
+    for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_cvStart.wait(lock, [&]{ return m_bStop || m_iJob!=iJob; });
+        if (m_bStop)
+          return;
+        iJob = m_iJob;
+      }
+
+      Work(a_iThread);
+
+      std::lock_guard<std::mutex> lock(m_Lock);
+      if (--m_iBusy==0)
+        m_cvDone.notify_one();
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Run chunks of the current job until no work is left. */
+  void ParserThreadPool::Work(int a_iThread)
+  {
+    int iBegin, iEnd;
+    do
+    {
+      while (TakeChunk(a_iThread, iBegin, iEnd))
+      {
+        try
+        {
+          RunChunk(m_pFun, m_pCtx, iBegin, iEnd, a_iThread);
+        }
+        catch(...)
+        {
+          {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            if (!m_pError)
+              m_pError = std::current_exception();
+          }
+
+          // drop the rest of the job
+          for (int i=0; i<m_iNumThreads; ++i)
+          {
+            std::lock_guard<std::mutex> lock(m_pQueue[i].Lock);
+            m_pQueue[i].iBegin = m_pQueue[i].iEnd;
+          }
+        }
+      }
+    } while (Steal(a_iThread));
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Take a chunk from the front of the range owned by a thread. */
+  bool ParserThreadPool::TakeChunk(int a_iThread, int &a_iBegin, int &a_iEnd)
+  {
+    SQueue &q = m_pQueue[a_iThread];
+    std::lock_guard<std::mutex> lock(q.Lock);
+    if (q.iBegin>=q.iEnd)
+      return false;
+
+    a_iBegin = q.iBegin;
+    a_iEnd = std::min(q.iEnd, q.iBegin + m_iGrain);
+    q.iBegin = a_iEnd;
+    return true;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Move the back half of the range of another thread to a thread.
+      \return false if all ranges are empty.
+  */
+  bool ParserThreadPool::Steal(int a_iThread)
+  {
+    for (int k=1; k<m_iNumThreads; ++k)
+    {
+      SQueue &victim = m_pQueue[(a_iThread + k) % m_iNumThreads];
+      int iBegin, iEnd;
+      {
+        std::lock_guard<std::mutex> lock(victim.Lock);
+        int iLeft = victim.iEnd - victim.iBegin;
+        if (iLeft<=0)
+          continue;
+
+        int iTake = (iLeft>m_iGrain) ? iLeft / 2 / m_iAlign * m_iAlign : iLeft;
+        if (iTake==0)
+          iTake = iLeft;
+
+        iEnd = victim.iEnd;
+        iBegin = victim.iEnd = iEnd - iTake;
+      }
+
+      SQueue &q = m_pQueue[a_iThread];
+      std::lock_guard<std::mutex> lock(q.Lock);
+      q.iBegin = iBegin;
+      q.iEnd = iEnd;
+      return true;
+    }
+
+    return false;
+  }
+
+  //---------------------------------------------------------------------------
+  /** \brief Process the indices [0, a_iSize) in parallel.
+      \param a_pFun The callback processing a range of indices.
+      \param a_pCtx Context passed to the callback.
+      \param a_iSize Number of indices.
+      \param a_iMinGrain Smallest chunk size, chunks start at multiples of it.
+      \throw The first exception thrown by the callback, the remaining 
+             indices are not processed in that case.
+
+    Returns when all indices are processed. Jobs submitted by several threads 
+    at once are run one after the other, nested jobs run on the calling thread.
+  */
+  void ParserThreadPool::Run(range_fun_type a_pFun, void *a_pCtx, int a_iSize, int a_iMinGrain)
+  {
+    if (a_iSize<=0)
+      return;
+
+    a_iMinGrain = std::max(a_iMinGrain, 1);
+    if (m_iNumThreads==1 || s_bInJob)
+    {
+      a_pFun(a_pCtx, 0, a_iSize, 0);
+      return;
+    }
+
+    // Measure the cost per index on the calling thread
+    typedef std::chrono::steady_clock clock_type;
+    clock_type::time_point t0 = clock_type::now();
+    double fTime = 0;
+    int iDone = 0;
+    for (int iProbe = a_iMinGrain; iDone<a_iSize && fTime<s_fProbeTime; iProbe *= 2)
+    {
+      int iEnd = std::min(a_iSize, iDone + iProbe);
+      a_pFun(a_pCtx, iDone, iEnd, 0);
+      iDone = iEnd;
+      fTime = std::chrono::duration<double>(clock_type::now() - t0).count();
+    }
+
+    int iLeft = a_iSize - iDone;
+    double fCost = fTime / iDone;
+    if (iLeft==0)
+      return;
+
+    if (fCost * iLeft < s_fMinJobTime)
+    {
+      a_pFun(a_pCtx, iDone, a_iSize, 0);
+      return;
+    }
+
+    std::lock_guard<std::mutex> run(m_RunLock);
+    Start();
+    if (m_iNumThreads==1)
+    {
+      a_pFun(a_pCtx, iDone, a_iSize, 0);
+      return;
+    }
+
+    // Chunks of about s_fChunkTime, at least a few per thread
+    int iGrain = (int)std::min(s_fChunkTime / std::max(fCost, 1e-12), (double)iLeft / (4 * m_iNumThreads));
+    m_iGrain = std::max(iGrain / a_iMinGrain * a_iMinGrain, a_iMinGrain);
+    m_iAlign = a_iMinGrain;
+    m_pFun = a_pFun;
+    m_pCtx = a_pCtx;
+
+    // Split the remaining range evenly
+    int nBlocks = (iLeft + a_iMinGrain - 1) / a_iMinGrain;
+    for (int i=0; i<m_iNumThreads; ++i)
+    {
+      std::lock_guard<std::mutex> lock(m_pQueue[i].Lock);
+      m_pQueue[i].iBegin = std::min(iDone + (int)((long long)nBlocks * i / m_iNumThreads) * a_iMinGrain, a_iSize);
+      m_pQueue[i].iEnd = std::min(iDone + (int)((long long)nBlocks * (i + 1) / m_iNumThreads) * a_iMinGrain, a_iSize);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      m_pError = std::exception_ptr();
+      m_iBusy = m_iNumThreads - 1;
+      ++m_iJob;
+    }
+    m_cvStart.notify_all();
+
+    Work(0);
+
+    std::exception_ptr pError;
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_cvDone.wait(lock, [&]{ return m_iBusy==0; });
+      std::swap(pError, m_pError);
+    }
+
+    if (pError)
+      std::rethrow_exception(pError);
+  }
+} // namespace mu
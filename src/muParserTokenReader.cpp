@@ -99,6 +99,7 @@ namespace mu
     m_cArgSep         = a_Reader.m_cArgSep;
 	m_fZero           = a_Reader.m_fZero;
 	m_lastTok         = a_Reader.m_lastTok;
+    m_vLoopVar        = a_Reader.m_vLoopVar;
   }
 
   //---------------------------------------------------------------------------
@@ -131,6 +132,7 @@ namespace mu
     ,m_iBrackets(0)
     ,m_lastTok()
     ,m_cArgSep(',')
+    ,m_vLoopVar()
   {
     assert(m_pParser);
     SetParent(m_pParser);
@@ -249,6 +251,7 @@ namespace mu
     m_iBrackets = 0;
     m_UsedVar.clear();
     m_lastTok = token_type();
+    m_vLoopVar.clear();
   }
 
   //---------------------------------------------------------------------------
@@ -266,9 +269,11 @@ namespace mu
 
     if ( IsEOF(tok) )        return SaveBeforeReturn(tok); // Check for end of formula
     if ( IsOprt(tok) )       return SaveBeforeReturn(tok); // Check for user defined binary operator
+    if ( IsLoopTok(tok) )    return SaveBeforeReturn(tok); // Check for sums and products
     if ( IsFunTok(tok) )     return SaveBeforeReturn(tok); // Check for function token
     if ( IsBuiltIn(tok) )    return SaveBeforeReturn(tok); // Check built in operators / tokens
     if ( IsArgSep(tok) )     return SaveBeforeReturn(tok); // Check for function argument separators
+    if ( IsLoopVarTok(tok) ) return SaveBeforeReturn(tok); // Check for loop variables of sums and products
     if ( IsValTok(tok) )     return SaveBeforeReturn(tok); // Check for values / constant tokens
     if ( IsVarTok(tok) )     return SaveBeforeReturn(tok); // Check for variable tokens
     if ( IsStrVarTok(tok) )  return SaveBeforeReturn(tok); // Check for string variables
@@ -337,6 +342,18 @@ namespace mu
     return iEnd;
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Find the end of the characters that belong to a certain charset.
+
+    Same as ExtractToken(const char_type*, string_type&, int) without creating 
+    the token string, names are looked up in place with ParserSharedMap::Find.
+  */
+  int ParserTokenReader::ExtractToken(const char_type *a_szCharSet, int a_iPos) const
+  {
+    int iEnd = (int)m_strFormula.find_first_not_of(a_szCharSet, a_iPos);
+    return (iEnd==(int)string_type::npos) ? (int)m_strFormula.length() : iEnd;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Check Expression for the presence of a binary operator token.
   
@@ -374,15 +391,17 @@ namespace mu
   */
   bool ParserTokenReader::IsBuiltIn(token_type &a_Tok)
   {
-    const char_type **const pOprtDef = m_pParser->GetOprtDef(),
-                     *const szFormula = m_strFormula.c_str();
+    const char_type **const pOprtDef = m_pParser->GetOprtDef();
 
     // Compare token with function and operator strings
     // check string for operator/function
     for (int i=0; pOprtDef[i]; i++)
     {
+      if (pOprtDef[i][0]!=m_strFormula[m_iPos])
+        continue;
+
       std::size_t len( std::char_traits<char_type>::length(pOprtDef[i]) );
-      if ( string_type(pOprtDef[i]) == string_type(szFormula + m_iPos, szFormula + m_iPos + len) )
+      if ( m_strFormula.compare(m_iPos, len, pOprtDef[i])==0 )
       {
         switch(i)
         {
@@ -445,6 +464,10 @@ namespace mu
 
               if (--m_iBrackets<0)
                 Error(ecUNEXPECTED_PARENS, m_iPos, pOprtDef[i]);
+
+              // The loop variable of a sum or product goes out of scope
+              while (m_vLoopVar.size() && m_vLoopVar.back().Brackets>m_iBrackets)
+                m_vLoopVar.pop_back();
               break;
 
         case cmELSE:
@@ -492,6 +515,9 @@ namespace mu
       m_iSynFlags  = noBC | noOPT | noEND | noARG_SEP | noPOSTOP | noASSIGN;
       m_iPos++;
       a_Tok.Set(cmARG_SEP, szSep);
+
+      if (m_vLoopVar.size() && m_vLoopVar.back().Brackets==m_iBrackets)
+        ++m_vLoopVar.back().ArgSep;
       return true;
     }
 
@@ -533,8 +559,7 @@ namespace mu
   */
   bool ParserTokenReader::IsInfixOpTok(token_type &a_Tok)
   {
-    string_type sTok;
-    int iEnd = ExtractToken(m_pParser->ValidInfixOprtChars(), sTok, m_iPos);
+    int iEnd = ExtractToken(m_pParser->ValidInfixOprtChars(), m_iPos);
     if (iEnd==m_iPos)
       return false;
 
@@ -542,7 +567,7 @@ namespace mu
     funmap_type::const_reverse_iterator it = m_pInfixOprtDef->rbegin();
     for ( ; it!=m_pInfixOprtDef->rend(); ++it)
     {
-      if (sTok.find(it->first)!=0)
+      if ((int)it->first.length()>iEnd-m_iPos || m_strFormula.compare(m_iPos, it->first.length(), it->first)!=0)
         continue;
 
       a_Tok.Set(it->second, it->first);
@@ -569,6 +594,61 @@ namespace mu
 */
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Check for the start of a sum or product.
+      \param a_Tok [out] The cmLOOP token if one is found.
+      \throw ParserException if Syntaxflags do not allow a function at the current position
+      \return true if the start of a sum or product has been found false otherwise.
+
+      A sum or product is written sum(k, a, b, expr) or prod(k, a, b, expr). The 
+      token contains its name, the opening bracket, the loop variable and the 
+      first argument separator. The loop variable must not be the name of a 
+      variable or a constant, otherwise this is a call of a function named sum or 
+      prod.
+  */
+  bool ParserTokenReader::IsLoopTok(token_type &a_Tok)
+  {
+    int iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
+    if (iEnd==m_iPos || m_strFormula[iEnd]!='(')
+      return false;
+
+    string_type sName = m_strFormula.substr(m_iPos, iEnd - m_iPos);
+    if (sName!=_T("sum") && sName!=_T("prod"))
+      return false;
+
+    const char_type *szFormula = m_strFormula.c_str();
+    int iVar = iEnd + 1;
+    while (szFormula[iVar]>0 && szFormula[iVar]<=0x20) 
+      ++iVar;
+
+    int iVarEnd = ExtractToken(m_pParser->ValidNameChars(), iVar);
+    if (iVarEnd==iVar || (szFormula[iVar]>='0' && szFormula[iVar]<='9'))
+      return false;
+
+    if ( m_pVarDef->Find(szFormula + iVar, iVarEnd - iVar) ||
+         m_pConstDef->Find(szFormula + iVar, iVarEnd - iVar) ||
+        (m_pStrVarDef && m_pStrVarDef->Find(szFormula + iVar, iVarEnd - iVar)) )
+      return false;
+
+    int iSep = iVarEnd;
+    while (szFormula[iSep]>0 && szFormula[iSep]<=0x20) 
+      ++iSep;
+
+    if (szFormula[iSep]!=m_cArgSep)
+      return false;
+
+    if (m_iSynFlags & noFUN)
+      Error(ecUNEXPECTED_FUN, m_iPos, sName);
+
+    SLoopVar var = { m_strFormula.substr(iVar, iVarEnd - iVar), ++m_iBrackets, 0 };
+    m_vLoopVar.push_back(var);
+
+    a_Tok.Set(cmLOOP, sName);
+    m_iPos = iSep + 1;
+    m_iSynFlags = noBC | noOPT | noEND | noARG_SEP | noPOSTOP | noASSIGN | noIF | noELSE;
+    return true;
+  }
+
   //---------------------------------------------------------------------------
   /** \brief Check whether the token at a given position is a function token.
       \param a_Tok [out] If a value token is found it will be placed here.
@@ -578,21 +658,20 @@ namespace mu
   */
   bool ParserTokenReader::IsFunTok(token_type &a_Tok)
   {
-    string_type strTok;
-    int iEnd = ExtractToken(m_pParser->ValidNameChars(), strTok, m_iPos);
+    int iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
     if (iEnd==m_iPos)
       return false;
 
-    funmap_type::const_iterator item = m_pFunDef->find(strTok);
-    if (item==m_pFunDef->end())
+    const char_type *szFormula = m_strFormula.c_str();
+    const funmap_type::value_type *item = m_pFunDef->Find(szFormula + m_iPos, iEnd - m_iPos);
+    if (!item)
       return false;
 
     // Check if the next sign is an opening bracket
-    const char_type *szFormula = m_strFormula.c_str();
     if (szFormula[iEnd]!='(')
       return false;
 
-    a_Tok.Set(item->second, strTok);
+    a_Tok.Set(item->second, item->first);
 
     m_iPos = (int)iEnd;
     if (m_iSynFlags & noFUN)
@@ -609,9 +688,11 @@ namespace mu
   */
   bool ParserTokenReader::IsOprt(token_type &a_Tok)
   {
-    const char_type *const szExpr = m_strFormula.c_str();
-    string_type strTok;
+    // Binary operators are rarely defined, skip reading the token then
+    if (m_pOprtDef->empty())
+      return false;
 
+    string_type strTok;
     int iEnd = ExtractOperatorToken(strTok, m_iPos);
     if (iEnd==m_iPos)
       return false;
@@ -620,7 +701,7 @@ namespace mu
     const char_type **const pOprtDef = m_pParser->GetOprtDef();
     for (int i=0; m_pParser->HasBuiltInOprt() && pOprtDef[i]; ++i)
     {
-      if (string_type(pOprtDef[i])==strTok)
+      if (strTok==pOprtDef[i])
         return false;
     }
 
@@ -634,7 +715,7 @@ namespace mu
     for ( ; it!=m_pOprtDef->rend(); ++it)
     {
       const string_type &sID = it->first;
-      if ( sID == string_type(szExpr + m_iPos, szExpr + m_iPos + sID.length()) )
+      if ( m_strFormula.compare(m_iPos, sID.length(), sID)==0 )
       {
         a_Tok.Set(it->second, strTok);
 
@@ -689,8 +770,7 @@ namespace mu
     // token readers.
     
     // Test if there could be a postfix operator
-    string_type sTok;
-    int iEnd = ExtractToken(m_pParser->ValidOprtChars(), sTok, m_iPos);
+    int iEnd = ExtractToken(m_pParser->ValidOprtChars(), m_iPos);
     if (iEnd==m_iPos)
       return false;
 
@@ -698,10 +778,10 @@ namespace mu
     funmap_type::const_reverse_iterator it = m_pPostOprtDef->rbegin();
     for ( ; it!=m_pPostOprtDef->rend(); ++it)
     {
-      if (sTok.find(it->first)!=0)
+      if ((int)it->first.length()>iEnd-m_iPos || m_strFormula.compare(m_iPos, it->first.length(), it->first)!=0)
         continue;
 
-      a_Tok.Set(it->second, sTok);
+      a_Tok.Set(it->second, m_strFormula.substr(m_iPos, iEnd - m_iPos));
   	  m_iPos += (int)it->first.length();
 
       m_iSynFlags = noVAL | noVAR | noFUN | noBO | noPOSTOP | noSTR | noASSIGN;
@@ -730,17 +810,18 @@ namespace mu
     
     // 2.) Check for user defined constant
     // Read everything that could be a constant name
-    iEnd = ExtractToken(m_pParser->ValidNameChars(), strTok, m_iPos);
+    iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
     if (iEnd!=m_iPos)
     {
-      valmap_type::const_iterator item = m_pConstDef->find(strTok);
-      if (item!=m_pConstDef->end())
+      const valmap_type::value_type *item = m_pConstDef->Find(m_strFormula.c_str() + m_iPos, iEnd - m_iPos);
+      if (item)
       {
+        const string_type &strName = item->first;
         m_iPos = iEnd;
-        a_Tok.SetVal(item->second, strTok);
+        a_Tok.SetVal(item->second, strName);
 
         if (m_iSynFlags & noVAL)
-          Error(ecUNEXPECTED_VAL, m_iPos - (int)strTok.length(), strTok);
+          Error(ecUNEXPECTED_VAL, m_iPos - (int)strName.length(), strName);
 
         m_iSynFlags = noVAL | noVAR | noFUN | noBO | noINFIXOP | noSTR | noASSIGN; 
         return true;
@@ -756,7 +837,7 @@ namespace mu
       if ( (*item)(m_strFormula.c_str() + m_iPos, &m_iPos, &fVal)==1 )
       {
         // 2013-11-27 Issue 2:  https://code.google.com/p/muparser/issues/detail?id=2
-        strTok.assign(m_strFormula.c_str(), iStart, m_iPos-iStart);
+        strTok.assign(m_strFormula, iStart, m_iPos-iStart);
 
         if (m_iSynFlags & noVAL)
           Error(ecUNEXPECTED_VAL, m_iPos - (int)strTok.length(), strTok);
@@ -780,22 +861,21 @@ namespace mu
     if (m_pVarDef->empty())
       return false;
 
-    string_type strTok;
-    int iEnd = ExtractToken(m_pParser->ValidNameChars(), strTok, m_iPos);
+    int iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
     if (iEnd==m_iPos)
       return false;
 
-    varmap_type::const_iterator item =  m_pVarDef->find(strTok);
-    if (item==m_pVarDef->end())
+    const varmap_type::value_type *item = m_pVarDef->Find(m_strFormula.c_str() + m_iPos, iEnd - m_iPos);
+    if (!item)
       return false;
 
     if (m_iSynFlags & noVAR)
-      Error(ecUNEXPECTED_VAR, m_iPos, strTok);
+      Error(ecUNEXPECTED_VAR, m_iPos, item->first);
 
     m_pParser->OnDetectVar(&m_strFormula, m_iPos, iEnd);
 
     m_iPos = iEnd;
-    a_Tok.SetVar(item->second, strTok);
+    a_Tok.SetVar(item->second, item->first);
     m_UsedVar[item->first] = item->second;  // Add variable to used-var-list
 
     m_iSynFlags = noVAL | noVAR | noFUN | noBO | noINFIXOP | noSTR;
@@ -805,23 +885,55 @@ namespace mu
     return true;
   }
 
+  //---------------------------------------------------------------------------
+  /** \brief Check whether a token at a given position is the loop variable of a sum or product.
+      
+      Loop variables are only known in the last argument of their sum or 
+      product, inner loops hide the variables of outer ones with the same name.
+  */
+  bool ParserTokenReader::IsLoopVarTok(token_type &a_Tok)
+  {
+    if (m_vLoopVar.empty())
+      return false;
+
+    int iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
+    if (iEnd==m_iPos)
+      return false;
+
+    for (int i=(int)m_vLoopVar.size()-1; i>=0; --i)
+    {
+      const SLoopVar &var = m_vLoopVar[i];
+      if (var.ArgSep<2 || m_strFormula.compare(m_iPos, iEnd - m_iPos, var.Name)!=0)
+        continue;
+
+      if (m_iSynFlags & noVAR)
+        Error(ecUNEXPECTED_VAR, m_iPos, var.Name);
+
+      m_iPos = iEnd;
+      a_Tok.SetLoopVar(i, var.Name);
+      m_iSynFlags = noVAL | noVAR | noFUN | noBO | noINFIXOP | noSTR | noASSIGN;
+      return true;
+    }
+
+    return false;
+  }
+
   //---------------------------------------------------------------------------
   bool ParserTokenReader::IsStrVarTok(token_type &a_Tok)
   {
     if (!m_pStrVarDef || m_pStrVarDef->empty())
       return false;
 
-    string_type strTok;
-    int iEnd = ExtractToken(m_pParser->ValidNameChars(), strTok, m_iPos);
+    int iEnd = ExtractToken(m_pParser->ValidNameChars(), m_iPos);
     if (iEnd==m_iPos)
       return false;
 
-    strmap_type::const_iterator item =  m_pStrVarDef->find(strTok);
-    if (item==m_pStrVarDef->end())
+    const strmap_type::value_type *item = m_pStrVarDef->Find(m_strFormula.c_str() + m_iPos, iEnd - m_iPos);
+    if (!item)
       return false;
 
     if (m_iSynFlags & noSTR)
-      Error(ecUNEXPECTED_VAR, m_iPos, strTok);
+      Error(ecUNEXPECTED_VAR, m_iPos, item->first);
 
     m_iPos = iEnd;
     if (!m_pParser->m_vStringVarBuf.size())
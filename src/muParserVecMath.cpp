@@ -0,0 +1,350 @@
+/*
+                 __________                                      
+    _____   __ __\______   \_____  _______  ______  ____ _______ 
+   /     \ |  |  \|     ___/\__  \ \_  __ \/  ___/_/ __ \\_  __ \
+  |  Y Y  \|  |  /|    |     / __ \_|  | \/\___ \ \  ___/ |  | \/
+  |__|_|  /|____/ |____|    (____  /|__|  /____  > \___  >|__|   
+        \/                       \/            \/      \/        
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this 
+  software and associated documentation files (the "Software"), to deal in the Software
+  without restriction, including without limitation the rights to use, copy, modify, 
+  merge, publish, distribute, sublicense, and/or sell copies of the Software, and to 
+  permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or 
+  substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+  NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+*/
+
+#include "muParserVecMath.h"
+#include "muParserSimd.h"
+
+//--- Standard includes ------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/** \file
+    \brief Implementation of the vectorized math functions.
+
+    The approximations follow the Cephes and fdlibm libraries: the argument 
+    is reduced to a small interval with a constant split in a high and a low 
+    part, a polynomial is evaluated on the reduced argument and the result is 
+    scaled back. Everything is written once for the vector traits of 
+    muParserSimd.h, the coefficients differ between double and float.
+*/
+
+
+namespace mu
+{
+  namespace vecmath
+  {
+    namespace
+    {
+      //------------------------------------------------------------------------------
+      /** \brief Reduction constants and polynomial coefficients, highest degree first. */
+      template<typename T>
+      struct Coef;
+
+      template<>
+      struct Coef<double>
+      {
+        static const double exp_p[12], log_p[7], sin_p[6], cos_p[6], tanh_p[3], tanh_q[4];
+        static const double exp_lo, exp_hi, log2e, ln2_hi, ln2_lo, sqrt2, 
+                            trig_max, two_over_pi, pio2_1, pio2_2, pio2_3, pio2_3t, tanh_cap;
+      };
+
+      // e^r = 1 + r + r^2*P(r), Taylor series for |r|<=ln(2)/2
+      const double Coef<double>::exp_p[12] = { 1.0/6227020800.0, 1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0, 
+                                               1.0/362880.0, 1.0/40320.0, 1.0/5040.0, 1.0/720.0, 1.0/120.0, 
+                                               1.0/24.0, 1.0/6.0, 0.5 };
+      // fdlibm __ieee754_log
+      const double Coef<double>::log_p[7] = { 1.479819860511658591e-01, 1.531383769920937332e-01, 1.818357216161805012e-01,
+                                              2.222219843214978396e-01, 2.857142874366239149e-01, 3.999999999940941908e-01, 
+                                              6.666666666666735130e-01 };
+      // Cephes sin and cos for |r|<=pi/4
+      const double Coef<double>::sin_p[6] = { 1.58962301576546568060e-10, -2.50507477628578072866e-8, 2.75573136213857245213e-6,
+                                              -1.98412698295895385996e-4, 8.33333333332211858878e-3, -1.66666666666666307295e-1 };
+      const double Coef<double>::cos_p[6] = { -1.13585365213876817300e-11, 2.08757008419747316778e-9, -2.75573141792967388112e-7,
+                                              2.48015872888517045348e-5, -1.38888888888730564116e-3, 4.16666666666665929218e-2 };
+      // Cephes tanh for |x|<0.625
+      const double Coef<double>::tanh_p[3] = { -9.64399179425052238628e-1, -9.92877231001918586564e1, -1.61468768441708447952e3 };
+      const double Coef<double>::tanh_q[4] = { 1, 1.12811678491632931402e2, 2.23548839060100448583e3, 4.84406305325125486048e3 };
+
+      const double Coef<double>::exp_lo      = -708;
+      const double Coef<double>::exp_hi      = 709;
+      const double Coef<double>::log2e       = 1.4426950408889634074;
+      const double Coef<double>::ln2_hi      = 6.93147180369123816490e-01;
+      const double Coef<double>::ln2_lo      = 1.90821492927058770002e-10;
+      const double Coef<double>::sqrt2       = 1.41421356237309504880;
+      const double Coef<double>::trig_max    = 1e6;           // n*pio2_1, n*pio2_2 and n*pio2_3 must be exact
+      const double Coef<double>::two_over_pi = 6.36619772367581343076e-01;
+      const double Coef<double>::pio2_1      = 1.57079632673412561417e+00;  // 33 bits
+      const double Coef<double>::pio2_2      = 6.07710050630396597660e-11;  // 33 bits
+      const double Coef<double>::pio2_3      = 2.02226624871116645580e-21;  // 33 bits
+      const double Coef<double>::pio2_3t     = 8.47842766036889956997e-32;
+      const double Coef<double>::tanh_cap    = 44;            // tanh(22) rounds to 1
+
+      template<>
+      struct Coef<float>
+      {
+        static const float exp_p[6], log_p[4], sin_p[3], cos_p[3], tanh_p[5], tanh_q[1];
+        static const float exp_lo, exp_hi, log2e, ln2_hi, ln2_lo, sqrt2, 
+                           trig_max, two_over_pi, pio2_1, pio2_2, pio2_3, pio2_3t, tanh_cap;
+      };
+
+      // Cephes expf
+      const float Coef<float>::exp_p[6] = { 1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 
+                                            4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f };
+      // FreeBSD logf
+      const float Coef<float>::log_p[4] = { 0.24279078841f, 0.28498786688f, 0.40000972152f, 0.66666662693f };
+      // Cephes sinf and cosf
+      const float Coef<float>::sin_p[3] = { -1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f };
+      const float Coef<float>::cos_p[3] = { 2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f };
+      // Cephes tanhf
+      const float Coef<float>::tanh_p[5] = { -5.70498872745e-3f, 2.06390887954e-2f, -5.37397155531e-2f, 
+                                             1.33314422036e-1f, -3.33332819422e-1f };
+      const float Coef<float>::tanh_q[1] = { 1 };
+
+      const float Coef<float>::exp_lo      = -87;
+      const float Coef<float>::exp_hi      = 88;
+      const float Coef<float>::log2e       = 1.44269504088896341f;
+      const float Coef<float>::ln2_hi      = 0.693359375f;
+      const float Coef<float>::ln2_lo      = -2.12194440e-4f;
+      const float Coef<float>::sqrt2       = 1.41421356237309504880f;
+      const float Coef<float>::trig_max    = 6000;          // n*pio2_1 and n*pio2_2 must be exact
+      const float Coef<float>::two_over_pi = 0.636619772367581343076f;
+      const float Coef<float>::pio2_1      = 1.57080078125f;  // 12 bits
+      const float Coef<float>::pio2_2      = -4.453584551811218e-06f;  // 12 bits
+      const float Coef<float>::pio2_3      = -8.705515752716053e-10f;
+      const float Coef<float>::pio2_3t     = 5.721188726109832e-18f;
+      const float Coef<float>::tanh_cap    = 20;
+
+      //------------------------------------------------------------------------------
+      /** \brief Scalar versions, used for the arguments out of range. */
+      template<typename T>
+      struct Scalar
+      {
+        static T Sqrt(T v)  { return std::sqrt(v); }
+        static T Abs(T v)   { return std::fabs(v); }
+        static T Exp(T v)   { return std::exp(v); }
+        static T Ln(T v)    { return std::log(v); }
+        static T Log2(T v)  { return std::log2(v); }
+        static T Log10(T v) { return std::log10(v); }
+        static T Sin(T v)   { return std::sin(v); }
+        static T Cos(T v)   { return std::cos(v); }
+        static T Tanh(T v)  { return std::tanh(v); }
+      };
+
+#if defined(MUP_SIMD_AVX) || defined(MUP_SIMD_SSE2)
+
+      template<typename T> struct VecOf;
+      template<> struct VecOf<double> { typedef simd::VecDouble type; };
+      template<> struct VecOf<float>  { typedef simd::VecFloat type; };
+
+      //------------------------------------------------------------------------------
+      /** \brief The approximations on vector registers. */
+      template<typename T>
+      struct Kernels
+      {
+        typedef typename VecOf<T>::type V;
+        typedef typename V::type vec;
+        typedef Coef<T> C;
+
+        template<std::size_t N>
+        static vec Poly(vec x, const T (&c)[N])
+        {
+          vec y = V::Set(c[0]);
+          for (std::size_t i=1; i<N; ++i)
+            y = V::Add(V::Mul(y, x), V::Set(c[i]));
+          return y;
+        }
+
+        static vec Sqrt(vec x) { return V::Sqrt(x); }
+        static vec Abs(vec x)  { return V::Abs(x); }
+
+        static vec Exp(vec x)
+        {
+          // x = n*ln(2) + r with |r|<=ln(2)/2
+          vec n = V::Round(V::Mul(x, V::Set(C::log2e)));
+          vec r = V::Sub(V::Sub(x, V::Mul(n, V::Set(C::ln2_hi))), V::Mul(n, V::Set(C::ln2_lo)));
+          vec y = V::Add(V::Set(1), V::Add(r, V::Mul(V::Mul(r, r), Poly(r, C::exp_p))));
+          return V::Mul(y, V::Pow2n(n));
+        }
+
+        static vec Ln(vec x)
+        {
+          // x = 2^e*m with sqrt(2)/2 <= m < sqrt(2)
+          vec m = V::Mantissa(x),
+              e = V::Exponent(x),
+              big = V::CmpGT(m, V::Set(C::sqrt2));
+          m = V::Blend(m, V::Mul(m, V::Set(0.5)), big);
+          e = V::Blend(e, V::Add(e, V::Set(1)), big);
+
+          // log(1+f) = f - f^2/2 + s*(f^2/2 + R(s^2)) with s = f/(2+f)
+          vec f = V::Sub(m, V::Set(1)),
+              s = V::Div(f, V::Add(V::Set(2), f)),
+              z = V::Mul(s, s),
+              R = V::Mul(z, Poly(z, C::log_p)),
+              hfsq = V::Mul(V::Set(0.5), V::Mul(f, f));
+          return V::Sub(V::Mul(e, V::Set(C::ln2_hi)), 
+                        V::Sub(V::Sub(hfsq, V::Add(V::Mul(s, V::Add(hfsq, R)), V::Mul(e, V::Set(C::ln2_lo)))), f));
+        }
+
+        static vec Log2(vec x)  { return V::Mul(Ln(x), V::Set(C::log2e)); }
+        static vec Log10(vec x) { return V::Mul(Ln(x), V::Set((T)0.43429448190325182765)); }
+
+        /** \brief Sine of x + a_iQuadrant*pi/2. */
+        static vec SinQ(vec x, int a_iQuadrant)
+        {
+          // x = n*pi/2 + r with |r|<=pi/4. The subtractions are exact when r is 
+          // small, the tail of pi/2 then keeps the relative error of r low near 
+          // the zeros of the result.
+          vec n = V::Round(V::Mul(x, V::Set(C::two_over_pi)));
+          vec r = V::Sub(V::Sub(V::Sub(x, V::Mul(n, V::Set(C::pio2_1))), V::Mul(n, V::Set(C::pio2_2))), V::Mul(n, V::Set(C::pio2_3)));
+          r = V::Sub(r, V::Mul(n, V::Set(C::pio2_3t)));
+          vec z = V::Mul(r, r);
+          vec s = V::Add(r, V::Mul(V::Mul(r, z), Poly(z, C::sin_p)));
+          vec c = V::Add(V::Sub(V::Set(1), V::Mul(V::Set(0.5), z)), V::Mul(V::Mul(z, z), Poly(z, C::cos_p)));
+
+          // q = (n + a_iQuadrant) mod 4, floor(y) is round(y - 3/8) for multiples of 1/4
+          vec q = V::Add(n, V::Set((T)a_iQuadrant));
+          q = V::Sub(q, V::Mul(V::Set(4), V::Round(V::Sub(V::Mul(q, V::Set(0.25)), V::Set(0.375)))));
+          vec odd = V::Or(V::CmpEQ(q, V::Set(1)), V::CmpEQ(q, V::Set(3))),
+              neg = V::CmpGE(q, V::Set(2)),
+              y = V::Blend(s, c, odd);
+          return V::Blend(y, V::Sub(V::Set(0), y), neg);
+        }
+
+        static vec Sin(vec x) { return SinQ(x, 0); }
+        static vec Cos(vec x) { return SinQ(x, 1); }
+
+        static vec Tanh(vec x)
+        {
+          // x + x^3*P(x^2)/Q(x^2) for small x, 1 - 2/(e^(2|x|)+1) otherwise
+          vec ax = V::Abs(x),
+              z = V::Mul(x, x),
+              small = V::Add(x, V::Div(V::Mul(V::Mul(x, z), Poly(z, C::tanh_p)), Poly(z, C::tanh_q))),
+              t = Exp(V::Min(V::Mul(V::Set(2), ax), V::Set(C::tanh_cap))),
+              big = V::Sub(V::Set(1), V::Div(V::Set(2), V::Add(t, V::Set(1))));
+          big = V::Or(big, V::And(x, V::Set(-0.0)));   // the sign of x
+          return V::Blend(big, small, V::CmpLT(ax, V::Set(0.625)));
+        }
+      };
+
+      //------------------------------------------------------------------------------
+      /** \brief Apply a vector kernel to an array.
+          \param a_pVal The values, replaced by the results
+          \param a_iSize The number of values
+          \param a_fLo Lower bound of the arguments the kernel handles
+          \param a_fHi Upper bound of the arguments the kernel handles
+
+        The remaining values that don't fill a register are padded. Arguments 
+        outside of [a_fLo, a_fHi] and NaN are recomputed by the scalar function.
+      */
+      template<typename T, typename Kernels<T>::vec (*TVec)(typename Kernels<T>::vec), T (*TScalar)(T)>
+      void Apply(T *a_pVal, int a_iSize, T a_fLo, T a_fHi)
+      {
+        typedef typename Kernels<T>::V V;
+        typedef typename V::type vec;
+        const vec lo = V::Set(a_fLo), 
+                  hi = V::Set(a_fHi);
+        const int iFull = (1 << V::size) - 1;
+
+        T buf[V::size];
+        for (int i=0; i<a_iSize; i+=V::size)
+        {
+          int n = std::min((int)V::size, a_iSize - i);
+          T *p = a_pVal + i;
+          if (n<V::size)
+          {
+            std::copy(p, p + n, buf);
+            std::fill(buf + n, buf + V::size, p[0]);
+            p = buf;
+          }
+
+          vec x = V::Load(p);
+          int iMask = V::MoveMask(V::And(V::CmpGE(x, lo), V::CmpLE(x, hi)));
+          if (iMask!=iFull)
+          {
+            T arg[V::size];
+            V::Store(arg, x);
+            V::Store(p, TVec(x));
+            for (int k=0; k<V::size; ++k)
+            {
+              if ((iMask & (1 << k))==0)
+                p[k] = TScalar(arg[k]);
+            }
+          }
+          else
+            V::Store(p, TVec(x));
+
+          if (p==buf)
+            std::copy(buf, buf + n, a_pVal + i);
+        }
+      }
+
+      template<typename T>
+      struct Domain
+      {
+        static T Inf() { return std::numeric_limits<T>::infinity(); }
+        static T Min() { return std::numeric_limits<T>::min(); }
+        static T Max() { return std::numeric_limits<T>::max(); }
+      };
+
+  #define MUP_VEC_FUN(NAME, LO, HI) \
+      template<typename T> \
+      void NAME##Impl(T *a_pVal, int a_iSize) \
+      { \
+        Apply<T, &Kernels<T>::NAME, &Scalar<T>::NAME>(a_pVal, a_iSize, LO, HI); \
+      }
+#else
+  #define MUP_VEC_FUN(NAME, LO, HI) \
+      template<typename T> \
+      void NAME##Impl(T *a_pVal, int a_iSize) \
+      { \
+        for (int i=0; i<a_iSize; ++i) \
+          a_pVal[i] = Scalar<T>::NAME(a_pVal[i]); \
+      }
+#endif
+
+      MUP_VEC_FUN(Sqrt,  -Domain<T>::Inf(), Domain<T>::Inf())
+      MUP_VEC_FUN(Abs,   -Domain<T>::Inf(), Domain<T>::Inf())
+      MUP_VEC_FUN(Exp,   Coef<T>::exp_lo, Coef<T>::exp_hi)
+      MUP_VEC_FUN(Ln,    Domain<T>::Min(), Domain<T>::Max())
+      MUP_VEC_FUN(Log2,  Domain<T>::Min(), Domain<T>::Max())
+      MUP_VEC_FUN(Log10, Domain<T>::Min(), Domain<T>::Max())
+      MUP_VEC_FUN(Sin,   -Coef<T>::trig_max, Coef<T>::trig_max)
+      MUP_VEC_FUN(Cos,   -Coef<T>::trig_max, Coef<T>::trig_max)
+      MUP_VEC_FUN(Tanh,  -Domain<T>::Inf(), Domain<T>::Inf())
+
+  #undef MUP_VEC_FUN
+    } // anonymous namespace
+
+    void Sqrt(value_type *a_pVal, int a_iSize)  { SqrtImpl(a_pVal, a_iSize); }
+    void Abs(value_type *a_pVal, int a_iSize)   { AbsImpl(a_pVal, a_iSize); }
+    void Exp(value_type *a_pVal, int a_iSize)   { ExpImpl(a_pVal, a_iSize); }
+    void Ln(value_type *a_pVal, int a_iSize)    { LnImpl(a_pVal, a_iSize); }
+    void Log2(value_type *a_pVal, int a_iSize)  { Log2Impl(a_pVal, a_iSize); }
+    void Log10(value_type *a_pVal, int a_iSize) { Log10Impl(a_pVal, a_iSize); }
+    void Sin(value_type *a_pVal, int a_iSize)   { SinImpl(a_pVal, a_iSize); }
+    void Cos(value_type *a_pVal, int a_iSize)   { CosImpl(a_pVal, a_iSize); }
+    void Tanh(value_type *a_pVal, int a_iSize)  { TanhImpl(a_pVal, a_iSize); }
+
+    void Sqrt(float *a_pVal, int a_iSize)       { SqrtImpl(a_pVal, a_iSize); }
+    void Abs(float *a_pVal, int a_iSize)        { AbsImpl(a_pVal, a_iSize); }
+    void Exp(float *a_pVal, int a_iSize)        { ExpImpl(a_pVal, a_iSize); }
+    void Ln(float *a_pVal, int a_iSize)         { LnImpl(a_pVal, a_iSize); }
+    void Log2(float *a_pVal, int a_iSize)       { Log2Impl(a_pVal, a_iSize); }
+    void Log10(float *a_pVal, int a_iSize)      { Log10Impl(a_pVal, a_iSize); }
+    void Sin(float *a_pVal, int a_iSize)        { SinImpl(a_pVal, a_iSize); }
+    void Cos(float *a_pVal, int a_iSize)        { CosImpl(a_pVal, a_iSize); }
+    void Tanh(float *a_pVal, int a_iSize)       { TanhImpl(a_pVal, a_iSize); }
+  } // namespace vecmath
+} // namespace mu
@@ -1,9 +1,14 @@
 #include "widgets.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
+#include "imgui_internal.h"
 #include "utils.h"
 
 inline float clamp(float v, float a, float b)
@@ -42,6 +47,220 @@ std::string toString(double v, int precision = 0)
     return sstream.str();
 }
 
+/**
+ * Node of a single sample.
+ */
+static GraphAnalyze::CurveLOD::Node sampleNode(const std::vector<double> &ys, size_t k)
+{
+    if(std::isfinite(ys[k]))
+        return { ys[k], ys[k], INFINITY, -INFINITY, k + 1, k + 1, false, false };
+    return { INFINITY, -INFINITY, INFINITY, -INFINITY, k, k + 1, true, false };
+}
+
+/**
+ * Appends the run of node b to the one of node a.
+ */
+static void mergeNode(GraphAnalyze::CurveLOD::Node &a, const GraphAnalyze::CurveLOD::Node &b)
+{
+    if(!a.gap)
+    {
+        a.minY = std::min(a.minY, b.minY);
+        a.maxY = std::max(a.maxY, b.maxY);
+        a.headEnd = b.headEnd;
+        if(b.gap)
+        {
+            a.tailMinY = b.tailMinY;
+            a.tailMaxY = b.tailMaxY;
+            a.tailBegin = b.tailBegin;
+            a.gap = true;
+            a.inner = b.inner;
+        }
+    }
+    else if(!b.gap)
+    {
+        a.tailMinY = std::min(a.tailMinY, b.minY);
+        a.tailMaxY = std::max(a.tailMaxY, b.maxY);
+    }
+    else
+    {
+        a.inner |= b.inner || a.tailMinY <= a.tailMaxY || b.minY <= b.maxY;
+        a.tailMinY = b.tailMinY;
+        a.tailMaxY = b.tailMaxY;
+        a.tailBegin = b.tailBegin;
+    }
+}
+
+void GraphAnalyze::CurveLOD::build(const std::vector<double> &ys)
+{
+    levels.assign(1, std::vector<Node>());
+    samples = ys.size();
+    for(size_t i = 0; i < ys.size(); i += LOD_FANOUT)
+    {
+        Node n = sampleNode(ys, i);
+        for(size_t k = i + 1; k < std::min(i + LOD_FANOUT, ys.size()); k++)
+            mergeNode(n, sampleNode(ys, k));
+        levels[0].push_back(n);
+    }
+    while(levels.back().size() > 1)
+    {
+        std::vector<Node> next;
+        const std::vector<Node> &prev = levels.back();
+        for(size_t i = 0; i < prev.size(); i += LOD_FANOUT)
+        {
+            Node n = prev[i];
+            for(size_t k = i + 1; k < std::min(i + LOD_FANOUT, prev.size()); k++)
+                mergeNode(n, prev[k]);
+            next.push_back(n);
+        }
+        levels.push_back(std::move(next));
+    }
+}
+
+/**
+ * Walks a CurveLOD from the top, stopping at the nodes that fit in a pixel
+ * column, and gathers them into runs of samples per column.
+ */
+struct CurvePlotter
+{
+    GraphAnalyze::GraphInfo &gi;
+    const GraphAnalyze::CurveLOD &lod;
+    const std::vector<double> &xs, &ys;
+    ImDrawList *drawList;
+    ImU32 col;
+    /**
+     * Number of samples under a node of each level.
+     */
+    std::vector<size_t> spans;
+    /**
+     * Pixel column of the current run, -1 if there's none.
+     */
+    int column = -1;
+    /**
+     * First and last samples of the current run, and its vertical extent.
+     */
+    double firstX, firstY, lastX, lastY, minY, maxY;
+    /**
+     * Last sample of the previous run, if the curve goes on from there.
+     */
+    double prevX, prevY;
+    bool connected = false;
+    
+    CurvePlotter(GraphAnalyze::GraphInfo &gi, const GraphAnalyze::CurveLOD &lod, const std::vector<double> &xs,
+        const std::vector<double> &ys, ImU32 col) : gi(gi), lod(lod), xs(xs), ys(ys),
+        drawList(ImGui::GetWindowDrawList()), col(col)
+    {
+        for(size_t k = 0, span = LOD_FANOUT; k < lod.levels.size(); k++, span *= LOD_FANOUT)
+            spans.push_back(span);
+    }
+    
+    int columnOf(double x)
+    {
+        return (int)std::floor((x - gi.minX) * (gi.size.x - 1) / (gi.maxX - gi.minX));
+    }
+    
+    /**
+     * Draws the current run: joins it to the previous one, then covers its
+     * vertical extent.
+     */
+    void flush()
+    {
+        if(column < 0)
+            return;
+        ImVec2 first = gi.scale(firstX, firstY);
+        if(connected)
+            drawList->AddLine(gi.scale(prevX, prevY), first, col, 1);
+        if(minY < maxY)
+        {
+            float x = gi.pos.x + column + .5f;
+            drawList->AddLine(ImVec2(x, gi.scale(0, minY).y), ImVec2(x, gi.scale(0, maxY).y), col, 1);
+        }
+        prevX = lastX;
+        prevY = lastY;
+        connected = true;
+        column = -1;
+    }
+    
+    /**
+     * Adds samples i to j, all finite and in pixel column c, to the runs.
+     */
+    void add(int c, size_t i, size_t j, double lo, double hi)
+    {
+        if(c != column)
+        {
+            flush();
+            column = c;
+            firstX = xs[i];
+            firstY = ys[i];
+            minY = lo;
+            maxY = hi;
+        }
+        else
+        {
+            minY = std::min(minY, lo);
+            maxY = std::max(maxY, hi);
+        }
+        lastX = xs[j];
+        lastY = ys[j];
+    }
+    
+    /**
+     * Ends the current run at a non-finite sample.
+     */
+    void breakRun()
+    {
+        flush();
+        connected = false;
+    }
+    
+    void visit(size_t level, size_t index)
+    {
+        size_t i = index * spans[level], j = std::min(i + spans[level], xs.size()) - 1;
+        if(xs[j] < gi.minX || xs[i] > gi.maxX)
+            return;
+        const GraphAnalyze::CurveLOD::Node &n = lod.levels[level][index];
+        int c = columnOf(xs[i]);
+        // Runs without finite samples, e.g. outside the domain, are skipped whatever their width
+        if(n.gap && !n.inner && n.headEnd == i && n.tailBegin > j)
+            breakRun();
+        else if(!n.gap && c == columnOf(xs[j]))
+            add(c, i, j, n.minY, n.maxY);
+        else if(!n.inner && c == columnOf(xs[j]))
+        {
+            if(n.headEnd > i)
+                add(c, i, n.headEnd - 1, n.minY, n.maxY);
+            breakRun();
+            if(n.tailBegin <= j)
+                add(c, n.tailBegin, j, n.tailMinY, n.tailMaxY);
+        }
+        else if(level > 0)
+        {
+            for(size_t k = index * LOD_FANOUT; k < std::min((index + 1) * LOD_FANOUT, lod.levels[level - 1].size()); k++)
+                visit(level - 1, k);
+        }
+        else
+        {
+            for(size_t k = i; k <= j; k++)
+            {
+                if(std::isfinite(ys[k]))
+                    add(columnOf(xs[k]), k, k, ys[k], ys[k]);
+                else
+                    breakRun();
+            }
+        }
+    }
+};
+
+void GraphAnalyze::PlotCurve(GraphInfo &gi, const CurveLOD &lod, const std::vector<double> &xs,
+    const std::vector<double> &ys, ImU32 col)
+{
+    if(lod.levels.empty() || lod.size() != xs.size() || xs.empty())
+        return;
+    CurvePlotter plotter(gi, lod, xs, ys, col);
+    for(size_t k = 0; k < lod.levels.back().size(); k++)
+        plotter.visit(lod.levels.size() - 1, k);
+    plotter.flush();
+}
+
 void GraphAnalyze::GraphWidget(GraphInfo &gi, std::vector<double> &xs, std::vector<double> &ys,
     int w, int h)
 {
@@ -100,15 +319,9 @@ void GraphAnalyze::GraphWidget(GraphInfo &gi, std::vector<double> &xs, std::vect
     }
     
     // Plot the actual function
-    col32 = 0xff000000;
-    for(int k = 0; k + 1 < w; k++)
-    {
-        unsigned int i = std::lower_bound(xs.begin(), xs.end(), gi.unscale(k + gi.pos.x, 0).x) - xs.begin(),
-            j = std::lower_bound(xs.begin(), xs.end(), gi.unscale(k + 1 + gi.pos.x, 0).x) - xs.begin();
-        if(i < xs.size() && j < ys.size())
-            drawList->AddLine(gi.scale(xs[i], ys[i]), gi.scale(xs[j], ys[j]),
-                col32, 1);
-    }
+    if(gi.lod.size() != ys.size())
+        gi.lod.build(ys);
+    PlotCurve(gi, gi.lod, xs, ys, 0xff000000);
     
     ImGui::PopClipRect();
     // Make the widget react like an actual ImGui widget wrt interaction
@@ -159,22 +372,91 @@ bool GraphAnalyze::userSelectArea(GraphInfo &gi, float *startX, float *endX,
     return false;
 }
 
+/**
+ * Expression last compiled by a parser through InputFunction.
+ */
+struct CompiledExpr
+{
+    ImU32 hash;
+    size_t length;
+    bool valid;
+};
+
 bool GraphAnalyze::InputFunction(const char *label, char *buf, size_t size, mu::Parser &p, bool *invalid)
 {
+    static std::unordered_map<const mu::Parser*, CompiledExpr> cache;
     bool valueChanged = ImGui::InputText(label, buf, size);
     *invalid = false;
     if(!ImGui::IsItemActive() && buf[0] != '\0')
     {
-        try
+        // Only recompile when the text changed, the parser keeps its bytecode
+        // otherwise. SetExpr appends a space to the expression, so the length
+        // check also catches the parser being given another expression.
+        CompiledExpr expr = { ImHash(buf, 0), strlen(buf), true };
+        CompiledExpr &cached = cache[&p];
+        if(cached.hash != expr.hash || cached.length != expr.length
+            || p.GetExpr().size() != expr.length + 1)
         {
             p.SetExpr(std::string(buf));
-            p.Eval();
-        }
-        catch(mu::Parser::exception_type &e)
-        {
-            *invalid = true;
+            expr.valid = p.Validate();
+            cached = expr;
         }
+        *invalid = !cached.valid;
     }
     
     return valueChanged;
 }
+
+bool GraphAnalyze::ParserProfileWidget(const char *label, const mu::ParserProfile &prof)
+{
+    if(!ImGui::CollapsingHeader(label, ImGuiTreeNodeFlags_DefaultOpen))
+        return false;
+    if(!prof.bEnabled)
+    {
+        ImGui::TextDisabled("Build with PROFILE=1 to collect the counters");
+        return false;
+    }
+
+    ImGui::PushID(label);
+    // What isn't spent in callbacks is spent dispatching tokens
+    double funTime = 0;
+    for(const mu::ParserProfile::SFunStat &f : prof.vFun)
+        funTime += f.fTime;
+    double perValue = prof.nEval ? 1e9 / prof.nEval : 0;
+    ImGui::Text("Parsed %llu times in %.3f ms", prof.nParse, prof.fParseTime * 1e3);
+    ImGui::Text("Evaluated %llu values in %.3f ms, %.1f ns per value", prof.nEval, prof.fEvalTime * 1e3,
+        prof.fEvalTime * perValue);
+    ImGui::Text("Dispatch %.3f ms, callbacks %.3f ms", (prof.fEvalTime - funTime) * 1e3, funTime * 1e3);
+
+    ImGui::Columns(3, "callbacks");
+    ImGui::Text("Callback"); ImGui::NextColumn();
+    ImGui::Text("Calls"); ImGui::NextColumn();
+    ImGui::Text("ns per call"); ImGui::NextColumn();
+    ImGui::Separator();
+    for(const mu::ParserProfile::SFunStat &f : prof.vFun)
+    {
+        ImGui::Text("%s", f.Name.c_str()); ImGui::NextColumn();
+        ImGui::Text("%llu", f.nCalls); ImGui::NextColumn();
+        ImGui::Text("%.1f", f.nCalls ? f.fTime * 1e9 / f.nCalls : 0.); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    ImGui::Columns(3, "tokens");
+    ImGui::Text("Token"); ImGui::NextColumn();
+    ImGui::Text("Count"); ImGui::NextColumn();
+    ImGui::Text("Per value"); ImGui::NextColumn();
+    ImGui::Separator();
+    for(int k = 0; k < mu::cmUNKNOWN; k++)
+    {
+        if(!prof.aCmdCount[k])
+            continue;
+        ImGui::Text("%s", mu::ParserProfile::GetCmdName((mu::ECmdCode)k)); ImGui::NextColumn();
+        ImGui::Text("%llu", prof.aCmdCount[k]); ImGui::NextColumn();
+        ImGui::Text("%.2f", prof.aCmdCount[k] * perValue * 1e-9); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    bool reset = ImGui::Button("Reset");
+    ImGui::PopID();
+    return reset;
+}